@@ -5,6 +5,7 @@
 #include "gguf.h" // for reading GGUF splits
 #include "json-schema-to-grammar.h"
 #include "log.h"
+#include "ngram-sam.h"
 #include "sampling.h"
 
 // fix problem with std::min and std::max
@@ -967,6 +968,19 @@ static bool common_params_parse_ex(int argc, char ** argv, common_params_context
         common_params_handle_model(params.vocoder.model,     params.hf_token, "", params.offline);
     }
 
+    // the speculative decoding modes that verify several drafts at once use more than one sequence per slot
+    {
+        const int32_t n_seq = common_speculative_n_seq(params);
+        if (n_seq > 1 && (size_t) params.n_parallel * n_seq > llama_max_parallel_sequences()) {
+            const char * flags = !params.speculative.model.path.empty() ? "--draft-branches" :
+                                 params.speculative.n_layer_exit > 0    ? "--draft-layer-exit with --draft-branches" :
+                                                                          "--lookahead with --lookahead-verify";
+            throw std::invalid_argument(string_format(
+                "error: %s uses %d sequences per slot, with -np %d this is %d sequences, more than the max of %zu\n",
+                flags, n_seq, params.n_parallel, params.n_parallel * n_seq, llama_max_parallel_sequences()));
+        }
+    }
+
     if (params.escape) {
         string_process_escapes(params.prompt);
         string_process_escapes(params.input_prefix);
@@ -1409,7 +1423,7 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
         [](common_params & params, const std::string & value) {
             params.lookup_cache_static = value;
         }
-    ).set_examples({LLAMA_EXAMPLE_LOOKUP}));
+    ).set_examples({LLAMA_EXAMPLE_LOOKUP, LLAMA_EXAMPLE_SERVER}));
     add_opt(common_arg(
         {"-lcd", "--lookup-cache-dynamic"}, "FNAME",
         "path to dynamic lookup cache to use for lookup decoding (updated by generation)",
@@ -1417,6 +1431,13 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             params.lookup_cache_dynamic = value;
         }
     ).set_examples({LLAMA_EXAMPLE_LOOKUP}));
+    add_opt(common_arg(
+        {"-lsd", "--lookup-sam-dynamic"}, "FNAME",
+        string_format("path to the token log of previous generations to draft from with a suffix automaton for lookup decoding (updated by generation, at most %d tokens)", LLAMA_NGRAM_SAM_LOG_MAX),
+        [](common_params & params, const std::string & value) {
+            params.lookup_sam_dynamic = value;
+        }
+    ).set_examples({LLAMA_EXAMPLE_LOOKUP}));
     add_opt(common_arg(
         {"-c", "--ctx-size"}, "N",
         string_format("size of the prompt context (default: %d, 0 = loaded from model)", params.n_ctx),
@@ -2243,6 +2264,30 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             params.mmproj_use_gpu = false;
         }
     ).set_examples(mmproj_examples).set_env("LLAMA_ARG_NO_MMPROJ_OFFLOAD"));
+    add_opt(common_arg(
+        {"--mmproj-cache-size"}, "N",
+        string_format("max. size in MiB of the cache of image/audio embeddings and of the preprocessed inputs they are keyed by, repeated inputs skip the encoder, 0 = disabled (default: %d)", params.mmproj_cache_size),
+        [](common_params & params, int value) {
+            if (value < 0) {
+                throw std::invalid_argument("invalid value");
+            }
+            params.mmproj_cache_size = value;
+        }
+    ).set_examples(mmproj_examples).set_env("LLAMA_ARG_MMPROJ_CACHE_SIZE"));
+    add_opt(common_arg(
+        {"--mmproj-cache-file"}, "FNAME",
+        "file to load the image/audio embedding cache from on start and save it to on exit, requires --mmproj-cache-size",
+        [](common_params & params, const std::string & value) {
+            params.mmproj_cache_file = value;
+        }
+    ).set_examples(mmproj_examples).set_env("LLAMA_ARG_MMPROJ_CACHE_FILE"));
+    add_opt(common_arg(
+        {"--mmproj-batch"},
+        string_format("encode the images of the same size of different requests in a single graph, if the multimodal projector supports it (default: %s)", params.mmproj_batch ? "enabled" : "disabled"),
+        [](common_params & params) {
+            params.mmproj_batch = true;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_MMPROJ_BATCH"));
     add_opt(common_arg(
         {"--image", "--audio"}, "FILE",
         "path to an image or audio file. use with multimodal models, can be repeated if you have multiple files\n",
@@ -3175,7 +3220,65 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
         [](common_params & params, const std::string & value) {
             params.speculative.p_split = std::stof(value);
         }
-    ).set_examples({LLAMA_EXAMPLE_SPECULATIVE}).set_env("LLAMA_ARG_DRAFT_P_SPLIT"));
+    ).set_examples({LLAMA_EXAMPLE_SPECULATIVE, LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_DRAFT_P_SPLIT"));
+    add_opt(common_arg(
+        {"--draft-branches"}, "N",
+        string_format("max number of branches of the draft tree for speculative decoding (default: %d, 1 = linear draft)", params.speculative.n_branch),
+        [](common_params & params, int value) {
+            if (value < 1 || value > 64) {
+                throw std::invalid_argument("invalid value");
+            }
+            params.speculative.n_branch = value;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_DRAFT_BRANCHES"));
+    add_opt(common_arg(
+        {"--draft-layer-exit"}, "N",
+        string_format("draft with only the first N layers of the target model when no draft model is given (self-speculative decoding) (default: %d, 0 = disabled)", params.speculative.n_layer_exit),
+        [](common_params & params, int value) {
+            if (value < 0) {
+                throw std::invalid_argument("invalid value");
+            }
+            params.speculative.n_layer_exit = value;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_DRAFT_LAYER_EXIT"));
+    add_opt(common_arg(
+        {"--draft-lookup-min"}, "N",
+        string_format("draft from an earlier occurrence in the prompt and the generated text instead of the draft model if it matches at least the last N tokens\n"
+            "without a draft model, this is the only source of drafts besides --lookup-cache-static (default: %d, 0 = disabled)", params.speculative.n_lookup_min),
+        [](common_params & params, int value) {
+            params.speculative.n_lookup_min = value;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_DRAFT_LOOKUP_MIN"));
+    add_opt(common_arg(
+        {"--lookahead"}, "W",
+        string_format("use lookahead decoding with a window of up to W tokens when no draft model is given (default: %d, 0 = disabled)", params.speculative.n_la_window),
+        [](common_params & params, int value) {
+            if (value < 0 || value >= 64) {
+                throw std::invalid_argument("invalid value");
+            }
+            params.speculative.n_la_window = value;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_LOOKAHEAD"));
+    add_opt(common_arg(
+        {"--lookahead-ngram"}, "N",
+        string_format("n-gram size for lookahead decoding (default: %d)", params.speculative.n_la_ngram),
+        [](common_params & params, int value) {
+            if (value < 3) {
+                throw std::invalid_argument("invalid value");
+            }
+            params.speculative.n_la_ngram = value;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_LOOKAHEAD_NGRAM"));
+    add_opt(common_arg(
+        {"--lookahead-verify"}, "G",
+        string_format("max number of n-grams to verify per step of lookahead decoding (default: %d)", params.speculative.n_la_verify),
+        [](common_params & params, int value) {
+            if (value < 1 || value >= 64) {
+                throw std::invalid_argument("invalid value");
+            }
+            params.speculative.n_la_verify = value;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_LOOKAHEAD_VERIFY"));
     add_opt(common_arg(
         {"--draft-p-min"}, "P",
         string_format("minimum speculative decoding probability (greedy) (default: %.1f)", (double)params.speculative.p_min),
@@ -3258,6 +3361,13 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             params.vocoder.use_guide_tokens = true;
         }
     ).set_examples({LLAMA_EXAMPLE_TTS, LLAMA_EXAMPLE_SERVER}));
+    add_opt(common_arg(
+        {"--tts-stream"},
+        "decode the audio with the vocoder while the codes are generated and write it to the output file incrementally",
+        [](common_params & params) {
+            params.vocoder.stream = true;
+        }
+    ).set_examples({LLAMA_EXAMPLE_TTS}));
     add_opt(common_arg(
         {"--tts-speaker-file"}, "FNAME",
         "speaker file path for audio generation",
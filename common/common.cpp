@@ -1128,11 +1128,27 @@ struct llama_model_params common_model_params_to_llama(common_params & params) {
     return mparams;
 }
 
+int32_t common_speculative_n_seq(const common_params & params) {
+    if (!params.speculative.model.path.empty()) {
+        // each branch of a draft tree is verified in a separate sequence
+        return params.speculative.n_branch;
+    }
+    if (params.speculative.n_layer_exit > 0) {
+        // self-speculative decoding also drafts each branch in a separate sequence
+        return params.speculative.n_branch + 1;
+    }
+    if (params.speculative.n_la_window > 0) {
+        // lookahead decoding uses a sequence for each column of the window and each verified n-gram but the first
+        return params.speculative.n_la_window + params.speculative.n_la_verify;
+    }
+    return 1;
+}
+
 struct llama_context_params common_context_params_to_llama(const common_params & params) {
     auto cparams = llama_context_default_params();
 
     cparams.n_ctx             = params.n_ctx;
-    cparams.n_seq_max         = params.n_parallel;
+    cparams.n_seq_max         = params.n_parallel * common_speculative_n_seq(params);
     cparams.n_batch           = params.n_batch;
     cparams.n_ubatch          = params.n_ubatch;
     cparams.n_threads         = params.cpuparams.n_threads;
@@ -196,6 +196,12 @@ struct common_params_speculative {
     int32_t n_max        =    16; // maximum number of tokens to draft during speculative decoding
     int32_t n_min        =     0; // minimum number of draft tokens to use for speculative decoding
     int32_t n_gpu_layers =    -1; // number of layers to store in VRAM for the draft model (-1 - use default)
+    int32_t n_branch     =     1; // max number of branches of the draft tree (1 = linear draft)
+    int32_t n_layer_exit =     0; // draft with the first n_layer_exit layers of the target model when there is no draft model (0 = disabled)
+    int32_t n_lookup_min =     0; // min length of a match in the prompt to draft from it instead of the draft model (0 = disabled)
+    int32_t n_la_window  =     0; // lookahead decoding window when there is no draft model (0 = disabled)
+    int32_t n_la_ngram   =     4; // lookahead decoding n-gram size
+    int32_t n_la_verify  =     8; // max number of n-grams to verify per step of lookahead decoding
     float   p_split      =  0.1f; // speculative decoding split probability
     float   p_min        = 0.75f; // minimum speculative decoding probability (greedy)
 
@@ -214,6 +220,7 @@ struct common_params_vocoder {
     std::string speaker_file = ""; // speaker file path                                      // NOLINT
 
     bool use_guide_tokens = false; // enable guide tokens to improve TTS accuracy            // NOLINT
+    bool stream           = false; // decode and write the audio while it is generated       // NOLINT
 };
 
 enum common_reasoning_format {
@@ -280,6 +287,7 @@ struct common_params {
     std::string input_suffix         = ""; // string to suffix user inputs with                             // NOLINT
     std::string lookup_cache_static  = ""; // path of static ngram cache file for lookup decoding           // NOLINT
     std::string lookup_cache_dynamic = ""; // path of dynamic ngram cache file for lookup decoding          // NOLINT
+    std::string lookup_sam_dynamic   = ""; // path of token log file of previous generations for lookup     // NOLINT
     std::string logits_file          = ""; // file for saving *all* logits                                  // NOLINT
 
     std::vector<std::string> in_files;   // all input files
@@ -351,6 +359,9 @@ struct common_params {
     struct common_params_model mmproj;
     bool mmproj_use_gpu = true;     // use GPU for multimodal model
     bool no_mmproj = false;         // explicitly disable multimodal model
+    int32_t mmproj_cache_size = 0;  // max. size of the image/audio embedding cache in MiB, 0 = disabled
+    std::string mmproj_cache_file;  // file to load the embedding cache from and save it to
+    bool mmproj_batch = false;      // encode the images of the same size in a single graph
     std::vector<std::string> image; // path to image file(s)
 
     // embedding
@@ -556,6 +567,9 @@ struct llama_model_params     common_model_params_to_llama  (      common_params
 struct llama_context_params   common_context_params_to_llama(const common_params & params);
 struct ggml_threadpool_params ggml_threadpool_params_from_cpu_params(const cpu_params & params);
 
+// number of sequences used by each parallel slot with the speculative decoding modes that verify several drafts at once
+int32_t common_speculative_n_seq(const common_params & params);
+
 // clear LoRA adapters from context, then apply new list of adapters
 void common_set_adapter_lora(struct llama_context * ctx, std::vector<common_adapter_lora_info> & lora);
 
@@ -0,0 +1,258 @@
+#pragma once
+
+// complex FFT shared by the audio code of the tools (mtmd log-mel spectrogram, tts inverse STFT)
+// header-only, so that libraries that do not link libcommon (e.g. mtmd) can use it too
+
+#include "ggml.h"
+
+#define _USE_MATH_DEFINES // for M_PI
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// mixed-radix Stockham autosort FFT of size n on split real/imaginary arrays, so that the butterflies of each stage
+// are contiguous loops over the sub-sequences that the compiler can vectorize
+// radix 4, 2 and 5 have dedicated butterflies, any other factor of n uses an O(radix^2) DFT
+//
+// forward: X[k] = sum_j x[j]*e^(-2*pi*i*j*k/n)
+// inverse: x[j] = sum_k X[k]*e^(+2*pi*i*j*k/n), not scaled
+struct common_fft {
+    struct stage {
+        int radix;
+        int n; // length of the sub-sequences transformed by this stage
+        int s; // stride between the sub-sequences
+
+        std::vector<float> wr; // twiddles, [n/radix][radix - 1]
+        std::vector<float> wi;
+
+        std::vector<float> rr; // roots of unity of the radix, [radix]
+        std::vector<float> ri;
+    };
+
+    int   n;
+    float sg; // sign of the exponent, -1 forward, +1 inverse
+
+    std::vector<stage> stages;
+
+    common_fft(int n, bool inverse) : n(n), sg(inverse ? 1.0f : -1.0f) {
+        GGML_ASSERT(n > 0);
+
+        for (int len = n, s = 1; len > 1; ) {
+            int radix = len % 4 == 0 ? 4 : 2;
+            if (len % radix != 0) {
+                radix = 3;
+                while (len % radix != 0) {
+                    radix += 2;
+                }
+            }
+
+            const int m = len/radix;
+
+            stage st;
+            st.radix = radix;
+            st.n     = len;
+            st.s     = s;
+            st.wr.resize(m*(radix - 1));
+            st.wi.resize(m*(radix - 1));
+            for (int p = 0; p < m; ++p) {
+                for (int k = 1; k < radix; ++k) {
+                    const double theta = (2*M_PI*p*k)/len;
+                    st.wr[p*(radix - 1) + k - 1] = cos(theta);
+                    st.wi[p*(radix - 1) + k - 1] = sg*sin(theta);
+                }
+            }
+            st.rr.resize(radix);
+            st.ri.resize(radix);
+            for (int k = 0; k < radix; ++k) {
+                const double theta = (2*M_PI*k)/radix;
+                st.rr[k] = cos(theta);
+                st.ri[k] = sg*sin(theta);
+            }
+            stages.push_back(std::move(st));
+
+            len /= radix;
+            s   *= radix;
+        }
+    }
+
+    // re, im: n complex values, transformed in place
+    // tr, ti: scratch buffers of n floats
+    void compute(float * re, float * im, float * tr, float * ti) const {
+        float * xr = re;
+        float * xi = im;
+        float * yr = tr;
+        float * yi = ti;
+
+        for (const auto & st : stages) {
+            switch (st.radix) {
+                case 2:  stage_radix_2(st, xr, xi, yr, yi); break;
+                case 4:  stage_radix_4(st, xr, xi, yr, yi); break;
+                case 5:  stage_radix_5(st, xr, xi, yr, yi); break;
+                default: stage_radix_n(st, xr, xi, yr, yi); break;
+            }
+            std::swap(xr, yr);
+            std::swap(xi, yi);
+        }
+
+        if (xr != re) {
+            memcpy(re, xr, n*sizeof(float));
+            memcpy(im, xi, n*sizeof(float));
+        }
+    }
+
+private:
+    static void stage_radix_2(const stage & st, const float * xr, const float * xi, float * yr, float * yi) {
+        const int m = st.n/2;
+        const int s = st.s;
+
+        for (int p = 0; p < m; ++p) {
+            const float wr = st.wr[p];
+            const float wi = st.wi[p];
+
+            const float * a0r = xr + s*(p + 0); const float * a0i = xi + s*(p + 0);
+            const float * a1r = xr + s*(p + m); const float * a1i = xi + s*(p + m);
+
+            float * b0r = yr + s*(2*p + 0); float * b0i = yi + s*(2*p + 0);
+            float * b1r = yr + s*(2*p + 1); float * b1i = yi + s*(2*p + 1);
+
+            for (int q = 0; q < s; ++q) {
+                const float dr = a0r[q] - a1r[q];
+                const float di = a0i[q] - a1i[q];
+
+                b0r[q] = a0r[q] + a1r[q];
+                b0i[q] = a0i[q] + a1i[q];
+                b1r[q] = dr*wr - di*wi;
+                b1i[q] = dr*wi + di*wr;
+            }
+        }
+    }
+
+    void stage_radix_4(const stage & st, const float * xr, const float * xi, float * yr, float * yi) const {
+        const int m = st.n/4;
+        const int s = st.s;
+
+        for (int p = 0; p < m; ++p) {
+            const float * wr = st.wr.data() + 3*p;
+            const float * wi = st.wi.data() + 3*p;
+
+            const float * a0r = xr + s*(p + 0*m); const float * a0i = xi + s*(p + 0*m);
+            const float * a1r = xr + s*(p + 1*m); const float * a1i = xi + s*(p + 1*m);
+            const float * a2r = xr + s*(p + 2*m); const float * a2i = xi + s*(p + 2*m);
+            const float * a3r = xr + s*(p + 3*m); const float * a3i = xi + s*(p + 3*m);
+
+            float * b0r = yr + s*(4*p + 0); float * b0i = yi + s*(4*p + 0);
+            float * b1r = yr + s*(4*p + 1); float * b1i = yi + s*(4*p + 1);
+            float * b2r = yr + s*(4*p + 2); float * b2i = yi + s*(4*p + 2);
+            float * b3r = yr + s*(4*p + 3); float * b3i = yi + s*(4*p + 3);
+
+            for (int q = 0; q < s; ++q) {
+                const float t0r = a0r[q] + a2r[q], t0i = a0i[q] + a2i[q];
+                const float t1r = a0r[q] - a2r[q], t1i = a0i[q] - a2i[q];
+                const float t2r = a1r[q] + a3r[q], t2i = a1i[q] + a3i[q];
+                const float t3r = a1r[q] - a3r[q], t3i = a1i[q] - a3i[q];
+
+                // 4-point DFT, multiplying by sg*i is (re, im) -> (-sg*im, sg*re)
+                const float c1r = t1r - sg*t3i, c1i = t1i + sg*t3r;
+                const float c2r = t0r - t2r,    c2i = t0i - t2i;
+                const float c3r = t1r + sg*t3i, c3i = t1i - sg*t3r;
+
+                b0r[q] = t0r + t2r;
+                b0i[q] = t0i + t2i;
+                b1r[q] = c1r*wr[0] - c1i*wi[0];
+                b1i[q] = c1r*wi[0] + c1i*wr[0];
+                b2r[q] = c2r*wr[1] - c2i*wi[1];
+                b2i[q] = c2r*wi[1] + c2i*wr[1];
+                b3r[q] = c3r*wr[2] - c3i*wi[2];
+                b3i[q] = c3r*wi[2] + c3i*wr[2];
+            }
+        }
+    }
+
+    static void stage_radix_5(const stage & st, const float * xr, const float * xi, float * yr, float * yi) {
+        const int m = st.n/5;
+        const int s = st.s;
+
+        const float c1 = st.rr[1], s1 = st.ri[1]; // cos/sin(2*pi/5), times sg for sin
+        const float c2 = st.rr[2], s2 = st.ri[2]; // cos/sin(4*pi/5), times sg for sin
+
+        for (int p = 0; p < m; ++p) {
+            const float * wr = st.wr.data() + 4*p;
+            const float * wi = st.wi.data() + 4*p;
+
+            const float * ar[5];
+            const float * ai[5];
+            float * br[5];
+            float * bi[5];
+            for (int j = 0; j < 5; ++j) {
+                ar[j] = xr + s*(p + j*m);
+                ai[j] = xi + s*(p + j*m);
+                br[j] = yr + s*(5*p + j);
+                bi[j] = yi + s*(5*p + j);
+            }
+
+            for (int q = 0; q < s; ++q) {
+                const float t1r = ar[1][q] + ar[4][q], t1i = ai[1][q] + ai[4][q];
+                const float t2r = ar[2][q] + ar[3][q], t2i = ai[2][q] + ai[3][q];
+                const float t3r = ar[1][q] - ar[4][q], t3i = ai[1][q] - ai[4][q];
+                const float t4r = ar[2][q] - ar[3][q], t4i = ai[2][q] - ai[3][q];
+
+                const float r1r = ar[0][q] + c1*t1r + c2*t2r, r1i = ai[0][q] + c1*t1i + c2*t2i;
+                const float r2r = ar[0][q] + c2*t1r + c1*t2r, r2i = ai[0][q] + c2*t1i + c1*t2i;
+                const float i1r = s1*t3r + s2*t4r,            i1i = s1*t3i + s2*t4i;
+                const float i2r = s2*t3r - s1*t4r,            i2i = s2*t3i - s1*t4i;
+
+                // c1 = r1 + i*i1, c4 = r1 - i*i1, c2 = r2 + i*i2, c3 = r2 - i*i2
+                const float cr[4] = { r1r - i1i, r2r - i2i, r2r + i2i, r1r + i1i };
+                const float ci[4] = { r1i + i1r, r2i + i2r, r2i - i2r, r1i - i1r };
+
+                br[0][q] = ar[0][q] + t1r + t2r;
+                bi[0][q] = ai[0][q] + t1i + t2i;
+                for (int k = 0; k < 4; ++k) {
+                    br[k + 1][q] = cr[k]*wr[k] - ci[k]*wi[k];
+                    bi[k + 1][q] = cr[k]*wi[k] + ci[k]*wr[k];
+                }
+            }
+        }
+    }
+
+    // any other radix, O(radix^2) DFT of the radix inputs
+    static void stage_radix_n(const stage & st, const float * xr, const float * xi, float * yr, float * yi) {
+        const int r = st.radix;
+        const int m = st.n/r;
+        const int s = st.s;
+
+        std::vector<float> ar(r);
+        std::vector<float> ai(r);
+
+        for (int p = 0; p < m; ++p) {
+            const float * wr = st.wr.data() + p*(r - 1);
+            const float * wi = st.wi.data() + p*(r - 1);
+
+            for (int q = 0; q < s; ++q) {
+                for (int j = 0; j < r; ++j) {
+                    ar[j] = xr[q + s*(p + j*m)];
+                    ai[j] = xi[q + s*(p + j*m)];
+                }
+
+                for (int k = 0; k < r; ++k) {
+                    float sr = 0.0f;
+                    float si = 0.0f;
+                    for (int j = 0, jk = 0; j < r; ++j, jk = (jk + k) % r) {
+                        sr += ar[j]*st.rr[jk] - ai[j]*st.ri[jk];
+                        si += ar[j]*st.ri[jk] + ai[j]*st.rr[jk];
+                    }
+
+                    const int i = q + s*(r*p + k);
+                    if (k == 0) {
+                        yr[i] = sr;
+                        yi[i] = si;
+                    } else {
+                        yr[i] = sr*wr[k - 1] - si*wi[k - 1];
+                        yi[i] = sr*wi[k - 1] + si*wr[k - 1];
+                    }
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,248 @@
+#include "lookahead.h"
+
+#include "log.h"
+#include "sampling.h"
+
+#include <algorithm>
+#include <cmath>
+
+common_lookahead::common_lookahead(const common_lookahead_params & params) : params(params) {
+    GGML_ASSERT(params.n_window > 0);
+    GGML_ASSERT(params.n_ngram  >= COMMON_LOOKAHEAD_NGRAM_MIN);
+    GGML_ASSERT(params.n_verify > 0 && params.n_verify <= COMMON_SPECULATIVE_TREE_MAX_SEQ);
+
+    reset();
+}
+
+void common_lookahead::reset() {
+    tree.clear();
+
+    levels.clear();
+    ngrams.clear();
+
+    p_accept = 1.0f;
+
+    n_window_cur = params.n_window;
+    n_verify_cur = params.n_verify;
+
+    n_window_step = 0;
+    i_levels      = 0;
+}
+
+void common_lookahead::add_ngram(llama_token first, const llama_token * next) {
+    const int n = params.n_ngram - 1;
+
+    auto & ring = ngrams[first];
+    if (ring.tokens.empty()) {
+        ring.tokens.resize(params.n_verify*n);
+    }
+
+    // filter-out repeating n-grams
+    for (int k = 0; k < ring.n; ++k) {
+        if (std::equal(next, next + n, ring.tokens.begin() + k*n)) {
+            return;
+        }
+    }
+
+    std::copy(next, next + n, ring.tokens.begin() + ring.head*n);
+
+    ring.n    = std::min(params.n_verify, ring.n + 1);
+    ring.head = (ring.head + 1) % params.n_verify;
+}
+
+int32_t common_lookahead::batch_add(
+        llama_batch & batch,
+        const llama_tokens & prompt,
+        llama_token id_last,
+        llama_pos n_past,
+        const std::vector<llama_seq_id> & seq_ids,
+        int32_t n_draft,
+        int32_t n_tokens) {
+    const int N = params.n_ngram;
+    const int W = params.n_window;
+    const int G = params.n_verify;
+
+    GGML_ASSERT((int) seq_ids.size() >= W + G);
+
+    if (levels.empty()) {
+        // the initial guesses are the last tokens of the prompt, any tokens would do
+        levels.assign(N - 1, llama_tokens(W, id_last));
+        for (int j = 0; j < N - 1; ++j) {
+            for (int i = 0; i < W && !prompt.empty(); ++i) {
+                levels[j][i] = prompt[prompt.size() - 1 - (j*W + i) % prompt.size()];
+            }
+        }
+    }
+
+    // verification tree from the n-grams that start with id_last, the most recent ones first
+    tree.clear();
+
+    const auto it = ngrams.find(id_last);
+    if (it != ngrams.end()) {
+        const auto & ring = it->second;
+
+        for (int k = 0; k < ring.n && tree.n_seq < n_verify_cur; ++k) {
+            const llama_token * ngram = ring.tokens.data() + ((ring.head - 1 - k + G) % G)*(N - 1);
+
+            const int32_t seq = tree.n_seq;
+
+            int32_t i_node = -1;
+            for (int d = 0; d < std::min(N - 1, n_draft); ++d) {
+                int32_t i_next = -1;
+                for (size_t i = i_node + 1; i < tree.tokens.size(); ++i) {
+                    if (tree.parent[i] == i_node && tree.tokens[i] == ngram[d]) {
+                        i_next = i;
+                        break;
+                    }
+                }
+
+                if (i_next < 0) {
+                    if ((int32_t) tree.tokens.size() + 1 >= n_tokens) {
+                        break;
+                    }
+
+                    i_next = tree.add(ngram[d], i_node, seq);
+                }
+
+                i_node = i_next;
+            }
+        }
+    }
+
+    // the window costs n_ngram - 1 tokens per column, except for the first token of the first level which is id_last
+    const int32_t n_free = n_tokens - 1 - (int32_t) tree.tokens.size();
+
+    n_window_step = std::max(0, std::min(n_window_cur, (n_free + 1) / (N - 1)));
+
+    const int32_t i_batch = batch.n_tokens;
+
+    auto seq_verify = [&](int s) {
+        return s == 0 ? seq_ids[0] : seq_ids[W + s];
+    };
+
+    // id_last belongs to all sequences
+    std::vector<llama_seq_id> seqs = { seq_ids[0] };
+    for (int i = 0; i < n_window_step; ++i) {
+        seqs.push_back(seq_ids[1 + i]);
+    }
+    for (int s = 1; s < tree.n_seq; ++s) {
+        seqs.push_back(seq_verify(s));
+    }
+
+    common_batch_add(batch, id_last, n_past, seqs, true);
+
+    // verification n-grams - queue these before the lookahead tokens for less KV cache fragmentation
+    for (size_t i = 0; i < tree.tokens.size(); ++i) {
+        seqs.clear();
+        for (int s = 0; s < tree.n_seq; ++s) {
+            if (tree.seq_mask[i] & (1ull << s)) {
+                seqs.push_back(seq_verify(s));
+            }
+        }
+
+        common_batch_add(batch, tree.tokens[i], n_past + 1 + tree.depth[i], seqs, true);
+    }
+
+    if (n_window_step > 0) {
+        // the first level is seen by the columns to its right
+        for (int i = 1; i < n_window_step; ++i) {
+            seqs.clear();
+            for (int k = i; k < n_window_step; ++k) {
+                seqs.push_back(seq_ids[1 + k]);
+            }
+
+            common_batch_add(batch, levels[0][i], n_past + i, seqs, false);
+        }
+
+        i_levels = batch.n_tokens - i_batch + (N - 3)*n_window_step;
+
+        // the other levels are only seen by their own column
+        for (int j = 1; j < N - 1; ++j) {
+            for (int i = 0; i < n_window_step; ++i) {
+                common_batch_add(batch, levels[j][i], n_past + j + i, { seq_ids[1 + i] }, j == N - 2);
+            }
+        }
+    }
+
+    return batch.n_tokens - i_batch;
+}
+
+llama_tokens common_lookahead::accept(
+        struct common_sampler * smpl,
+        struct llama_context * ctx,
+        int32_t i_batch,
+        int32_t & seq_best) {
+    const int N = params.n_ngram;
+    const int W = params.n_window;
+
+    int32_t i_last = -1;
+
+    const llama_tokens ids = common_speculative_tree_accept(smpl, ctx, tree, i_last, i_batch);
+
+    seq_best = 0;
+    if (i_last >= 0) {
+        int s = 0;
+        while ((tree.seq_mask[i_last] & (1ull << s)) == 0) {
+            s++;
+        }
+
+        seq_best = s == 0 ? 0 : W + s;
+    }
+
+    if (n_window_step > 0) {
+        const int n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(llama_get_model(ctx)));
+
+        // the first token of the n-gram of each column
+        const llama_tokens first(levels[0].begin(), levels[0].begin() + n_window_step);
+
+        for (int j = 0; j < N - 2; ++j) {
+            levels[j] = levels[j + 1];
+        }
+
+        // the new guesses of the last level are the greedy continuations of the current one
+        for (int i = 0; i < n_window_step; ++i) {
+            const float * logits = llama_get_logits_ith(ctx, i_batch + i_levels + i);
+
+            levels[N - 2][i] = std::max_element(logits, logits + n_vocab) - logits;
+        }
+
+        // n-gram generation
+        // ref: https://github.com/hao-ai-lab/LookaheadDecoding/issues/14#issuecomment-1826198518
+        llama_tokens ngram(N - 1);
+        for (int f = 0; f < n_window_step; ++f) {
+            for (int j = 0; j < N - 1; ++j) {
+                ngram[j] = levels[j][f];
+            }
+
+            add_ngram(first[f], ngram.data());
+        }
+
+        // each accepted drafted token moves the window one more position forward
+        for (size_t v = 1; v < ids.size(); ++v) {
+            for (int j = 0; j < N - 2; ++j) {
+                levels[j] = levels[j + 1];
+            }
+
+            levels[N - 2] = levels[0];
+        }
+    }
+
+    // adapt the window and the number of verified n-grams to the fraction of the drafted tokens that are accepted
+    if (!tree.tokens.empty()) {
+        p_accept = 0.9f*p_accept + 0.1f*(float) (ids.size() - 1)/(N - 1);
+
+        // an acceptance of half of the n-gram or more uses the full size, the size never drops below a quarter
+        const float t = std::min(1.0f, 2.0f*p_accept);
+
+        const int32_t n_window_min = std::max(1, params.n_window/4);
+        const int32_t n_verify_min = std::max(1, params.n_verify/4);
+
+        n_window_cur = n_window_min + std::lround(t*(params.n_window - n_window_min));
+        n_verify_cur = n_verify_min + std::lround(t*(params.n_verify - n_verify_min));
+    }
+
+    LOG_DBG("%s: accepted %d/%d, n_window = %d, n_verify = %d, p_accept = %.3f, n-grams for %d tokens\n",
+            __func__, (int) ids.size() - 1, (int) tree.tokens.size(), n_window_cur, n_verify_cur, p_accept, (int) ngrams.size());
+
+    return ids;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "llama.h"
+#include "common.h"
+#include "speculative.h"
+
+#include <unordered_map>
+#include <vector>
+
+// Lookahead (Jacobi) decoding
+// ref: https://lmsys.org/blog/2023-11-21-lookahead-decoding/
+//
+// Each step evaluates, in addition to the last accepted token:
+//  - a verification tree of up to n_verify n-grams that started with that token earlier in the generation
+//  - a window of n_window guesses for the next tokens, refined over the last n_ngram - 1 Jacobi iterations
+// The refined guesses produce new n-grams for the pool, the verified n-grams produce the accepted tokens.
+// The window and the number of verified n-grams adapt to the measured acceptance rate.
+//
+// Layout of the sequences in seq_ids (n_window + n_verify in total):
+//  - seq_ids[0]:                            the target sequence, also used by branch 0 of the verification tree
+//  - seq_ids[1 .. n_window]:                one sequence per column of the lookahead window
+//  - seq_ids[n_window + 1 .. n_window + n_verify - 1]: branches 1 .. n_verify - 1 of the verification tree
+// All of them must contain the prompt up to n_past when the step is added to the batch.
+
+#define COMMON_LOOKAHEAD_NGRAM_MIN 3
+
+struct common_lookahead_params {
+    int32_t n_window = 8; // max lookahead window (W)
+    int32_t n_ngram  = 4; // n-gram size (N)
+    int32_t n_verify = 8; // max number of n-grams to verify (G)
+};
+
+struct common_lookahead {
+    common_lookahead(const common_lookahead_params & params);
+
+    // forget the n-grams and the guesses of the previous generation
+    void reset();
+
+    // add id_last, the verification tree and the lookahead window to the batch
+    // n_draft:   max number of tokens to accept from a verified n-gram
+    // n_tokens:  max number of tokens to add to the batch, at least 1 for id_last
+    // prompt:    used to initialize the guesses
+    // returns the number of tokens added to the batch
+    int32_t batch_add(
+                            llama_batch & batch,
+                     const llama_tokens & prompt,
+                            llama_token   id_last,
+                              llama_pos   n_past,
+        const std::vector<llama_seq_id> & seq_ids,
+                                int32_t   n_draft,
+                                int32_t   n_tokens);
+
+    // sample the accepted tokens after the batch has been evaluated and advance the Jacobi iteration
+    // i_batch is the batch index of id_last, relative to the evaluated batch
+    // returns the accepted drafted tokens followed by one token sampled by the target model
+    // seq_best is set to the index in seq_ids of the sequence with the accepted tokens
+    llama_tokens accept(
+                  struct common_sampler * smpl,
+                   struct llama_context * ctx,
+                                 int32_t   i_batch,
+                                 int32_t & seq_best);
+
+    // verification tree of the last step
+    common_speculative_tree tree;
+
+    // current size of the window and max number of n-grams to verify
+    int32_t n_window_cur;
+    int32_t n_verify_cur;
+
+private:
+    // continuations of the n-grams that start with the same token, a ring buffer of n_verify x (n_ngram - 1) tokens
+    struct ngram_ring {
+        int32_t head = 0;
+        int32_t n    = 0;
+
+        llama_tokens tokens;
+    };
+
+    void add_ngram(llama_token first, const llama_token * next);
+
+    const common_lookahead_params params;
+
+    // guesses of the last n_ngram - 1 Jacobi iterations, [n_ngram - 1][n_window]
+    std::vector<llama_tokens> levels;
+
+    std::unordered_map<llama_token, ngram_ring> ngrams;
+
+    // exponential moving average of the fraction of accepted tokens per step
+    float p_accept;
+
+    // state of the last step
+    int32_t n_window_step; // 0 - the window was not evaluated
+    int32_t i_levels;      // batch index of the last level, relative to id_last
+};
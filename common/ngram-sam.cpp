@@ -0,0 +1,260 @@
+#include "ngram-sam.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+static constexpr uint32_t LLAMA_NGRAM_SAM_MAGIC   = 0x4d41534c; // 'LSAM'
+static constexpr uint32_t LLAMA_NGRAM_SAM_VERSION = 1;
+
+static size_t common_ngram_sam_hash(int32_t s, llama_token token) {
+    // see https://probablydance.com/2018/06/16/fibonacci-hashing-the-optimization-that-the-world-forgot-or-a-better-alternative-to-integer-modulo/
+    return (((uint64_t) (uint32_t) s << 32) | (uint32_t) token) * 11400714819323198485llu;
+}
+
+common_ngram_sam::common_ngram_sam() {
+    clear();
+}
+
+void common_ngram_sam::clear() {
+    tokens.clear();
+    states.clear();
+    edges.clear();
+
+    states.push_back({ 0, -1, -1, -1 });
+    last = 0;
+
+    table.assign(1024, -1);
+}
+
+int32_t common_ngram_sam::find(int32_t s, llama_token token) const {
+    const size_t mask = table.size() - 1;
+
+    for (size_t i = common_ngram_sam_hash(s, token) & mask; table[i] >= 0; i = (i + 1) & mask) {
+        const edge & e = edges[table[i]];
+        if (e.from == s && e.token == token) {
+            return table[i];
+        }
+    }
+
+    return -1;
+}
+
+void common_ngram_sam::rehash(size_t size) {
+    table.assign(size, -1);
+
+    const size_t mask = size - 1;
+
+    for (size_t ie = 0; ie < edges.size(); ++ie) {
+        size_t i = common_ngram_sam_hash(edges[ie].from, edges[ie].token) & mask;
+        while (table[i] >= 0) {
+            i = (i + 1) & mask;
+        }
+        table[i] = ie;
+    }
+}
+
+void common_ngram_sam::insert(int32_t s, llama_token token, int32_t next) {
+    // keep the load factor of the table below 1/2
+    if (2*(edges.size() + 1) > table.size()) {
+        rehash(2*table.size());
+    }
+
+    const int32_t ie = edges.size();
+    edges.push_back({ s, token, next, states[s].edge });
+    states[s].edge = ie;
+
+    const size_t mask = table.size() - 1;
+
+    size_t i = common_ngram_sam_hash(s, token) & mask;
+    while (table[i] >= 0) {
+        i = (i + 1) & mask;
+    }
+    table[i] = ie;
+}
+
+void common_ngram_sam::append(llama_token token) {
+    const int32_t pos = tokens.size();
+
+    tokens.push_back(token);
+
+    // the longest suffix that occurred before now also occurs at the current end
+    if (states[last].link > 0) {
+        states[states[last].link].end = pos - 1;
+    }
+
+    const int32_t cur = states.size();
+    states.push_back({ states[last].len + 1, 0, pos, -1 });
+
+    int32_t p = last;
+    while (p >= 0 && find(p, token) < 0) {
+        insert(p, token, cur);
+        p = states[p].link;
+    }
+
+    if (p >= 0) {
+        const int32_t q = edges[find(p, token)].next;
+
+        if (states[p].len + 1 == states[q].len) {
+            states[cur].link = q;
+        } else {
+            const int32_t clone = states.size();
+            states.push_back({ states[p].len + 1, states[q].link, states[q].end, -1 });
+
+            for (int32_t ie = states[q].edge; ie >= 0; ie = edges[ie].edge) {
+                insert(clone, edges[ie].token, edges[ie].next);
+            }
+
+            for (int32_t ie; p >= 0 && edges[ie = find(p, token)].next == q; p = states[p].link) {
+                edges[ie].next = clone;
+            }
+
+            states[q].link   = clone;
+            states[cur].link = clone;
+        }
+    }
+
+    last = cur;
+}
+
+void common_ngram_sam::append(const llama_token * data, size_t n_tokens) {
+    for (size_t i = 0; i < n_tokens; ++i) {
+        append(data[i]);
+    }
+}
+
+bool common_ngram_sam::contains(const llama_token * data, size_t n_tokens) const {
+    int32_t s = 0;
+    for (size_t i = 0; i < n_tokens; ++i) {
+        const int32_t ie = find(s, data[i]);
+        if (ie < 0) {
+            return false;
+        }
+        s = edges[ie].next;
+    }
+
+    return true;
+}
+
+int32_t common_ngram_sam::draft(std::vector<llama_token> & draft, int n_draft, int n_min) const {
+    const int32_t s = states[last].link;
+    if (s <= 0) {
+        return 0;
+    }
+
+    const int32_t n_match = states[s].len;
+    if (n_match < std::max(1, n_min)) {
+        return n_match;
+    }
+
+    const size_t n_draft_prev = draft.size();
+    const size_t n_tokens     = tokens.size();
+
+    // continue with the tokens after the earlier occurrence
+    // if it overlaps with the current end, the drafted tokens themselves are repeated
+    for (size_t i = states[s].end + 1; (int) (draft.size() - n_draft_prev) < n_draft; ++i) {
+        const llama_token token = i < n_tokens ? tokens[i] : draft[n_draft_prev + i - n_tokens];
+        if (token == LLAMA_TOKEN_NULL) {
+            break;
+        }
+
+        draft.push_back(token);
+    }
+
+    return n_match;
+}
+
+bool common_ngram_sam::save(const std::string & filename) const {
+    std::ofstream file_out(filename, std::ios::binary);
+    if (!file_out) {
+        LOG_ERR("%s: failed to open file '%s'\n", __func__, filename.c_str());
+        return false;
+    }
+
+    const uint64_t n_tokens = tokens.size();
+
+    file_out.write(reinterpret_cast<const char *>(&LLAMA_NGRAM_SAM_MAGIC),   sizeof(uint32_t));
+    file_out.write(reinterpret_cast<const char *>(&LLAMA_NGRAM_SAM_VERSION), sizeof(uint32_t));
+    file_out.write(reinterpret_cast<const char *>(&n_tokens),                sizeof(uint64_t));
+    file_out.write(reinterpret_cast<const char *>(tokens.data()),            n_tokens*sizeof(llama_token));
+
+    return file_out.good();
+}
+
+bool common_ngram_sam::load(const std::string & filename) {
+    std::ifstream file_in(filename, std::ios::binary);
+    if (!file_in) {
+        return false;
+    }
+
+    uint32_t magic    = 0;
+    uint32_t version  = 0;
+    uint64_t n_tokens = 0;
+
+    file_in.read(reinterpret_cast<char *>(&magic),    sizeof(uint32_t));
+    file_in.read(reinterpret_cast<char *>(&version),  sizeof(uint32_t));
+    file_in.read(reinterpret_cast<char *>(&n_tokens), sizeof(uint64_t));
+
+    if (!file_in || magic != LLAMA_NGRAM_SAM_MAGIC || version != LLAMA_NGRAM_SAM_VERSION) {
+        LOG_ERR("%s: '%s' is not a suffix automaton file\n", __func__, filename.c_str());
+        return false;
+    }
+
+    std::vector<llama_token> data(n_tokens);
+    if (!file_in.read(reinterpret_cast<char *>(data.data()), n_tokens*sizeof(llama_token))) {
+        LOG_ERR("%s: failed to read %llu tokens from '%s'\n", __func__, (unsigned long long) n_tokens, filename.c_str());
+        return false;
+    }
+
+    clear();
+
+    states.reserve(2*n_tokens + 1);
+    append(data.data(), data.size());
+
+    return true;
+}
+
+bool common_ngram_sam_log_append(const std::string & filename, const std::vector<llama_token> & text, size_t n_max) {
+    common_ngram_sam log;
+
+    // if the file does not exist it is created
+    if (std::ifstream(filename).good() && !log.load(filename)) {
+        LOG_ERR("%s: not overwriting '%s'\n", __func__, filename.c_str());
+        return false;
+    }
+
+    if (text.empty() || log.contains(text.data(), text.size())) {
+        return true;
+    }
+
+    // drop the texts that are a prefix of the new one, for ex. the same prompt with a shorter output
+    std::vector<llama_token> tokens;
+    tokens.reserve(log.tokens.size() + 1 + text.size());
+    for (auto it = log.tokens.begin(); it != log.tokens.end(); ) {
+        const auto end = std::find(it, log.tokens.end(), LLAMA_TOKEN_NULL);
+        if ((size_t) (end - it) > text.size() || !std::equal(it, end, text.begin())) {
+            tokens.insert(tokens.end(), it, end);
+            tokens.push_back(LLAMA_TOKEN_NULL);
+        }
+        it = end == log.tokens.end() ? end : end + 1;
+    }
+    tokens.insert(tokens.end(), text.begin(), text.end());
+
+    if (tokens.size() > n_max) {
+        // drop whole texts from the front, or the start of the text if it is longer than n_max by itself
+        auto it = std::find(tokens.end() - n_max, tokens.end(), LLAMA_TOKEN_NULL);
+        if (it == tokens.end()) {
+            it = tokens.end() - n_max;
+        } else {
+            ++it;
+        }
+        tokens.erase(tokens.begin(), it);
+    }
+
+    // only the tokens are saved, the automaton does not have to match them
+    log.tokens = std::move(tokens);
+
+    return log.save(filename);
+}
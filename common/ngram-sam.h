@@ -0,0 +1,82 @@
+#pragma once
+
+#include "llama.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// min. length of a suffix match to draft from
+#define LLAMA_NGRAM_SAM_MIN 2
+
+// max. number of tokens kept in a token log file by common_ngram_sam_log_append
+#define LLAMA_NGRAM_SAM_LOG_MAX (1 << 20)
+
+// Suffix automaton over a token sequence that can only be appended to.
+// It finds the longest suffix of the sequence that occurred before, without a limit on its length,
+// and drafts the tokens that followed that earlier occurrence.
+// Appending a token takes amortized constant time and the memory is a few flat arrays.
+struct common_ngram_sam {
+    common_ngram_sam();
+
+    // Append tokens to the sequence.
+    // LLAMA_TOKEN_NULL can be used as a separator between unrelated texts, drafts never continue past it.
+    void append(llama_token token);
+    void append(const llama_token * tokens, size_t n_tokens);
+
+    // Try to draft tokens that continue the sequence.
+    // draft:   the drafted tokens are appended to it.
+    // n_draft: maximum number of tokens to add to draft.
+    // n_min:   min. length of the suffix match to draft from.
+    // returns: the length of the longest suffix of the sequence that occurred before.
+    int32_t draft(std::vector<llama_token> & draft, int n_draft, int n_min = LLAMA_NGRAM_SAM_MIN) const;
+
+    // Whether the tokens occur as a contiguous span of the sequence.
+    bool contains(const llama_token * data, size_t n_tokens) const;
+
+    void clear();
+
+    size_t size() const { return tokens.size(); }
+
+    // Save the sequence to a file in a compact binary format, the automaton is rebuilt on load.
+    bool save(const std::string & filename) const;
+
+    // Load a sequence saved with save() and rebuild the automaton.
+    bool load(const std::string & filename);
+
+    std::vector<llama_token> tokens;
+
+private:
+    struct state {
+        int32_t len;  // length of the longest string of the state
+        int32_t link; // suffix link
+        int32_t end;  // position of the last token of an occurrence, the latest one for the suffix link of the last state
+        int32_t edge; // first outgoing transition
+    };
+
+    struct edge {
+        int32_t     from; // source state
+        llama_token token;
+        int32_t     next; // target state
+        int32_t     edge; // next outgoing transition of the same state
+    };
+
+    int32_t find(int32_t s, llama_token token) const;
+    void    insert(int32_t s, llama_token token, int32_t next);
+    void    rehash(size_t size);
+
+    std::vector<state> states;
+    std::vector<edge>  edges;
+
+    // open addressing hash table (state, token) -> edge
+    std::vector<int32_t> table;
+
+    int32_t last;
+};
+
+// Append a text to a token log file saved with common_ngram_sam::save(), so that later runs can draft from it.
+// The text is skipped if it already occurs in the log, for ex. when the same prompt gives the same output again,
+// and earlier texts that are a prefix of it are replaced by it.
+// The oldest texts are dropped so that the log keeps at most n_max tokens.
+// A missing file is created. A file that is not a token log is left untouched and false is returned.
+bool common_ngram_sam_log_append(const std::string & filename, const std::vector<llama_token> & text, size_t n_max = LLAMA_NGRAM_SAM_LOG_MAX);
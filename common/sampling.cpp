@@ -3,7 +3,11 @@
 #include "common.h"
 #include "log.h"
 
+#include "ggml-backend.h"
+#include "ggml-cpu.h"
+
 #include <cmath>
+#include <functional>
 #include <unordered_map>
 #include <algorithm>
 
@@ -112,14 +116,7 @@ struct common_sampler {
 
     llama_token_data_array cur_p;
 
-    void set_logits(struct llama_context * ctx, int idx) {
-        const auto * logits = llama_get_logits_ith(ctx, idx);
-
-        const llama_model * model = llama_get_model(ctx);
-        const llama_vocab * vocab = llama_model_get_vocab(model);
-
-        const int n_vocab = llama_vocab_n_tokens(vocab);
-
+    void set_logits(const float * logits, int n_vocab) {
         cur.resize(n_vocab);
 
         for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
@@ -335,8 +332,8 @@ void common_perf_print(const struct llama_context * ctx, const struct common_sam
     }
 }
 
-llama_token common_sampler_sample(struct common_sampler * gsmpl, struct llama_context * ctx, int idx, bool grammar_first) {
-    gsmpl->set_logits(ctx, idx);
+llama_token common_sampler_sample_logits(struct common_sampler * gsmpl, const float * logits, int n_vocab, bool grammar_first) {
+    gsmpl->set_logits(logits, n_vocab);
 
     auto & grmr  = gsmpl->grmr;
     auto & chain = gsmpl->chain;
@@ -371,7 +368,7 @@ llama_token common_sampler_sample(struct common_sampler * gsmpl, struct llama_co
 
     // resampling:
     // if the token is not valid, sample again, but first apply the grammar sampler and then the sampling chain
-    gsmpl->set_logits(ctx, idx);
+    gsmpl->set_logits(logits, n_vocab);
 
     llama_sampler_apply(grmr,  &cur_p);
     llama_sampler_apply(chain, &cur_p);
@@ -381,6 +378,88 @@ llama_token common_sampler_sample(struct common_sampler * gsmpl, struct llama_co
     return cur_p.data[cur_p.selected].id;
 }
 
+llama_token common_sampler_sample(struct common_sampler * gsmpl, struct llama_context * ctx, int idx, bool grammar_first) {
+    const llama_vocab * vocab = llama_model_get_vocab(llama_get_model(ctx));
+
+    return common_sampler_sample_logits(gsmpl, llama_get_logits_ith(ctx, idx), llama_vocab_n_tokens(vocab), grammar_first);
+}
+
+// runs f(ith, nth) on the threads of a ggml threadpool, as the only node of a graph on the CPU backend
+static void common_threadpool_run(struct ggml_threadpool * threadpool, int n_tasks, const std::function<void(int, int)> & f) {
+    ggml_backend_dev_t dev = ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_CPU);
+    GGML_ASSERT(dev && "no CPU backend found");
+
+    ggml_backend_reg_t reg = ggml_backend_dev_backend_reg(dev);
+
+    auto * set_threadpool_fn = (decltype(ggml_backend_cpu_set_threadpool) *) ggml_backend_reg_get_proc_address(reg, "ggml_backend_cpu_set_threadpool");
+    auto * set_n_threads_fn  = (ggml_backend_set_n_threads_t) ggml_backend_reg_get_proc_address(reg, "ggml_backend_set_n_threads");
+    GGML_ASSERT(set_threadpool_fn && set_n_threads_fn);
+
+    ggml_backend_t backend = ggml_backend_dev_init(dev, nullptr);
+    GGML_ASSERT(backend);
+
+    set_threadpool_fn(backend, threadpool);
+    set_n_threads_fn(backend, 0); // use all the threads of the threadpool
+
+    ggml_init_params params = {
+        /*.mem_size   =*/ ggml_tensor_overhead() + ggml_graph_overhead_custom(1, false),
+        /*.mem_buffer =*/ nullptr,
+        /*.no_alloc   =*/ true,
+    };
+
+    ggml_context * ctx = ggml_init(params);
+
+    const ggml_custom_op_t op = [](ggml_tensor * /*dst*/, int ith, int nth, void * userdata) {
+        (*(const std::function<void(int, int)> *) userdata)(ith, nth);
+    };
+
+    ggml_tensor * t = ggml_custom_4d(ctx, GGML_TYPE_F32, 1, 1, 1, 1, nullptr, 0, op, n_tasks, const_cast<std::function<void(int, int)> *>(&f));
+
+    ggml_cgraph * gf = ggml_new_graph_custom(ctx, 1, false);
+    ggml_build_forward_expand(gf, t);
+
+    GGML_ASSERT(ggml_backend_graph_compute(backend, gf) == GGML_STATUS_SUCCESS);
+
+    ggml_free(ctx);
+    ggml_backend_free(backend);
+}
+
+std::vector<llama_token> common_sampler_sample_batch_logits(const std::vector<struct common_sampler *> & gsmpls, const std::vector<const float *> & logits, int n_vocab, struct ggml_threadpool * threadpool, bool grammar_first) {
+    GGML_ASSERT(gsmpls.size() == logits.size() && "gsmpls.size() must be logits.size()");
+
+    const int n_outputs = logits.size();
+
+    std::vector<llama_token> result(n_outputs);
+
+    const auto worker = [&](int ith, int nth) {
+        for (int i = ith; i < n_outputs; i += nth) {
+            result[i] = common_sampler_sample_logits(gsmpls[i], logits[i], n_vocab, grammar_first);
+        }
+    };
+
+    if (threadpool == nullptr || n_outputs <= 1) {
+        worker(0, 1);
+    } else {
+        common_threadpool_run(threadpool, n_outputs, worker);
+    }
+
+    return result;
+}
+
+std::vector<llama_token> common_sampler_sample_batch(const std::vector<struct common_sampler *> & gsmpls, struct llama_context * ctx, const std::vector<int> & idxs, struct ggml_threadpool * threadpool, bool grammar_first) {
+    GGML_ASSERT(gsmpls.size() == idxs.size() && "gsmpls.size() must be idxs.size()");
+
+    const llama_vocab * vocab = llama_model_get_vocab(llama_get_model(ctx));
+
+    // get the logits on this thread, as this synchronizes the context
+    std::vector<const float *> logits(idxs.size());
+    for (size_t i = 0; i < idxs.size(); ++i) {
+        logits[i] = llama_get_logits_ith(ctx, idxs[i]);
+    }
+
+    return common_sampler_sample_batch_logits(gsmpls, logits, llama_vocab_n_tokens(vocab), threadpool, grammar_first);
+}
+
 std::vector<llama_token> common_sampler_sample_and_accept_n(struct common_sampler * gsmpl, struct llama_context * ctx, const std::vector<int> & idxs, const llama_tokens & draft, bool grammar_first) {
     GGML_ASSERT(idxs.size() == draft.size() + 1 && "idxs.size() must be draft.size() + 1");
 
@@ -60,6 +60,23 @@ void common_perf_print(const struct llama_context * ctx, const struct common_sam
 //
 llama_token common_sampler_sample(struct common_sampler * gsmpl, struct llama_context * ctx, int idx, bool grammar_first = false);
 
+// same as common_sampler_sample, with the logits of the output given directly
+llama_token common_sampler_sample_logits(struct common_sampler * gsmpl, const float * logits, int n_vocab, bool grammar_first = false);
+
+// batched version of common_sampler_sample
+//
+// samples the idxs[i]-th output with gsmpls[i], the samplers must be distinct
+// the outputs are sampled in parallel on the threads of threadpool, typically the one attached to ctx with llama_attach_threadpool
+// if threadpool is nullptr, they are sampled one after the other on the calling thread
+// each sampler keeps its own candidates, so common_sampler_get_candidates() can be used afterwards
+//
+// as with common_sampler_sample, the returned tokens are not accepted
+//
+std::vector<llama_token> common_sampler_sample_batch(const std::vector<struct common_sampler *> & gsmpls, struct llama_context * ctx, const std::vector<int> & idxs, struct ggml_threadpool * threadpool = nullptr, bool grammar_first = false);
+
+// same as common_sampler_sample_batch, with the logits of the outputs given directly
+std::vector<llama_token> common_sampler_sample_batch_logits(const std::vector<struct common_sampler *> & gsmpls, const std::vector<const float *> & logits, int n_vocab, struct ggml_threadpool * threadpool = nullptr, bool grammar_first = false);
+
 // generalized version of common_sampler_sample
 //
 // will cross-reference the sampled tokens with a batch of draft tokens and accept those that match
@@ -3,9 +3,11 @@
 #include "log.h"
 #include "common.h"
 #include "sampling.h"
+#include "ngram-sam.h"
 
 #include <cstring>
 #include <algorithm>
+#include <numeric>
 
 #define SPEC_VOCAB_MAX_SIZE_DIFFERENCE  128
 #define SPEC_VOCAB_CHECK_START_TOKEN_ID 5
@@ -16,17 +18,86 @@ struct common_speculative {
 
     llama_batch batch;
     llama_tokens prompt;
+
+    // self-speculative decoding: ctx is the target context and the drafts are evaluated with its first n_layer_exit layers
+    int32_t n_layer_exit;
+
+    llama_seq_id              seq_tgt; // sequence of the target prompt (self-speculative decoding only)
+    std::vector<llama_seq_id> seq_dft; // sequence of each draft branch
+
+    // the target prompt, to draft from earlier occurrences of its suffix
+    common_ngram_sam sam;
+
+    // n-gram cache from a large text corpus, used if the target prompt has no match (optional)
+    common_ngram_cache * nc_static;
 };
 
+static void common_speculative_init_sampler(struct common_speculative * result);
+
 struct common_speculative * common_speculative_init(
         struct llama_context * ctx_dft) {
     auto * result = new common_speculative {
-        /* .ctx    = */ ctx_dft,
-        /* .smpl   = */ nullptr,
-        /* .batch  = */ llama_batch_init(llama_n_batch(ctx_dft), 0, 1),
-        /* .prompt = */ {},
+        /* .ctx          = */ ctx_dft,
+        /* .smpl         = */ nullptr,
+        /* .batch        = */ llama_batch_init(llama_n_batch(ctx_dft), 0, 1),
+        /* .prompt       = */ {},
+        /* .n_layer_exit = */ 0,
+        /* .seq_tgt      = */ 0,
+        /* .seq_dft      = */ std::vector<llama_seq_id>(std::min<int>(llama_n_seq_max(ctx_dft), COMMON_SPECULATIVE_TREE_MAX_SEQ)),
+        /* .sam          = */ {},
+        /* .nc_static    = */ nullptr,
+    };
+
+    std::iota(result->seq_dft.begin(), result->seq_dft.end(), 0);
+
+    common_speculative_init_sampler(result);
+
+    return result;
+}
+
+struct common_speculative * common_speculative_init_self(
+        struct llama_context * ctx_tgt,
+        int32_t n_layer_exit,
+        llama_seq_id seq_tgt,
+        const std::vector<llama_seq_id> & seq_dft) {
+    GGML_ASSERT(n_layer_exit > 0 && !seq_dft.empty());
+
+    auto * result = new common_speculative {
+        /* .ctx          = */ ctx_tgt,
+        /* .smpl         = */ nullptr,
+        /* .batch        = */ llama_batch_init(llama_n_batch(ctx_tgt), 0, 1),
+        /* .prompt       = */ {},
+        /* .n_layer_exit = */ n_layer_exit,
+        /* .seq_tgt      = */ seq_tgt,
+        /* .seq_dft      = */ seq_dft,
+        /* .sam          = */ {},
+        /* .nc_static    = */ nullptr,
     };
 
+    common_speculative_init_sampler(result);
+
+    return result;
+}
+
+struct common_speculative * common_speculative_init_lookup(common_ngram_cache * nc_static) {
+    auto * result = new common_speculative {
+        /* .ctx          = */ nullptr,
+        /* .smpl         = */ nullptr,
+        /* .batch        = */ {},
+        /* .prompt       = */ {},
+        /* .n_layer_exit = */ 0,
+        /* .seq_tgt      = */ 0,
+        /* .seq_dft      = */ {},
+        /* .sam          = */ {},
+        /* .nc_static    = */ nc_static,
+    };
+
+    return result;
+}
+
+static void common_speculative_init_sampler(struct common_speculative * result) {
+    auto * ctx_dft = result->ctx;
+
     // TODO: optimize or pass from outside?
 #if 0
     {
@@ -58,8 +129,6 @@ struct common_speculative * common_speculative_init(
         result->smpl = common_sampler_init(llama_get_model(ctx_dft), params);
     }
 #endif
-
-    return result;
 }
 
 void common_speculative_free(struct common_speculative * spec) {
@@ -134,18 +203,115 @@ bool common_speculative_are_compatible(
     return true;
 }
 
-llama_tokens common_speculative_gen_draft(
+// draft from the n-gram cache of a large text corpus
+static bool common_speculative_gen_draft_static(
         struct common_speculative * spec,
         struct common_speculative_params params,
         const llama_tokens & prompt_tgt,
-        llama_token id_last) {
+        llama_token id_last,
+        llama_tokens & result) {
+    // only the last n-grams of the prompt are looked up
+    const size_t n_tail = LLAMA_NGRAM_MAX - 1;
+
+    if (prompt_tgt.size() < n_tail) {
+        return false;
+    }
+
+    common_ngram_cache nc_empty;
+
+    llama_tokens inp(prompt_tgt.end() - n_tail, prompt_tgt.end());
+    inp.push_back(id_last);
+
+    result = { id_last };
+
+    common_ngram_cache_draft(inp, result, params.n_draft, LLAMA_NGRAM_MIN, LLAMA_NGRAM_MAX, nc_empty, nc_empty, *spec->nc_static);
+
+    result.erase(result.begin());
+
+    LOG_DBG("%s: n_draft = %d\n", __func__, (int) result.size());
+
+    return !result.empty();
+}
+
+// draft from the longest suffix of the target prompt that occurred before in it
+// returns false if the match is shorter than n_lookup_min and the static n-gram cache has no draft either
+static bool common_speculative_gen_draft_lookup(
+        struct common_speculative * spec,
+        struct common_speculative_params params,
+        const llama_tokens & prompt_tgt,
+        llama_token id_last,
+        llama_tokens & result) {
+    auto & sam = spec->sam;
+
+    result.clear();
+
+    if (params.n_lookup_min <= 0) {
+        return spec->nc_static && common_speculative_gen_draft_static(spec, params, prompt_tgt, id_last, result);
+    }
+
+    // the target prompt is usually the previous one with a few new tokens at the end
+    const size_t n_prev = sam.size();
+    if (n_prev > prompt_tgt.size() + 1 ||
+        !std::equal(sam.tokens.begin(), sam.tokens.begin() + std::min(n_prev, prompt_tgt.size()), prompt_tgt.begin()) ||
+        (n_prev == prompt_tgt.size() + 1 && sam.tokens.back() != id_last)) {
+        sam.clear();
+    }
+
+    if (sam.size() < prompt_tgt.size()) {
+        sam.append(prompt_tgt.data() + sam.size(), prompt_tgt.size() - sam.size());
+    }
+    if (sam.size() == prompt_tgt.size()) {
+        sam.append(id_last);
+    }
+
+    const int32_t n_match = sam.draft(result, params.n_draft, params.n_lookup_min);
+
+    LOG_DBG("%s: n_match = %d, n_draft = %d\n", __func__, n_match, (int) result.size());
+
+    if (result.empty() && spec->nc_static) {
+        return common_speculative_gen_draft_static(spec, params, prompt_tgt, id_last, result);
+    }
+
+    return !result.empty();
+}
+
+// sync the draft context with the target prompt and evaluate id_last
+// returns true if a previous draft that the target agreed with was passed back in result
+static bool common_speculative_begin(
+        struct common_speculative * spec,
+        struct common_speculative_params params,
+        const llama_tokens & prompt_tgt,
+        llama_token id_last,
+        llama_tokens & result) {
     auto & batch  = spec->batch;
     auto & ctx    = spec->ctx;
-    auto & smpl   = spec->smpl;
     auto & prompt = spec->prompt;
 
     auto * mem = llama_get_memory(ctx);
 
+    result.clear();
+
+    if (spec->n_layer_exit > 0) {
+        // the target context already has the prompt, so the draft sequence simply shares its cells
+        for (const auto seq : spec->seq_dft) {
+            llama_memory_seq_rm(mem, seq, -1, -1);
+        }
+        llama_memory_seq_cp(mem, spec->seq_tgt, spec->seq_dft[0], -1, -1);
+
+        prompt = prompt_tgt;
+
+        llama_set_n_layer_exit(ctx, spec->n_layer_exit);
+
+        common_batch_clear(batch);
+        common_batch_add  (batch, id_last, prompt.size(), { spec->seq_dft[0] }, true);
+
+        prompt.push_back(id_last);
+
+        llama_decode(ctx, batch);
+
+        return false;
+    }
+
     int reuse_i = 0;
     int reuse_n = 0;
 
@@ -171,7 +337,6 @@ llama_tokens common_speculative_gen_draft(
 
     LOG_DBG("%s: reuse_i = %d, reuse_n = %d, prompt = %d\n", __func__, reuse_i, reuse_n, (int) prompt.size());
 
-    llama_tokens result;
     result.reserve(params.n_draft);
 
     if (reuse_n == 0) {
@@ -190,7 +355,7 @@ llama_tokens common_speculative_gen_draft(
                 }
             }
 
-            return result;
+            return true;
         }
 
         if (reuse_i > 0) {
@@ -237,6 +402,51 @@ llama_tokens common_speculative_gen_draft(
 
     llama_decode(ctx, batch);
 
+    return false;
+}
+
+// remove the drafts of the first n_seq branches from the context, except for the main branch of a draft model
+static void common_speculative_end(struct common_speculative * spec, int n_seq) {
+    auto * mem = llama_get_memory(spec->ctx);
+
+    if (spec->n_layer_exit > 0) {
+        llama_set_n_layer_exit(spec->ctx, 0);
+
+        for (int s = 0; s < n_seq; ++s) {
+            llama_memory_seq_rm(mem, spec->seq_dft[s], -1, -1);
+        }
+
+        return;
+    }
+
+    for (int s = 1; s < n_seq; ++s) {
+        llama_memory_seq_rm(mem, spec->seq_dft[s], -1, -1);
+    }
+}
+
+llama_tokens common_speculative_gen_draft(
+        struct common_speculative * spec,
+        struct common_speculative_params params,
+        const llama_tokens & prompt_tgt,
+        llama_token id_last) {
+    auto & batch  = spec->batch;
+    auto & ctx    = spec->ctx;
+    auto & smpl   = spec->smpl;
+    auto & prompt = spec->prompt;
+
+    llama_tokens result;
+
+    if (common_speculative_gen_draft_lookup(spec, params, prompt_tgt, id_last, result) || ctx == nullptr) {
+        return result;
+    }
+
+    if (common_speculative_begin(spec, params, prompt_tgt, id_last, result)) {
+        return result;
+    }
+
+    // position of id_last
+    const llama_pos n_past = prompt.size() - 1;
+
     common_sampler_reset(smpl);
 
     // sample n_draft tokens from the draft model
@@ -268,7 +478,7 @@ llama_tokens common_speculative_gen_draft(
             break;
         }
 
-        common_batch_add(batch, id, n_past + i + 1, { 0 }, true);
+        common_batch_add(batch, id, n_past + i + 1, { spec->seq_dft[0] }, true);
 
         // evaluate the drafted tokens on the draft model
         llama_decode(ctx, batch);
@@ -276,5 +486,220 @@ llama_tokens common_speculative_gen_draft(
         prompt.push_back(id);
     }
 
+    common_speculative_end(spec, 1);
+
+    return result;
+}
+
+void common_speculative_tree::clear() {
+    tokens.clear();
+    parent.clear();
+    depth.clear();
+    seq_mask.clear();
+
+    n_seq = 0;
+}
+
+int32_t common_speculative_tree::add(llama_token id, int32_t i_parent, int32_t seq) {
+    const int32_t i = tokens.size();
+
+    tokens.push_back(id);
+    parent.push_back(i_parent);
+    depth.push_back(i_parent < 0 ? 0 : depth[i_parent] + 1);
+    seq_mask.push_back(0);
+
+    // all ancestors of the node become part of the branch
+    for (int32_t j = i; j >= 0 && (seq_mask[j] & (1ull << seq)) == 0; j = parent[j]) {
+        seq_mask[j] |= 1ull << seq;
+    }
+
+    n_seq = std::max(n_seq, seq + 1);
+
+    return i;
+}
+
+common_speculative_tree common_speculative_gen_draft_tree(
+        struct common_speculative * spec,
+        struct common_speculative_params params,
+        const llama_tokens & prompt_tgt,
+        llama_token id_last) {
+    auto & batch  = spec->batch;
+    auto & ctx    = spec->ctx;
+    auto & smpl   = spec->smpl;
+    auto & prompt = spec->prompt;
+
+    common_speculative_tree result;
+
+    {
+        llama_tokens reused;
+        if (common_speculative_gen_draft_lookup(spec, params, prompt_tgt, id_last, reused) || ctx == nullptr ||
+            common_speculative_begin(spec, params, prompt_tgt, id_last, reused)) {
+            for (size_t i = 0; i < reused.size(); ++i) {
+                result.add(reused[i], (int32_t) i - 1, 0);
+            }
+
+            return result;
+        }
+    }
+
+    auto * mem = llama_get_memory(ctx);
+
+    const int n_seq_max = std::min<int>(params.n_branch, spec->seq_dft.size());
+
+    // position of id_last
+    const llama_pos n_past = prompt.size() - 1;
+
+    // the draft branches, branch s is evaluated in sequence s of the draft context
+    struct draft_branch {
+        int32_t seq;
+        int32_t i_node;  // last node of the branch in the tree, -1 - id_last
+        int32_t i_batch; // index of the logits of the last node in the batch
+    };
+
+    std::vector<draft_branch> branches = { { 0, -1, 0 } };
+    std::vector<draft_branch> branches_next;
+
+    common_sampler_reset(smpl);
+
+    for (int i = 0; !branches.empty() && (int) result.tokens.size() < params.n_draft; ++i) {
+        common_batch_clear(batch);
+
+        branches_next.clear();
+
+        for (const auto & br : branches) {
+            if ((int) result.tokens.size() >= params.n_draft) {
+                break;
+            }
+
+            const int s = br.seq;
+
+            common_sampler_sample(smpl, ctx, br.i_batch, true);
+
+            const auto * cur_p = common_sampler_get_candidates(smpl);
+
+            for (int k = 0; k < std::min(3, (int) cur_p->size); ++k) {
+                LOG_DBG(" - draft candidate %3d for seq %3d, pos %3d: %6d (%8.3f) '%s'\n",
+                        k, s, i, cur_p->data[k].id, cur_p->data[k].p, common_token_to_piece(ctx, cur_p->data[k].id).c_str());
+            }
+
+            // the top candidate continues the branch, the runner-ups above p_split start new branches
+            int n_child = 1;
+            while (n_child < (int) cur_p->size && cur_p->data[n_child].p >= params.p_split &&
+                   std::max(result.n_seq, 1) + n_child - 1 < n_seq_max &&
+                   (int) result.tokens.size() + n_child < params.n_draft) {
+                n_child++;
+            }
+
+            for (int k = 0; k < n_child; ++k) {
+                const llama_token id = cur_p->data[k].id;
+
+                int seq = s;
+                if (k > 0) {
+                    seq = result.n_seq;
+
+                    LOG_DBG("splitting seq %3d into %3d\n", s, seq);
+
+                    llama_memory_seq_rm(mem,                   spec->seq_dft[seq], -1, -1);
+                    llama_memory_seq_cp(mem, spec->seq_dft[s], spec->seq_dft[seq], -1, -1);
+                }
+
+                common_sampler_accept(smpl, id, true);
+
+                const int32_t i_node = result.add(id, br.i_node, seq);
+
+                if (params.n_draft <= (int) result.tokens.size()) {
+                    break;
+                }
+
+                // only continue with high-confidence draft tokens, unless the branch was split here
+                if (cur_p->data[k].p < params.p_min && (n_child == 1 || cur_p->data[k].p < params.p_split)) {
+                    continue;
+                }
+
+                branches_next.push_back({ seq, i_node, batch.n_tokens });
+
+                common_batch_add(batch, id, n_past + i + 1, { spec->seq_dft[seq] }, true);
+
+                if (seq == 0) {
+                    prompt.push_back(id);
+                }
+            }
+        }
+
+        if (batch.n_tokens == 0) {
+            break;
+        }
+
+        // evaluate the drafted tokens of all branches on the draft model
+        llama_decode(ctx, batch);
+
+        branches.swap(branches_next);
+    }
+
+    common_speculative_end(spec, std::max(result.n_seq, 1));
+
+    return result;
+}
+
+void common_speculative_tree_batch_add(
+        struct llama_batch & batch,
+        const common_speculative_tree & tree,
+        llama_token id_last,
+        llama_pos n_past,
+        const std::vector<llama_seq_id> & seq_ids) {
+    std::vector<llama_seq_id> seqs;
+
+    // the last accepted token is shared by all branches
+    for (int s = 0; s < std::max(1, tree.n_seq); ++s) {
+        seqs.push_back(seq_ids[s]);
+    }
+
+    common_batch_add(batch, id_last, n_past, seqs, true);
+
+    for (size_t i = 0; i < tree.tokens.size(); ++i) {
+        seqs.clear();
+        for (int s = 0; s < tree.n_seq; ++s) {
+            if (tree.seq_mask[i] & (1ull << s)) {
+                seqs.push_back(seq_ids[s]);
+            }
+        }
+
+        common_batch_add(batch, tree.tokens[i], n_past + 1 + tree.depth[i], seqs, true);
+    }
+}
+
+llama_tokens common_speculative_tree_accept(
+        struct common_sampler * smpl,
+        struct llama_context * ctx,
+        const common_speculative_tree & tree,
+        int32_t & i_last,
+        int32_t i_batch) {
+    llama_tokens result;
+
+    i_last = -1;
+
+    while (true) {
+        const llama_token id = common_sampler_sample(smpl, ctx, i_batch + i_last + 1);
+
+        common_sampler_accept(smpl, id, true);
+
+        result.push_back(id);
+
+        // continue with the child that matches the sampled token, if any
+        int32_t i_next = -1;
+        for (size_t i = i_last + 1; i < tree.tokens.size(); ++i) {
+            if (tree.parent[i] == i_last && tree.tokens[i] == id) {
+                i_next = i;
+                break;
+            }
+        }
+
+        if (i_next < 0) {
+            break;
+        }
+
+        i_last = i_next;
+    }
+
     return result;
 }
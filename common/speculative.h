@@ -2,18 +2,55 @@
 
 #include "llama.h"
 #include "common.h"
+#include "ngram-cache.h"
+
+// max number of branches of a draft tree
+#define COMMON_SPECULATIVE_TREE_MAX_SEQ 64
 
 struct common_speculative;
 
 struct common_speculative_params {
-    int n_draft = 16;  // max drafted tokens
-    int n_reuse = 256;
+    int n_draft  = 16; // max drafted tokens
+    int n_reuse  = 256;
+    int n_branch = 1;  // max number of branches of a draft tree
+
+    int n_lookup_min = 0; // min length of a match in the target prompt to draft from it instead of the draft model (0 - disabled)
+
+    float p_min   = 0.75f; // min probability required to accept a token in the draft
+    float p_split = 0.10f; // min probability required to start a new branch in a draft tree
+};
 
-    float p_min = 0.75f; // min probability required to accept a token in the draft
+// a tree of drafted tokens that continues the last accepted token
+// the nodes are stored in the order they were drafted, so a parent always comes before its children
+// branch s is the path from the root to a leaf; the nodes on that path have bit s set in seq_mask
+struct common_speculative_tree {
+    llama_tokens          tokens;
+    std::vector<int32_t>  parent;   // parent node, -1 - the last accepted token
+    std::vector<int32_t>  depth;    // 0 for the children of the last accepted token
+    std::vector<uint64_t> seq_mask; // branches that go through the node
+
+    int32_t n_seq = 0; // number of branches
+
+    void clear();
+
+    // add a node to branch seq and return its index
+    int32_t add(llama_token id, int32_t i_parent, int32_t seq);
 };
 
 struct common_speculative * common_speculative_init(struct llama_context * ctx_dft);
 
+// self-speculative decoding: draft with the first n_layer_exit layers of the target context itself
+// the target prompt is expected in seq_tgt, draft branch s is evaluated in seq_dft[s]
+struct common_speculative * common_speculative_init_self(
+        struct llama_context * ctx_tgt,
+                     int32_t   n_layer_exit,
+                llama_seq_id   seq_tgt,
+        const std::vector<llama_seq_id> & seq_dft);
+
+// prompt-lookup decoding: draft only from earlier occurrences in the target prompt and from the optional static n-gram cache
+// there is no draft context, nc_static must outlive the speculator
+struct common_speculative * common_speculative_init_lookup(common_ngram_cache * nc_static);
+
 void common_speculative_free(struct common_speculative * spec);
 
 bool common_speculative_are_compatible(
@@ -26,3 +63,32 @@ llama_tokens common_speculative_gen_draft(
         struct common_speculative_params   params,
                       const llama_tokens & prompt,
                              llama_token   id_last);
+
+// sample a tree of up to n_draft tokens with up to n_branch branches using the draft model
+// the number of branches is also limited by the sequences available for drafting
+common_speculative_tree common_speculative_gen_draft_tree(
+               struct common_speculative * spec,
+        struct common_speculative_params   params,
+                      const llama_tokens & prompt,
+                             llama_token   id_last);
+
+// add the last accepted token and the draft tree to the batch for evaluation with the target model
+// seq_ids[s] is the sequence of branch s in the target context, all of which must contain the prompt up to n_past
+// the root gets the batch index 0 and node i gets the batch index i + 1
+void common_speculative_tree_batch_add(
+                       struct llama_batch & batch,
+           const common_speculative_tree & tree,
+                              llama_token   id_last,
+                                llama_pos   n_past,
+        const std::vector<llama_seq_id>   & seq_ids);
+
+// sample along the draft tree with the target model after the batch has been evaluated
+// i_batch is the batch index of the last accepted token, node i is expected at the batch index i_batch + i + 1
+// returns the tokens of the longest accepted path followed by one token sampled by the target model
+// i_last is set to the last accepted node, or -1 if no drafted token was accepted
+llama_tokens common_speculative_tree_accept(
+                  struct common_sampler * smpl,
+                   struct llama_context * ctx,
+           const common_speculative_tree & tree,
+                                  int32_t & i_last,
+                                  int32_t   i_batch = 0);
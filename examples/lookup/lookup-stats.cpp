@@ -2,6 +2,7 @@
 #include "common.h"
 #include "log.h"
 #include "ngram-cache.h"
+#include "ngram-sam.h"
 #include "llama.h"
 #include "ggml.h"
 
@@ -36,6 +37,8 @@ int main(int argc, char ** argv){
     std::vector<llama_token> inp;
     inp = common_tokenize(ctx.get(), params.prompt, true, true);
 
+    // previous generations and the current chunk
+    common_ngram_sam   ngram_sam;
     common_ngram_cache ngram_cache_context;
     common_ngram_cache ngram_cache_dynamic;
     common_ngram_cache ngram_cache_static;
@@ -61,6 +64,10 @@ int main(int argc, char ** argv){
             } catch (std::ifstream::failure const &) {} // if the file does not exist it will simply be created at the end of the program
         }
 
+        if (!params.lookup_sam_dynamic.empty()) {
+            ngram_sam.load(params.lookup_sam_dynamic);
+        }
+
         t_draft_flat_us += ggml_time_us() - t_start_draft_us;
     }
 
@@ -79,6 +86,12 @@ int main(int argc, char ** argv){
         std::vector<llama_token> pseudo_output;
         pseudo_output.push_back(inp_slice[0]);
 
+        // each chunk is a separate text
+        if (ngram_sam.size() > 0) {
+            ngram_sam.append(LLAMA_TOKEN_NULL);
+        }
+        ngram_sam.append(pseudo_output.back());
+
         while ((int) pseudo_output.size() < n_ctx) {
             // Simulate drafting and decoding from draft:
             std::vector<llama_token> draft;
@@ -86,7 +99,10 @@ int main(int argc, char ** argv){
 
             {
                 const int64_t t_start_draft_us = ggml_time_us();
-                common_ngram_cache_draft(pseudo_output, draft, n_draft, LLAMA_NGRAM_MIN, LLAMA_NGRAM_MAX, ngram_cache_context, ngram_cache_dynamic, ngram_cache_static);
+                ngram_sam.draft(draft, n_draft);
+                if (draft.size() == 1) {
+                    common_ngram_cache_draft(pseudo_output, draft, n_draft, LLAMA_NGRAM_MIN, LLAMA_NGRAM_MAX, ngram_cache_context, ngram_cache_dynamic, ngram_cache_static);
+                }
                 t_draft_us += ggml_time_us() - t_start_draft_us;
             }
 
@@ -105,6 +121,7 @@ int main(int argc, char ** argv){
 
                 {
                     const int64_t t_start_draft_us = ggml_time_us();
+                    ngram_sam.append(ground_truth);
                     common_ngram_cache_update(ngram_cache_context, LLAMA_NGRAM_MIN, LLAMA_NGRAM_MAX, pseudo_output, 1, false);
                     t_draft_us += ggml_time_us() - t_start_draft_us;
                 }
@@ -115,6 +132,7 @@ int main(int argc, char ** argv){
                 pseudo_output.push_back(inp_slice[pseudo_output.size()]);
                 {
                     const int64_t t_start_draft_us = ggml_time_us();
+                    ngram_sam.append(pseudo_output.back());
                     common_ngram_cache_update(ngram_cache_context, LLAMA_NGRAM_MIN, LLAMA_NGRAM_MAX, pseudo_output, 1, false);
                     t_draft_us += ggml_time_us() - t_start_draft_us;
                 }
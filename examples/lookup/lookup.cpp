@@ -2,6 +2,7 @@
 #include "ggml.h"
 #include "common.h"
 #include "ngram-cache.h"
+#include "ngram-sam.h"
 #include "sampling.h"
 #include "log.h"
 #include "llama.h"
@@ -40,6 +41,8 @@ int main(int argc, char ** argv){
     std::vector<llama_token> inp;
     inp = common_tokenize(ctx, params.prompt, true, true);
 
+    // previous generations and the current context, drafts come from the longest suffix match in it
+    common_ngram_sam   ngram_sam;
     common_ngram_cache ngram_cache_context;
     common_ngram_cache ngram_cache_dynamic;
     common_ngram_cache ngram_cache_static;
@@ -66,6 +69,14 @@ int main(int argc, char ** argv){
             } catch (std::ifstream::failure const &) {} // if the file does not exist it will simply be created at the end of the program
         }
 
+        // if the file does not exist it will simply be created at the end of the program
+        if (!params.lookup_sam_dynamic.empty() && ngram_sam.load(params.lookup_sam_dynamic)) {
+            ngram_sam.append(LLAMA_TOKEN_NULL);
+        }
+
+        // Fill up the suffix automaton with tokens from user input:
+        ngram_sam.append(inp.data(), inp.size());
+
         t_draft_flat_us += ggml_time_us() - t_start_draft_us;
     }
 
@@ -141,8 +152,9 @@ int main(int argc, char ** argv){
                 ++i_dft;
                 inp.push_back(id);
                 {
-                    // Update context ngram cache with the newly accepted token:
+                    // Update the suffix automaton and the context ngram cache with the newly accepted token:
                     const int64_t t_start_draft_us = ggml_time_us();
+                    ngram_sam.append(id);
                     common_ngram_cache_update(ngram_cache_context, LLAMA_NGRAM_MIN, LLAMA_NGRAM_MAX, inp, 1, false);
                     t_draft_us += ggml_time_us() - t_start_draft_us;
                 }
@@ -167,8 +179,9 @@ int main(int argc, char ** argv){
             draft.push_back(id);
             inp.push_back(id);
             {
-                // Update context ngram cache with the newly accepted token:
+                // Update the suffix automaton and the context ngram cache with the newly accepted token:
                 const int64_t t_start_draft_us = ggml_time_us();
+                ngram_sam.append(id);
                 common_ngram_cache_update(ngram_cache_context, LLAMA_NGRAM_MIN, LLAMA_NGRAM_MAX, inp, 1, false);
                 t_draft_us += ggml_time_us() - t_start_draft_us;
             }
@@ -191,7 +204,11 @@ int main(int argc, char ** argv){
         GGML_ASSERT(draft[0] == inp.back());
         const int64_t t_start_draft_us = ggml_time_us();
 
-        common_ngram_cache_draft(inp, draft, n_draft, LLAMA_NGRAM_MIN, LLAMA_NGRAM_MAX, ngram_cache_context, ngram_cache_dynamic, ngram_cache_static);
+        // fall back to the ngram caches if the sequence has no long enough match
+        ngram_sam.draft(draft, n_draft);
+        if (draft.size() == 1) {
+            common_ngram_cache_draft(inp, draft, n_draft, LLAMA_NGRAM_MIN, LLAMA_NGRAM_MAX, ngram_cache_context, ngram_cache_dynamic, ngram_cache_static);
+        }
 
         for (size_t i = 1; i < draft.size(); ++i) {
             common_batch_add(batch_tgt, draft[i], n_past + i, { 0 }, true);
@@ -212,6 +229,11 @@ int main(int argc, char ** argv){
     common_ngram_cache_merge(ngram_cache_dynamic, ngram_cache_context);
     common_ngram_cache_save(ngram_cache_dynamic, params.lookup_cache_dynamic);
 
+    // Append this generation to the token log of the previous ones:
+    if (!params.lookup_sam_dynamic.empty()) {
+        common_ngram_sam_log_append(params.lookup_sam_dynamic, inp);
+    }
+
     LOG("\n\n");
 
     LOG_INF("encoded %4d tokens in %8.3f seconds, speed: %8.3f t/s\n", n_input,   (t_enc_end - t_enc_start) / 1e6f, inp.size() / ((t_enc_end - t_enc_start) / 1e6f));
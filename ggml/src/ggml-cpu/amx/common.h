@@ -89,3 +89,13 @@ inline bool qtype_has_amx_kernels(const enum ggml_type type) {
         (type == GGML_TYPE_Q6_K) ||
         (type == GGML_TYPE_IQ4_XS);
 }
+
+// floating types that have AMX support
+inline bool ftype_has_amx_kernels(const enum ggml_type type) {
+#if defined(__AMX_BF16__) && defined(__AVX512BF16__)
+    return type == GGML_TYPE_BF16;
+#else
+    GGML_UNUSED(type);
+    return false;
+#endif
+}
@@ -8,6 +8,7 @@
 #include "mmq.h"
 #include "ggml-impl.h"
 #include "ggml-cpu-impl.h"
+#include "ggml-cpu.h"
 #include "quants.h"
 #include "ggml-quants.h"
 #include <algorithm>
@@ -201,36 +202,76 @@ struct tile_config_t{
 //    advanced-matrix-extensions-intrinsics-functions.html
 //
 
+// the int8 and the bf16 kernels use different tile shapes,
+// keep track of the config currently loaded by each thread
+enum tile_config_kind {
+    TILE_CONFIG_NONE,
+    TILE_CONFIG_INT8,
+    TILE_CONFIG_BF16,
+};
+
+static thread_local tile_config_kind tile_config_loaded = TILE_CONFIG_NONE;
+
+// NB: the config stays in static storage, the `ldtilecfg` asm of some gcc versions
+// does not declare that it reads the whole 64 bytes and the stores could be dropped
+
 #define TC_CONFIG_TILE(i, r, cb) tc.rows[i] = r; tc.colsb[i] = cb
 void ggml_tile_config_init(void) {
-    static thread_local bool is_first_time = true;
+    if (tile_config_loaded == TILE_CONFIG_INT8) {
+        return;
+    }
+
+    static thread_local tile_config_t tc;
+    tc.palette_id = 1;
+    tc.start_row = 0;
+    TC_CONFIG_TILE(TMM0, 8, 64);
+    TC_CONFIG_TILE(TMM1, 8, 64);
+    TC_CONFIG_TILE(TMM2, 16, 32);
+    TC_CONFIG_TILE(TMM3, 16, 32);
+    TC_CONFIG_TILE(TMM4, 16, 64);
+    TC_CONFIG_TILE(TMM5, 16, 64);
+    TC_CONFIG_TILE(TMM6, 16, 64);
+    TC_CONFIG_TILE(TMM7, 16, 64);
+    _tile_loadconfig(&tc);
+
+    tile_config_loaded = TILE_CONFIG_INT8;
+}
 
-    if (!is_first_time) {
+#if defined(__AMX_BF16__) && defined(__AVX512BF16__)
+// Notes: amx-bf16 tile config
+//
+// TDPBF16PS multiplies A {16, 32} bf16 with B {32, 16} bf16 and accumulates
+// into C {16, 16} fp32. B is prepacked to vnni-2 format, from {n, k} to {k/2, n, 2},
+// so each {16, 32} block of the weight becomes a tile of 16 rows of 64 bytes:
+//
+//             A    B    C
+//    rows    16   16   16
+//    colsb   64   64   64
+//
+// The tile distribution follows the same 2-2-4 pattern as the int8 kernels,
+// C being fp32 it stays in the tiles for the whole K loop.
+//
+void ggml_tile_config_init_bf16(void) {
+    if (tile_config_loaded == TILE_CONFIG_BF16) {
         return;
     }
 
     static thread_local tile_config_t tc;
-    tile_config_t current_tc;
-    _tile_storeconfig(&current_tc);
-
-    // load only when config changes
-    if (tc.palette_id == 0 || (memcmp(&current_tc.colsb, &tc.colsb, sizeof(uint16_t) * 8) != 0 &&
-                               memcmp(&current_tc.rows, &tc.rows, sizeof(uint8_t) * 8) != 0)) {
-        tc.palette_id = 1;
-        tc.start_row = 0;
-        TC_CONFIG_TILE(TMM0, 8, 64);
-        TC_CONFIG_TILE(TMM1, 8, 64);
-        TC_CONFIG_TILE(TMM2, 16, 32);
-        TC_CONFIG_TILE(TMM3, 16, 32);
-        TC_CONFIG_TILE(TMM4, 16, 64);
-        TC_CONFIG_TILE(TMM5, 16, 64);
-        TC_CONFIG_TILE(TMM6, 16, 64);
-        TC_CONFIG_TILE(TMM7, 16, 64);
-        _tile_loadconfig(&tc);
-    }
-
-    is_first_time = false;
+    tc.palette_id = 1;
+    tc.start_row = 0;
+    TC_CONFIG_TILE(TMM0, 16, 64);
+    TC_CONFIG_TILE(TMM1, 16, 64);
+    TC_CONFIG_TILE(TMM2, 16, 64);
+    TC_CONFIG_TILE(TMM3, 16, 64);
+    TC_CONFIG_TILE(TMM4, 16, 64);
+    TC_CONFIG_TILE(TMM5, 16, 64);
+    TC_CONFIG_TILE(TMM6, 16, 64);
+    TC_CONFIG_TILE(TMM7, 16, 64);
+    _tile_loadconfig(&tc);
+
+    tile_config_loaded = TILE_CONFIG_BF16;
 }
+#endif
 
 // we need an extra 16 * 4B (TILE_N * int32_t) for each NB/KB block for compensation.
 // See the notes `s8s8 igemm compensation in avx512-vnni` for detail.
@@ -2078,7 +2119,7 @@ void tinygemm_kernel_amx(int M, int N, int KB, const void * RESTRICT _A, const v
         _tile_stored(TMM5, Tile5(C_pre), TILE_N * sizeof(int32_t));
 
         if (need_unpack) {
-            unpack_B<TB>(Tile1, B_blk0);
+            unpack_B<TB>(Tile1, B_blk1);
             _tile_loadd(TMM1, Tile1, TILE_N * VNNI_BLK);
         } else {
             _tile_loadd(TMM1, B_blk1, TILE_N * VNNI_BLK);
@@ -2296,6 +2337,154 @@ void tinygemm_kernel_amx(int M, int N, int KB, const void * RESTRICT _A, const v
     return;
 }
 
+#if defined(__AMX_BF16__) && defined(__AVX512BF16__)
+
+// packed_B layout for bf16: {NB, KB, TILE_K / 2, TILE_N, 2}
+constexpr int BF16_TILE_SIZE = TILE_N * TILE_K * sizeof(ggml_bf16_t);
+
+// pack a {TILE_N, TILE_K} block of B to vnni-2 format
+inline void pack_B_bf16(ggml_bf16_t * RESTRICT packed_B, const ggml_bf16_t * RESTRICT B, int K) {
+    // gather the pairs {k, k + 1} of the 16 rows
+    const __m512i vindex = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                                              _mm512_set1_epi32(K * sizeof(ggml_bf16_t)));
+    for (int k = 0; k < TILE_K / 2; ++k) {
+        const __m512i v = _mm512_i32gather_epi32(vindex, (const void *)(B + 2 * k), 1);
+        _mm512_storeu_si512((__m512i *)(packed_B + k * TILE_N * 2), v);
+    }
+}
+
+// convert a row of A to bf16, round to nearest even like GGML_FP32_TO_BF16
+// denormals are flushed to zero, the tile and vdpbf16ps products treat denormal inputs as zero anyway
+inline void convert_A_bf16(ggml_bf16_t * RESTRICT A, const float * RESTRICT x, int K) {
+    int k = 0;
+    for (; k + 31 < K; k += 32) {
+        _mm512_storeu_si512((__m512i *)(A + k), m512i(_mm512_cvtne2ps_pbh(_mm512_loadu_ps(x + k + 16), _mm512_loadu_ps(x + k))));
+    }
+    for (; k < K; ++k) {
+        A[k] = GGML_FP32_TO_BF16(x[k]);
+    }
+}
+
+void convert_B_packed_format_bf16(void * RESTRICT packed_B, const ggml_bf16_t * RESTRICT B, int N, int K) {
+    const int NB = N / TILE_N;
+    const int KB = K / TILE_K;
+
+    parallel_for(NB, [&](int begin, int end) {
+        for (int n = begin; n < end; ++n) {
+            for (int k = 0; k < KB; ++k) {
+                pack_B_bf16((ggml_bf16_t *)((char *)packed_B + PACKED_INDEX((int64_t) n, k, KB, BF16_TILE_SIZE)),
+                            B + (int64_t) n * TILE_N * K + k * TILE_K, K);
+            }
+        }
+    });
+}
+
+// avx512-bf16 kernel for small M, reads the same packed B as the amx kernel:
+// a row of a B tile holds the pairs {k, k + 1} of 16 columns, which is the
+// operand layout of `vdpbf16ps` with A broadcasted by pairs.
+template <int BLOCK_M, int BLOCK_N>
+struct tinygemm_kernel_bf16_avx {
+    static void apply(int K, const ggml_bf16_t * RESTRICT A, int lda, const char * RESTRICT B, float * RESTRICT C, int ldc) {
+        constexpr int ROWS = BLOCK_M;
+        constexpr int COLS = BLOCK_N / TILE_N;
+        const int KB = K / TILE_K;
+
+        __m512i va;
+        __m512i vb[COLS];
+        __m512 vc[ROWS * COLS];
+
+        auto loadc = [&](auto idx) {
+            vc[idx] = _mm512_setzero_ps();
+        };
+        Unroll<ROWS * COLS>{}(loadc);
+
+        auto compute = [&](auto idx, int kb, int k) {
+            constexpr int row = idx / COLS;
+            constexpr int col = idx % COLS;
+
+            if constexpr (col == 0) {
+                va = _mm512_set1_epi32(*(const int32_t *)(A + row * lda + kb * TILE_K + 2 * k));
+            }
+            if constexpr (row == 0) {
+                vb[col] = _mm512_loadu_si512((const __m512i *)(B + PACKED_INDEX(col, kb, KB, BF16_TILE_SIZE) + k * TILE_N * 4));
+            }
+            vc[idx] = _mm512_dpbf16_ps(vc[idx], m512bh(va), m512bh(vb[col]));
+        };
+
+        for (int kb = 0; kb < KB; ++kb) {
+            for (int k = 0; k < TILE_K / 2; ++k) {
+                Unroll<ROWS * COLS>{}(compute, kb, k);
+            }
+        }
+
+        auto storec = [&](auto idx) {
+            constexpr int row = idx / COLS;
+            constexpr int col = idx % COLS;
+            _mm512_storeu_ps(C + row * ldc + col * TILE_N, vc[idx]);
+        };
+        Unroll<ROWS * COLS>{}(storec);
+    }
+};
+
+#define LAUNCH_TINYGEMM_KERNEL_BF16_AVX(MB_SIZE, NB_SIZE)                        \
+    tinygemm_kernel_bf16_avx<MB_SIZE, NB_SIZE>::apply(                           \
+        K, A + mb_start * K, K,                                                  \
+        (const char *)src0->data + PACKED_INDEX((int64_t) nb_start / TILE_N, 0, KB, BF16_TILE_SIZE), \
+        (float *) dst->data + mb_start * ldc + nb_start, ldc);
+
+// amx-bf16 kernel for a {M, 2 * TILE_N} block of C, M <= 2 * TILE_M
+//
+// A is padded to a multiple of 2 * TILE_M rows so the tiles can always be fully loaded
+void tinygemm_kernel_bf16_amx(int M, int K, const ggml_bf16_t * RESTRICT A, int lda, const char * RESTRICT B, float * RESTRICT C, int ldc) {
+    GGML_ASSERT(M <= 2 * TILE_M);
+    const int KB = K / TILE_K;
+    const bool m1 = M > TILE_M;
+
+    _tile_zero(TMM4);
+    _tile_zero(TMM6);
+    if (m1) {
+        _tile_zero(TMM5);
+        _tile_zero(TMM7);
+    }
+
+    for (int kb = 0; kb < KB; ++kb) {
+        _tile_loadd(TMM0, B + PACKED_INDEX(0, kb, KB, BF16_TILE_SIZE), TILE_N * 4);
+        _tile_loadd(TMM1, B + PACKED_INDEX(1, kb, KB, BF16_TILE_SIZE), TILE_N * 4);
+
+        _tile_loadd(TMM2, A + kb * TILE_K, lda * sizeof(ggml_bf16_t));
+        _tile_dpbf16ps(TMM4, TMM2, TMM0);
+        _tile_dpbf16ps(TMM6, TMM2, TMM1);
+
+        if (m1) {
+            _tile_loadd(TMM3, A + TILE_M * lda + kb * TILE_K, lda * sizeof(ggml_bf16_t));
+            _tile_dpbf16ps(TMM5, TMM3, TMM0);
+            _tile_dpbf16ps(TMM7, TMM3, TMM1);
+        }
+    }
+
+    if (M == 2 * TILE_M) {
+        _tile_stored(TMM4, C, ldc * sizeof(float));
+        _tile_stored(TMM6, C + TILE_N, ldc * sizeof(float));
+        _tile_stored(TMM5, C + TILE_M * ldc, ldc * sizeof(float));
+        _tile_stored(TMM7, C + TILE_M * ldc + TILE_N, ldc * sizeof(float));
+        return;
+    }
+
+    // partial block, store through a buffer
+    static thread_local float TileC[2 * TILE_M * 2 * TILE_N];
+    _tile_stored(TMM4, TileC, 2 * TILE_N * sizeof(float));
+    _tile_stored(TMM6, TileC + TILE_N, 2 * TILE_N * sizeof(float));
+    if (m1) {
+        _tile_stored(TMM5, TileC + TILE_M * 2 * TILE_N, 2 * TILE_N * sizeof(float));
+        _tile_stored(TMM7, TileC + TILE_M * 2 * TILE_N + TILE_N, 2 * TILE_N * sizeof(float));
+    }
+    for (int m = 0; m < M; ++m) {
+        memcpy(C + m * ldc, TileC + m * 2 * TILE_N, 2 * TILE_N * sizeof(float));
+    }
+}
+
+#endif // defined(__AMX_BF16__) && defined(__AVX512BF16__)
+
 } // anonymous namespace
 
 // get the packed tensor size for quantized weights
@@ -2330,6 +2519,13 @@ void ggml_backend_amx_convert_weight(struct ggml_tensor * tensor, const void * d
     const int K = tensor->ne[0]; // ne0: in_features
     const int N = tensor->ne[1]; // ne1: out_features
 
+#if defined(__AMX_BF16__) && defined(__AVX512BF16__)
+    if (TYPE == GGML_TYPE_BF16) {
+        convert_B_packed_format_bf16((void *)((char *)tensor->data + offset), (const ggml_bf16_t *)data, N, K);
+        return;
+    }
+#endif
+
     GGML_DISPATCH_QTYPES(TYPE, [&] {
         convert_B_packed_format<type, blck_size>((void *)((char *)tensor->data + offset), (const type *)data, N, K);
     });
@@ -2348,6 +2544,11 @@ size_t ggml_backend_amx_desired_wsize(const struct ggml_tensor * dst) {
     const int M = dst->ne[1];
     const int K = src0->ne[0];
 
+    if (TYPE == GGML_TYPE_BF16) {
+        // A converted to bf16, padded to full tiles
+        return div_up(M, 2 * TILE_M) * 2 * TILE_M * K * sizeof(ggml_bf16_t);
+    }
+
     size_t desired_wsize = 0;
 
     GGML_DISPATCH_QTYPES(TYPE, [&] {
@@ -2358,6 +2559,94 @@ size_t ggml_backend_amx_desired_wsize(const struct ggml_tensor * dst) {
     return desired_wsize;
 }
 
+#if defined(__AMX_BF16__) && defined(__AVX512BF16__)
+// bf16 gemm: avx512-bf16 for small batches, amx-bf16 otherwise
+//
+// src0: weight in shape of {N, K}, bf16 in vnni-2 format
+// src1: input  in shape of {M, K}, float32, converted to bf16 in the work space
+//
+static void ggml_backend_amx_mul_mat_bf16(const ggml_compute_params * params, struct ggml_tensor * dst) {
+    struct ggml_tensor * src0 = dst->src[0];
+    struct ggml_tensor * src1 = dst->src[1];
+
+    const int M = dst->ne[1];
+    const int N = dst->ne[0];
+    const int K = src0->ne[0];
+    const int KB = K / TILE_K;
+    const int ldc = dst->nb[1] / dst->nb[0];
+
+    const int M_padded = div_up(M, 2 * TILE_M) * 2 * TILE_M;
+    GGML_ASSERT(params->wsize >= (size_t) M_padded * K * sizeof(ggml_bf16_t));
+
+    ggml_bf16_t * A = (ggml_bf16_t *) params->wdata;
+
+    // convert A, each thread takes a share of the rows
+    parallel_for_ggml(params, M_padded, [&](int begin, int end) {
+        for (int m = begin; m < end; ++m) {
+            if (m < M) {
+                convert_A_bf16(A + m * K, (const float *)((const char *) src1->data + m * src1->nb[1]), K);
+            } else {
+                memset(A + m * K, 0, K * sizeof(ggml_bf16_t));
+            }
+        }
+    });
+
+    ggml_barrier(params->threadpool);
+
+    if (M <= 4) {
+        // the weight is streamed once, 4 tiles of 16 columns per block
+        constexpr int BLOCK_N = TILE_N * 4;
+        const int NB = div_up(N, BLOCK_N);
+        const int mb_start = 0;
+
+        parallel_for_ggml(params, NB, [&](int begin, int end) {
+            for (int nb = begin; nb < end; ++nb) {
+                const int nb_start = nb * BLOCK_N;
+                const int nb_size = std::min(BLOCK_N, N - nb_start); // 32 or 64
+
+                switch (M << 8 | nb_size) {
+                    case 0x140: LAUNCH_TINYGEMM_KERNEL_BF16_AVX(1, 64); break;
+                    case 0x120: LAUNCH_TINYGEMM_KERNEL_BF16_AVX(1, 32); break;
+                    case 0x240: LAUNCH_TINYGEMM_KERNEL_BF16_AVX(2, 64); break;
+                    case 0x220: LAUNCH_TINYGEMM_KERNEL_BF16_AVX(2, 32); break;
+                    case 0x340: LAUNCH_TINYGEMM_KERNEL_BF16_AVX(3, 64); break;
+                    case 0x320: LAUNCH_TINYGEMM_KERNEL_BF16_AVX(3, 32); break;
+                    case 0x440: LAUNCH_TINYGEMM_KERNEL_BF16_AVX(4, 64); break;
+                    case 0x420: LAUNCH_TINYGEMM_KERNEL_BF16_AVX(4, 32); break;
+                    default: fprintf(stderr, "Unexpected block size!\n");
+                }
+            }
+        });
+        return;
+    }
+
+    // handle 4 tiles at a time, the blocks of a thread share the same columns
+    // so that the packed weight of the block stays in cache
+    constexpr int BLOCK_M = TILE_M * 2;
+    constexpr int BLOCK_N = TILE_N * 2;
+    const int MB = div_up(M, BLOCK_M);
+    const int NB = div_up(N, BLOCK_N);
+
+    parallel_for_ggml(params, MB * NB, [&](int begin, int end) {
+        ggml_tile_config_init_bf16();
+
+        for (int i = begin; i < end; ++i) {
+            const int mb = i % MB;
+            const int nb = i / MB;
+
+            const int mb_start = mb * BLOCK_M;
+            const int mb_size = std::min(BLOCK_M, M - mb_start);
+            const int nb_start = nb * BLOCK_N;
+
+            tinygemm_kernel_bf16_amx(
+                mb_size, K, A + mb_start * K, K,
+                (const char *)src0->data + PACKED_INDEX((int64_t) nb * 2, 0, KB, BF16_TILE_SIZE),
+                (float *) dst->data + mb_start * ldc + nb_start, ldc);
+        }
+    });
+}
+#endif
+
 // NB: mixed dtype gemm with Advanced Matrix Extensions (Intel AMX)
 //
 // src0: weight in shape of {N, K}, quantized
@@ -2419,6 +2708,13 @@ void ggml_backend_amx_mul_mat(const ggml_compute_params * params, struct ggml_te
         return;
     }
 
+#if defined(__AMX_BF16__) && defined(__AVX512BF16__)
+    if (TYPE == GGML_TYPE_BF16) {
+        ggml_backend_amx_mul_mat_bf16(params, dst);
+        return;
+    }
+#endif
+
     // pointer to work space, used convert A from float to quantized type
     void * wdata = params->wdata;
 
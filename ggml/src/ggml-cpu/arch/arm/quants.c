@@ -37,6 +37,70 @@ static const uint64_t table_b2b_0[1 << 8] = { B8(00, 10) }; // ( b) << 4
 static const uint64_t table_b2b_1[1 << 8] = { B8(10, 00) }; // (!b) << 4
 #endif
 
+void quantize_row_q4_0(const float * GGML_RESTRICT x, void * GGML_RESTRICT vy, int64_t k) {
+    assert(QK4_0 == 32);
+    assert(k % QK4_0 == 0);
+    const int nb = k / QK4_0;
+
+    block_q4_0 * GGML_RESTRICT y = vy;
+
+#if defined(__ARM_NEON)
+    const float32x4_t off = vdupq_n_f32(8.5f);
+    const int32x4_t   m15 = vdupq_n_s32(15);
+
+    for (int i = 0; i < nb; i++) {
+        float32x4_t srcv [8];
+        float32x4_t asrcv[8];
+        float32x4_t amaxv[8];
+
+        for (int j = 0; j < 8; j++) srcv[j]  = vld1q_f32(x + i*32 + 4*j);
+        for (int j = 0; j < 8; j++) asrcv[j] = vabsq_f32(srcv[j]);
+
+        for (int j = 0; j < 4; j++) amaxv[2*j] = vmaxq_f32(asrcv[2*j], asrcv[2*j+1]);
+        for (int j = 0; j < 2; j++) amaxv[4*j] = vmaxq_f32(amaxv[4*j], amaxv[4*j+2]);
+        for (int j = 0; j < 1; j++) amaxv[8*j] = vmaxq_f32(amaxv[8*j], amaxv[8*j+4]);
+
+        const float amax = vmaxvq_f32(amaxv[0]);
+
+        // like the reference, keep the sign of the first element with the largest magnitude
+        float max = 0.0f;
+        if (amax > 0.0f) {
+            for (int j = 0; j < 32; j++) {
+                if (fabsf(x[i*32 + j]) == amax) {
+                    max = x[i*32 + j];
+                    break;
+                }
+            }
+        }
+
+        const float d  = max / -8;
+        const float id = d ? 1.0f/d : 0.0f;
+
+        y[i].d = GGML_FP32_TO_FP16(d);
+
+        // truncation of x*id + 8.5, clamped to 15
+        int32x4_t vi[8];
+        for (int j = 0; j < 8; j++) {
+            vi[j] = vminq_s32(vcvtq_s32_f32(vaddq_f32(vmulq_n_f32(srcv[j], id), off)), m15);
+        }
+
+        // element j in the low nibble, element j + 16 in the high nibble
+        for (int j = 0; j < 4; j++) {
+            vi[j] = vorrq_s32(vi[j], vshlq_n_s32(vi[j + 4], 4));
+        }
+
+        const int16x8_t q0 = vcombine_s16(vmovn_s32(vi[0]), vmovn_s32(vi[1]));
+        const int16x8_t q1 = vcombine_s16(vmovn_s32(vi[2]), vmovn_s32(vi[3]));
+
+        vst1q_u8(y[i].qs, vreinterpretq_u8_s8(vcombine_s8(vmovn_s16(q0), vmovn_s16(q1))));
+    }
+#else
+    GGML_UNUSED(nb);
+    // scalar
+    quantize_row_q4_0_ref(x, y, k);
+#endif
+}
+
 void quantize_row_q8_0(const float * GGML_RESTRICT x, void * GGML_RESTRICT vy, int64_t k) {
     assert(QK8_0 == 32);
     assert(k % QK8_0 == 0);
@@ -64,14 +128,17 @@ void quantize_row_q8_0(const float * GGML_RESTRICT x, void * GGML_RESTRICT vy, i
 
         y[i].d = GGML_FP32_TO_FP16(d);
 
+        int32x4_t vi[8];
         for (int j = 0; j < 8; j++) {
-            const float32x4_t v  = vmulq_n_f32(srcv[j], id);
-            const int32x4_t   vi = vcvtnq_s32_f32(v);
+            vi[j] = vcvtnq_s32_f32(vmulq_n_f32(srcv[j], id));
+        }
 
-            y[i].qs[4*j + 0] = vgetq_lane_s32(vi, 0);
-            y[i].qs[4*j + 1] = vgetq_lane_s32(vi, 1);
-            y[i].qs[4*j + 2] = vgetq_lane_s32(vi, 2);
-            y[i].qs[4*j + 3] = vgetq_lane_s32(vi, 3);
+        // narrow to int8, the values are in [-127, 127]
+        for (int j = 0; j < 2; j++) {
+            const int16x8_t q0 = vcombine_s16(vmovn_s32(vi[4*j + 0]), vmovn_s32(vi[4*j + 1]));
+            const int16x8_t q1 = vcombine_s16(vmovn_s32(vi[4*j + 2]), vmovn_s32(vi[4*j + 3]));
+
+            vst1q_s8(y[i].qs + 16*j, vcombine_s8(vmovn_s16(q0), vmovn_s16(q1)));
         }
     }
 #else
@@ -3960,6 +4027,100 @@ void ggml_vec_dot_iq1_m_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const vo
 #endif
 }
 
+void quantize_row_iq4_nl(const float * GGML_RESTRICT x, void * GGML_RESTRICT vy, int64_t k) {
+    assert(k % QK4_NL == 0);
+    const int nb = k / QK4_NL;
+
+    block_iq4_nl * GGML_RESTRICT y = vy;
+
+#if defined(__ARM_NEON)
+    // the index of the nearest value is the number of midpoints between consecutive values that are <= x
+    float32x4_t mids[15];
+    for (int j = 0; j < 15; ++j) {
+        mids[j] = vdupq_n_f32(0.5f*(kvalues_iq4nl[j] + kvalues_iq4nl[j + 1]));
+    }
+
+    const int8x16_t values = vld1q_s8(kvalues_iq4nl);
+
+    for (int i = 0; i < nb; i++) {
+        float32x4_t srcv [8];
+        float32x4_t asrcv[8];
+        float32x4_t amaxv[8];
+
+        for (int j = 0; j < 8; j++) srcv[j]  = vld1q_f32(x + i*32 + 4*j);
+        for (int j = 0; j < 8; j++) asrcv[j] = vabsq_f32(srcv[j]);
+
+        for (int j = 0; j < 4; j++) amaxv[2*j] = vmaxq_f32(asrcv[2*j], asrcv[2*j+1]);
+        for (int j = 0; j < 2; j++) amaxv[4*j] = vmaxq_f32(amaxv[4*j], amaxv[4*j+2]);
+        for (int j = 0; j < 1; j++) amaxv[8*j] = vmaxq_f32(amaxv[8*j], amaxv[8*j+4]);
+
+        const float amax = vmaxvq_f32(amaxv[0]);
+
+        if (amax < GROUP_MAX_EPS) {
+            y[i].d = GGML_FP32_TO_FP16(0.f);
+            memset(y[i].qs, 0, QK4_NL/2);
+            continue;
+        }
+
+        // like the reference, keep the sign of the first element with the largest magnitude
+        float max = 0.0f;
+        for (int j = 0; j < 32; j++) {
+            if (fabsf(x[i*32 + j]) == amax) {
+                max = x[i*32 + j];
+                break;
+            }
+        }
+
+        const float id = 1/(max/kvalues_iq4nl[0]);
+
+        uint32x4_t l[8];
+        for (int j = 0; j < 8; j++) {
+            const float32x4_t al = vmulq_n_f32(srcv[j], id);
+
+            uint32x4_t lj = vdupq_n_u32(0);
+            for (int m = 0; m < 15; m++) {
+                lj = vsubq_u32(lj, vcgeq_f32(al, mids[m]));
+            }
+            l[j] = lj;
+        }
+
+        const uint8x16_t l0 = vcombine_u8(vmovn_u16(vcombine_u16(vmovn_u32(l[0]), vmovn_u32(l[1]))),
+                                          vmovn_u16(vcombine_u16(vmovn_u32(l[2]), vmovn_u32(l[3]))));
+        const uint8x16_t l1 = vcombine_u8(vmovn_u16(vcombine_u16(vmovn_u32(l[4]), vmovn_u32(l[5]))),
+                                          vmovn_u16(vcombine_u16(vmovn_u32(l[6]), vmovn_u32(l[7]))));
+
+        // least squares scale with the weights x*x
+        // the sums are not accumulated in the order of the reference, so d can differ from it in the last bit
+        const int8x16_t q0 = ggml_vqtbl1q_s8(values, l0);
+        const int8x16_t q1 = ggml_vqtbl1q_s8(values, l1);
+
+        const int16x8_t qw[4] = {
+            vmovl_s8(vget_low_s8(q0)), vmovl_s8(vget_high_s8(q0)),
+            vmovl_s8(vget_low_s8(q1)), vmovl_s8(vget_high_s8(q1)),
+        };
+
+        float32x4_t sumqx = vdupq_n_f32(0.0f);
+        float32x4_t sumq2 = vdupq_n_f32(0.0f);
+        for (int j = 0; j < 8; j++) {
+            const int16x4_t   qh = j%2 == 0 ? vget_low_s16(qw[j/2]) : vget_high_s16(qw[j/2]);
+            const float32x4_t q  = vcvtq_f32_s32(vmovl_s16(qh));
+            const float32x4_t wq = vmulq_f32(vmulq_f32(srcv[j], srcv[j]), q);
+            sumqx = vaddq_f32(sumqx, vmulq_f32(wq, srcv[j]));
+            sumq2 = vaddq_f32(sumq2, vmulq_f32(wq, q));
+        }
+
+        y[i].d = GGML_FP32_TO_FP16(vaddvq_f32(sumqx)/vaddvq_f32(sumq2));
+
+        // element j in the low nibble, element j + 16 in the high nibble
+        vst1q_u8(y[i].qs, vorrq_u8(l0, vshlq_n_u8(l1, 4)));
+    }
+#else
+    GGML_UNUSED(nb);
+    // scalar
+    quantize_row_iq4_nl_ref(x, y, k);
+#endif
+}
+
 void ggml_vec_dot_iq4_nl_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
     assert(nrc == 1);
     UNUSED(nrc);
@@ -275,6 +275,120 @@ static inline float hsum_float_4x4(const __m128 a, const __m128 b, const __m128
 #endif // __AVX__ || __AVX2__ || __AVX512F__
 #endif // defined(__AVX__) || defined(__AVX2__) || defined(__AVX512F__) || defined(__SSSE3__)
 
+void quantize_row_q4_0(const float * GGML_RESTRICT x, void * GGML_RESTRICT vy, int64_t k) {
+    assert(QK4_0 == 32);
+    assert(k % QK4_0 == 0);
+    const int nb = k / QK4_0;
+
+    block_q4_0 * GGML_RESTRICT y = vy;
+
+#if defined(__AVX512F__)
+    const __m512  signBit = _mm512_set1_ps( -0.0f );
+    const __m512  off     = _mm512_set1_ps( 8.5f );
+    const __m512i m15     = _mm512_set1_epi32( 15 );
+
+    for (int i = 0; i < nb; i++) {
+        const __m512 v0 = _mm512_loadu_ps( x );
+        const __m512 v1 = _mm512_loadu_ps( x + 16 );
+        x += 32;
+
+        const float amax = _mm512_reduce_max_ps( _mm512_max_ps( _mm512_andnot_ps( signBit, v0 ), _mm512_andnot_ps( signBit, v1 ) ) );
+
+        // like the reference, keep the sign of the first element with the largest magnitude
+        float max = 0.0f;
+        if (amax > 0.0f) {
+            const __m512 vp = _mm512_set1_ps(  amax );
+            const __m512 vn = _mm512_set1_ps( -amax );
+            const uint32_t mp = _mm512_cmp_ps_mask( v0, vp, _CMP_EQ_OQ ) | ((uint32_t) _mm512_cmp_ps_mask( v1, vp, _CMP_EQ_OQ ) << 16);
+            const uint32_t mn = _mm512_cmp_ps_mask( v0, vn, _CMP_EQ_OQ ) | ((uint32_t) _mm512_cmp_ps_mask( v1, vn, _CMP_EQ_OQ ) << 16);
+            const uint32_t m  = mp | mn;
+            max = (m & (~m + 1)) & mn ? -amax : amax;
+        }
+
+        const float d  = max / -8;
+        const float id = d ? 1.0f/d : 0.0f;
+
+        y[i].d = GGML_FP32_TO_FP16(d);
+
+        const __m512 mul = _mm512_set1_ps( id );
+
+        // truncation of x*id + 8.5, clamped to 15
+        const __m512i q0 = _mm512_min_epi32( _mm512_cvttps_epi32( _mm512_add_ps( _mm512_mul_ps( v0, mul ), off ) ), m15 );
+        const __m512i q1 = _mm512_min_epi32( _mm512_cvttps_epi32( _mm512_add_ps( _mm512_mul_ps( v1, mul ), off ) ), m15 );
+
+        // element j in the low nibble, element j + 16 in the high nibble
+        const __m512i q = _mm512_or_si512( q0, _mm512_slli_epi32( q1, 4 ) );
+
+        _mm_storeu_si128( (__m128i *) y[i].qs, _mm512_cvtepi32_epi8( q ) );
+    }
+#elif defined(__AVX2__)
+    const __m256  signBit = _mm256_set1_ps( -0.0f );
+    const __m256  off     = _mm256_set1_ps( 8.5f );
+    const __m256i m15     = _mm256_set1_epi32( 15 );
+    const __m256i perm    = _mm256_setr_epi32( 0, 4, 1, 5, 2, 6, 3, 7 );
+
+    for (int i = 0; i < nb; i++) {
+        __m256 v[4];
+        for (int j = 0; j < 4; j++) {
+            v[j] = _mm256_loadu_ps( x + 8*j );
+        }
+        x += 32;
+
+        __m256 maxAbs = _mm256_andnot_ps( signBit, v[0] );
+        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v[1] ) );
+        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v[2] ) );
+        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v[3] ) );
+
+        __m128 max4 = _mm_max_ps( _mm256_extractf128_ps( maxAbs, 1 ), _mm256_castps256_ps128( maxAbs ) );
+        max4 = _mm_max_ps( max4, _mm_movehl_ps( max4, max4 ) );
+        max4 = _mm_max_ss( max4, _mm_movehdup_ps( max4 ) );
+        const float amax = _mm_cvtss_f32( max4 );
+
+        // like the reference, keep the sign of the first element with the largest magnitude
+        float max = 0.0f;
+        if (amax > 0.0f) {
+            const __m256 vp = _mm256_set1_ps(  amax );
+            const __m256 vn = _mm256_set1_ps( -amax );
+            uint32_t mp = 0;
+            uint32_t mn = 0;
+            for (int j = 0; j < 4; j++) {
+                mp |= (uint32_t) _mm256_movemask_ps( _mm256_cmp_ps( v[j], vp, _CMP_EQ_OQ ) ) << 8*j;
+                mn |= (uint32_t) _mm256_movemask_ps( _mm256_cmp_ps( v[j], vn, _CMP_EQ_OQ ) ) << 8*j;
+            }
+            const uint32_t m = mp | mn;
+            max = (m & (~m + 1)) & mn ? -amax : amax;
+        }
+
+        const float d  = max / -8;
+        const float id = d ? 1.0f/d : 0.0f;
+
+        y[i].d = GGML_FP32_TO_FP16(d);
+
+        const __m256 mul = _mm256_set1_ps( id );
+
+        // truncation of x*id + 8.5, clamped to 15
+        __m256i q[4];
+        for (int j = 0; j < 4; j++) {
+            q[j] = _mm256_min_epi32( _mm256_cvttps_epi32( _mm256_add_ps( _mm256_mul_ps( v[j], mul ), off ) ), m15 );
+        }
+
+        // element j in the low nibble, element j + 16 in the high nibble
+        const __m256i q01 = _mm256_or_si256( q[0], _mm256_slli_epi32( q[2], 4 ) );
+        const __m256i q23 = _mm256_or_si256( q[1], _mm256_slli_epi32( q[3], 4 ) );
+
+        // bytes 0-3, 8-11 in the low lane and 4-7, 12-15 in the high lane
+        __m256i qb = _mm256_packus_epi16( _mm256_packs_epi32( q01, q23 ), _mm256_setzero_si256() );
+        qb = _mm256_permutevar8x32_epi32( qb, perm );
+
+        _mm_storeu_si128( (__m128i *) y[i].qs, _mm256_castsi256_si128( qb ) );
+    }
+#else
+    GGML_UNUSED(nb);
+    // scalar
+    quantize_row_q4_0_ref(x, y, k);
+#endif
+}
+
 void quantize_row_q8_0(const float * GGML_RESTRICT x, void * GGML_RESTRICT vy, int64_t k) {
     assert(QK8_0 == 32);
     assert(k % QK8_0 == 0);
@@ -282,7 +396,29 @@ void quantize_row_q8_0(const float * GGML_RESTRICT x, void * GGML_RESTRICT vy, i
 
     block_q8_0 * GGML_RESTRICT y = vy;
 
-#if defined(__AVX2__) || defined(__AVX__)
+#if defined(__AVX512F__)
+    const __m512 signBit = _mm512_set1_ps( -0.0f );
+
+    for (int i = 0; i < nb; i++) {
+        const __m512 v0 = _mm512_loadu_ps( x );
+        const __m512 v1 = _mm512_loadu_ps( x + 16 );
+        x += 32;
+
+        const float maxScalar = _mm512_reduce_max_ps( _mm512_max_ps( _mm512_andnot_ps( signBit, v0 ), _mm512_andnot_ps( signBit, v1 ) ) );
+
+        const float d = maxScalar / 127.f;
+        y[i].d = GGML_FP32_TO_FP16(d);
+        const float id = ( maxScalar != 0.0f ) ? 127.f / maxScalar : 0.0f;
+        const __m512 mul = _mm512_set1_ps( id );
+
+        // round to nearest and narrow with saturation to int8
+        const __m512i i0 = _mm512_cvt_roundps_epi32( _mm512_mul_ps( v0, mul ), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC );
+        const __m512i i1 = _mm512_cvt_roundps_epi32( _mm512_mul_ps( v1, mul ), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC );
+
+        _mm_storeu_si128( (__m128i *)(y[i].qs +  0), _mm512_cvtsepi32_epi8( i0 ) );
+        _mm_storeu_si128( (__m128i *)(y[i].qs + 16), _mm512_cvtsepi32_epi8( i1 ) );
+    }
+#elif defined(__AVX2__) || defined(__AVX__)
     for (int i = 0; i < nb; i++) {
         // Load elements into 4 AVX vectors
         __m256 v0 = _mm256_loadu_ps( x );
@@ -4091,6 +4227,167 @@ void ggml_vec_dot_iq1_m_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const vo
 #endif
 }
 
+void quantize_row_iq4_nl(const float * GGML_RESTRICT x, void * GGML_RESTRICT vy, int64_t k) {
+    assert(k % QK4_NL == 0);
+    const int nb = k / QK4_NL;
+
+    block_iq4_nl * GGML_RESTRICT y = vy;
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+    // the index of the nearest value is the number of midpoints between consecutive values that are <= x
+    float mids[16];
+    for (int j = 0; j < 15; ++j) {
+        mids[j] = 0.5f*(kvalues_iq4nl[j] + kvalues_iq4nl[j + 1]);
+    }
+    mids[15] = INFINITY;
+#endif
+
+#if defined(__AVX512F__)
+    const __m512  signBit = _mm512_set1_ps( -0.0f );
+    const __m512  vmids   = _mm512_loadu_ps( mids );
+    const __m512  values  = _mm512_cvtepi32_ps( _mm512_cvtepi8_epi32( _mm_loadu_si128( (const __m128i *) kvalues_iq4nl ) ) );
+
+    for (int i = 0; i < nb; i++) {
+        const __m512 v0 = _mm512_loadu_ps( x );
+        const __m512 v1 = _mm512_loadu_ps( x + 16 );
+        x += 32;
+
+        const float amax = _mm512_reduce_max_ps( _mm512_max_ps( _mm512_andnot_ps( signBit, v0 ), _mm512_andnot_ps( signBit, v1 ) ) );
+        if (amax < GROUP_MAX_EPS) {
+            y[i].d = GGML_FP32_TO_FP16(0.f);
+            memset(y[i].qs, 0, QK4_NL/2);
+            continue;
+        }
+
+        // like the reference, keep the sign of the first element with the largest magnitude
+        const __m512 vp = _mm512_set1_ps(  amax );
+        const __m512 vn = _mm512_set1_ps( -amax );
+        const uint32_t mp = _mm512_cmp_ps_mask( v0, vp, _CMP_EQ_OQ ) | ((uint32_t) _mm512_cmp_ps_mask( v1, vp, _CMP_EQ_OQ ) << 16);
+        const uint32_t mn = _mm512_cmp_ps_mask( v0, vn, _CMP_EQ_OQ ) | ((uint32_t) _mm512_cmp_ps_mask( v1, vn, _CMP_EQ_OQ ) << 16);
+        const uint32_t m  = mp | mn;
+        const float max = (m & (~m + 1)) & mn ? -amax : amax;
+
+        const __m512 id = _mm512_set1_ps( 1/(max/kvalues_iq4nl[0]) );
+
+        const __m512 al0 = _mm512_mul_ps( v0, id );
+        const __m512 al1 = _mm512_mul_ps( v1, id );
+
+        // binary search of the midpoints
+        __m512i l0 = _mm512_setzero_si512();
+        __m512i l1 = _mm512_setzero_si512();
+        for (int s = 8; s > 0; s /= 2) {
+            const __m512i vs = _mm512_set1_epi32( s );
+            const __m512i vt = _mm512_set1_epi32( s - 1 );
+            const __m512 t0 = _mm512_permutexvar_ps( _mm512_add_epi32( l0, vt ), vmids );
+            const __m512 t1 = _mm512_permutexvar_ps( _mm512_add_epi32( l1, vt ), vmids );
+            l0 = _mm512_mask_add_epi32( l0, _mm512_cmp_ps_mask( al0, t0, _CMP_GE_OQ ), l0, vs );
+            l1 = _mm512_mask_add_epi32( l1, _mm512_cmp_ps_mask( al1, t1, _CMP_GE_OQ ), l1, vs );
+        }
+
+        // least squares scale with the weights x*x
+        const __m512 q0 = _mm512_permutexvar_ps( l0, values );
+        const __m512 q1 = _mm512_permutexvar_ps( l1, values );
+        const __m512 wq0 = _mm512_mul_ps( _mm512_mul_ps( v0, v0 ), q0 );
+        const __m512 wq1 = _mm512_mul_ps( _mm512_mul_ps( v1, v1 ), q1 );
+        const float sumqx = _mm512_reduce_add_ps( _mm512_add_ps( _mm512_mul_ps( wq0, v0 ), _mm512_mul_ps( wq1, v1 ) ) );
+        const float sumq2 = _mm512_reduce_add_ps( _mm512_add_ps( _mm512_mul_ps( wq0, q0 ), _mm512_mul_ps( wq1, q1 ) ) );
+
+        y[i].d = GGML_FP32_TO_FP16(sumqx/sumq2);
+
+        // element j in the low nibble, element j + 16 in the high nibble
+        const __m512i l = _mm512_or_si512( l0, _mm512_slli_epi32( l1, 4 ) );
+
+        _mm_storeu_si128( (__m128i *) y[i].qs, _mm512_cvtepi32_epi8( l ) );
+    }
+#elif defined(__AVX2__)
+    const __m256  signBit = _mm256_set1_ps( -0.0f );
+    const __m256  mids_lo = _mm256_loadu_ps( mids );
+    const __m256  mids_hi = _mm256_loadu_ps( mids + 8 );
+    const __m256  mid_7   = _mm256_set1_ps( mids[7] );
+    const __m256  vals_lo = _mm256_cvtepi32_ps( _mm256_cvtepi8_epi32( _mm_loadl_epi64( (const __m128i *)  kvalues_iq4nl      ) ) );
+    const __m256  vals_hi = _mm256_cvtepi32_ps( _mm256_cvtepi8_epi32( _mm_loadl_epi64( (const __m128i *) (kvalues_iq4nl + 8) ) ) );
+    const __m256i perm    = _mm256_setr_epi32( 0, 4, 1, 5, 2, 6, 3, 7 );
+
+    for (int i = 0; i < nb; i++) {
+        __m256 v[4];
+        for (int j = 0; j < 4; j++) {
+            v[j] = _mm256_loadu_ps( x + 8*j );
+        }
+        x += 32;
+
+        __m256 maxAbs = _mm256_andnot_ps( signBit, v[0] );
+        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v[1] ) );
+        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v[2] ) );
+        maxAbs = _mm256_max_ps( maxAbs, _mm256_andnot_ps( signBit, v[3] ) );
+
+        __m128 max4 = _mm_max_ps( _mm256_extractf128_ps( maxAbs, 1 ), _mm256_castps256_ps128( maxAbs ) );
+        max4 = _mm_max_ps( max4, _mm_movehl_ps( max4, max4 ) );
+        max4 = _mm_max_ss( max4, _mm_movehdup_ps( max4 ) );
+        const float amax = _mm_cvtss_f32( max4 );
+
+        if (amax < GROUP_MAX_EPS) {
+            y[i].d = GGML_FP32_TO_FP16(0.f);
+            memset(y[i].qs, 0, QK4_NL/2);
+            continue;
+        }
+
+        // like the reference, keep the sign of the first element with the largest magnitude
+        const __m256 vp = _mm256_set1_ps(  amax );
+        const __m256 vn = _mm256_set1_ps( -amax );
+        uint32_t mp = 0;
+        uint32_t mn = 0;
+        for (int j = 0; j < 4; j++) {
+            mp |= (uint32_t) _mm256_movemask_ps( _mm256_cmp_ps( v[j], vp, _CMP_EQ_OQ ) ) << 8*j;
+            mn |= (uint32_t) _mm256_movemask_ps( _mm256_cmp_ps( v[j], vn, _CMP_EQ_OQ ) ) << 8*j;
+        }
+        const uint32_t m = mp | mn;
+        const float max = (m & (~m + 1)) & mn ? -amax : amax;
+
+        const __m256 id = _mm256_set1_ps( 1/(max/kvalues_iq4nl[0]) );
+
+        __m256i l[4];
+        __m256  sumqx = _mm256_setzero_ps();
+        __m256  sumq2 = _mm256_setzero_ps();
+
+        for (int j = 0; j < 4; j++) {
+            const __m256 al = _mm256_mul_ps( v[j], id );
+
+            // binary search of the midpoints: the first step selects the half of the table used by the others
+            const __m256  hi = _mm256_cmp_ps( al, mid_7, _CMP_GE_OQ );
+            __m256i lj = _mm256_and_si256( _mm256_castps_si256( hi ), _mm256_set1_epi32( 8 ) );
+            for (int s = 4; s > 0; s /= 2) {
+                const __m256i it = _mm256_add_epi32( lj, _mm256_set1_epi32( s - 1 ) );
+                const __m256  t  = _mm256_blendv_ps( _mm256_permutevar8x32_ps( mids_lo, it ), _mm256_permutevar8x32_ps( mids_hi, it ), hi );
+                lj = _mm256_add_epi32( lj, _mm256_and_si256( _mm256_castps_si256( _mm256_cmp_ps( al, t, _CMP_GE_OQ ) ), _mm256_set1_epi32( s ) ) );
+            }
+            l[j] = lj;
+
+            // least squares scale with the weights x*x
+            const __m256 q  = _mm256_blendv_ps( _mm256_permutevar8x32_ps( vals_lo, lj ), _mm256_permutevar8x32_ps( vals_hi, lj ), hi );
+            const __m256 wq = _mm256_mul_ps( _mm256_mul_ps( v[j], v[j] ), q );
+            sumqx = _mm256_add_ps( sumqx, _mm256_mul_ps( wq, v[j] ) );
+            sumq2 = _mm256_add_ps( sumq2, _mm256_mul_ps( wq, q ) );
+        }
+
+        y[i].d = GGML_FP32_TO_FP16(hsum_float_8(sumqx)/hsum_float_8(sumq2));
+
+        // element j in the low nibble, element j + 16 in the high nibble
+        const __m256i l01 = _mm256_or_si256( l[0], _mm256_slli_epi32( l[2], 4 ) );
+        const __m256i l23 = _mm256_or_si256( l[1], _mm256_slli_epi32( l[3], 4 ) );
+
+        // bytes 0-3, 8-11 in the low lane and 4-7, 12-15 in the high lane
+        __m256i lb = _mm256_packus_epi16( _mm256_packs_epi32( l01, l23 ), _mm256_setzero_si256() );
+        lb = _mm256_permutevar8x32_epi32( lb, perm );
+
+        _mm_storeu_si128( (__m128i *) y[i].qs, _mm256_castsi256_si128( lb ) );
+    }
+#else
+    GGML_UNUSED(nb);
+    // scalar
+    quantize_row_iq4_nl_ref(x, y, k);
+#endif
+}
+
 void ggml_vec_dot_iq4_nl_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, size_t bx, const void * GGML_RESTRICT vy, size_t by, int nrc) {
     assert(nrc == 1);
     UNUSED(nrc);
@@ -3282,3 +3282,522 @@ void ggml_gemm_q4_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const vo
     }
 #endif
 }
+
+void ggml_gemv_q6_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert (n % qk == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(s);
+    UNUSED(bs);
+    UNUSED(vx);
+    UNUSED(vy);
+    UNUSED(nr);
+    UNUSED(nc);
+    UNUSED(nb);
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+    // Masks to extract the lower 4 bits and the upper 2 bits (moved to the bits 4-5) of the quants
+    const __m512i m4b = _mm512_set1_epi8(0x0F);
+    const __m512i m3h = _mm512_set1_epi8(0x30);
+    // Shuffle masks to repeat the scales of each row for its 4 sums of 2 quants, rows 0-3 in the lower 128 bit lane and 4-7 in the upper one
+    const __m256i scalemask_0 = _mm256_setr_epi8(0, 0, 0, 0, 2, 2, 2, 2,  4,  4,  4,  4,  6,  6,  6,  6, 8, 8, 8, 8, 10, 10, 10, 10, 12, 12, 12, 12, 14, 14, 14, 14);
+    const __m256i scalemask_1 = _mm256_setr_epi8(1, 1, 1, 1, 3, 3, 3, 3,  5,  5,  5,  5,  7,  7,  7,  7, 9, 9, 9, 9, 11, 11, 11, 11, 13, 13, 13, 13, 15, 15, 15, 15);
+    // The sums of the rows are in the order 0, 1, 4, 5, 2, 3, 6, 7 after _mm256_hadd_epi32
+    const __m256i finalpermutemask = _mm256_set_epi32(7, 6, 3, 2, 5, 4, 1, 0);
+
+    const block_q8_K * a_ptr = (const block_q8_K *) vy;
+    for (int64_t x = 0; x < nc / ncols_interleaved; x++) {
+        const block_q6_Kx8 * b_ptr = (const block_q6_Kx8 *) vx + (x * nb);
+
+        // Master FP accumulator
+        __m256 acc_row = _mm256_setzero_ps();
+
+        for (int64_t b = 0; b < nb; b++) {
+            __m512i iacc = _mm512_setzero_si512();
+
+            // Groups of 8 quants 4*i .. 4*i + 3, i.e. the sub-blocks 2*i and 2*i + 1
+            for (int i = 0; i < QK_K / 32; i++) {
+                // Quants of B0-B7, 8 of each row for each group
+                const __m512i rhs_raw_ql_0 = _mm512_loadu_si512((const __m512i *)(b_ptr[b].ql + i * 128));
+                const __m512i rhs_raw_ql_1 = _mm512_loadu_si512((const __m512i *)(b_ptr[b].ql + i * 128 + 64));
+                const __m512i rhs_raw_qh   = _mm512_loadu_si512((const __m512i *)(b_ptr[b].qh + i * 64));
+
+                const __m512i rhs_vec_0 = _mm512_or_si512(_mm512_and_si512(rhs_raw_ql_0, m4b),                        _mm512_and_si512(_mm512_slli_epi16(rhs_raw_qh, 4), m3h));
+                const __m512i rhs_vec_1 = _mm512_or_si512(_mm512_and_si512(rhs_raw_ql_1, m4b),                        _mm512_and_si512(_mm512_slli_epi16(rhs_raw_qh, 2), m3h));
+                const __m512i rhs_vec_2 = _mm512_or_si512(_mm512_and_si512(_mm512_srli_epi16(rhs_raw_ql_0, 4), m4b), _mm512_and_si512(rhs_raw_qh, m3h));
+                const __m512i rhs_vec_3 = _mm512_or_si512(_mm512_and_si512(_mm512_srli_epi16(rhs_raw_ql_1, 4), m4b), _mm512_and_si512(_mm512_srli_epi16(rhs_raw_qh, 2), m3h));
+
+                // The 8 quants of A of each group repeated in the eight 64 bit lanes
+                const __m512i lhs_vec_0 = _mm512_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(a_ptr[b].qs + (i * 4 + 0) * blocklen)));
+                const __m512i lhs_vec_1 = _mm512_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(a_ptr[b].qs + (i * 4 + 1) * blocklen)));
+                const __m512i lhs_vec_2 = _mm512_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(a_ptr[b].qs + (i * 4 + 2) * blocklen)));
+                const __m512i lhs_vec_3 = _mm512_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(a_ptr[b].qs + (i * 4 + 3) * blocklen)));
+
+                // The unsigned quants (without the offset of 32) fit in the 16 bit sums of 2 groups
+                const __m512i sum_0 = _mm512_add_epi16(_mm512_maddubs_epi16(rhs_vec_0, lhs_vec_0), _mm512_maddubs_epi16(rhs_vec_1, lhs_vec_1));
+                const __m512i sum_1 = _mm512_add_epi16(_mm512_maddubs_epi16(rhs_vec_2, lhs_vec_2), _mm512_maddubs_epi16(rhs_vec_3, lhs_vec_3));
+
+                const __m256i scales = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(b_ptr[b].scales + i * 16)));
+                const __m512i scale_0 = _mm512_cvtepi8_epi16(_mm256_shuffle_epi8(scales, scalemask_0));
+                const __m512i scale_1 = _mm512_cvtepi8_epi16(_mm256_shuffle_epi8(scales, scalemask_1));
+
+#if defined(__AVX512VNNI__)
+                iacc = _mm512_dpwssd_epi32(_mm512_dpwssd_epi32(iacc, sum_0, scale_0), sum_1, scale_1);
+#else
+                iacc = _mm512_add_epi32(iacc, _mm512_add_epi32(_mm512_madd_epi16(sum_0, scale_0), _mm512_madd_epi16(sum_1, scale_1)));
+#endif
+            }
+
+            // The offset of 32 of the quants is subtracted with the sums of the quants of A in groups of 16
+            __m256i iacc_min = _mm256_setzero_si256();
+            for (int p = 0; p < QK_K / 32; p++) {
+                int32_t bsums;
+                memcpy(&bsums, a_ptr[b].bsums + p * 2, sizeof(int32_t));
+                const __m256i scales = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(b_ptr[b].scales + p * 16)));
+                iacc_min = _mm256_add_epi32(iacc_min, _mm256_madd_epi16(scales, _mm256_set1_epi32(bsums)));
+            }
+
+            const __m256i iacc_sum = _mm256_hadd_epi32(_mm512_castsi512_si256(iacc), _mm512_extracti64x4_epi64(iacc, 1));
+            const __m256i iacc_row = _mm256_sub_epi32(_mm256_permutevar8x32_epi32(iacc_sum, finalpermutemask), _mm256_slli_epi32(iacc_min, 5));
+
+            const __m256 col_scale_f32 = GGML_F32Cx8_LOAD(b_ptr[b].d);
+            const __m256 row_scale_f32 = _mm256_set1_ps(a_ptr[b].d);
+
+            acc_row = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc_row), _mm256_mul_ps(col_scale_f32, row_scale_f32), acc_row);
+        }
+
+        _mm256_storeu_ps(s + x * ncols_interleaved, acc_row);
+    }
+#elif defined(__AVX2__)
+    // Masks to extract the lower 4 bits and the upper 2 bits (moved to the bits 4-5) of the quants
+    const __m256i m4b = _mm256_set1_epi8(0x0F);
+    const __m256i m3h = _mm256_set1_epi8(0x30);
+    // Shuffle masks to repeat the scales of the rows 0-3 / 4-7 for the 4 sums of 2 quants of each row
+    const __m128i scalemask[2][2] = {
+        { _mm_setr_epi8(0, 0, 0, 0, 2, 2, 2, 2,  4,  4,  4,  4,  6,  6,  6,  6), _mm_setr_epi8(1, 1, 1, 1, 3, 3, 3, 3,  5,  5,  5,  5,  7,  7,  7,  7) },
+        { _mm_setr_epi8(8, 8, 8, 8, 10, 10, 10, 10, 12, 12, 12, 12, 14, 14, 14, 14), _mm_setr_epi8(9, 9, 9, 9, 11, 11, 11, 11, 13, 13, 13, 13, 15, 15, 15, 15) },
+    };
+    // The sums of the rows are in the order 0, 1, 4, 5, 2, 3, 6, 7 after _mm256_hadd_epi32
+    const __m256i finalpermutemask = _mm256_set_epi32(7, 6, 3, 2, 5, 4, 1, 0);
+
+    const block_q8_K * a_ptr = (const block_q8_K *) vy;
+    for (int64_t x = 0; x < nc / ncols_interleaved; x++) {
+        const block_q6_Kx8 * b_ptr = (const block_q6_Kx8 *) vx + (x * nb);
+
+        // Master FP accumulator
+        __m256 acc_row = _mm256_setzero_ps();
+
+        for (int64_t b = 0; b < nb; b++) {
+            __m256i iacc[2] = { _mm256_setzero_si256(), _mm256_setzero_si256() };
+
+            // Groups of 8 quants 4*i .. 4*i + 3, i.e. the sub-blocks 2*i and 2*i + 1
+            for (int i = 0; i < QK_K / 32; i++) {
+                // The 8 quants of A of each group repeated in the four 64 bit lanes
+                __m256i lhs_vec[4];
+                for (int t = 0; t < 4; t++) {
+                    lhs_vec[t] = _mm256_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(a_ptr[b].qs + (i * 4 + t) * blocklen)));
+                }
+
+                const __m128i scales = _mm_loadu_si128((const __m128i *)(b_ptr[b].scales + i * 16));
+
+                for (int h = 0; h < 2; h++) {
+                    // Quants of B0-B3 or B4-B7, 8 of each row for each group
+                    const __m256i rhs_raw_ql_0 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].ql + i * 128 + h * 32));
+                    const __m256i rhs_raw_ql_1 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].ql + i * 128 + h * 32 + 64));
+                    const __m256i rhs_raw_qh   = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qh + i * 64 + h * 32));
+
+                    const __m256i rhs_vec_0 = _mm256_or_si256(_mm256_and_si256(rhs_raw_ql_0, m4b),                        _mm256_and_si256(_mm256_slli_epi16(rhs_raw_qh, 4), m3h));
+                    const __m256i rhs_vec_1 = _mm256_or_si256(_mm256_and_si256(rhs_raw_ql_1, m4b),                        _mm256_and_si256(_mm256_slli_epi16(rhs_raw_qh, 2), m3h));
+                    const __m256i rhs_vec_2 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(rhs_raw_ql_0, 4), m4b), _mm256_and_si256(rhs_raw_qh, m3h));
+                    const __m256i rhs_vec_3 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(rhs_raw_ql_1, 4), m4b), _mm256_and_si256(_mm256_srli_epi16(rhs_raw_qh, 2), m3h));
+
+                    // The unsigned quants (without the offset of 32) fit in the 16 bit sums of 2 groups
+                    const __m256i sum_0 = _mm256_add_epi16(_mm256_maddubs_epi16(rhs_vec_0, lhs_vec[0]), _mm256_maddubs_epi16(rhs_vec_1, lhs_vec[1]));
+                    const __m256i sum_1 = _mm256_add_epi16(_mm256_maddubs_epi16(rhs_vec_2, lhs_vec[2]), _mm256_maddubs_epi16(rhs_vec_3, lhs_vec[3]));
+
+                    const __m256i scale_0 = _mm256_cvtepi8_epi16(_mm_shuffle_epi8(scales, scalemask[h][0]));
+                    const __m256i scale_1 = _mm256_cvtepi8_epi16(_mm_shuffle_epi8(scales, scalemask[h][1]));
+
+                    iacc[h] = _mm256_add_epi32(iacc[h], _mm256_add_epi32(_mm256_madd_epi16(sum_0, scale_0), _mm256_madd_epi16(sum_1, scale_1)));
+                }
+            }
+
+            // The offset of 32 of the quants is subtracted with the sums of the quants of A in groups of 16
+            __m256i iacc_min = _mm256_setzero_si256();
+            for (int p = 0; p < QK_K / 32; p++) {
+                int32_t bsums;
+                memcpy(&bsums, a_ptr[b].bsums + p * 2, sizeof(int32_t));
+                const __m256i scales = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(b_ptr[b].scales + p * 16)));
+                iacc_min = _mm256_add_epi32(iacc_min, _mm256_madd_epi16(scales, _mm256_set1_epi32(bsums)));
+            }
+
+            const __m256i iacc_row = _mm256_sub_epi32(_mm256_permutevar8x32_epi32(_mm256_hadd_epi32(iacc[0], iacc[1]), finalpermutemask), _mm256_slli_epi32(iacc_min, 5));
+
+            const __m256 col_scale_f32 = GGML_F32Cx8_LOAD(b_ptr[b].d);
+            const __m256 row_scale_f32 = _mm256_set1_ps(a_ptr[b].d);
+
+            acc_row = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc_row), _mm256_mul_ps(col_scale_f32, row_scale_f32), acc_row);
+        }
+
+        _mm256_storeu_ps(s + x * ncols_interleaved, acc_row);
+    }
+#else
+    ggml_gemv_q6_K_8x8_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+#endif
+}
+
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+// Dot products of the 8 rows of B with the 4 * NA rows of NA consecutive block_q8_Kx4 rows of A
+// The quants of B are unpacked once for all the rows of A, see ggml_gemv_q6_K_8x8_q8_K
+template <int NA>
+static inline void ggml_gemm_q6_K_8x8_q8_K_avx512(int nb, float * GGML_RESTRICT s, size_t bs, const block_q6_Kx8 * GGML_RESTRICT b_ptr, const block_q8_Kx4 * GGML_RESTRICT a_ptr) {
+    const int blocklen = 8;
+
+    const __m512i m4b = _mm512_set1_epi8(0x0F);
+    const __m512i m3h = _mm512_set1_epi8(0x30);
+    const __m256i scalemask_0 = _mm256_setr_epi8(0, 0, 0, 0, 2, 2, 2, 2,  4,  4,  4,  4,  6,  6,  6,  6, 8, 8, 8, 8, 10, 10, 10, 10, 12, 12, 12, 12, 14, 14, 14, 14);
+    const __m256i scalemask_1 = _mm256_setr_epi8(1, 1, 1, 1, 3, 3, 3, 3,  5,  5,  5,  5,  7,  7,  7,  7, 9, 9, 9, 9, 11, 11, 11, 11, 13, 13, 13, 13, 15, 15, 15, 15);
+    const __m256i finalpermutemask = _mm256_set_epi32(7, 6, 3, 2, 5, 4, 1, 0);
+
+    // Master FP accumulators
+    __m256 acc_rows[4 * NA];
+    for (int m = 0; m < 4 * NA; m++) {
+        acc_rows[m] = _mm256_setzero_ps();
+    }
+
+    for (int64_t b = 0; b < nb; b++) {
+        __m512i iacc[4 * NA];
+        for (int m = 0; m < 4 * NA; m++) {
+            iacc[m] = _mm512_setzero_si512();
+        }
+
+        for (int i = 0; i < QK_K / 32; i++) {
+            const __m512i rhs_raw_ql_0 = _mm512_loadu_si512((const __m512i *)(b_ptr[b].ql + i * 128));
+            const __m512i rhs_raw_ql_1 = _mm512_loadu_si512((const __m512i *)(b_ptr[b].ql + i * 128 + 64));
+            const __m512i rhs_raw_qh   = _mm512_loadu_si512((const __m512i *)(b_ptr[b].qh + i * 64));
+
+            const __m512i rhs_vec_0 = _mm512_or_si512(_mm512_and_si512(rhs_raw_ql_0, m4b),                        _mm512_and_si512(_mm512_slli_epi16(rhs_raw_qh, 4), m3h));
+            const __m512i rhs_vec_1 = _mm512_or_si512(_mm512_and_si512(rhs_raw_ql_1, m4b),                        _mm512_and_si512(_mm512_slli_epi16(rhs_raw_qh, 2), m3h));
+            const __m512i rhs_vec_2 = _mm512_or_si512(_mm512_and_si512(_mm512_srli_epi16(rhs_raw_ql_0, 4), m4b), _mm512_and_si512(rhs_raw_qh, m3h));
+            const __m512i rhs_vec_3 = _mm512_or_si512(_mm512_and_si512(_mm512_srli_epi16(rhs_raw_ql_1, 4), m4b), _mm512_and_si512(_mm512_srli_epi16(rhs_raw_qh, 2), m3h));
+
+            const __m256i scales = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(b_ptr[b].scales + i * 16)));
+            const __m512i scale_0 = _mm512_cvtepi8_epi16(_mm256_shuffle_epi8(scales, scalemask_0));
+            const __m512i scale_1 = _mm512_cvtepi8_epi16(_mm256_shuffle_epi8(scales, scalemask_1));
+
+            for (int m = 0; m < 4 * NA; m++) {
+                // The 8 quants of the row m of A of each group repeated in the eight 64 bit lanes
+                const int8_t * lhs = a_ptr[(m / 4) * nb + b].qs + i * 4 * 4 * blocklen + (m % 4) * blocklen;
+                const __m512i lhs_vec_0 = _mm512_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(lhs)));
+                const __m512i lhs_vec_1 = _mm512_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(lhs + 32)));
+                const __m512i lhs_vec_2 = _mm512_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(lhs + 64)));
+                const __m512i lhs_vec_3 = _mm512_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(lhs + 96)));
+
+                const __m512i sum_0 = _mm512_add_epi16(_mm512_maddubs_epi16(rhs_vec_0, lhs_vec_0), _mm512_maddubs_epi16(rhs_vec_1, lhs_vec_1));
+                const __m512i sum_1 = _mm512_add_epi16(_mm512_maddubs_epi16(rhs_vec_2, lhs_vec_2), _mm512_maddubs_epi16(rhs_vec_3, lhs_vec_3));
+
+#if defined(__AVX512VNNI__)
+                iacc[m] = _mm512_dpwssd_epi32(_mm512_dpwssd_epi32(iacc[m], sum_0, scale_0), sum_1, scale_1);
+#else
+                iacc[m] = _mm512_add_epi32(iacc[m], _mm512_add_epi32(_mm512_madd_epi16(sum_0, scale_0), _mm512_madd_epi16(sum_1, scale_1)));
+#endif
+            }
+        }
+
+        // The bsums of the row m of A for the sub-blocks 2*p and 2*p + 1 are adjacent in block_q8_Kx4
+        __m256i iacc_min[4 * NA];
+        for (int m = 0; m < 4 * NA; m++) {
+            iacc_min[m] = _mm256_setzero_si256();
+        }
+        for (int p = 0; p < QK_K / 32; p++) {
+            const __m256i scales = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(b_ptr[b].scales + p * 16)));
+            for (int m = 0; m < 4 * NA; m++) {
+                int32_t bsums;
+                memcpy(&bsums, a_ptr[(m / 4) * nb + b].bsums + (p / 2) * 16 + (m % 4) * 4 + (p % 2) * 2, sizeof(int32_t));
+                iacc_min[m] = _mm256_add_epi32(iacc_min[m], _mm256_madd_epi16(scales, _mm256_set1_epi32(bsums)));
+            }
+        }
+
+        const __m256 col_scale_f32 = GGML_F32Cx8_LOAD(b_ptr[b].d);
+
+        for (int m = 0; m < 4 * NA; m++) {
+            const __m256i iacc_sum = _mm256_hadd_epi32(_mm512_castsi512_si256(iacc[m]), _mm512_extracti64x4_epi64(iacc[m], 1));
+            const __m256i iacc_row = _mm256_sub_epi32(_mm256_permutevar8x32_epi32(iacc_sum, finalpermutemask), _mm256_slli_epi32(iacc_min[m], 5));
+            acc_rows[m] = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc_row), _mm256_mul_ps(col_scale_f32, _mm256_set1_ps(a_ptr[(m / 4) * nb + b].d[m % 4])), acc_rows[m]);
+        }
+    }
+
+    for (int m = 0; m < 4 * NA; m++) {
+        _mm256_storeu_ps(s + m * bs, acc_rows[m]);
+    }
+}
+#endif
+
+void ggml_gemm_q6_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert (n % qk == 0);
+    assert (nr % 4 == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(s);
+    UNUSED(bs);
+    UNUSED(vx);
+    UNUSED(vy);
+    UNUSED(nr);
+    UNUSED(nc);
+    UNUSED(nb);
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+    const block_q8_Kx4 * a_ptr_start = (const block_q8_Kx4 *) vy;
+    const block_q6_Kx8 * b_ptr_start = (const block_q6_Kx8 *) vx;
+
+    // The 8 rows of B stay in the cache while all the rows of A are processed, two block_q8_Kx4 structures at a time when possible
+    for (int64_t x = 0; x < nc / ncols_interleaved; x++) {
+        int64_t y = 0;
+        for (; y + 2 <= nr / 4; y += 2) {
+            ggml_gemm_q6_K_8x8_q8_K_avx512<2>(nb, s + (y * 4) * bs + x * ncols_interleaved, bs, b_ptr_start + (x * nb), a_ptr_start + (y * nb));
+        }
+        for (; y < nr / 4; y++) {
+            ggml_gemm_q6_K_8x8_q8_K_avx512<1>(nb, s + (y * 4) * bs + x * ncols_interleaved, bs, b_ptr_start + (x * nb), a_ptr_start + (y * nb));
+        }
+    }
+#elif defined(__AVX2__)
+    // Same as in ggml_gemv_q6_K_8x8_q8_K, the quants of B are unpacked once for the 4 rows of A
+    const __m256i m4b = _mm256_set1_epi8(0x0F);
+    const __m256i m3h = _mm256_set1_epi8(0x30);
+    const __m128i scalemask[2][2] = {
+        { _mm_setr_epi8(0, 0, 0, 0, 2, 2, 2, 2,  4,  4,  4,  4,  6,  6,  6,  6), _mm_setr_epi8(1, 1, 1, 1, 3, 3, 3, 3,  5,  5,  5,  5,  7,  7,  7,  7) },
+        { _mm_setr_epi8(8, 8, 8, 8, 10, 10, 10, 10, 12, 12, 12, 12, 14, 14, 14, 14), _mm_setr_epi8(9, 9, 9, 9, 11, 11, 11, 11, 13, 13, 13, 13, 15, 15, 15, 15) },
+    };
+    const __m256i finalpermutemask = _mm256_set_epi32(7, 6, 3, 2, 5, 4, 1, 0);
+
+    // The 8 rows of B stay in the cache while all the rows of A are processed
+    for (int64_t x = 0; x < nc / ncols_interleaved; x++) {
+        const block_q6_Kx8 * b_ptr = (const block_q6_Kx8 *) vx + (x * nb);
+        for (int64_t y = 0; y < nr / 4; y++) {
+            const block_q8_Kx4 * a_ptr = (const block_q8_Kx4 *) vy + (y * nb);
+
+            // Master FP accumulators
+            __m256 acc_rows[4];
+            for (int m = 0; m < 4; m++) {
+                acc_rows[m] = _mm256_setzero_ps();
+            }
+
+            for (int64_t b = 0; b < nb; b++) {
+                __m256i iacc[4][2];
+                for (int m = 0; m < 4; m++) {
+                    iacc[m][0] = _mm256_setzero_si256();
+                    iacc[m][1] = _mm256_setzero_si256();
+                }
+
+                for (int i = 0; i < QK_K / 32; i++) {
+                    const __m128i scales = _mm_loadu_si128((const __m128i *)(b_ptr[b].scales + i * 16));
+
+                    for (int h = 0; h < 2; h++) {
+                        const __m256i rhs_raw_ql_0 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].ql + i * 128 + h * 32));
+                        const __m256i rhs_raw_ql_1 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].ql + i * 128 + h * 32 + 64));
+                        const __m256i rhs_raw_qh   = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qh + i * 64 + h * 32));
+
+                        const __m256i rhs_vec_0 = _mm256_or_si256(_mm256_and_si256(rhs_raw_ql_0, m4b),                        _mm256_and_si256(_mm256_slli_epi16(rhs_raw_qh, 4), m3h));
+                        const __m256i rhs_vec_1 = _mm256_or_si256(_mm256_and_si256(rhs_raw_ql_1, m4b),                        _mm256_and_si256(_mm256_slli_epi16(rhs_raw_qh, 2), m3h));
+                        const __m256i rhs_vec_2 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(rhs_raw_ql_0, 4), m4b), _mm256_and_si256(rhs_raw_qh, m3h));
+                        const __m256i rhs_vec_3 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(rhs_raw_ql_1, 4), m4b), _mm256_and_si256(_mm256_srli_epi16(rhs_raw_qh, 2), m3h));
+
+                        const __m256i scale_0 = _mm256_cvtepi8_epi16(_mm_shuffle_epi8(scales, scalemask[h][0]));
+                        const __m256i scale_1 = _mm256_cvtepi8_epi16(_mm_shuffle_epi8(scales, scalemask[h][1]));
+
+                        for (int m = 0; m < 4; m++) {
+                            // The 8 quants of the row m of A of each group repeated in the four 64 bit lanes
+                            const int8_t * lhs = a_ptr[b].qs + i * 4 * 4 * blocklen + m * blocklen;
+                            const __m256i lhs_vec_0 = _mm256_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(lhs)));
+                            const __m256i lhs_vec_1 = _mm256_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(lhs + 32)));
+                            const __m256i lhs_vec_2 = _mm256_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(lhs + 64)));
+                            const __m256i lhs_vec_3 = _mm256_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(lhs + 96)));
+
+                            const __m256i sum_0 = _mm256_add_epi16(_mm256_maddubs_epi16(rhs_vec_0, lhs_vec_0), _mm256_maddubs_epi16(rhs_vec_1, lhs_vec_1));
+                            const __m256i sum_1 = _mm256_add_epi16(_mm256_maddubs_epi16(rhs_vec_2, lhs_vec_2), _mm256_maddubs_epi16(rhs_vec_3, lhs_vec_3));
+
+                            iacc[m][h] = _mm256_add_epi32(iacc[m][h], _mm256_add_epi32(_mm256_madd_epi16(sum_0, scale_0), _mm256_madd_epi16(sum_1, scale_1)));
+                        }
+                    }
+                }
+
+                // The bsums of the row m of A for the sub-blocks 2*p and 2*p + 1 are adjacent in block_q8_Kx4
+                __m256i iacc_min[4];
+                for (int m = 0; m < 4; m++) {
+                    iacc_min[m] = _mm256_setzero_si256();
+                }
+                for (int p = 0; p < QK_K / 32; p++) {
+                    const __m256i scales = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(b_ptr[b].scales + p * 16)));
+                    for (int m = 0; m < 4; m++) {
+                        int32_t bsums;
+                        memcpy(&bsums, a_ptr[b].bsums + (p / 2) * 16 + m * 4 + (p % 2) * 2, sizeof(int32_t));
+                        iacc_min[m] = _mm256_add_epi32(iacc_min[m], _mm256_madd_epi16(scales, _mm256_set1_epi32(bsums)));
+                    }
+                }
+
+                const __m256 col_scale_f32 = GGML_F32Cx8_LOAD(b_ptr[b].d);
+
+                for (int m = 0; m < 4; m++) {
+                    const __m256i iacc_row = _mm256_sub_epi32(_mm256_permutevar8x32_epi32(_mm256_hadd_epi32(iacc[m][0], iacc[m][1]), finalpermutemask), _mm256_slli_epi32(iacc_min[m], 5));
+                    acc_rows[m] = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc_row), _mm256_mul_ps(col_scale_f32, _mm256_set1_ps(a_ptr[b].d[m])), acc_rows[m]);
+                }
+            }
+
+            for (int m = 0; m < 4; m++) {
+                _mm256_storeu_ps(s + (y * 4 + m) * bs + x * ncols_interleaved, acc_rows[m]);
+            }
+        }
+    }
+#else
+    ggml_gemm_q6_K_8x8_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+#endif
+}
+
+void ggml_gemv_q8_0_8x8_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK8_0;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert (n % qk == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(s);
+    UNUSED(bs);
+    UNUSED(vx);
+    UNUSED(vy);
+    UNUSED(nr);
+    UNUSED(nc);
+    UNUSED(nb);
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+#if defined(__AVX2__)
+    // The sums of the rows are in the order 0, 1, 4, 5, 2, 3, 6, 7 after _mm256_hadd_epi32, the scales are loaded in the same order
+    const __m128i deltamask = _mm_set_epi8(15, 14, 13, 12, 7, 6, 5, 4, 11, 10, 9, 8, 3, 2, 1, 0);
+    const __m256i finalpermutemask = _mm256_set_epi32(7, 6, 3, 2, 5, 4, 1, 0);
+
+    const block_q8_0 * a_ptr = (const block_q8_0 *) vy;
+    for (int64_t x = 0; x < nc / ncols_interleaved; x++) {
+        const block_q8_0x8 * b_ptr = (const block_q8_0x8 *) vx + (x * nb);
+
+        // Master FP accumulator
+        __m256 acc_row = _mm256_setzero_ps();
+
+        for (int64_t b = 0; b < nb; b++) {
+            __m256i iacc_0123 = _mm256_setzero_si256();
+            __m256i iacc_4567 = _mm256_setzero_si256();
+
+            for (int k = 0; k < qk / blocklen; k++) {
+                // B0-B3 and B4-B7 (8*k .. 8*k + 7) with A0(8*k .. 8*k + 7) repeated in the four 64 bit lanes
+                const __m256i rhs_vec_0123 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qs + k * ncols_interleaved * blocklen));
+                const __m256i rhs_vec_4567 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qs + k * ncols_interleaved * blocklen + 32));
+                const __m256i lhs_vec = _mm256_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(a_ptr[b].qs + k * blocklen)));
+
+                iacc_0123 = mul_sum_i8_pairs_acc_int32x8(iacc_0123, rhs_vec_0123, lhs_vec);
+                iacc_4567 = mul_sum_i8_pairs_acc_int32x8(iacc_4567, rhs_vec_4567, lhs_vec);
+            }
+
+            const __m256 col_scale_f32 = GGML_F32Cx8_REARRANGE_LOAD(b_ptr[b].d, deltamask);
+            const __m256 row_scale_f32 = _mm256_set1_ps(GGML_FP16_TO_FP32(a_ptr[b].d));
+
+            acc_row = _mm256_fmadd_ps(_mm256_cvtepi32_ps(_mm256_hadd_epi32(iacc_0123, iacc_4567)), _mm256_mul_ps(col_scale_f32, row_scale_f32), acc_row);
+        }
+
+        // Accumulated output values permuted so as to be stored in appropriate order post accumulation
+        acc_row = _mm256_permutevar8x32_ps(acc_row, finalpermutemask);
+        _mm256_storeu_ps(s + x * ncols_interleaved, acc_row);
+    }
+#else
+    ggml_gemv_q8_0_8x8_q8_0_generic(n, s, bs, vx, vy, nr, nc);
+#endif
+}
+
+void ggml_gemm_q8_0_8x8_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK8_0;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert (n % qk == 0);
+    assert (nr % 4 == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(s);
+    UNUSED(bs);
+    UNUSED(vx);
+    UNUSED(vy);
+    UNUSED(nr);
+    UNUSED(nc);
+    UNUSED(nb);
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+#if defined(__AVX2__)
+    // Same as in ggml_gemv_q8_0_8x8_q8_0, for the 4 rows of block_q8_0x4
+    const __m128i deltamask = _mm_set_epi8(15, 14, 13, 12, 7, 6, 5, 4, 11, 10, 9, 8, 3, 2, 1, 0);
+    const __m256i finalpermutemask = _mm256_set_epi32(7, 6, 3, 2, 5, 4, 1, 0);
+
+    // The 8 rows of B stay in the cache while all the rows of A are processed
+    for (int64_t x = 0; x < nc / ncols_interleaved; x++) {
+        const block_q8_0x8 * b_ptr = (const block_q8_0x8 *) vx + (x * nb);
+        for (int64_t y = 0; y < nr / 4; y++) {
+            const block_q8_0x4 * a_ptr = (const block_q8_0x4 *) vy + (y * nb);
+
+            // Master FP accumulators
+            __m256 acc_rows[4];
+            for (int m = 0; m < 4; m++) {
+                acc_rows[m] = _mm256_setzero_ps();
+            }
+
+            for (int64_t b = 0; b < nb; b++) {
+                __m256i iacc_0123[4];
+                __m256i iacc_4567[4];
+                for (int m = 0; m < 4; m++) {
+                    iacc_0123[m] = _mm256_setzero_si256();
+                    iacc_4567[m] = _mm256_setzero_si256();
+                }
+
+                for (int k = 0; k < qk / blocklen; k++) {
+                    const __m256i rhs_vec_0123 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qs + k * ncols_interleaved * blocklen));
+                    const __m256i rhs_vec_4567 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qs + k * ncols_interleaved * blocklen + 32));
+
+                    for (int m = 0; m < 4; m++) {
+                        const __m256i lhs_vec = _mm256_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(a_ptr[b].qs + k * 4 * blocklen + m * blocklen)));
+
+                        iacc_0123[m] = mul_sum_i8_pairs_acc_int32x8(iacc_0123[m], rhs_vec_0123, lhs_vec);
+                        iacc_4567[m] = mul_sum_i8_pairs_acc_int32x8(iacc_4567[m], rhs_vec_4567, lhs_vec);
+                    }
+                }
+
+                const __m256 col_scale_f32 = GGML_F32Cx8_REARRANGE_LOAD(b_ptr[b].d, deltamask);
+
+                for (int m = 0; m < 4; m++) {
+                    const __m256 row_scale_f32 = _mm256_set1_ps(GGML_FP16_TO_FP32(a_ptr[b].d[m]));
+                    acc_rows[m] = _mm256_fmadd_ps(_mm256_cvtepi32_ps(_mm256_hadd_epi32(iacc_0123[m], iacc_4567[m])), _mm256_mul_ps(col_scale_f32, row_scale_f32), acc_rows[m]);
+                }
+            }
+
+            for (int m = 0; m < 4; m++) {
+                _mm256_storeu_ps(s + (y * 4 + m) * bs + x * ncols_interleaved, _mm256_permutevar8x32_ps(acc_rows[m], finalpermutemask));
+            }
+        }
+    }
+#else
+    ggml_gemm_q8_0_8x8_q8_0_generic(n, s, bs, vx, vy, nr, nc);
+#endif
+}
@@ -15,6 +15,16 @@
 extern "C" {
 #endif
 
+// src1 of the matmuls converted to the vec_dot_type of src0
+// it is stored in its own region of the work buffer, so that the next matmuls with the same src1 can reuse it
+struct ggml_compute_src1_cache {
+    size_t size;
+    void * data;
+
+    const struct ggml_tensor * src1; // tensor converted in data, NULL if none
+    enum ggml_type             type;
+};
+
 struct ggml_compute_params {
     // ith = thread index, nth = number of threads
     int ith, nth;
@@ -24,6 +34,9 @@ struct ggml_compute_params {
     void * wdata;
 
     struct ggml_threadpool * threadpool;
+
+    // per thread, all the threads update it in the same way
+    struct ggml_compute_src1_cache * src1_cache;
 };
 
 
@@ -453,6 +453,8 @@ struct ggml_threadpool {
     int32_t      prio;        // Scheduling priority
     uint32_t     poll;        // Polling level (0 - no polling)
 
+    size_t       src1_size;   // size of the region of the work buffer for the src1 of the matmuls
+
     enum ggml_status ec;
 };
 
@@ -1130,7 +1132,7 @@ static void ggml_compute_forward_mul_mat_one_chunk(
         return;
     }
 
-    const void * wdata = (src1->type == vec_dot_type) ? src1->data : params->wdata;
+    const void * wdata = (src1->type == vec_dot_type) ? src1->data : params->src1_cache->data;
     const size_t row_size = ggml_row_size(vec_dot_type, ne10);
 
     assert(ne12 % ne02 == 0);
@@ -1164,7 +1166,7 @@ static void ggml_compute_forward_mul_mat_one_chunk(
                 const char * src0_row = (const char*)src0->data + (0 + i02 * nb02 + i03 * nb03);
 
                 // desc: when src1 is not a contiguous memory block we have to calculate the offset using the strides
-                //       if it is, then we have either copied the data to params->wdata and made it contiguous or we are using
+                //       if it is, then we have either copied the data to params->src1_cache and made it contiguous or we are using
                 //       the original src1 data pointer, so we should index using the indices directly
                 // TODO: this is a bit of a hack, we should probably have a better way to handle this
                 const char * src1_col = (const char*)wdata +
@@ -1251,17 +1253,23 @@ static void ggml_compute_forward_mul_mat(
 UseGgmlGemm1:;
 #endif
 
-    if (src1->type != vec_dot_type) {
-        char * wdata = params->wdata;
+    struct ggml_compute_src1_cache * cache = params->src1_cache;
+
+    // src1 is already converted if the previous matmul had the same src1 and vec_dot_type
+    if (src1->type != vec_dot_type && (cache->src1 != src1 || cache->type != vec_dot_type)) {
+        char * wdata = cache->data;
 
         const size_t nbw0 = ggml_type_size(vec_dot_type);
         const size_t nbw1 = ggml_row_size(vec_dot_type, ne10);
         const size_t nbw2 = nbw1*ne11;
         const size_t nbw3 = nbw2*ne12;
 
-        assert(params->wsize >= ne13*nbw3);
+        GGML_ASSERT(cache->size >= ne13*nbw3);
         GGML_ASSERT(src1->type == GGML_TYPE_F32);
 
+        cache->src1 = src1;
+        cache->type = vec_dot_type;
+
     #if 0
         for (int64_t i13 = 0; i13 < ne13; ++i13) {
             for (int64_t i12 = 0; i12 < ne12; ++i12) {
@@ -1297,7 +1305,7 @@ UseGgmlGemm1:;
 
 #if GGML_USE_LLAMAFILE
     if (src1->type != vec_dot_type) {
-        const void* wdata = (src1->type == vec_dot_type) ? src1->data : params->wdata;
+        const void* wdata = (src1->type == vec_dot_type) ? src1->data : cache->data;
         const size_t row_size = ggml_row_size(vec_dot_type, ne10);
 
         for (int64_t i13 = 0; i13 < ne13; i13++)
@@ -1384,72 +1392,81 @@ UseGgmlGemm2:;
 }
 
 // ggml_compute_forward_mul_mat_id
-
-#define MMID_MATRIX_ROW(row_id, i1) matrix_rows[(row_id)*ids->ne[0]*ids->ne[1] + (i1)]
+//
+// grouped GEMM: the rows of src1 are sorted by expert, converted to vec_dot_type in this order, and the chunks
+// (expert, src0 rows, src1 rows) of all the experts are distributed across the threads in a single pass,
+// so that the experts with few rows do not leave the threads idle and each expert is a regular matrix multiplication
+// on ARM and NUMA systems, each thread takes instead its own part of every expert (static split)
 
 struct mmid_row_mapping {
     int32_t i1;
     int32_t i2;
 };
 
+// chunks of an expert with nr1 rows of src1: nchunk0 x nchunk1 chunks of dr0 src0 rows and dr1 src1 rows
+static inline void ggml_mul_mat_id_chunks(
+    const int64_t nr0, const int64_t nr1, const int nth, const bool disable_chunking,
+    int64_t * nchunk0, int64_t * nchunk1, int64_t * dr0, int64_t * dr1) {
+
+    if (disable_chunking) {
+        // one chunk per thread, some of them may be empty
+        *nchunk0 = nr0 > nr1 ? nth : 1;
+        *nchunk1 = nr0 > nr1 ? 1 : nth;
+        *dr0 = (nr0 + *nchunk0 - 1) / *nchunk0;
+        *dr1 = (nr1 + *nchunk1 - 1) / *nchunk1;
+    } else {
+        *dr0 = nr1 < 16 ? 64 : 16;
+        *dr1 = nr1 < 16 ? nr1 : 16;
+        *nchunk0 = (nr0 + *dr0 - 1) / *dr0;
+        *nchunk1 = (nr1 + *dr1 - 1) / *dr1;
+    }
+}
+
 static void ggml_compute_forward_mul_mat_id_one_chunk(
     struct ggml_tensor * dst,
     const struct ggml_tensor * src0,
-    const struct ggml_tensor * src1,
-    const struct ggml_tensor * ids,
-    const int64_t cur_a,
+    const char * src0_cur,
+    const char * src1_cur,
+    const struct mmid_row_mapping * rows_cur,
+    const size_t row_size,
+    const int64_t num_rows_per_vec_dot,
     const int64_t ir0_start,
     const int64_t ir0_end,
     const int64_t ir1_start,
-    const int64_t ir1_end,
-    const char * src0_cur,
-    const struct mmid_row_mapping * matrix_rows,
-    const size_t row_size,
-    const bool src1_cont,
-    const void * wdata) {
+    const int64_t ir1_end) {
 
-    GGML_TENSOR_BINARY_OP_LOCALS
+    const int64_t ne00 = src0->ne[0];
+    const size_t  nb01 = src0->nb[1];
 
-    const enum ggml_type type = src0->type;
+    const size_t nb1 = dst->nb[1];
+    const size_t nb2 = dst->nb[2];
 
-    ggml_vec_dot_t    const vec_dot      = type_traits_cpu[type].vec_dot;
-    enum ggml_type    const vec_dot_type = type_traits_cpu[type].vec_dot_type;
+    ggml_vec_dot_t const vec_dot = type_traits_cpu[src0->type].vec_dot;
 
     const int64_t blck_0 = 16;
     const int64_t blck_1 = 16;
 
-    float tmp[16];
+    // 16 * 2, accounting for mmla kernels
+    float tmp[32];
 
     for (int64_t iir1 = ir1_start; iir1 < ir1_end; iir1 += blck_1) {
         for (int64_t iir0 = ir0_start; iir0 < ir0_end; iir0 += blck_0) {
-            for (int64_t ir1 = iir1; ir1 < iir1 + blck_1 && ir1 < ir1_end; ++ir1) {
-                const int64_t _i12 = ir1; // logical row index for this expert
-
-                struct mmid_row_mapping row_mapping = MMID_MATRIX_ROW(cur_a, _i12);
-                const int id       = row_mapping.i1; // selected expert index
-
-                const int64_t  i11 = id % ne11;
-                const int64_t  i12 = row_mapping.i2; // row index in src1
+            for (int64_t ir1 = iir1; ir1 < iir1 + blck_1 && ir1 < ir1_end; ir1 += num_rows_per_vec_dot) {
+                // the rows of the expert are contiguous in src1_cur
+                const char * src1_col = src1_cur + ir1*row_size;
 
-                const int64_t  i1 = id;  // selected expert index
-                const int64_t  i2 = i12; // row
+                for (int64_t ir0 = iir0; ir0 < iir0 + blck_0 && ir0 < ir0_end; ir0 += num_rows_per_vec_dot) {
+                    vec_dot(ne00, &tmp[ir0 - iir0], (num_rows_per_vec_dot > 1 ? 16 : 0), src0_cur + ir0*nb01, (num_rows_per_vec_dot > 1 ? nb01 : 0), src1_col, (num_rows_per_vec_dot > 1 ? row_size : 0), num_rows_per_vec_dot);
+                }
 
-                // desc: when src1 is not a contiguous memory block we have to calculate the offset using the strides
-                //       if it is, then we have either copied the data to params->wdata and made it contiguous or we are using
-                //       the original src1 data pointer, so we should index using the indices directly
-                // TODO: this is a bit of a hack, we should probably have a better way to handle this
-                const char * src1_col = (const char *) wdata +
-                    (src1_cont || src1->type != vec_dot_type
-                    ? (i11      + i12*ne11)*row_size
-                    : (i11*nb11 + i12*nb12));
+                for (int cn = 0; cn < num_rows_per_vec_dot; ++cn) {
+                    const struct mmid_row_mapping row_mapping = rows_cur[ir1 + cn];
 
-                float * dst_col = (float *) ((char *) dst->data + (i1*nb1 + i2*nb2));
+                    // i1 = selected expert index, i2 = row
+                    float * dst_col = (float *) ((char *) dst->data + (row_mapping.i1*nb1 + row_mapping.i2*nb2));
 
-                for (int64_t ir0 = iir0; ir0 < iir0 + blck_0 && ir0 < ir0_end; ++ir0) {
-                    vec_dot(ne00, &tmp[ir0 - iir0], 0, src0_cur + ir0*nb01, 0, src1_col, 0, 1);
+                    memcpy(&dst_col[iir0], tmp + (cn * 16), (MIN(iir0 + blck_0, ir0_end) - iir0)*sizeof(float));
                 }
-
-                memcpy(&dst_col[iir0], tmp, (MIN(iir0 + blck_0, ir0_end) - iir0)*sizeof(float));
             }
         }
     }
@@ -1478,10 +1495,9 @@ static void ggml_compute_forward_mul_mat_id(
 
     const enum ggml_type type = src0->type;
 
-    const bool src1_cont = ggml_is_contiguous(src1);
-
-    enum ggml_type    const vec_dot_type    = type_traits_cpu[type].vec_dot_type;
-    ggml_from_float_t const from_float      = type_traits_cpu[vec_dot_type].from_float;
+    enum ggml_type    const vec_dot_type     = type_traits_cpu[type].vec_dot_type;
+    ggml_from_float_t const from_float       = type_traits_cpu[vec_dot_type].from_float;
+    int64_t           const vec_dot_num_rows = type_traits_cpu[type].nrows;
 
     // we don't support permuted src0 or src1
     GGML_ASSERT(nb00 == ggml_type_size(type));
@@ -1493,152 +1509,158 @@ static void ggml_compute_forward_mul_mat_id(
     GGML_ASSERT(nb1 <= nb2);
     GGML_ASSERT(nb2 <= nb3);
 
+    GGML_ASSERT(src1->type == vec_dot_type || src1->type == GGML_TYPE_F32);
+
     // row groups
     const int n_ids = ids->ne[0]; // n_expert_used
     const int n_as  = ne02;       // n_expert
 
+    // rows of src1 used by the experts
+    const int64_t n_rows = n_ids*ids->ne[1];
+
+    const size_t row_size = ggml_row_size(vec_dot_type, ne10);
+
     void * wdata_cur = params->wdata;
 
-    if (src1->type != vec_dot_type) {
-        incr_ptr_aligned(&wdata_cur, ggml_row_size(vec_dot_type, ggml_nelements(src1)), sizeof(int64_t));
-    }
+    char * wdata_src1 = // [n_rows], sorted by expert
+        incr_ptr_aligned(&wdata_cur, n_rows*row_size, sizeof(int64_t));
 
-    int64_t * matrix_row_counts = // [n_as]
-        incr_ptr_aligned(&wdata_cur, n_as*sizeof(int64_t), sizeof(int64_t));
+    int64_t * expert_offs = // [n_as + 1], first sorted row of each expert
+        incr_ptr_aligned(&wdata_cur, (n_as + 1)*sizeof(int64_t), sizeof(int64_t));
 
-    struct mmid_row_mapping * matrix_rows = // [n_as][ids->ne[0]*ids->ne[1]]
-        incr_ptr_aligned(&wdata_cur, n_as*ids->ne[0]*ids->ne[1]*sizeof(struct mmid_row_mapping), sizeof(int64_t));
+    int64_t * chunk_offs = // [n_as + 1], first chunk of each expert
+        incr_ptr_aligned(&wdata_cur, (n_as + 1)*sizeof(int64_t), sizeof(int64_t));
 
-    char (*atomic_current_chunk)[CACHE_LINE_SIZE] = // [n_as]
-        incr_ptr_aligned(&wdata_cur, CACHE_LINE_SIZE * n_as, CACHE_LINE_SIZE);
+    struct mmid_row_mapping * rows = // [n_rows], sorted by expert
+        incr_ptr_aligned(&wdata_cur, n_rows*sizeof(struct mmid_row_mapping), sizeof(int64_t));
 
     GGML_ASSERT(params->wsize >= (size_t)((char *) wdata_cur - (char *) params->wdata));
 
-    if (src1->type != vec_dot_type) {
-        char * wdata = params->wdata;
+#if defined(__aarch64__)
+    // disable for ARM
+    const bool disable_chunking = true;
+#else
+    // disable for NUMA
+    const bool disable_chunking = ggml_is_numa();
+#endif // defined(__aarch64__)
 
-        const size_t nbw0 = ggml_type_size(vec_dot_type);
-        const size_t nbw1 = ggml_row_size(vec_dot_type, ne10);
-        const size_t nbw2 = nbw1*ne11;
-        const size_t nbw3 = nbw2*ne12;
+    if (ith == 0) {
+        // count the rows of each expert
+        memset(expert_offs, 0, (n_as + 1)*sizeof(int64_t));
 
-        assert(params->wsize >= ne13*nbw3);
-        GGML_ASSERT(src1->type == GGML_TYPE_F32);
+        for (int64_t iid1 = 0; iid1 < ids->ne[1]; ++iid1) {
+            for (int id = 0; id < n_ids; ++id) {
+                const int32_t i02 = *(const int32_t *) ((const char *) ids->data + iid1*ids->nb[1] + id*ids->nb[0]);
 
-#if 0
-        for (int64_t i13 = 0; i13 < ne13; ++i13) {
-            for (int64_t i12 = ith; i12 < ne12; i12 += nth) {
-                for (int64_t i11 = 0; i11 < ne11; ++i11) {
-                    from_float((float *)((char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11),
-                               (void *)               (wdata + i13*nbw3 + i12*nbw2 + i11*nbw1),
-                               ne10);
-                }
+                assert(i02 >= 0 && i02 < n_as);
+
+                expert_offs[i02 + 1] += 1;
             }
         }
-#else
-        for (int64_t i13 = 0; i13 < ne13; ++i13) {
-            for (int64_t i12 = 0; i12 < ne12; ++i12) {
-                for (int64_t i11 = 0; i11 < ne11; ++i11) {
-                    size_t bs = ggml_blck_size(vec_dot_type);
-                    int64_t ne10_block_start = (ith * ne10/bs) / nth;
-                    int64_t ne10_block_end   = ((ith + 1) * ne10/bs) / nth;
-                    from_float((float *)((char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11 + ne10_block_start*bs*nb10),
-                               (void *)               (wdata + i13*nbw3 + i12*nbw2 + i11*nbw1 + ne10_block_start*nbw0),
-                               (ne10_block_end - ne10_block_start) * bs);
-                }
-            }
+
+        for (int cur_a = 0; cur_a < n_as; ++cur_a) {
+            expert_offs[cur_a + 1] += expert_offs[cur_a];
         }
-#endif
-    }
 
-    if (ith == 0) {
-        // initialize matrix_row_counts
-        memset(matrix_row_counts, 0, n_as*sizeof(int64_t));
+        // counting sort, the rows of an expert stay in the order of the tokens
+        // chunk_offs holds the next free row of each expert meanwhile
+        memcpy(chunk_offs, expert_offs, n_as*sizeof(int64_t));
 
-        // group rows by src0 matrix
         for (int64_t iid1 = 0; iid1 < ids->ne[1]; ++iid1) {
             for (int id = 0; id < n_ids; ++id) {
                 const int32_t i02 = *(const int32_t *) ((const char *) ids->data + iid1*ids->nb[1] + id*ids->nb[0]);
 
-                assert(i02 >= 0 && i02 < n_as);
+                rows[chunk_offs[i02]++] = (struct mmid_row_mapping) {id, iid1};
+            }
+        }
+
+        chunk_offs[0] = 0;
+        for (int cur_a = 0; cur_a < n_as; ++cur_a) {
+            const int64_t cne1 = expert_offs[cur_a + 1] - expert_offs[cur_a];
 
-                MMID_MATRIX_ROW(i02, matrix_row_counts[i02]) = (struct mmid_row_mapping) {id, iid1};
-                matrix_row_counts[i02] += 1;
+            int64_t nchunk0 = 0;
+            int64_t nchunk1 = 0;
+            if (cne1 > 0) {
+                int64_t dr0, dr1;
+                ggml_mul_mat_id_chunks(ne01, cne1, nth, disable_chunking, &nchunk0, &nchunk1, &dr0, &dr1);
             }
+
+            chunk_offs[cur_a + 1] = chunk_offs[cur_a] + nchunk0*nchunk1;
         }
-    }
 
-    // reset current_chunk
-    for (int cur_a = ith; cur_a < n_as; cur_a += nth) {
-        atomic_int * current_chunk_ctr = (atomic_int *)(atomic_current_chunk + cur_a);
-        *current_chunk_ctr = nth;
+        // Every thread starts at ith, so the first unprocessed chunk is nth.  This save a bit of coordination right at the start.
+        atomic_store_explicit(&params->threadpool->current_chunk, nth, memory_order_relaxed);
     }
 
     ggml_barrier(params->threadpool);
 
-    for (int cur_a = 0; cur_a < n_as; ++cur_a) {
-        const int64_t cne1 = matrix_row_counts[cur_a];
-
-        if (cne1 == 0) {
-            continue;
-        }
+    // gather the rows of src1 in the sorted order, converted to vec_dot_type
+    for (int64_t ir = ith; ir < n_rows; ir += nth) {
+        const struct mmid_row_mapping row_mapping = rows[ir];
 
-        const char * src0_cur = (const char *) src0->data + cur_a * nb02;
-        const void * wdata = (src1->type == vec_dot_type) ? src1->data : params->wdata;
-        const size_t row_size = ggml_row_size(vec_dot_type, ne10);
+        const int64_t i11 = row_mapping.i1 % ne11;
+        const int64_t i12 = row_mapping.i2; // row index in src1
 
-        const int64_t nr0 = ne01;
-        const int64_t nr1 = cne1;
+        const char * src1_row = (const char *) src1->data + i11*nb11 + i12*nb12;
 
-        int chunk_size = 16;
-        if (nr0 == 1 || nr1 == 1) {
-            chunk_size = 64;
+        if (src1->type == vec_dot_type) {
+            memcpy(wdata_src1 + ir*row_size, src1_row, row_size);
+        } else {
+            from_float((const float *) src1_row, wdata_src1 + ir*row_size, ne10);
         }
+    }
 
-#if defined(__aarch64__)
-        // disable for ARM
-        const bool disable_chunking = true;
-#else
-        // disable for NUMA
-        const bool disable_chunking = ggml_is_numa();
-#endif // defined(__aarch64__)
+    ggml_barrier(params->threadpool);
 
-        int64_t nchunk0 = (nr0 + chunk_size - 1) / chunk_size;
-        int64_t nchunk1 = (nr1 + chunk_size - 1) / chunk_size;
+    const int64_t nchunk = chunk_offs[n_as];
 
-        if (nchunk0 * nchunk1 < nth * 4 || disable_chunking) {
-            nchunk0 = nr0 > nr1 ? nth : 1;
-            nchunk1 = nr0 > nr1 ? 1 : nth;
-        }
+    int cur_a = 0;
+
+    // The first chunk comes from our thread_id, the rest will get auto-assigned.
+    int64_t current_chunk = ith;
 
-        const int64_t dr0 = (nr0 + nchunk0 - 1) / nchunk0;
-        const int64_t dr1 = (nr1 + nchunk1 - 1) / nchunk1;
+    while (current_chunk < nchunk) {
+        // the chunks of an expert are consecutive, the chunks taken by a thread are increasing
+        while (current_chunk >= chunk_offs[cur_a + 1]) {
+            cur_a++;
+        }
 
-        int current_chunk = ith;
+        const int64_t nr0 = ne01;
+        const int64_t nr1 = expert_offs[cur_a + 1] - expert_offs[cur_a];
 
-        atomic_int * current_chunk_ctr = (atomic_int *)(atomic_current_chunk + cur_a);
+        int64_t nchunk0, nchunk1, dr0, dr1;
+        ggml_mul_mat_id_chunks(nr0, nr1, nth, disable_chunking, &nchunk0, &nchunk1, &dr0, &dr1);
 
-        while (current_chunk < nchunk0 * nchunk1) {
-            const int64_t ith0 = current_chunk % nchunk0;
-            const int64_t ith1 = current_chunk / nchunk0;
+        const int64_t ith0 = (current_chunk - chunk_offs[cur_a]) % nchunk0;
+        const int64_t ith1 = (current_chunk - chunk_offs[cur_a]) / nchunk0;
 
-            const int64_t ir0_start = dr0 * ith0;
-            const int64_t ir0_end = MIN(ir0_start + dr0, nr0);
+        const int64_t ir0_start = dr0 * ith0;
+        const int64_t ir0_end = MIN(ir0_start + dr0, nr0);
 
-            const int64_t ir1_start = dr1 * ith1;
-            const int64_t ir1_end = MIN(ir1_start + dr1, nr1);
+        const int64_t ir1_start = dr1 * ith1;
+        const int64_t ir1_end = MIN(ir1_start + dr1, nr1);
 
-            ggml_compute_forward_mul_mat_id_one_chunk(
-                dst, src0, src1, ids, cur_a,
-                ir0_start, ir0_end, ir1_start, ir1_end,
-                src0_cur, matrix_rows, row_size, src1_cont, wdata
-            );
+        // dot kernels can handle 1 row and col at a time, but mmla kernels can process 2 rows and cols
+        int64_t num_rows_per_vec_dot = vec_dot_num_rows;
 
-            if (nth >= nchunk0 * nchunk1) {
-                break;
-            }
+        if ((nr0 % 2 != 0) || ((ir0_end - ir0_start) % 2 != 0) || ((ir1_end - ir1_start) % 2 != 0)) {
+            num_rows_per_vec_dot = 1;
+        }
 
-            current_chunk = atomic_fetch_add_explicit(current_chunk_ctr, 1, memory_order_relaxed);
+        ggml_compute_forward_mul_mat_id_one_chunk(
+            dst, src0,
+            (const char *) src0->data + cur_a*nb02,
+            wdata_src1 + expert_offs[cur_a]*row_size,
+            rows + expert_offs[cur_a],
+            row_size, num_rows_per_vec_dot,
+            ir0_start, ir0_end, ir1_start, ir1_end
+        );
+
+        if (disable_chunking) {
+            // every expert has nth chunks, the next chunk of this thread is in the next expert
+            current_chunk += nth;
+        } else {
+            current_chunk = atomic_fetch_add_explicit(&params->threadpool->current_chunk, 1, memory_order_relaxed);
         }
     }
 }
@@ -2007,6 +2029,131 @@ static void ggml_compute_forward(struct ggml_compute_params * params, struct ggm
     }
 }
 
+static bool ggml_cpu_tensors_overlap(const struct ggml_tensor * a, const struct ggml_tensor * b) {
+    const char * a0 = (const char *) a->data;
+    const char * a1 = a0 + ggml_nbytes(a);
+    const char * b0 = (const char *) b->data;
+    const char * b1 = b0 + ggml_nbytes(b);
+
+    return a0 < b1 && b0 < a1;
+}
+
+// the ops that do not write to the memory of dst
+static bool ggml_cpu_op_is_view(enum ggml_op op) {
+    return op == GGML_OP_NONE || op == GGML_OP_RESHAPE || op == GGML_OP_VIEW || op == GGML_OP_PERMUTE || op == GGML_OP_TRANSPOSE;
+}
+
+// op fusion
+//
+// some chains of nodes are computed in a single pass, without storing the intermediate results and
+// without the barriers between the nodes:
+//
+//  - RMS_NORM + MUL:        the normalized rows are scaled by the weight
+//  - RMS_NORM + MUL + MUL_MAT with a quantized weight:
+//                           in addition, the rows of the MUL are converted to the vec_dot_type of the weight
+//                           while they are in cache, the MUL_MAT finds its src1 already converted
+//                           the MUL is still stored, its other users (e.g. the K and V projections) read it
+//  - UNARY(SILU) + MUL:     SwiGLU
+//
+// the intermediate results must have no other user in the graph, see ggml_can_fuse
+// set GGML_CPU_DISABLE_FUSION to compute every node separately
+
+static bool ggml_cpu_disable_fusion = false;
+
+// the fused kernels read the sources and write dst in a single pass, split across the threads
+// the allocator can place dst in the memory of a source that is freed after the first node of the chain:
+// this is only safe if they are the same tensor, a partial overlap would be overwritten before it is read
+static bool ggml_cpu_fusion_can_alias(const struct ggml_tensor * dst, const struct ggml_tensor * src) {
+    if (!ggml_cpu_tensors_overlap(dst, src)) {
+        return true;
+    }
+
+    return dst->data == src->data && dst->type == src->type && ggml_are_same_shape(dst, src) && ggml_are_same_stride(dst, src);
+}
+
+// returns the number of nodes computed starting at node_n, 0 if the node is not the start of a fused chain
+static int ggml_compute_forward_fused(const struct ggml_compute_params * params, const struct ggml_cgraph * cgraph, int node_n) {
+    if (ggml_cpu_disable_fusion) {
+        return 0;
+    }
+
+    struct ggml_tensor * node = cgraph->nodes[node_n];
+
+    if (node->op == GGML_OP_RMS_NORM) {
+        static const enum ggml_op ops[] = { GGML_OP_RMS_NORM, GGML_OP_MUL };
+
+        if (!ggml_can_fuse(cgraph, node_n, ops, 2)) {
+            return 0;
+        }
+
+        struct ggml_tensor * mul = cgraph->nodes[node_n + 1];
+        const struct ggml_tensor * x = node->src[0];
+        const struct ggml_tensor * w = mul->src[1];
+
+        if (mul->src[0] != node || x->type != GGML_TYPE_F32 || w->type != GGML_TYPE_F32 || mul->type != GGML_TYPE_F32 ||
+            x->nb[0] != sizeof(float) || w->nb[0] != sizeof(float) || mul->nb[0] != sizeof(float) ||
+            !ggml_can_repeat(w, mul) || w->ne[0] != mul->ne[0] || ggml_is_empty(mul) ||
+            !ggml_cpu_fusion_can_alias(mul, x)) {
+            return 0;
+        }
+
+        // the next node multiplies the MUL with a quantized weight
+        // the weights in an extra buffer type (AMX, repacked layouts) have their own conversion of src1
+        if (node_n + 2 < cgraph->n_nodes) {
+            struct ggml_tensor * mm = cgraph->nodes[node_n + 2];
+
+            if (mm->op == GGML_OP_MUL_MAT && mm->src[1] == mul && mm->src[0]->extra == NULL &&
+                ggml_is_quantized(mm->src[0]->type) && ggml_is_contiguous(mul) && !ggml_is_empty(mm)) {
+                const enum ggml_type vec_dot_type = type_traits_cpu[mm->src[0]->type].vec_dot_type;
+
+                struct ggml_compute_src1_cache * cache = params->src1_cache;
+
+                GGML_ASSERT(cache->size >= ggml_row_size(vec_dot_type, ggml_nelements(mul)));
+
+                ggml_compute_forward_rms_norm_mul(params, mul,
+                        type_traits_cpu[vec_dot_type].from_float, cache->data, ggml_row_size(vec_dot_type, mul->ne[0]));
+
+                cache->src1 = mul;
+                cache->type = vec_dot_type;
+
+                // the barrier of the matmul after the conversion makes the cache visible to all threads
+                ggml_compute_forward_mul_mat(params, mm);
+
+                return 3;
+            }
+        }
+
+        ggml_compute_forward_rms_norm_mul(params, mul, NULL, NULL, 0);
+
+        return 2;
+    }
+
+    if (node->op == GGML_OP_UNARY && ggml_get_unary_op(node) == GGML_UNARY_OP_SILU) {
+        static const enum ggml_op ops[] = { GGML_OP_UNARY, GGML_OP_MUL };
+
+        if (!ggml_can_fuse(cgraph, node_n, ops, 2)) {
+            return 0;
+        }
+
+        struct ggml_tensor * mul = cgraph->nodes[node_n + 1];
+        const struct ggml_tensor * x = node->src[0];
+        const struct ggml_tensor * g = mul->src[1];
+
+        if (mul->src[0] != node || x->type != GGML_TYPE_F32 || g->type != GGML_TYPE_F32 || mul->type != GGML_TYPE_F32 ||
+            !ggml_are_same_shape(x, mul) || !ggml_are_same_shape(g, mul) ||
+            !ggml_is_contiguous(x) || !ggml_is_contiguous(g) || !ggml_is_contiguous(mul) || ggml_is_empty(mul) ||
+            !ggml_cpu_fusion_can_alias(mul, x) || !ggml_cpu_fusion_can_alias(mul, g)) {
+            return 0;
+        }
+
+        ggml_compute_forward_silu_mul(params, mul);
+
+        return 2;
+    }
+
+    return 0;
+}
+
 // Android's libc implementation "bionic" does not support setting affinity
 #if defined(__gnu_linux__)
 static void set_numa_thread_affinity(int thread_n) {
@@ -2599,6 +2746,31 @@ void ggml_threadpool_resume(struct ggml_threadpool * threadpool) {
 #endif
 }
 
+// the matmuls convert src1 to the vec_dot_type of src0 in a region at the end of the work buffer
+// the other ops do not use it, so the conversion stays valid for the next matmuls with the same src1,
+// e.g. the Q, K and V projections of the same activations or the gate and up projections of the FFN
+static size_t ggml_graph_mul_mat_src1_size(const struct ggml_cgraph * cgraph, int n_threads) {
+    size_t size = 0;
+
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        const struct ggml_tensor * node = cgraph->nodes[i];
+
+        size_t cur = 0;
+
+        if (node->op != GGML_OP_MUL_MAT || ggml_cpu_extra_work_size(n_threads, node, &cur)) {
+            continue;
+        }
+
+        const enum ggml_type vec_dot_type = type_traits_cpu[node->src[0]->type].vec_dot_type;
+
+        if (node->src[1]->type != vec_dot_type) {
+            size = MAX(size, ggml_row_size(vec_dot_type, ggml_nelements(node->src[1])));
+        }
+    }
+
+    return GGML_PAD(size, CACHE_LINE_SIZE);
+}
+
 struct ggml_cplan ggml_graph_plan(
           const struct ggml_cgraph * cgraph,
                                int   n_threads,
@@ -2659,11 +2831,11 @@ struct ggml_cplan ggml_graph_plan(
                     } break;
                 case GGML_OP_MUL_MAT:
                     {
-                        const enum ggml_type vec_dot_type = type_traits_cpu[node->src[0]->type].vec_dot_type;
-
-                        if (node->src[1]->type != vec_dot_type) {
-                            cur = ggml_row_size(vec_dot_type, ggml_nelements(node->src[1]));
-                        }
+                        // src1 is converted in its own region, see ggml_graph_mul_mat_src1_size
+#if GGML_USE_LLAMAFILE
+                        const struct ggml_tensor * src0 = node->src[0];
+                        cur = llamafile_sgemm_wsize(n_tasks, src0->ne[0]/ggml_blck_size(src0->type), src0->type);
+#endif
                     } break;
                 case GGML_OP_MUL_MAT_ID:
                     {
@@ -2673,16 +2845,13 @@ struct ggml_cplan ggml_graph_plan(
                         const struct ggml_tensor * ids = node->src[2];
                         const enum ggml_type vec_dot_type = type_traits_cpu[src0->type].vec_dot_type;
                         const int n_as = src0->ne[2];
-                        // src1
-                        if (src1->type != vec_dot_type) {
-                            cur += ggml_row_size(vec_dot_type, ggml_nelements(src1)) + sizeof(int64_t);
-                        }
-                        // matrix_row_counts
-                        cur += n_as * sizeof(int64_t) + sizeof(int64_t);
-                        // matrix_rows
-                        cur += n_as*ids->ne[0]*ids->ne[1]*sizeof(struct mmid_row_mapping) + sizeof(int64_t);
-                        // atomic_current_chunk
-                        cur += CACHE_LINE_SIZE*n_as + CACHE_LINE_SIZE;
+                        const int64_t n_rows = ids->ne[0]*ids->ne[1];
+                        // src1 rows sorted by expert
+                        cur += ggml_row_size(vec_dot_type, src1->ne[0])*n_rows + sizeof(int64_t);
+                        // expert_offs, chunk_offs
+                        cur += 2*(n_as + 1)*sizeof(int64_t) + 2*sizeof(int64_t);
+                        // rows
+                        cur += n_rows*sizeof(struct mmid_row_mapping) + sizeof(int64_t);
                     } break;
                 case GGML_OP_OUT_PROD:
                     {
@@ -2741,6 +2910,21 @@ struct ggml_cplan ggml_graph_plan(
                         const int64_t ne20 = node->src[2]->ne[0]; // DV
 
                         cur = sizeof(float)*(1*ne10 + 2*ne20)*n_tasks; // 1x head size K + 2x head size V (per thread)
+
+                        // partial results of the KV chunks (flash decoding)
+                        const int64_t nr = node->src[0]->ne[1]*node->src[0]->ne[2]*node->src[0]->ne[3];
+                        const int64_t nc = ggml_fa_kv_chunks(nr, node->src[1]->ne[1], n_tasks);
+                        if (nc > 1) {
+                            cur += sizeof(float)*(ne20 + 2)*nr*nc;
+                        }
+
+                        if (node->src[0]->ne[1] >= GGML_FA_TILE_Q_MIN) {
+                            // tiled: Q^T, K and V tiles, KQ^T tile, VKQ accumulators (per thread)
+                            cur = sizeof(float)*(GGML_FA_TILE_Q*(ne10 + ne20) + GGML_FA_TILE_KV*(ne10 + ne20 + GGML_FA_TILE_Q))*n_tasks;
+
+                            // mask of the (query tile, KV tile) pairs
+                            cur += ((node->src[0]->ne[1] + GGML_FA_TILE_Q - 1)/GGML_FA_TILE_Q)*((node->src[1]->ne[1] + GGML_FA_TILE_KV - 1)/GGML_FA_TILE_KV);
+                        }
                     } break;
                 case GGML_OP_FLASH_ATTN_BACK:
                     {
@@ -2779,6 +2963,11 @@ struct ggml_cplan ggml_graph_plan(
         work_size += CACHE_LINE_SIZE*(n_threads);
     }
 
+    const size_t src1_size = ggml_graph_mul_mat_src1_size(cgraph, n_threads);
+    if (src1_size > 0) {
+        work_size = GGML_PAD(work_size, CACHE_LINE_SIZE) + src1_size;
+    }
+
     cplan.threadpool = threadpool;
     cplan.n_threads  = MIN(max_tasks, n_threads);
     cplan.work_size  = work_size;
@@ -2796,18 +2985,47 @@ static thread_ret_t ggml_graph_compute_thread(void * data) {
 
     set_numa_thread_affinity(state->ith);
 
+    const size_t wsize = cplan->work_size - tp->src1_size;
+
+    struct ggml_compute_src1_cache src1_cache = {
+        /*.size =*/ tp->src1_size,
+        /*.data =*/ tp->src1_size > 0 ? (char *) cplan->work_data + wsize : NULL,
+        /*.src1 =*/ NULL,
+        /*.type =*/ GGML_TYPE_COUNT,
+    };
+
     struct ggml_compute_params params = {
         /*.ith       =*/ state->ith,
         /*.nth       =*/ atomic_load_explicit(&tp->n_threads_cur, memory_order_relaxed),
-        /*.wsize     =*/ cplan->work_size,
+        /*.wsize     =*/ wsize,
         /*.wdata     =*/ cplan->work_data,
         /*.threadpool=*/ tp,
+        /*.src1_cache=*/ &src1_cache,
     };
 
     for (int node_n = 0; node_n < cgraph->n_nodes && atomic_load_explicit(&tp->abort, memory_order_relaxed) != node_n; node_n++) {
         struct ggml_tensor * node = cgraph->nodes[node_n];
 
-        ggml_compute_forward(&params, node);
+        const int node_0 = node_n;
+
+        const int n_fused = ggml_compute_forward_fused(&params, cgraph, node_n);
+        if (n_fused > 0) {
+            node_n += n_fused - 1;
+        } else {
+            ggml_compute_forward(&params, node);
+        }
+
+        // the converted src1 is stale if a node wrote to its memory (in-place ops, copies to views)
+        if (src1_cache.src1 != NULL) {
+            for (int i = node_0; i <= node_n; i++) {
+                const struct ggml_tensor * cur = cgraph->nodes[i];
+
+                if (cur != src1_cache.src1 && !ggml_cpu_op_is_view(cur->op) && ggml_cpu_tensors_overlap(cur, src1_cache.src1)) {
+                    src1_cache.src1 = NULL;
+                    break;
+                }
+            }
+        }
 
         if (state->ith == 0 && cplan->abort_callback &&
                 cplan->abort_callback(cplan->abort_callback_data)) {
@@ -3071,6 +3289,9 @@ enum ggml_status ggml_graph_compute(struct ggml_cgraph * cgraph, struct ggml_cpl
         threadpool->ec               = GGML_STATUS_SUCCESS;
     }
 
+    threadpool->src1_size = ggml_graph_mul_mat_src1_size(cgraph, n_threads);
+    GGML_ASSERT(threadpool->src1_size <= cplan->work_size);
+
 #ifdef GGML_USE_OPENMP
     if (n_threads > 1) {
         #pragma omp parallel num_threads(n_threads)
@@ -3430,6 +3651,8 @@ void ggml_cpu_init(void) {
     static bool is_first_call = true;
 
     if (is_first_call) {
+        ggml_cpu_disable_fusion = getenv("GGML_CPU_DISABLE_FUSION") != NULL;
+
         // initialize GELU, Quick GELU, SILU and EXP F32 tables
         {
             const uint64_t t_start = ggml_time_us(); UNUSED(t_start);
@@ -1074,6 +1074,376 @@ class tinyBLAS_Q0_AVX {
 };
 #endif // __AVX__
 
+#if defined(__AVX2__)
+/**
+ * GEMM for the K-quants (Q4_K, Q5_K, Q6_K) with Q8_K activations.
+ *
+ * Each row of A is unpacked once into unsigned 8-bit quants with a 16-bit scale per pair of quants, so
+ * that the tiles of C only need maddubs + madd (or vpdpwssd with VNNI) in the inner loop, with RM x RN
+ * integer accumulators per super-block. The mins of Q4_K/Q5_K and the -32 offset of Q6_K are applied
+ * per super-block from the sums of the Q8_K quants in groups of 16 (bsums).
+ */
+template <typename TA>
+class tinyBLAS_K_AVX {
+  public:
+    tinyBLAS_K_AVX(int64_t k,
+                   const TA *A, int64_t lda,
+                   const block_q8_K *B, int64_t ldb,
+                   float *C, int64_t ldc,
+                   void *wdata,
+                   int ith, int nth)
+        : A(A), B(B), C(C), k(k), lda(lda), ldb(ldb), ldc(ldc), ith(ith), nth(nth),
+          Abuf((block_unpacked *)(((uintptr_t)wdata + alignof(block_unpacked) - 1) & ~(uintptr_t)(alignof(block_unpacked) - 1))) {
+    }
+
+    // scratch needed by each thread: up to 4 unpacked rows, plus room for the alignment
+    static size_t wsize(int64_t k) {
+        return 4 * k * sizeof(block_unpacked) + alignof(block_unpacked);
+    }
+
+    void matmul(int64_t m, int64_t n) {
+        mnpack(0, m, 0, n);
+    }
+
+  private:
+#if defined(__AVX512BW__)
+    typedef __m512i vec_t;
+    typedef __m512  vecf_t;
+#else
+    typedef __m256i vec_t;
+    typedef __m256  vecf_t;
+#endif
+
+    // Q6_K has no separate dmin, its offset is removed from the integer sums
+    static constexpr bool has_dmin = !std::is_same<TA, block_q6_K>::value;
+
+    // super-block of a row of A, unpacked
+    struct alignas(64) block_unpacked {
+        uint8_t q[QK_K];          // quants, made unsigned
+        int16_t sc[QK_K/2];       // scale of each pair of quants
+        int16_t mins[QK_K/16];    // offset of each group of 16 quants (Q6_K)
+        float   dmins[QK_K/32];   // offset of each group of 32 quants, times dmin (Q4_K, Q5_K)
+        float   d;
+    };
+
+#if VECTOR_REGISTERS == 32
+    static constexpr int RN = 4;
+#else
+    static constexpr int RN = 2;
+#endif
+
+    void mnpack(int64_t m0, int64_t m, int64_t n0, int64_t n) {
+        int64_t mc;
+        switch (MIN(m - m0, 4)) {
+        case 4:
+            mc = 4;
+            gemm<4>(m0, m, n0, n);
+            break;
+        case 3:
+            mc = 3;
+            gemm<3>(m0, m, n0, n);
+            break;
+        case 2:
+            mc = 2;
+            gemm<2>(m0, m, n0, n);
+            break;
+        case 1:
+            mc = 1;
+            gemm<1>(m0, m, n0, n);
+            break;
+        default:
+            return;
+        }
+        mnpack(m0 + (m - m0) / mc * mc, m, n0, n);
+    }
+
+    // the jobs are tiles of RM rows by a block of columns, the rows are unpacked once per job
+    // the columns are split in blocks only when there are not enough row tiles for the threads
+    template <int RM>
+    NOINLINE void gemm(int64_t m0, int64_t m, int64_t n0, int64_t n) {
+        int64_t ytiles = (m - m0) / RM;
+        int64_t xtiles = (n - n0 + RN - 1) / RN;
+        int64_t xblocks = 1;
+        if (ytiles < 4 * nth)
+            xblocks = MIN(xtiles, (4 * nth + ytiles - 1) / ytiles);
+        int64_t nblock = (xtiles + xblocks - 1) / xblocks * RN;
+        int64_t jobs = ytiles * xblocks;
+        int64_t duty = (jobs + nth - 1) / nth;
+        int64_t start = duty * ith;
+        int64_t end = start + duty;
+        if (end > jobs)
+            end = jobs;
+        for (int64_t job = start; job < end; ++job) {
+            int64_t ii = m0 + job / xblocks * RM;
+            int64_t j0 = n0 + job % xblocks * nblock;
+            int64_t j1 = MIN(n, j0 + nblock);
+            const block_unpacked * Au = unpack_rows(ii, RM);
+            int64_t jj = j0;
+            for (; jj + RN <= j1; jj += RN)
+                gemm_tile<RM, RN>(Au, ii, jj);
+            switch (j1 - jj) {
+#if VECTOR_REGISTERS == 32
+            case 3:
+                gemm_tile<RM, 3>(Au, ii, jj);
+                break;
+            case 2:
+                gemm_tile<RM, 2>(Au, ii, jj);
+                break;
+#endif
+            case 1:
+                gemm_tile<RM, 1>(Au, ii, jj);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    template <int RM, int RN>
+    inline void gemm_tile(const block_unpacked * Au, int64_t ii, int64_t jj) {
+        vecf_t Cv[RN][RM] = {};
+        for (int64_t l = 0; l < k; ++l) {
+            vec_t Ci[RN][RM];
+            for (int64_t j = 0; j < RN; ++j)
+                for (int64_t i = 0; i < RM; ++i)
+                    Ci[j][i] = vzero();
+            for (int c = 0; c < QK_K; c += sizeof(vec_t)) {
+                vec_t bv[RN];
+                for (int64_t j = 0; j < RN; ++j)
+                    bv[j] = vload(B[ldb * (jj + j) + l].qs + c);
+                for (int64_t i = 0; i < RM; ++i) {
+                    const vec_t av = vload(Au[k * i + l].q + c);
+                    const vec_t sv = vload(Au[k * i + l].sc + c / 2);
+                    for (int64_t j = 0; j < RN; ++j)
+                        Ci[j][i] = vdot(Ci[j][i], av, bv[j], sv);
+                }
+            }
+            for (int64_t j = 0; j < RN; ++j) {
+                const block_q8_K & b = B[ldb * (jj + j) + l];
+                const vecf_t db = vset1(b.d);
+                if constexpr (has_dmin) {
+                    const vecf_t bs = mul(vbsums(b.bsums), db);
+                    for (int64_t i = 0; i < RM; ++i) {
+                        Cv[j][i] = madd(mul(vset1(Au[k * i + l].d), db), vcvt(Ci[j][i]), Cv[j][i]);
+                        Cv[j][i] = vnmadd(vloadf(Au[k * i + l].dmins), bs, Cv[j][i]);
+                    }
+                } else {
+                    const vec_t bs = vload16(b.bsums);
+                    for (int64_t i = 0; i < RM; ++i) {
+                        const vec_t ci = vsub(Ci[j][i], vmadd(vload16(Au[k * i + l].mins), bs));
+                        Cv[j][i] = madd(mul(vset1(Au[k * i + l].d), db), vcvt(ci), Cv[j][i]);
+                    }
+                }
+            }
+        }
+        for (int64_t j = 0; j < RN; ++j)
+            for (int64_t i = 0; i < RM; ++i)
+                C[ldc * (jj + j) + (ii + i)] = hsum(Cv[j][i]);
+    }
+
+    // unpack rows ii .. ii + rm - 1 of A, reusing the last ones if possible
+    const block_unpacked * unpack_rows(int64_t ii, int64_t rm) {
+        if (ii != unpacked_ii || rm != unpacked_rm) {
+            for (int64_t i = 0; i < rm; ++i)
+                for (int64_t l = 0; l < k; ++l)
+                    unpack(A[lda * (ii + i) + l], Abuf[k * i + l]);
+            unpacked_ii = ii;
+            unpacked_rm = rm;
+        }
+        return Abuf;
+    }
+
+    // 6-bit scales and mins of Q4_K/Q5_K, one per 32 quants
+    static void unpack_scales(const uint8_t * scales, float dmin, block_unpacked & y) {
+        for (int j = 0; j < QK_K/32; ++j) {
+            uint8_t sc, m;
+            if (j < 4) {
+                sc = scales[j] & 63;
+                m  = scales[j + 4] & 63;
+            } else {
+                sc = (scales[j + 4] & 0xF) | ((scales[j - 4] >> 6) << 4);
+                m  = (scales[j + 4] >>  4) | ((scales[j - 0] >> 6) << 4);
+            }
+            _mm256_storeu_si256((__m256i *)(y.sc + 16 * j), _mm256_set1_epi16(sc));
+            y.dmins[j] = dmin * m;
+        }
+    }
+
+    static void unpack(const block_q4_K & x, block_unpacked & y) {
+        const __m256i m4 = _mm256_set1_epi8(0xF);
+        for (int j = 0; j < QK_K/64; ++j) {
+            const __m256i q4 = _mm256_loadu_si256((const __m256i *)(x.qs + 32 * j));
+            _mm256_storeu_si256((__m256i *)(y.q + 64 * j +  0), _mm256_and_si256(q4, m4));
+            _mm256_storeu_si256((__m256i *)(y.q + 64 * j + 32), _mm256_and_si256(_mm256_srli_epi16(q4, 4), m4));
+        }
+        unpack_scales(x.scales, unhalf(x.dmin), y);
+        y.d = unhalf(x.d);
+    }
+
+    static void unpack(const block_q5_K & x, block_unpacked & y) {
+        const __m256i m4 = _mm256_set1_epi8(0xF);
+        const __m256i m1 = _mm256_set1_epi8(1);
+        const __m256i qh = _mm256_loadu_si256((const __m256i *)x.qh);
+        for (int j = 0; j < QK_K/64; ++j) {
+            const __m256i q4 = _mm256_loadu_si256((const __m256i *)(x.qs + 32 * j));
+            const __m256i h0 = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(qh, 2 * j + 0), m1), 4);
+            const __m256i h1 = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(qh, 2 * j + 1), m1), 4);
+            _mm256_storeu_si256((__m256i *)(y.q + 64 * j +  0), _mm256_or_si256(_mm256_and_si256(q4, m4), h0));
+            _mm256_storeu_si256((__m256i *)(y.q + 64 * j + 32), _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(q4, 4), m4), h1));
+        }
+        unpack_scales(x.scales, unhalf(x.dmin), y);
+        y.d = unhalf(x.d);
+    }
+
+    // the quants are stored with an offset of 32, which is subtracted with the mins
+    static void unpack(const block_q6_K & x, block_unpacked & y) {
+        const __m256i m4 = _mm256_set1_epi8(0xF);
+        const __m256i m2 = _mm256_set1_epi8(3);
+        for (int j = 0; j < QK_K/128; ++j) {
+            const __m256i ql0 = _mm256_loadu_si256((const __m256i *)(x.ql + 64 * j +  0));
+            const __m256i ql1 = _mm256_loadu_si256((const __m256i *)(x.ql + 64 * j + 32));
+            const __m256i qh  = _mm256_loadu_si256((const __m256i *)(x.qh + 32 * j));
+            const __m256i h0 = _mm256_slli_epi16(_mm256_and_si256(qh, m2), 4);
+            const __m256i h1 = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(qh, 2), m2), 4);
+            const __m256i h2 = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(qh, 4), m2), 4);
+            const __m256i h3 = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(qh, 6), m2), 4);
+            uint8_t * q = y.q + 128 * j;
+            _mm256_storeu_si256((__m256i *)(q +  0), _mm256_or_si256(_mm256_and_si256(ql0, m4), h0));
+            _mm256_storeu_si256((__m256i *)(q + 32), _mm256_or_si256(_mm256_and_si256(ql1, m4), h1));
+            _mm256_storeu_si256((__m256i *)(q + 64), _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(ql0, 4), m4), h2));
+            _mm256_storeu_si256((__m256i *)(q + 96), _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(ql1, 4), m4), h3));
+        }
+        for (int g = 0; g < QK_K/16; g += 2) {
+            _mm256_storeu_si256((__m256i *)(y.sc + 8 * g),
+                                MM256_SET_M128I(_mm_set1_epi16(x.scales[g + 1]), _mm_set1_epi16(x.scales[g])));
+        }
+        _mm256_storeu_si256((__m256i *)y.mins,
+                            _mm256_slli_epi16(_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)x.scales)), 5));
+        y.d = unhalf(x.d);
+    }
+
+#if defined(__AVX512BW__)
+    static inline vec_t vzero() {
+        return _mm512_setzero_si512();
+    }
+
+    static inline vec_t vload(const void * p) {
+        return _mm512_loadu_si512(p);
+    }
+
+    // 16 x int16, with the upper half set to zero
+    static inline vec_t vload16(const int16_t * p) {
+        return _mm512_inserti64x4(_mm512_setzero_si512(), _mm256_loadu_si256((const __m256i *)p), 0);
+    }
+
+    // 8 x float, with the upper half set to zero
+    static inline vecf_t vloadf(const float * p) {
+        return _mm512_maskz_loadu_ps(0xFF, p);
+    }
+
+    // sums of the Q8_K quants in groups of 32, with the upper half set to zero
+    static inline vecf_t vbsums(const int16_t * p) {
+        return _mm512_cvtepi32_ps(_mm512_madd_epi16(vload16(p), _mm512_set1_epi16(1)));
+    }
+
+    static inline vecf_t vset1(float x) {
+        return _mm512_set1_ps(x);
+    }
+
+    static inline vecf_t vcvt(vec_t x) {
+        return _mm512_cvtepi32_ps(x);
+    }
+
+    static inline vecf_t vnmadd(vecf_t a, vecf_t b, vecf_t c) {
+        return _mm512_fnmadd_ps(a, b, c);
+    }
+
+    static inline vec_t vsub(vec_t x, vec_t y) {
+        return _mm512_sub_epi32(x, y);
+    }
+
+    static inline vec_t vmadd(vec_t x, vec_t y) {
+        return _mm512_madd_epi16(x, y);
+    }
+
+    // acc + s * (u * q), with the products of u * q summed in pairs
+    static inline vec_t vdot(vec_t acc, vec_t u, vec_t q, vec_t s) {
+        const vec_t p = _mm512_maddubs_epi16(u, q);
+#if defined(__AVX512VNNI__)
+        return _mm512_dpwssd_epi32(acc, p, s);
+#else
+        return _mm512_add_epi32(acc, _mm512_madd_epi16(p, s));
+#endif
+    }
+#else
+    static inline vec_t vzero() {
+        return _mm256_setzero_si256();
+    }
+
+    static inline vec_t vload(const void * p) {
+        return _mm256_loadu_si256((const __m256i *)p);
+    }
+
+    static inline vec_t vload16(const int16_t * p) {
+        return _mm256_loadu_si256((const __m256i *)p);
+    }
+
+    static inline vecf_t vloadf(const float * p) {
+        return _mm256_loadu_ps(p);
+    }
+
+    static inline vecf_t vbsums(const int16_t * p) {
+        return _mm256_cvtepi32_ps(_mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)p), _mm256_set1_epi16(1)));
+    }
+
+    static inline vecf_t vset1(float x) {
+        return _mm256_set1_ps(x);
+    }
+
+    static inline vecf_t vcvt(vec_t x) {
+        return _mm256_cvtepi32_ps(x);
+    }
+
+    static inline vecf_t vnmadd(vecf_t a, vecf_t b, vecf_t c) {
+        return _mm256_fnmadd_ps(a, b, c);
+    }
+
+    static inline vec_t vsub(vec_t x, vec_t y) {
+        return _mm256_sub_epi32(x, y);
+    }
+
+    static inline vec_t vmadd(vec_t x, vec_t y) {
+        return _mm256_madd_epi16(x, y);
+    }
+
+    static inline vec_t vdot(vec_t acc, vec_t u, vec_t q, vec_t s) {
+        const vec_t p = _mm256_maddubs_epi16(u, q);
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+        return _mm256_dpwssd_epi32(acc, p, s);
+#elif defined(__AVXVNNI__)
+        return _mm256_dpwssd_avx_epi32(acc, p, s);
+#else
+        return _mm256_add_epi32(acc, _mm256_madd_epi16(p, s));
+#endif
+    }
+#endif
+
+    const TA *const A;
+    const block_q8_K *const B;
+    float *const C;
+    const int64_t k;
+    const int64_t lda;
+    const int64_t ldb;
+    const int64_t ldc;
+    const int ith;
+    const int nth;
+    block_unpacked *const Abuf;
+
+    int64_t unpacked_ii = -1;
+    int64_t unpacked_rm = 0;
+};
+#endif // __AVX2__
+
 //PPC Implementation
 #if defined(__MMA__)
 
@@ -3277,6 +3647,32 @@ class tinyBLAS_PPC {
 #endif
 } // namespace
 
+/**
+ * Returns the size of the work buffer needed by llamafile_sgemm().
+ *
+ * Only the K-quant kernels need one, to unpack the rows of A of each thread.
+ *
+ * @param nth is number of threads
+ * @param k is cols in `A`, in blocks of `Atype`
+ * @param Atype is GGML data type of `A`
+ */
+size_t llamafile_sgemm_wsize(int nth, int64_t k, int Atype) {
+    switch (Atype) {
+#if defined(__AVX2__)
+    case GGML_TYPE_Q4_K:
+        return tinyBLAS_K_AVX<block_q4_K>::wsize(k) * nth;
+    case GGML_TYPE_Q5_K:
+        return tinyBLAS_K_AVX<block_q5_K>::wsize(k) * nth;
+    case GGML_TYPE_Q6_K:
+        return tinyBLAS_K_AVX<block_q6_K>::wsize(k) * nth;
+#endif
+    default:
+        (void)nth;
+        (void)k;
+        return 0;
+    }
+}
+
 /**
  * Performs optimized matrix multiplication on CPU.
  *
@@ -3573,6 +3969,75 @@ bool llamafile_sgemm(const struct ggml_compute_params * params, int64_t m, int64
 #endif
     }
 
+    case GGML_TYPE_Q4_K: {
+        if (Btype != GGML_TYPE_Q8_K)
+            return false;
+#if defined(__AVX2__)
+        // the rows are unpacked once per tile, which does not pay off for the smallest batches
+        if (n < 4)
+            return false;
+        const size_t wsize = tinyBLAS_K_AVX<block_q4_K>::wsize(k);
+        if (params->wsize < wsize * params->nth)
+            return false;
+        tinyBLAS_K_AVX<block_q4_K> tb{
+            k, (const block_q4_K *)A, lda,
+            (const block_q8_K *)B, ldb,
+            (float *)C, ldc,
+            (char *)params->wdata + wsize * params->ith,
+            params->ith, params->nth};
+        tb.matmul(m, n);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    case GGML_TYPE_Q5_K: {
+        if (Btype != GGML_TYPE_Q8_K)
+            return false;
+#if defined(__AVX2__)
+        // the rows are unpacked once per tile, which does not pay off for the smallest batches
+        if (n < 4)
+            return false;
+        const size_t wsize = tinyBLAS_K_AVX<block_q5_K>::wsize(k);
+        if (params->wsize < wsize * params->nth)
+            return false;
+        tinyBLAS_K_AVX<block_q5_K> tb{
+            k, (const block_q5_K *)A, lda,
+            (const block_q8_K *)B, ldb,
+            (float *)C, ldc,
+            (char *)params->wdata + wsize * params->ith,
+            params->ith, params->nth};
+        tb.matmul(m, n);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    case GGML_TYPE_Q6_K: {
+        if (Btype != GGML_TYPE_Q8_K)
+            return false;
+#if defined(__AVX2__)
+        // the rows are unpacked once per tile, which does not pay off for the smallest batches
+        if (n < 4)
+            return false;
+        const size_t wsize = tinyBLAS_K_AVX<block_q6_K>::wsize(k);
+        if (params->wsize < wsize * params->nth)
+            return false;
+        tinyBLAS_K_AVX<block_q6_K> tb{
+            k, (const block_q6_K *)A, lda,
+            (const block_q8_K *)B, ldb,
+            (float *)C, ldc,
+            (char *)params->wdata + wsize * params->ith,
+            params->ith, params->nth};
+        tb.matmul(m, n);
+        return true;
+#else
+        return false;
+#endif
+    }
+
     default:
         return false;
     }
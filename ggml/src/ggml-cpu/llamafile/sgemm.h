@@ -1,4 +1,5 @@
 #pragma once
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -14,6 +15,9 @@ bool llamafile_sgemm(const struct ggml_compute_params * params, int64_t, int64_t
                      const void *, int64_t, const void *, int64_t, void *, int64_t,
                      int, int, int);
 
+// work buffer needed by llamafile_sgemm, for k elements per row of A
+size_t llamafile_sgemm_wsize(int nth, int64_t k, int Atype);
+
 #ifdef __cplusplus
 }
 #endif
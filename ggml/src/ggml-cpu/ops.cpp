@@ -966,6 +966,95 @@ static void ggml_compute_forward_dup_f32(
     }
 }
 
+// convert the rows of src0 to the quantized type of the contiguous dst
+// the rows of all the dims are split between the threads, the K cache writes have only n_head_kv rows in dim 1
+// when there are fewer rows than threads, the rows are also split in ranges of blocks
+static void ggml_compute_forward_dup_to_q(
+        const ggml_compute_params * params,
+        ggml_tensor * dst) {
+
+    const ggml_tensor * src0 = dst->src[0];
+
+    GGML_TENSOR_UNARY_OP_LOCALS
+
+    const int ith = params->ith; // thread index
+    const int nth = params->nth; // number of threads
+
+    ggml_from_float_t const quantize_row_q = ggml_get_type_traits_cpu(dst->type)->from_float;
+
+    const int64_t qk = ggml_blck_size(dst->type);
+    const size_t  bs = ggml_type_size(dst->type);
+
+    const int64_t nr  = ne01*ne02*ne03;
+    const int64_t nbr = ne00/qk; // blocks per row
+
+    if (nr == 0 || nbr == 0) {
+        return;
+    }
+
+    // blocks per chunk and chunks per row, none of the chunks is empty
+    const int64_t nc0 = MIN(nbr, MAX(1, nth/nr));
+    const int64_t dbc = (nbr + nc0 - 1)/nc0;
+    const int64_t nc  = (nbr + dbc - 1)/dbc;
+
+    // chunk range for this thread
+    const int64_t nk = nr*nc;
+    const int64_t dk = (nk + nth - 1)/nth;
+    const int64_t k0 = dk*ith;
+    const int64_t k1 = MIN(k0 + dk, nk);
+
+    float * src0_f32 = (float *) params->wdata + (ne00 + CACHE_LINE_SIZE_F32) * ith;
+
+    // row and chunk of k0, the indices are then advanced with the chunks
+    int64_t ir = k0/nc;
+    int64_t ic = k0%nc;
+
+    int64_t i03 = ir/(ne02*ne01);
+    int64_t i02 = (ir - i03*ne02*ne01)/ne01;
+    int64_t i01 = (ir - i03*ne02*ne01 - i02*ne01);
+
+    for (int64_t k = k0; k < k1; k++) {
+        const int64_t b0 = ic*dbc;
+        const int64_t b1 = MIN(b0 + dbc, nbr);
+
+        const char * src0_ptr = (const char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03 + b0*qk*nb00;
+              char * dst_ptr  = (char *) dst->data + (ir*nbr + b0)*bs;
+
+        const int64_t n = (b1 - b0)*qk;
+
+        switch (src0->type) {
+            case GGML_TYPE_F32:
+                {
+                    quantize_row_q((const float *) src0_ptr, dst_ptr, n);
+                } break;
+            case GGML_TYPE_F16:
+                {
+                    ggml_cpu_fp16_to_fp32((const ggml_fp16_t *) src0_ptr, src0_f32, n);
+                    quantize_row_q(src0_f32, dst_ptr, n);
+                } break;
+            case GGML_TYPE_BF16:
+                {
+                    ggml_cpu_bf16_to_fp32((const ggml_bf16_t *) src0_ptr, src0_f32, n);
+                    quantize_row_q(src0_f32, dst_ptr, n);
+                } break;
+            default:
+                GGML_ABORT("fatal error");
+        }
+
+        if (++ic == nc) {
+            ic = 0;
+            ir++;
+            if (++i01 == ne01) {
+                i01 = 0;
+                if (++i02 == ne02) {
+                    i02 = 0;
+                    i03++;
+                }
+            }
+        }
+    }
+}
+
 // A simplified version of ggml_compute_forward_dup that doesn't do float upcasting, and just plain old memcpy.
 static void ggml_compute_forward_dup_bytes(
         const ggml_compute_params * params,
@@ -1178,6 +1267,13 @@ void ggml_compute_forward_dup(
         return;
     }
 
+    if ((src0->type == GGML_TYPE_F32 || src0->type == GGML_TYPE_F16 || src0->type == GGML_TYPE_BF16) &&
+        ggml_is_quantized(dst->type) && ggml_get_type_traits_cpu(dst->type)->from_float && ggml_is_contiguous(dst) &&
+        src0->nb[0] == ggml_type_size(src0->type) && src0->ne[0] % ggml_blck_size(dst->type) == 0) {
+        ggml_compute_forward_dup_to_q(params, dst);
+        return;
+    }
+
     switch (src0->type) {
         case GGML_TYPE_F16:
             {
@@ -3083,6 +3179,67 @@ void ggml_compute_forward_leaky_relu(
     }
 }
 
+// ggml_compute_forward_silu_mul
+
+// fused UNARY(SILU) + MUL, dst = silu(src0)*src1 for contiguous tensors of the same shape
+static void ggml_compute_forward_silu_mul_f32(
+        const ggml_compute_params * params,
+        ggml_tensor * dst) {
+
+    const ggml_tensor * silu = dst->src[0];
+    const ggml_tensor * src0 = silu->src[0];
+    const ggml_tensor * src1 = dst->src[1];
+
+    GGML_ASSERT(silu->op == GGML_OP_UNARY && ggml_get_unary_op(silu) == GGML_UNARY_OP_SILU);
+    GGML_ASSERT(ggml_are_same_shape(src0, dst) && ggml_are_same_shape(src1, dst));
+    GGML_ASSERT(ggml_is_contiguous(src0) && ggml_is_contiguous(src1) && ggml_is_contiguous(dst));
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    const int64_t n = ggml_nelements(dst);
+
+    // the elements are split in blocks, so that a single row (token generation) is also split across the threads
+    const int64_t bs = 64;
+    const int64_t nb = (n + bs - 1)/bs;
+
+    // blocks per thread
+    const int64_t db = (nb + nth - 1)/nth;
+
+    // element range for this thread
+    const int64_t i0 = MIN(db*ith*bs, n);
+    const int64_t i1 = MIN(i0 + db*bs, n);
+
+    if (i0 >= i1) {
+        return;
+    }
+
+    float       * y = (float       *) dst->data  + i0;
+    const float * x = (const float *) src0->data + i0;
+    const float * g = (const float *) src1->data + i0;
+
+    ggml_vec_silu_f32(i1 - i0, y, x);
+    ggml_vec_mul_f32 (i1 - i0, y, y, g);
+}
+
+void ggml_compute_forward_silu_mul(
+        const ggml_compute_params * params,
+        ggml_tensor * dst) {
+
+    const ggml_tensor * src0 = dst->src[0]->src[0];
+
+    switch (src0->type) {
+        case GGML_TYPE_F32:
+            {
+                ggml_compute_forward_silu_mul_f32(params, dst);
+            } break;
+        default:
+            {
+                GGML_ABORT("fatal error");
+            }
+    }
+}
+
 // ggml_compute_forward_silu_back
 
 static void ggml_compute_forward_silu_back_f32(
@@ -3333,6 +3490,90 @@ void ggml_compute_forward_rms_norm(
     }
 }
 
+// ggml_compute_forward_rms_norm_mul
+
+// fused RMS_NORM + MUL, dst = rms_norm(src0)*src1 with src1 broadcast over the rows
+// if from_float is not NULL, the rows of dst are also converted with it into wdata, with a stride of nbw1 bytes
+static void ggml_compute_forward_rms_norm_mul_f32(
+        const ggml_compute_params * params,
+        ggml_tensor * dst,
+        ggml_from_float_t from_float,
+        void * wdata,
+        size_t nbw1) {
+
+    const ggml_tensor * norm = dst->src[0];
+    const ggml_tensor * src0 = norm->src[0];
+    const ggml_tensor * src1 = dst->src[1];
+
+    GGML_ASSERT(norm->op == GGML_OP_RMS_NORM);
+    GGML_ASSERT(ggml_are_same_shape(src0, dst));
+    GGML_ASSERT(ggml_can_repeat(src1, dst) && src1->ne[0] == dst->ne[0]);
+
+    GGML_ASSERT(src0->nb[0] == sizeof(float));
+    GGML_ASSERT(src1->nb[0] == sizeof(float));
+    GGML_ASSERT( dst->nb[0] == sizeof(float));
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    GGML_TENSOR_BINARY_OP_LOCALS
+
+    float eps;
+    memcpy(&eps, norm->op_params, sizeof(float));
+
+    GGML_ASSERT(eps >= 0.0f);
+
+    for (int64_t i03 = 0; i03 < ne03; i03++) {
+        for (int64_t i02 = 0; i02 < ne02; i02++) {
+            for (int64_t i01 = ith; i01 < ne01; i01 += nth) {
+                const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+                const float * w = (float *) ((char *) src1->data + (i01%ne11)*nb11 + (i02%ne12)*nb12 + (i03%ne13)*nb13);
+
+                ggml_float sum = 0.0;
+                for (int64_t i00 = 0; i00 < ne00; i00++) {
+                    sum += (ggml_float)(x[i00] * x[i00]);
+                }
+
+                const float mean = sum/ne00;
+
+                float * y = (float *) ((char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3);
+
+                memcpy(y, x, ne00 * sizeof(float));
+
+                const float scale = 1.0f/sqrtf(mean + eps);
+
+                ggml_vec_scale_f32(ne00, y, scale);
+                ggml_vec_mul_f32(ne00, y, y, w);
+
+                if (from_float) {
+                    from_float(y, (char *) wdata + ((i03*ne02 + i02)*ne01 + i01)*nbw1, ne00);
+                }
+            }
+        }
+    }
+}
+
+void ggml_compute_forward_rms_norm_mul(
+        const ggml_compute_params * params,
+        ggml_tensor * dst,
+        ggml_from_float_t from_float,
+        void * wdata,
+        size_t nbw1) {
+
+    const ggml_tensor * src0 = dst->src[0]->src[0];
+
+    switch (src0->type) {
+        case GGML_TYPE_F32:
+            {
+                ggml_compute_forward_rms_norm_mul_f32(params, dst, from_float, wdata, nbw1);
+            } break;
+        default:
+            {
+                GGML_ABORT("fatal error");
+            }
+    }
+}
+
 static void ggml_compute_forward_rms_norm_back_f32(
         const ggml_compute_params * params,
         ggml_tensor * dst) {
@@ -7012,6 +7253,41 @@ void ggml_compute_forward_argsort(
 
 // ggml_compute_forward_flash_attn_ext
 
+// masked KV rows have a mask value of -INFINITY
+static const ggml_fp16_t ggml_fa_fp16_neg_inf = 0xFC00;
+
+// the KV rows that are not masked in a row of the mask are in [*kv0, *kv1)
+static void ggml_fa_kv_range(const ggml_fp16_t * mp, int64_t n_kv, int64_t * kv0, int64_t * kv1) {
+    const uint64_t neg_inf4 = 0x0001000100010001ull*ggml_fa_fp16_neg_inf;
+
+    int64_t i0 = 0;
+    for (; i0 + 4 <= n_kv; i0 += 4) {
+        uint64_t w;
+        memcpy(&w, mp + i0, sizeof(w));
+        if (w != neg_inf4) {
+            break;
+        }
+    }
+    while (i0 < n_kv && mp[i0] == ggml_fa_fp16_neg_inf) {
+        ++i0;
+    }
+
+    int64_t i1 = n_kv;
+    for (; i1 - 4 >= i0; i1 -= 4) {
+        uint64_t w;
+        memcpy(&w, mp + i1 - 4, sizeof(w));
+        if (w != neg_inf4) {
+            break;
+        }
+    }
+    while (i1 > i0 && mp[i1 - 1] == ggml_fa_fp16_neg_inf) {
+        --i1;
+    }
+
+    *kv0 = i0;
+    *kv1 = i1;
+}
+
 static void ggml_compute_forward_flash_attn_ext_f16(
         const ggml_compute_params * params,
         const ggml_tensor * q,
@@ -7068,12 +7344,18 @@ static void ggml_compute_forward_flash_attn_ext_f16(
     // total rows in q
     const int nr = neq1*neq2*neq3;
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
+    // split the KV rows in chunks if there are not enough q rows (flash decoding)
+    const int64_t nc = ggml_fa_kv_chunks(nr, nek1, nth);
 
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    // total (row, chunk) pairs
+    const int nw = nr*nc;
+
+    // pairs per thread
+    const int dw = (nw + nth - 1)/nth;
+
+    // pair range for this thread
+    const int iw0 = dw*ith;
+    const int iw1 = MIN(iw0 + dw, nw);
 
     float scale         = 1.0f;
     float max_bias      = 0.0f;
@@ -7101,13 +7383,38 @@ static void ggml_compute_forward_flash_attn_ext_f16(
     GGML_ASSERT((                            q_to_vec_dot) && "fattn: unsupported K-type");
     GGML_ASSERT((v->type == GGML_TYPE_F32 || v_to_float  ) && "fattn: unsupported V-type");
 
-    // loop over n_batch and n_head
-    for (int ir = ir0; ir < ir1; ++ir) {
+    // partial results of the chunks: VKQ, S and M
+    float * partials = (float *) params->wdata + nth*(1*DK + 2*DV + CACHE_LINE_SIZE_F32);
+
+    // KV rows that are not masked for the q row iq1_kv
+    int64_t kv0 = 0;
+    int64_t kv1 = nek1;
+    int     iq1_kv = -1;
+
+    // loop over n_batch, n_head and the KV chunks
+    for (int iw = iw0; iw < iw1; ++iw) {
+        const int ir = iw/nc;
+
         // q indices
         const int iq3 = ir/(neq2*neq1);
         const int iq2 = (ir - iq3*neq2*neq1)/neq1;
         const int iq1 = (ir - iq3*neq2*neq1 - iq2*neq1);
 
+        const ggml_fp16_t * mp = mask ? (ggml_fp16_t *)((char *) mask->data + iq1*mask->nb[1]) : NULL;
+
+        // the masked KV rows at the start and the end (e.g. causal or sliding window) are not visited
+        if (mp && iq1 != iq1_kv) {
+            ggml_fa_kv_range(mp, nek1, &kv0, &kv1);
+            iq1_kv = iq1;
+        }
+
+        // KV rows per chunk
+        const int64_t dc = (kv1 - kv0 + nc - 1)/nc;
+
+        // KV chunk
+        const int64_t ic0 = MIN(kv0 + (iw - ir*nc)*dc, kv1);
+        const int64_t ic1 = MIN(ic0 + dc, kv1);
+
         const uint32_t h = iq2; // head index
         const float slope = (max_bias > 0.0f) ? h < n_head_log2 ? powf(m0, h + 1) : powf(m1, 2*(h - n_head_log2) + 1) : 1.0f;
 
@@ -7125,8 +7432,6 @@ static void ggml_compute_forward_flash_attn_ext_f16(
             memset(VKQ32, 0, DV*sizeof(float));
         }
 
-        const ggml_fp16_t * mp = mask ? (ggml_fp16_t *)((char *) mask->data + iq1*mask->nb[1]) : NULL;
-
         // k indices
         const int ik3 = iq3 / rk3;
         const int ik2 = iq2 / rk2;
@@ -7141,7 +7446,7 @@ static void ggml_compute_forward_flash_attn_ext_f16(
         // online softmax / attention
         // loop over n_kv and n_head_kv
         // ref: https://arxiv.org/pdf/2112.05682.pdf
-        for (int64_t ic = 0; ic < nek1; ++ic) {
+        for (int64_t ic = ic0; ic < ic1; ++ic) {
             const float mv = mp ? slope*GGML_FP16_TO_FP32(mp[ic]) : 0.0f;
             if (mv == -INFINITY) {
                 continue;
@@ -7214,6 +7519,16 @@ static void ggml_compute_forward_flash_attn_ext_f16(
             }
         }
 
+        if (nc > 1) {
+            float * part = partials + iw*(DV + 2);
+
+            memcpy(part, VKQ32, DV*sizeof(float));
+            part[DV + 0] = S;
+            part[DV + 1] = M;
+
+            continue;
+        }
+
         // V /= S
         const float S_inv = 1.0f/S;
         ggml_vec_scale_f32(DV, VKQ32, S_inv);
@@ -7229,6 +7544,494 @@ static void ggml_compute_forward_flash_attn_ext_f16(
         // permute(0, 2, 1, 3)
         memcpy((char *) dst->data + (i3*ne2*ne1 + i2 + i1*ne1)*nb1, VKQ32, nb1);
     }
+
+    if (nc == 1) {
+        return;
+    }
+
+    ggml_barrier(params->threadpool);
+
+    // reduce the chunks, parallelize by q rows
+
+    // rows per thread
+    const int dr = (nr + nth - 1)/nth;
+
+    // row range for this thread
+    const int ir0 = dr*ith;
+    const int ir1 = MIN(ir0 + dr, nr);
+
+    float * VKQ32 = (float *) params->wdata + ith*(1*DK + 2*DV + CACHE_LINE_SIZE_F32);
+
+    for (int ir = ir0; ir < ir1; ++ir) {
+        const float * part = partials + ir*nc*(DV + 2);
+
+        float M = -INFINITY;
+        for (int64_t c = 0; c < nc; ++c) {
+            M = MAX(M, part[c*(DV + 2) + DV + 1]);
+        }
+
+        float S = 0.0f;
+        memset(VKQ32, 0, DV*sizeof(float));
+
+        for (int64_t c = 0; c < nc; ++c) {
+            const float Sc = part[c*(DV + 2) + DV + 0];
+            const float Mc = part[c*(DV + 2) + DV + 1];
+
+            if (Mc == -INFINITY) {
+                // all the KV rows of the chunk are masked
+                continue;
+            }
+
+            const float ms = expf(Mc - M);
+
+            ggml_vec_mad_f32(DV, VKQ32, part + c*(DV + 2), ms);
+            S += Sc*ms;
+        }
+
+        // V /= S
+        const float S_inv = 1.0f/S;
+        ggml_vec_scale_f32(DV, VKQ32, S_inv);
+
+        // q indices
+        const int iq3 = ir/(neq2*neq1);
+        const int iq2 = (ir - iq3*neq2*neq1)/neq1;
+        const int iq1 = (ir - iq3*neq2*neq1 - iq2*neq1);
+
+        // permute(0, 2, 1, 3)
+        memcpy((char *) dst->data + (iq3*ne2*ne1 + iq2 + iq1*ne1)*nb1, VKQ32, nb1);
+    }
+}
+
+// tiled flash attention
+//
+// a tile of GGML_FA_TILE_Q query rows of one head is processed against tiles of GGML_FA_TILE_KV rows of K/V:
+//   - the K/V rows of a tile are converted to F32 once and reused by all the queries of the tile
+//   - Q is stored transposed, the scores are computed as K*Q^T: both K*Q^T and P*V are then sums of
+//     outer products of a broadcast scalar with contiguous rows, without horizontal reductions
+//   - the online softmax is applied to the [KV][Q] score tile, vectorized over the queries
+// the threads are partitioned over (batch, head, query tile)
+
+#if defined(__AVX512F__) || (defined(__ARM_NEON) && defined(__aarch64__))
+#define GGML_FA_TILE_RM 8 // 32 vector registers
+#else
+#define GGML_FA_TILE_RM 4
+#endif
+
+#if defined(GGML_SIMD) && !defined(__ARM_FEATURE_SVE)
+#define GGML_FA_TILE_EPR GGML_F32_EPR
+#else
+#define GGML_FA_TILE_EPR 4
+#endif
+
+// c[i][j] += sum_l a[i*lda + l*lka]*b[l*ldb + j], for i < RM, j < NV*GGML_FA_TILE_EPR and l < k
+template <int RM, int NV>
+static inline void ggml_fa_tile_mad_kernel(
+        int64_t k,
+        const float * GGML_RESTRICT a, int64_t lda, int64_t lka,
+        const float * GGML_RESTRICT b, int64_t ldb,
+              float * GGML_RESTRICT c, int64_t ldc) {
+#if defined(GGML_SIMD) && !defined(__ARM_FEATURE_SVE)
+    GGML_F32_VEC acc[RM][NV];
+
+    for (int i = 0; i < RM; ++i) {
+        for (int j = 0; j < NV; ++j) {
+            acc[i][j] = GGML_F32_VEC_LOAD(c + i*ldc + j*GGML_F32_EPR);
+        }
+    }
+
+    for (int64_t l = 0; l < k; ++l) {
+        GGML_F32_VEC bv[NV];
+        for (int j = 0; j < NV; ++j) {
+            bv[j] = GGML_F32_VEC_LOAD(b + l*ldb + j*GGML_F32_EPR);
+        }
+        for (int i = 0; i < RM; ++i) {
+            const GGML_F32_VEC av = GGML_F32_VEC_SET1(a[i*lda + l*lka]);
+            for (int j = 0; j < NV; ++j) {
+                acc[i][j] = GGML_F32_VEC_FMA(acc[i][j], bv[j], av);
+            }
+        }
+    }
+
+    for (int i = 0; i < RM; ++i) {
+        for (int j = 0; j < NV; ++j) {
+            GGML_F32_VEC_STORE(c + i*ldc + j*GGML_F32_EPR, acc[i][j]);
+        }
+    }
+#else
+    for (int i = 0; i < RM; ++i) {
+        for (int64_t l = 0; l < k; ++l) {
+            const float av = a[i*lda + l*lka];
+            for (int j = 0; j < NV*GGML_FA_TILE_EPR; ++j) {
+                c[i*ldc + j] += av*b[l*ldb + j];
+            }
+        }
+    }
+#endif
+}
+
+template <int NV>
+static void ggml_fa_tile_mad_cols(
+        int64_t m, int64_t k,
+        const float * GGML_RESTRICT a, int64_t lda, int64_t lka,
+        const float * GGML_RESTRICT b, int64_t ldb,
+              float * GGML_RESTRICT c, int64_t ldc) {
+    int64_t i = 0;
+    for (; i + GGML_FA_TILE_RM <= m; i += GGML_FA_TILE_RM) {
+        ggml_fa_tile_mad_kernel<GGML_FA_TILE_RM, NV>(k, a + i*lda, lda, lka, b, ldb, c + i*ldc, ldc);
+    }
+    for (; i < m; ++i) {
+        ggml_fa_tile_mad_kernel<1, NV>(k, a + i*lda, lda, lka, b, ldb, c + i*ldc, ldc);
+    }
+}
+
+// c[m][n] += a[m][k]*b[k][n], the element (i, l) of a is a[i*lda + l*lka]
+static void ggml_fa_tile_mad(
+        int64_t m, int64_t n, int64_t k,
+        const float * GGML_RESTRICT a, int64_t lda, int64_t lka,
+        const float * GGML_RESTRICT b, int64_t ldb,
+              float * GGML_RESTRICT c, int64_t ldc) {
+    int64_t j = 0;
+    for (; j + 2*GGML_FA_TILE_EPR <= n; j += 2*GGML_FA_TILE_EPR) {
+        ggml_fa_tile_mad_cols<2>(m, k, a, lda, lka, b + j, ldb, c + j, ldc);
+    }
+    for (; j + GGML_FA_TILE_EPR <= n; j += GGML_FA_TILE_EPR) {
+        ggml_fa_tile_mad_cols<1>(m, k, a, lda, lka, b + j, ldb, c + j, ldc);
+    }
+    for (; j < n; ++j) {
+        for (int64_t i = 0; i < m; ++i) {
+            float sum = 0.0f;
+            for (int64_t l = 0; l < k; ++l) {
+                sum += a[i*lda + l*lka]*b[l*ldb + j];
+            }
+            c[i*ldc + j] += sum;
+        }
+    }
+}
+
+// convert n rows of K/V to F32, returns the rows and their stride (in floats)
+static const float * ggml_fa_tile_to_float(
+        const ggml_tensor * t, const char * data, int64_t n, ggml_to_float_t to_float, float * dst, int64_t * ld) {
+    const int64_t D = t->ne[0];
+
+    switch (t->type) {
+        case GGML_TYPE_F32:
+            {
+                *ld = t->nb[1]/sizeof(float);
+                return (const float *) data;
+            }
+        case GGML_TYPE_F16:
+            {
+                for (int64_t j = 0; j < n; ++j) {
+                    ggml_cpu_fp16_to_fp32((const ggml_fp16_t *) (data + j*t->nb[1]), dst + j*D, D);
+                }
+            } break;
+        case GGML_TYPE_BF16:
+            {
+                for (int64_t j = 0; j < n; ++j) {
+                    ggml_cpu_bf16_to_fp32((const ggml_bf16_t *) (data + j*t->nb[1]), dst + j*D, D);
+                }
+            } break;
+        default:
+            {
+                for (int64_t j = 0; j < n; ++j) {
+                    to_float(data + j*t->nb[1], dst + j*D, D);
+                }
+            } break;
+    }
+
+    *ld = D;
+    return dst;
+}
+
+// mask of a (query tile, KV tile) pair
+enum ggml_fa_kv_tile {
+    GGML_FA_KV_TILE_MASKED, // all the values are -INFINITY: the KV tile is skipped
+    GGML_FA_KV_TILE_ZERO,   // all the values are 0: the mask is not applied
+    GGML_FA_KV_TILE_MIXED,
+};
+
+static ggml_fa_kv_tile ggml_fa_kv_tile_type(const ggml_tensor * mask, int64_t iq1, int64_t nq, int64_t ic, int64_t nkv) {
+    bool masked = true;
+    bool zero   = true;
+
+    for (int64_t i = 0; i < nq && (masked || zero); ++i) {
+        const ggml_fp16_t * mp = (const ggml_fp16_t *) ((const char *) mask->data + (iq1 + i)*mask->nb[1]) + ic;
+
+        for (int64_t j = 0; j < nkv; ++j) {
+            masked = masked && mp[j] == ggml_fa_fp16_neg_inf;
+            zero   = zero   && (mp[j] & 0x7FFF) == 0;
+        }
+    }
+
+    return masked ? GGML_FA_KV_TILE_MASKED : zero ? GGML_FA_KV_TILE_ZERO : GGML_FA_KV_TILE_MIXED;
+}
+
+static void ggml_compute_forward_flash_attn_ext_f16_tiled(
+        const ggml_compute_params * params,
+        const ggml_tensor * q,
+        const ggml_tensor * k,
+        const ggml_tensor * v,
+        const ggml_tensor * mask,
+        ggml_tensor * dst) {
+
+    GGML_TENSOR_LOCALS(int64_t, neq, q,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbq, q,   nb)
+    GGML_TENSOR_LOCALS(int64_t, nek, k,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbk, k,   nb)
+    GGML_TENSOR_LOCALS(int64_t, nev, v,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbv, v,   nb)
+    GGML_TENSOR_LOCALS(int64_t, ne,  dst, ne)
+    GGML_TENSOR_LOCALS(size_t,  nb,  dst, nb)
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    const int64_t DK = nek0;
+    const int64_t DV = nev0;
+    const int64_t N  = neq1;
+
+    const int64_t TQ  = GGML_FA_TILE_Q;
+    const int64_t TKV = GGML_FA_TILE_KV;
+
+    GGML_ASSERT(ne0 == DV);
+    GGML_ASSERT(ne2 == N);
+
+    // input tensor rows must be contiguous
+    GGML_ASSERT(nbq0 == ggml_type_size(q->type));
+    GGML_ASSERT(nbk0 == ggml_type_size(k->type));
+    GGML_ASSERT(nbv0 == ggml_type_size(v->type));
+
+    GGML_ASSERT(neq0 == DK);
+    GGML_ASSERT(nek0 == DK);
+    GGML_ASSERT(nev0 == DV);
+
+    // dst cannot be transposed or permuted
+    GGML_ASSERT(nb0 == sizeof(float));
+    GGML_ASSERT(nb0 <= nb1);
+    GGML_ASSERT(nb1 <= nb2);
+    GGML_ASSERT(nb2 <= nb3);
+
+    // broadcast factors
+    const int64_t rk2 = neq2/nek2;
+    const int64_t rk3 = neq3/nek3;
+
+    const int64_t rv2 = neq2/nev2;
+    const int64_t rv3 = neq3/nev3;
+
+    // parallelize by query tiles
+    const int64_t nqt = (N + TQ - 1)/TQ;
+
+    // total tiles
+    const int64_t nt = nqt*neq2*neq3;
+
+    // tiles per thread
+    const int64_t dt = (nt + nth - 1)/nth;
+
+    // tile range for this thread
+    const int64_t it0 = dt*ith;
+    const int64_t it1 = MIN(it0 + dt, nt);
+
+    float scale         = 1.0f;
+    float max_bias      = 0.0f;
+    float logit_softcap = 0.0f;
+
+    memcpy(&scale,         (float *) dst->op_params + 0, sizeof(float));
+    memcpy(&max_bias,      (float *) dst->op_params + 1, sizeof(float));
+    memcpy(&logit_softcap, (float *) dst->op_params + 2, sizeof(float));
+
+    if (logit_softcap != 0) {
+        scale /= logit_softcap;
+    }
+
+    const uint32_t n_head      = neq2;
+    const uint32_t n_head_log2 = 1u << (uint32_t) floor(log2(n_head));
+
+    const float m0 = powf(2.0f, -(max_bias       ) / n_head_log2);
+    const float m1 = powf(2.0f, -(max_bias / 2.0f) / n_head_log2);
+
+    ggml_to_float_t const k_to_float = ggml_get_type_traits(k->type)->to_float;
+    ggml_to_float_t const v_to_float = ggml_get_type_traits(v->type)->to_float;
+
+    GGML_ASSERT((k->type == GGML_TYPE_F32 || k_to_float) && "fattn: unsupported K-type");
+    GGML_ASSERT((v->type == GGML_TYPE_F32 || v_to_float) && "fattn: unsupported V-type");
+
+    float * QT  = (float *) params->wdata + ith*(TQ*(DK + DV) + TKV*(DK + DV + TQ) + CACHE_LINE_SIZE_F32); // [DK][TQ] Q^T
+    float * K32 = QT  + DK*TQ;  // [TKV][DK] K tile
+    float * V32 = K32 + TKV*DK; // [TKV][DV] V tile
+    float * KQT = V32 + TKV*DV; // [TKV][TQ] K*Q^T, then softmax(Q*K^T)^T
+    float * VKQ = KQT + TKV*TQ; // [TQ][DV]  FP32 VKQ accumulator
+
+    float S [GGML_FA_TILE_Q]; // sums
+    float M [GGML_FA_TILE_Q]; // maximum KQ values
+    float Mt[GGML_FA_TILE_Q]; // maximum KQ values of the KV tile
+    float St[GGML_FA_TILE_Q]; // sums of the KV tile
+
+    const ggml_fp16_t * mp[GGML_FA_TILE_Q];
+
+    // KV tiles
+    const int64_t nkt = (nek1 + TKV - 1)/TKV;
+
+    // mask of each (query tile, KV tile) pair, shared by all the heads
+    uint8_t * kv_tiles = (uint8_t *) ((float *) params->wdata + nth*(TQ*(DK + DV) + TKV*(DK + DV + TQ) + CACHE_LINE_SIZE_F32));
+
+    if (mask) {
+        for (int64_t t = ith; t < nqt*nkt; t += nth) {
+            const int64_t iq1 = (t/nkt)*TQ;
+            const int64_t ic  = (t%nkt)*TKV;
+
+            kv_tiles[t] = ggml_fa_kv_tile_type(mask, iq1, MIN(TQ, N - iq1), ic, MIN(TKV, nek1 - ic));
+        }
+
+        ggml_barrier(params->threadpool);
+    }
+
+    for (int64_t it = it0; it < it1; ++it) {
+        // q indices
+        const int64_t iq3 = it/(neq2*nqt);
+        const int64_t iq2 = (it - iq3*neq2*nqt)/nqt;
+        const int64_t iq1 = (it - iq3*neq2*nqt - iq2*nqt)*TQ;
+
+        // queries in this tile
+        const int64_t nq = MIN(TQ, N - iq1);
+
+        const uint32_t h = iq2; // head index
+        const float slope = (max_bias > 0.0f) ? h < n_head_log2 ? powf(m0, h + 1) : powf(m1, 2*(h - n_head_log2) + 1) : 1.0f;
+
+        // k indices
+        const int64_t ik3 = iq3 / rk3;
+        const int64_t ik2 = iq2 / rk2;
+
+        // v indices
+        const int64_t iv3 = iq3 / rv3;
+        const int64_t iv2 = iq2 / rv2;
+
+        // the columns of the missing queries are zero
+        if (nq < TQ) {
+            memset(QT, 0, DK*TQ*sizeof(float));
+        }
+
+        for (int64_t i = 0; i < nq; ++i) {
+            const float * pq = (const float *) ((char *) q->data + ((iq1 + i)*nbq1 + iq2*nbq2 + iq3*nbq3));
+            for (int64_t d = 0; d < DK; ++d) {
+                QT[d*TQ + i] = pq[d];
+            }
+
+            mp[i] = mask ? (ggml_fp16_t *)((char *) mask->data + (iq1 + i)*mask->nb[1]) : NULL;
+        }
+
+        for (int64_t i = 0; i < TQ; ++i) {
+            S[i] = 0.0f;
+            M[i] = -INFINITY;
+        }
+
+        memset(VKQ, 0, nq*DV*sizeof(float));
+
+        // online softmax / attention, one KV tile at a time
+        for (int64_t ic = 0; ic < nek1; ic += TKV) {
+            const int64_t nkv = MIN(TKV, nek1 - ic);
+
+            const ggml_fa_kv_tile kv_tile = mask ? (ggml_fa_kv_tile) kv_tiles[(iq1/TQ)*nkt + ic/TKV] : GGML_FA_KV_TILE_ZERO;
+
+            if (kv_tile == GGML_FA_KV_TILE_MASKED) {
+                continue;
+            }
+
+            int64_t ldk;
+            const float * kt = ggml_fa_tile_to_float(k, (const char *) k->data + (ic*nbk1 + ik2*nbk2 + ik3*nbk3), nkv, k_to_float, K32, &ldk);
+
+            // KQ^T = K*Q^T
+            memset(KQT, 0, nkv*TQ*sizeof(float));
+            ggml_fa_tile_mad(nkv, TQ, DK, kt, ldk, 1, QT, TQ, KQT, TQ);
+
+            ggml_vec_scale_f32(nkv*TQ, KQT, scale); // scale KQ values
+
+            if (logit_softcap != 0.0f) {
+                for (int64_t j = 0; j < nkv*TQ; ++j) {
+                    KQT[j] = logit_softcap*tanhf(KQT[j]);
+                }
+            }
+
+            if (kv_tile == GGML_FA_KV_TILE_MIXED) {
+                for (int64_t i = 0; i < nq; ++i) {
+                    for (int64_t j = 0; j < nkv; ++j) {
+                        KQT[j*TQ + i] += slope*GGML_FP16_TO_FP32(mp[i][ic + j]); // apply mask
+                    }
+                }
+            }
+
+            for (int64_t i = 0; i < TQ; ++i) {
+                Mt[i] = -INFINITY;
+                St[i] = 0.0f;
+            }
+
+            for (int64_t j = 0; j < nkv; ++j) {
+                const float * s = KQT + j*TQ;
+                for (int64_t i = 0; i < TQ; ++i) {
+                    Mt[i] = s[i] > Mt[i] ? s[i] : Mt[i];
+                }
+            }
+
+            for (int64_t i = 0; i < TQ; ++i) {
+                const float Mold = M[i];
+
+                M[i] = MAX(Mold, Mt[i]);
+
+                // upon new higher max val, scale VKQ and KQ sum with this value
+                // the new max of a query that is masked so far is still -INFINITY
+                const float ms = M[i] == -INFINITY ? 1.0f : expf(Mold - M[i]);
+
+                if (ms != 1.0f && i < nq) {
+                    ggml_vec_scale_f32(DV, VKQ + i*DV, ms);
+                }
+
+                S[i] *= ms;
+
+                // subtracted from the KQ values, the masked values stay at -INFINITY
+                Mt[i] = M[i] == -INFINITY ? 0.0f : M[i];
+            }
+
+            // KQ^T = expf(KQ^T - M)
+            for (int64_t j = 0; j < nkv; ++j) {
+                float * s = KQT + j*TQ;
+                for (int64_t i = 0; i < TQ; ++i) {
+                    s[i] -= Mt[i];
+                }
+            }
+
+            ggml_vec_soft_max_f32(nkv*TQ, KQT, KQT, 0.0f);
+
+            for (int64_t j = 0; j < nkv; ++j) {
+                const float * s = KQT + j*TQ;
+                for (int64_t i = 0; i < TQ; ++i) {
+                    St[i] += s[i];
+                }
+            }
+
+            for (int64_t i = 0; i < TQ; ++i) {
+                S[i] += St[i];
+            }
+
+            int64_t ldv;
+            const float * vt = ggml_fa_tile_to_float(v, (const char *) v->data + (ic*nbv1 + iv2*nbv2 + iv3*nbv3), nkv, v_to_float, V32, &ldv);
+
+            // VKQ += P*V, with P = (KQ^T)^T
+            ggml_fa_tile_mad(nq, DV, nkv, KQT, 1, TQ, vt, ldv, VKQ, DV);
+        }
+
+        for (int64_t i = 0; i < nq; ++i) {
+            // V /= S
+            const float S_inv = 1.0f/S[i];
+            ggml_vec_scale_f32(DV, VKQ + i*DV, S_inv);
+
+            // dst indices
+            const int64_t i1 = iq1 + i;
+            const int64_t i2 = iq2;
+            const int64_t i3 = iq3;
+
+            // permute(0, 2, 1, 3)
+            memcpy((char *) dst->data + (i3*ne2*ne1 + i2 + i1*ne1)*nb1, VKQ + i*DV, nb1);
+        }
+    }
 }
 
 void ggml_compute_forward_flash_attn_ext(
@@ -7243,7 +8046,11 @@ void ggml_compute_forward_flash_attn_ext(
         case GGML_PREC_F32:
             {
                 // uses F32 accumulators
-                ggml_compute_forward_flash_attn_ext_f16(params, q, k, v, mask, dst);
+                if (q->ne[1] >= GGML_FA_TILE_Q_MIN) {
+                    ggml_compute_forward_flash_attn_ext_f16_tiled(params, q, k, v, mask, dst);
+                } else {
+                    ggml_compute_forward_flash_attn_ext_f16(params, q, k, v, mask, dst);
+                }
             } break;
         default:
             {
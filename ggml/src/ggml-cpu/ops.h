@@ -20,6 +20,38 @@
 
 static const size_t CACHE_LINE_SIZE_F32 = CACHE_LINE_SIZE/sizeof(float);
 
+//
+// flash attention tiles
+//
+// query rows and K/V rows processed together by the tiled flash attention
+// the work size of GGML_OP_FLASH_ATTN_EXT depends on them
+//
+
+#define GGML_FA_TILE_Q  32
+#define GGML_FA_TILE_KV 64
+
+// smaller batches of queries use the row-at-a-time kernel
+#define GGML_FA_TILE_Q_MIN 4
+
+//
+// flash decoding
+//
+// when there are fewer query rows than threads, the KV rows are split in chunks processed by different threads
+// the partial results of the chunks are reduced at the end
+//
+
+#define GGML_FA_KV_CHUNK_MIN 256
+
+static inline int64_t ggml_fa_kv_chunks(int64_t n_rows, int64_t n_kv, int n_threads) {
+    if (n_rows >= n_threads || n_kv < 2*GGML_FA_KV_CHUNK_MIN) {
+        return 1;
+    }
+
+    const int64_t n_chunks = n_kv/GGML_FA_KV_CHUNK_MIN;
+
+    return n_chunks < n_threads ? n_chunks : n_threads;
+}
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -106,6 +138,15 @@ void ggml_compute_forward_cross_entropy_loss(const struct ggml_compute_params *
 void ggml_compute_forward_cross_entropy_loss_back(const struct ggml_compute_params * params, struct ggml_tensor * dst);
 void ggml_compute_forward_opt_step_adamw(const struct ggml_compute_params * params, struct ggml_tensor * dst);
 
+// fused ops, dst is the last node of the chain
+void ggml_compute_forward_rms_norm_mul(
+    const struct ggml_compute_params * params,
+    struct ggml_tensor * dst,
+    ggml_from_float_t from_float,
+    void * wdata,
+    size_t nbw1);
+void ggml_compute_forward_silu_mul(const struct ggml_compute_params * params, struct ggml_tensor * dst);
+
 #ifdef __cplusplus
 }
 #endif
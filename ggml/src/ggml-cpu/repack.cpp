@@ -412,6 +412,94 @@ void ggml_gemv_q4_K_8x8_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs,
     }
 }
 
+void ggml_gemv_q6_K_8x8_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert (n % qk == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(s);
+    UNUSED(bs);
+    UNUSED(vx);
+    UNUSED(vy);
+    UNUSED(nr);
+    UNUSED(nc);
+    UNUSED(nb);
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+    float sumf[8];
+    int sumi;
+
+    const block_q8_K * a_ptr = (const block_q8_K *) vy;
+    for (int x = 0; x < nc / ncols_interleaved; x++) {
+        const block_q6_Kx8 * b_ptr = (const block_q6_Kx8 *) vx + (x * nb);
+
+        for (int j = 0; j < ncols_interleaved; j++) sumf[j] = 0.0;
+        for (int l = 0; l < nb; l++) {
+            for (int k = 0; k < (qk / blocklen); k++) {
+                const int sb = k / 2;
+                for (int j = 0; j < ncols_interleaved; j++) {
+                    const uint8_t * ql = b_ptr[l].ql + (k / 4) * 128 + (k % 2) * 64 + j * blocklen;
+                    const uint8_t * qh = b_ptr[l].qh + (k / 4) * 64  + j * blocklen;
+                    sumi = 0;
+                    for (int i = 0; i < blocklen; ++i) {
+                        const int v = (((ql[i] >> ((k % 4) / 2 * 4)) & 0xF) | (((qh[i] >> ((k % 4) * 2)) & 3) << 4)) - 32;
+                        sumi += v * a_ptr[l].qs[k * blocklen + i];
+                    }
+                    sumf[j] += sumi * b_ptr[l].scales[(sb / 2) * 16 + j * 2 + sb % 2] * GGML_FP16_TO_FP32(b_ptr[l].d[j]) * a_ptr[l].d;
+                }
+            }
+        }
+        for (int j = 0; j < ncols_interleaved; j++) s[x * ncols_interleaved + j] = sumf[j];
+    }
+}
+
+void ggml_gemv_q8_0_8x8_q8_0_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK8_0;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert (n % qk == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(s);
+    UNUSED(bs);
+    UNUSED(vx);
+    UNUSED(vy);
+    UNUSED(nr);
+    UNUSED(nc);
+    UNUSED(nb);
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+    float sumf[8];
+    int sumi;
+
+    const block_q8_0 * a_ptr = (const block_q8_0 *) vy;
+    for (int x = 0; x < nc / ncols_interleaved; x++) {
+        const block_q8_0x8 * b_ptr = (const block_q8_0x8 *) vx + (x * nb);
+
+        for (int j = 0; j < ncols_interleaved; j++) sumf[j] = 0.0;
+        for (int l = 0; l < nb; l++) {
+            for (int j = 0; j < ncols_interleaved; j++) {
+                sumi = 0;
+                for (int k = 0; k < (qk / blocklen); k++) {
+                    for (int i = 0; i < blocklen; ++i) {
+                        sumi += b_ptr[l].qs[k * ncols_interleaved * blocklen + j * blocklen + i] * a_ptr[l].qs[k * blocklen + i];
+                    }
+                }
+                sumf[j] += sumi * GGML_FP16_TO_FP32(b_ptr[l].d[j]) * GGML_FP16_TO_FP32(a_ptr[l].d);
+            }
+        }
+        for (int j = 0; j < ncols_interleaved; j++) s[x * ncols_interleaved + j] = sumf[j];
+    }
+}
+
 void ggml_gemv_iq4_nl_4x4_q8_0_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
     const int qk = QK8_0;
     const int nb = n / qk;
@@ -711,6 +799,112 @@ void ggml_gemm_q4_K_8x8_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs,
     }
 }
 
+void ggml_gemm_q6_K_8x8_q8_K_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert (n % qk == 0);
+    assert (nr % 4 == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(s);
+    UNUSED(bs);
+    UNUSED(vx);
+    UNUSED(vy);
+    UNUSED(nr);
+    UNUSED(nc);
+    UNUSED(nb);
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+    float sumf[4][8];
+    int sumi;
+
+    for (int y = 0; y < nr / 4; y++) {
+        const block_q8_Kx4 * a_ptr = (const block_q8_Kx4 *) vy + (y * nb);
+        for (int x = 0; x < nc / ncols_interleaved; x++) {
+            const block_q6_Kx8 * b_ptr = (const block_q6_Kx8 *) vx + (x * nb);
+            for (int m = 0; m < 4; m++) {
+                for (int j = 0; j < ncols_interleaved; j++) sumf[m][j] = 0.0;
+            }
+            for (int l = 0; l < nb; l++) {
+                for (int k = 0; k < (qk / blocklen); k++) {
+                    const int sb = k / 2;
+                    for (int m = 0; m < 4; m++) {
+                        for (int j = 0; j < ncols_interleaved; j++) {
+                            const uint8_t * ql = b_ptr[l].ql + (k / 4) * 128 + (k % 2) * 64 + j * blocklen;
+                            const uint8_t * qh = b_ptr[l].qh + (k / 4) * 64  + j * blocklen;
+                            sumi = 0;
+                            for (int i = 0; i < blocklen; ++i) {
+                                const int v = (((ql[i] >> ((k % 4) / 2 * 4)) & 0xF) | (((qh[i] >> ((k % 4) * 2)) & 3) << 4)) - 32;
+                                sumi += v * a_ptr[l].qs[k * 4 * blocklen + m * blocklen + i];
+                            }
+                            sumf[m][j] += sumi * b_ptr[l].scales[(sb / 2) * 16 + j * 2 + sb % 2] * GGML_FP16_TO_FP32(b_ptr[l].d[j]) * a_ptr[l].d[m];
+                        }
+                    }
+                }
+            }
+            for (int m = 0; m < 4; m++) {
+                for (int j = 0; j < ncols_interleaved; j++)
+                    s[(y * 4 + m) * bs + x * ncols_interleaved + j] = sumf[m][j];
+            }
+        }
+    }
+}
+
+void ggml_gemm_q8_0_8x8_q8_0_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK8_0;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert (n % qk == 0);
+    assert (nr % 4 == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(s);
+    UNUSED(bs);
+    UNUSED(vx);
+    UNUSED(vy);
+    UNUSED(nr);
+    UNUSED(nc);
+    UNUSED(nb);
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+    float sumf[4][8];
+    int sumi;
+
+    for (int y = 0; y < nr / 4; y++) {
+        const block_q8_0x4 * a_ptr = (const block_q8_0x4 *) vy + (y * nb);
+        for (int x = 0; x < nc / ncols_interleaved; x++) {
+            const block_q8_0x8 * b_ptr = (const block_q8_0x8 *) vx + (x * nb);
+            for (int m = 0; m < 4; m++) {
+                for (int j = 0; j < ncols_interleaved; j++) sumf[m][j] = 0.0;
+            }
+            for (int l = 0; l < nb; l++) {
+                for (int m = 0; m < 4; m++) {
+                    for (int j = 0; j < ncols_interleaved; j++) {
+                        sumi = 0;
+                        for (int k = 0; k < (qk / blocklen); k++) {
+                            for (int i = 0; i < blocklen; ++i) {
+                                sumi += b_ptr[l].qs[k * ncols_interleaved * blocklen + j * blocklen + i] * a_ptr[l].qs[k * 4 * blocklen + m * blocklen + i];
+                            }
+                        }
+                        sumf[m][j] += sumi * GGML_FP16_TO_FP32(b_ptr[l].d[j]) * GGML_FP16_TO_FP32(a_ptr[l].d[m]);
+                    }
+                }
+            }
+            for (int m = 0; m < 4; m++) {
+                for (int j = 0; j < ncols_interleaved; j++)
+                    s[(y * 4 + m) * bs + x * ncols_interleaved + j] = sumf[m][j];
+            }
+        }
+    }
+}
+
 void ggml_gemm_iq4_nl_4x4_q8_0_generic(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
     const int qk = QK8_0;
     const int nb = n / qk;
@@ -975,6 +1169,127 @@ static int repack_q4_K_to_q4_K_8_bl(struct ggml_tensor * t, int interleave_block
     GGML_UNUSED(data_size);
 }
 
+// interleave 8 block_q6_Ks in groups of 8 quants, see block_q6_Kx8 for the layout
+static block_q6_Kx8 make_block_q6_Kx8(block_q6_K * in) {
+    block_q6_Kx8 out;
+    memset(&out, 0, sizeof(out));
+
+    for (int j = 0; j < 8; j++) {
+        out.d[j] = in[j].d;
+
+        for (int sb = 0; sb < QK_K / 16; sb++) {
+            out.scales[(sb / 2) * 16 + j * 2 + sb % 2] = in[j].scales[sb];
+        }
+
+        // unpack the 6-bit quants in the order of the elements
+        uint8_t q[QK_K];
+        for (int n = 0; n < QK_K; n += 128) {
+            const uint8_t * ql = in[j].ql + n / 2;
+            const uint8_t * qh = in[j].qh + n / 4;
+            for (int l = 0; l < 32; ++l) {
+                q[n + l +  0] = (ql[l +  0] & 0xF) | (((qh[l] >> 0) & 3) << 4);
+                q[n + l + 32] = (ql[l + 32] & 0xF) | (((qh[l] >> 2) & 3) << 4);
+                q[n + l + 64] = (ql[l +  0] >>  4) | (((qh[l] >> 4) & 3) << 4);
+                q[n + l + 96] = (ql[l + 32] >>  4) | (((qh[l] >> 6) & 3) << 4);
+            }
+        }
+
+        for (int k = 0; k < QK_K / 8; k++) {
+            uint8_t * ql = out.ql + (k / 4) * 128 + (k % 2) * 64 + j * 8;
+            uint8_t * qh = out.qh + (k / 4) * 64  + j * 8;
+            for (int i = 0; i < 8; i++) {
+                ql[i] |= (q[k * 8 + i] & 0xF) << ((k % 4) / 2 * 4);
+                qh[i] |= (q[k * 8 + i] >> 4) << ((k % 4) * 2);
+            }
+        }
+    }
+
+    return out;
+}
+
+// interleave 8 block_q8_0s in blocks of blck_size_interleave
+static block_q8_0x8 make_block_q8_0x8(block_q8_0 * in, unsigned int blck_size_interleave) {
+    block_q8_0x8 out;
+
+    for (int i = 0; i < 8; i++) {
+        out.d[i] = in[i].d;
+    }
+
+    const int end = QK8_0 * 8 / blck_size_interleave;
+
+    for (int i = 0; i < end; ++i) {
+        int src_id = i % 8;
+        int src_offset = (i / 8) * blck_size_interleave;
+        int dst_offset = i * blck_size_interleave;
+
+        memcpy(&out.qs[dst_offset], &in[src_id].qs[src_offset], blck_size_interleave);
+    }
+
+    return out;
+}
+
+static int repack_q6_K_to_q6_K_8_bl(struct ggml_tensor * t, int interleave_block, const void * GGML_RESTRICT data, size_t data_size) {
+    GGML_ASSERT(t->type == GGML_TYPE_Q6_K);
+    GGML_ASSERT(interleave_block == 8);
+    constexpr int nrows_interleaved = 8;
+
+    block_q6_Kx8 * dst = (block_q6_Kx8*)t->data;
+    const block_q6_K * src = (const block_q6_K*) data;
+    block_q6_K dst_tmp[8];
+    int nrow = ggml_nrows(t);
+    int nblocks = t->ne[0] / QK_K;
+
+    GGML_ASSERT(data_size == nrow * nblocks * sizeof(block_q6_K));
+
+    if (t->ne[1] % nrows_interleaved != 0 || t->ne[0] % 8 != 0) {
+        return -1;
+    }
+
+    for (int b = 0; b < nrow; b += nrows_interleaved) {
+        for (int64_t x = 0; x < nblocks; x++) {
+            for (int i  = 0; i < nrows_interleaved; i++ ) {
+                dst_tmp[i] = src[x + i * nblocks];
+            }
+            *dst++ = make_block_q6_Kx8(dst_tmp);
+        }
+        src += nrows_interleaved * nblocks;
+    }
+    return 0;
+
+    GGML_UNUSED(data_size);
+}
+
+static int repack_q8_0_to_q8_0_8_bl(struct ggml_tensor * t, int interleave_block, const void * GGML_RESTRICT data, size_t data_size) {
+    GGML_ASSERT(t->type == GGML_TYPE_Q8_0);
+    GGML_ASSERT(interleave_block == 8);
+    constexpr int nrows_interleaved = 8;
+
+    block_q8_0x8 * dst = (block_q8_0x8*)t->data;
+    const block_q8_0 * src = (const block_q8_0*) data;
+    block_q8_0 dst_tmp[8];
+    int nrow = ggml_nrows(t);
+    int nblocks = t->ne[0] / QK8_0;
+
+    GGML_ASSERT(data_size == nrow * nblocks * sizeof(block_q8_0));
+
+    if (t->ne[1] % nrows_interleaved != 0 || t->ne[0] % 8 != 0) {
+        return -1;
+    }
+
+    for (int b = 0; b < nrow; b += nrows_interleaved) {
+        for (int64_t x = 0; x < nblocks; x++) {
+            for (int i  = 0; i < nrows_interleaved; i++ ) {
+                dst_tmp[i] = src[x + i * nblocks];
+            }
+            *dst++ = make_block_q8_0x8(dst_tmp, interleave_block);
+        }
+        src += nrows_interleaved * nblocks;
+    }
+    return 0;
+
+    GGML_UNUSED(data_size);
+}
+
 static int repack_q4_0_to_q4_0_8_bl(struct ggml_tensor * t, int interleave_block, const void * GGML_RESTRICT data, size_t data_size) {
     GGML_ASSERT(t->type == GGML_TYPE_Q4_0);
     GGML_ASSERT(interleave_block == 8);
@@ -1095,6 +1410,14 @@ template <> int repack<block_q4_K, 8, 8>(struct ggml_tensor * t, const void * da
     return repack_q4_K_to_q4_K_8_bl(t, 8, data, data_size);
 }
 
+template <> int repack<block_q6_K, 8, 8>(struct ggml_tensor * t, const void * data, size_t data_size) {
+    return repack_q6_K_to_q6_K_8_bl(t, 8, data, data_size);
+}
+
+template <> int repack<block_q8_0, 8, 8>(struct ggml_tensor * t, const void * data, size_t data_size) {
+    return repack_q8_0_to_q8_0_8_bl(t, 8, data, data_size);
+}
+
 template <> int repack<block_iq4_nl, 4, 4>(struct ggml_tensor * t, const void * data, size_t data_size) {
     return repack_iq4_nl_to_iq4_nl_4_bl(t, 4, data, data_size);
 }
@@ -1124,6 +1447,14 @@ template <> void gemv<block_q4_K, 8, 8, GGML_TYPE_Q8_K>(int n, float * s, size_t
     ggml_gemv_q4_K_8x8_q8_K(n, s, bs, vx, vy, nr, nc);
 }
 
+template <> void gemv<block_q6_K, 8, 8, GGML_TYPE_Q8_K>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemv_q6_K_8x8_q8_K(n, s, bs, vx, vy, nr, nc);
+}
+
+template <> void gemv<block_q8_0, 8, 8, GGML_TYPE_Q8_0>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemv_q8_0_8x8_q8_0(n, s, bs, vx, vy, nr, nc);
+}
+
 template <> void gemv<block_iq4_nl, 4, 4, GGML_TYPE_Q8_0>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
     ggml_gemv_iq4_nl_4x4_q8_0(n, s, bs, vx, vy, nr, nc);
 }
@@ -1148,6 +1479,14 @@ template <> void gemm<block_q4_K, 8, 8, GGML_TYPE_Q8_K>(int n, float * s, size_t
     ggml_gemm_q4_K_8x8_q8_K(n, s, bs, vx, vy, nr, nc);
 }
 
+template <> void gemm<block_q6_K, 8, 8, GGML_TYPE_Q8_K>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemm_q6_K_8x8_q8_K(n, s, bs, vx, vy, nr, nc);
+}
+
+template <> void gemm<block_q8_0, 8, 8, GGML_TYPE_Q8_0>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
+    ggml_gemm_q8_0_8x8_q8_0(n, s, bs, vx, vy, nr, nc);
+}
+
 template <> void gemm<block_iq4_nl, 4, 4, GGML_TYPE_Q8_0>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
     ggml_gemm_iq4_nl_4x4_q8_0(n, s, bs, vx, vy, nr, nc);
 }
@@ -1159,7 +1498,7 @@ class tensor_traits_base : public ggml::cpu::tensor_traits {
 
 template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS, ggml_type PARAM_TYPE> class tensor_traits : public tensor_traits_base {
 
-    bool work_size(int /* n_threads */, const struct ggml_tensor * op, size_t & size) override {
+    bool work_size(int n_threads, const struct ggml_tensor * op, size_t & size) override {
         // not realy a GGML_TYPE_Q8_0 but same size.
         switch (op->op) {
             case GGML_OP_MUL_MAT:
@@ -1169,15 +1508,21 @@ template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS, ggml_type PAR
                 }
             case GGML_OP_MUL_MAT_ID:
                 {
-                    size = ggml_row_size(PARAM_TYPE, ggml_nelements(op->src[1]));
-                    size = GGML_PAD(size, sizeof(int64_t)); // + padding for next bloc.
+                    const int64_t ne02   = op->src[0]->ne[2]; // n_as, n_expert
+                    const int64_t ne10   = op->src[1]->ne[0];
+                    const int64_t n_rows = op->src[2]->ne[0]*op->src[2]->ne[1]; // n_expert_used*n_tokens
 
-                    const int64_t ne02 = op->src[0]->ne[2]; // n_as, n_expert
-                    const int64_t ne12 = op->src[1]->ne[2]; // n_tokens
+                    // src1 rows sorted by expert
+                    size = ggml_row_size(PARAM_TYPE, ne10)*n_rows;
+                    size = GGML_PAD(size, sizeof(int64_t)); // + padding for next bloc.
 
                     const size_t sizeof_mmid_row_mapping = sizeof(int64_t);
 
-                    size += sizeof_mmid_row_mapping*ne02*(ne12 + 1);
+                    // expert_offs, chunk_offs, rows
+                    size += 2*(ne02 + 1)*sizeof(int64_t) + sizeof_mmid_row_mapping*n_rows;
+
+                    // 4 rows of src1 per thread, gathered before the conversion
+                    size += n_threads*4*ne10*sizeof(float);
 
                     return true;
                 }
@@ -1229,20 +1574,24 @@ template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS, ggml_type PAR
         GGML_ASSERT(ggml_n_dims(op->src[0]) == 2);
         // GGML_ASSERT(ggml_n_dims(op->src[1]) == 2);
 
+        // src0 is broadcast over the batch dims, all the rows of src1 are processed as one matrix
+        GGML_ASSERT(ggml_is_contiguous(src1));
+        const int64_t nr1 = ne11 * ne12 * ne13;
+
         char *       wdata = static_cast<char *>(params->wdata);
         const size_t nbw1  = ggml_row_size(PARAM_TYPE, ne10);
 
-        assert(params->wsize >= nbw1 * ne11);
+        assert(params->wsize >= nbw1 * nr1);
 
         const ggml_from_float_t from_float = ggml_get_type_traits_cpu(PARAM_TYPE)->from_float;
 
         int64_t i11_processed = 0;
-        for (int64_t i11 = ith * 4; i11 < ne11 - ne11 % 4; i11 += nth * 4) {
+        for (int64_t i11 = ith * 4; i11 < nr1 - nr1 % 4; i11 += nth * 4) {
             ggml_quantize_mat_t<INTER_SIZE, PARAM_TYPE>((float *) ((char *) src1->data + i11 * nb11), (void *) (wdata + i11 * nbw1), 4, ne10);
         }
 
-        i11_processed = ne11 - ne11 % 4;
-        for (int64_t i11 = i11_processed + ith; i11 < ne11; i11 += nth) {
+        i11_processed = nr1 - nr1 % 4;
+        for (int64_t i11 = i11_processed + ith; i11 < nr1; i11 += nth) {
             from_float((float *) ((char *) src1->data + i11 * nb11), (void *) (wdata + i11 * nbw1), ne10);
         }
 
@@ -1259,13 +1608,13 @@ template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS, ggml_type PAR
         }
 
         // If there are more than three rows in src1, use gemm; otherwise, use gemv.
-        if (ne11 > 3) {
+        if (nr1 > 3) {
             gemm<BLOC_TYPE, INTER_SIZE, NB_COLS, PARAM_TYPE>(ne00,
                     (float *) ((char *) dst->data) + src0_start, ne01,
                     (const char *) src0->data + src0_start * nb01,
-                    (const char *) src1_wdata, ne11 - ne11 % 4, src0_end - src0_start);
+                    (const char *) src1_wdata, nr1 - nr1 % 4, src0_end - src0_start);
         }
-        for (int iter = ne11 - ne11 % 4; iter < ne11; iter++) {
+        for (int iter = nr1 - nr1 % 4; iter < nr1; iter++) {
             gemv<BLOC_TYPE, INTER_SIZE, NB_COLS, PARAM_TYPE>(ne00,
                     (float *) ((char *) dst->data + (iter * nb1)) + src0_start, ne01,
                     (const char *) src0->data + src0_start * nb01,
@@ -1307,9 +1656,10 @@ template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS, ggml_type PAR
         const int n_ids = ids->ne[0]; // n_expert_used
         const int n_as  = ne02;       // n_expert
 
+        // rows of src1 used by the experts
+        const int64_t n_rows = n_ids*ids->ne[1];
+
         const size_t nbw1 = ggml_row_size(PARAM_TYPE, ne10);
-        const size_t nbw2 = nbw1*ne11;
-        const size_t nbw3 = nbw2*ne12;
 
         struct mmid_row_mapping {
             int32_t i1;
@@ -1317,33 +1667,30 @@ template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS, ggml_type PAR
         };
 
         GGML_ASSERT(params->wsize >=
-                (GGML_PAD(nbw3, sizeof(int64_t)) +
-                 n_as*(ne12 + 1)*sizeof(mmid_row_mapping))
+                (GGML_PAD(nbw1*n_rows, sizeof(int64_t)) +
+                 2*(n_as + 1)*sizeof(int64_t) +
+                 n_rows*sizeof(mmid_row_mapping) +
+                 nth*4*ne10*sizeof(float))
                 );
 
-        auto * wdata          = (char *)params->wdata;
-        auto * wdata_src1_end = (char *)wdata + GGML_PAD(nbw3, sizeof(int64_t));
-
-        // total of [n_as][ne12 + 1] elemets of type mmid_row_mapping (2*int32_t = int64_t)
-        auto * matrix_row_counts = (int64_t *) (wdata_src1_end);                                        // [n_as]
-        struct mmid_row_mapping * matrix_rows = (struct mmid_row_mapping *) (matrix_row_counts + n_as); // [n_as][ne12]
+        // the rows of src1 sorted by expert, converted to PARAM_TYPE
+        // the groups of 4 rows of an expert are interleaved for gemm, the remaining rows are stored as is for gemv
+        auto * wdata_src1  = (char *) params->wdata;                                                    // [n_rows]
+        auto * expert_offs = (int64_t *) (wdata_src1 + GGML_PAD(nbw1*n_rows, sizeof(int64_t)));         // [n_as + 1]
+        auto * chunk_offs  = expert_offs + n_as + 1;                                                    // [n_as + 1]
+        auto * rows        = (mmid_row_mapping *) (chunk_offs + n_as + 1);                              // [n_rows]
+        auto * wdata_f32   = (float *) (rows + n_rows) + ith*4*ne10;                                    // [4][ne10] per thread
 
-        // src1: float32 => param type
-        for (int64_t i12 = 0; i12 < ne12; ++i12) {
-            for (int64_t i11 = ith; i11 < ne11; i11 += nth) {
-                from_float((float *)((char *) src1->data + i12 * nb12 + i11 * nb11),
-                           (void *)               (wdata + i12 * nbw2 + i11 * nbw1),
-                           ne10);
-            }
-        }
+        // chunks: NB_COLS aligned src0 rows x src1 rows of an expert, the latter are a multiple of 4
+        const int64_t dr0 = 64;
+        const int64_t dr1 = 64;
 
-#define MMID_MATRIX_ROW(row_id, i1) matrix_rows[(row_id) * ne12 + (i1)]
+        static_assert(dr0 % NB_COLS == 0, "chunk not aligned to the repacked rows");
 
         if (ith == 0) {
-            // initialize matrix_row_counts
-            memset(matrix_row_counts, 0, n_as * sizeof(int64_t));
+            // count the rows of each expert
+            memset(expert_offs, 0, (n_as + 1)*sizeof(int64_t));
 
-            // group rows by src0 matrix
             for (int32_t iid1 = 0; iid1 < ids->ne[1]; ++iid1) {
                 for (int32_t id = 0; id < n_ids; ++id) {
                     const int32_t i02 =
@@ -1351,57 +1698,132 @@ template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS, ggml_type PAR
 
                     GGML_ASSERT(i02 >= 0 && i02 < n_as);
 
-                    MMID_MATRIX_ROW(i02, matrix_row_counts[i02]) = { id, iid1 };
-                    matrix_row_counts[i02] += 1;
+                    expert_offs[i02 + 1] += 1;
+                }
+            }
+
+            for (int cur_a = 0; cur_a < n_as; ++cur_a) {
+                expert_offs[cur_a + 1] += expert_offs[cur_a];
+            }
+
+            // counting sort, the rows of an expert stay in the order of the tokens
+            // chunk_offs holds the next free row of each expert meanwhile
+            memcpy(chunk_offs, expert_offs, n_as*sizeof(int64_t));
+
+            for (int32_t iid1 = 0; iid1 < ids->ne[1]; ++iid1) {
+                for (int32_t id = 0; id < n_ids; ++id) {
+                    const int32_t i02 =
+                        *(const int32_t *) ((const char *) ids->data + iid1 * ids->nb[1] + id * ids->nb[0]);
+
+                    rows[chunk_offs[i02]++] = { id, iid1 };
                 }
             }
+
+            chunk_offs[0] = 0;
+            for (int cur_a = 0; cur_a < n_as; ++cur_a) {
+                const int64_t cne1 = expert_offs[cur_a + 1] - expert_offs[cur_a];
+
+                chunk_offs[cur_a + 1] = chunk_offs[cur_a] + ((ne01 + dr0 - 1)/dr0)*((cne1 + dr1 - 1)/dr1);
+            }
+
+            // Every thread starts at ith, so the first unprocessed chunk is nth.
+            ggml_threadpool_chunk_set(params->threadpool, nth);
         }
 
         ggml_barrier(params->threadpool);
 
-        // compute each matrix multiplication in sequence
+        // src1: float32 => param type, in the sorted order
+        int64_t job = 0;
         for (int cur_a = 0; cur_a < n_as; ++cur_a) {
-            const int64_t cne1 = matrix_row_counts[cur_a];
+            const int64_t off  = expert_offs[cur_a];
+            const int64_t cne1 = expert_offs[cur_a + 1] - off;
+            const int64_t n4   = cne1 - cne1 % 4;
+
+            for (int64_t ir1 = 0; ir1 < cne1; ir1 += ir1 < n4 ? 4 : 1, job++) {
+                if (job % nth != ith) {
+                    continue;
+                }
 
-            if (cne1 == 0) {
-                continue;
+                if (ir1 < n4) {
+                    for (int64_t r = 0; r < 4; r++) {
+                        const mmid_row_mapping row_mapping = rows[off + ir1 + r];
+
+                        memcpy(wdata_f32 + r*ne10,
+                               (const char *) src1->data + (row_mapping.i1 % ne11)*nb11 + row_mapping.i2*nb12,
+                               ne10*sizeof(float));
+                    }
+
+                    ggml_quantize_mat_t<INTER_SIZE, PARAM_TYPE>(wdata_f32, wdata_src1 + (off + ir1)*nbw1, 4, ne10);
+                } else {
+                    const mmid_row_mapping row_mapping = rows[off + ir1];
+
+                    from_float((const float *) ((const char *) src1->data + (row_mapping.i1 % ne11)*nb11 + row_mapping.i2*nb12),
+                               wdata_src1 + (off + ir1)*nbw1, ne10);
+                }
             }
+        }
 
-            const auto * src0_cur = (const char *) src0->data + cur_a*nb02;
+        ggml_barrier(params->threadpool);
+
+        // the chunks of all the experts are distributed across the threads
+        const int64_t nchunk  = chunk_offs[n_as];
+        const int64_t nchunk0 = (ne01 + dr0 - 1)/dr0;
 
-            //const int64_t nr0 = ne01; // src0 rows
-            const int64_t nr1 = cne1; // src1 rows
+        float tmp[4*dr0];
 
-            int64_t src0_cur_start = (ith * ne01) / nth;
-            int64_t src0_cur_end   = ((ith + 1) * ne01) / nth;
+        int cur_a = 0;
 
-            src0_cur_start = (src0_cur_start % NB_COLS) ? src0_cur_start + NB_COLS - (src0_cur_start % NB_COLS) : src0_cur_start;
-            src0_cur_end   = (src0_cur_end   % NB_COLS) ? src0_cur_end   + NB_COLS - (src0_cur_end   % NB_COLS) : src0_cur_end;
+        int64_t current_chunk = ith;
 
-            if (src0_cur_start >= src0_cur_end) {
-                return;
+        while (current_chunk < nchunk) {
+            // the chunks of an expert are consecutive, the chunks taken by a thread are increasing
+            while (current_chunk >= chunk_offs[cur_a + 1]) {
+                cur_a++;
             }
 
-            for (int ir1 = 0; ir1 < nr1; ir1++) {
-                struct mmid_row_mapping row_mapping = MMID_MATRIX_ROW(cur_a, ir1);
+            const int64_t off  = expert_offs[cur_a];
+            const int64_t cne1 = expert_offs[cur_a + 1] - off;
+            const int64_t n4   = cne1 - cne1 % 4;
+
+            const int64_t ith0 = (current_chunk - chunk_offs[cur_a]) % nchunk0;
+            const int64_t ith1 = (current_chunk - chunk_offs[cur_a]) / nchunk0;
+
+            const int64_t ir0_start = dr0*ith0;
+            const int64_t ir0_end   = std::min(ir0_start + dr0, ne01);
+
+            const int64_t ir1_start = dr1*ith1;
+            const int64_t ir1_end   = std::min(ir1_start + dr1, cne1);
 
-                const int id = row_mapping.i1; // selected expert index
+            const auto * src0_cur = (const char *) src0->data + cur_a*nb02 + ir0_start*nb01;
 
-                const int64_t i11 = id % ne11;
-                const int64_t i12 = row_mapping.i2; // row index in src1
+            // groups of 4 rows: gemm, the results are scattered to the rows of dst
+            for (int64_t ir1 = ir1_start; ir1 < std::min(ir1_end, n4); ir1 += 4) {
+                gemm<BLOC_TYPE, INTER_SIZE, NB_COLS, PARAM_TYPE>(ne00,
+                        tmp, ir0_end - ir0_start,
+                        src0_cur,
+                        wdata_src1 + (off + ir1)*nbw1, 4, ir0_end - ir0_start);
 
-                const int64_t i1 = id;  // selected expert index
-                const int64_t i2 = i12; // row
+                for (int64_t r = 0; r < 4; r++) {
+                    const mmid_row_mapping row_mapping = rows[off + ir1 + r];
 
-                const auto * src1_col = (const char *) wdata + (i11 * nbw1 + i12 * nbw2);
+                    // i1 = selected expert index, i2 = row
+                    memcpy((float *) ((char *) dst->data + (row_mapping.i1*nb1 + row_mapping.i2*nb2)) + ir0_start,
+                           tmp + r*(ir0_end - ir0_start), (ir0_end - ir0_start)*sizeof(float));
+                }
+            }
+
+            // remaining rows: gemv
+            for (int64_t ir1 = std::max(ir1_start, n4); ir1 < ir1_end; ir1++) {
+                const mmid_row_mapping row_mapping = rows[off + ir1];
 
                 gemv<BLOC_TYPE, INTER_SIZE, NB_COLS, PARAM_TYPE>(ne00,
-                        (float *)((char *) dst->data + (i1 * nb1 + i2 * nb2)) + src0_cur_start, ne01,
-                        src0_cur + src0_cur_start * nb01,
-                        src1_col, 1, src0_cur_end - src0_cur_start);
+                        (float *) ((char *) dst->data + (row_mapping.i1*nb1 + row_mapping.i2*nb2)) + ir0_start, ne01,
+                        src0_cur,
+                        wdata_src1 + (off + ir1)*nbw1, 1, ir0_end - ir0_start);
             }
+
+            current_chunk = ggml_threadpool_chunk_add(params->threadpool, 1);
         }
-#undef MMID_MATRIX_ROW
     }
 
     int repack(struct ggml_tensor * t, const void * data, size_t data_size) override {
@@ -1420,6 +1842,10 @@ static const ggml::cpu::tensor_traits * ggml_repack_get_optimal_repack_type(cons
     static const ggml::cpu::repack::tensor_traits<block_q4_0, 8, 4, GGML_TYPE_Q8_0> q4_0_4x8_q8_0;
     static const ggml::cpu::repack::tensor_traits<block_q4_0, 8, 8, GGML_TYPE_Q8_0> q4_0_8x8_q8_0;
     static const ggml::cpu::repack::tensor_traits<block_q4_K, 8, 8, GGML_TYPE_Q8_K> q4_K_8x8_q8_K;
+    static const ggml::cpu::repack::tensor_traits<block_q6_K, 8, 8, GGML_TYPE_Q8_K> q6_K_8x8_q8_K;
+
+    // instance for Q8
+    static const ggml::cpu::repack::tensor_traits<block_q8_0, 8, 8, GGML_TYPE_Q8_0> q8_0_8x8_q8_0;
 
     // instance for IQ4
     static const ggml::cpu::repack::tensor_traits<block_iq4_nl, 4, 4, GGML_TYPE_Q8_0> iq4_nl_4x4_q8_0;
@@ -1446,6 +1872,18 @@ static const ggml::cpu::tensor_traits * ggml_repack_get_optimal_repack_type(cons
                 return &q4_K_8x8_q8_K;
             }
         }
+    } else if (cur->type == GGML_TYPE_Q6_K) {
+        if (ggml_cpu_has_avx2()) {
+            if (cur->ne[1] % 8 == 0) {
+                return &q6_K_8x8_q8_K;
+            }
+        }
+    } else if (cur->type == GGML_TYPE_Q8_0) {
+        if (ggml_cpu_has_avx2()) {
+            if (cur->ne[1] % 8 == 0) {
+                return &q8_0_8x8_q8_0;
+            }
+        }
     } else if (cur->type == GGML_TYPE_IQ4_NL) {
         if (ggml_cpu_has_neon() && ggml_cpu_has_dotprod()) {
             if (cur->ne[1] % 4 == 0) {
@@ -1515,7 +1953,7 @@ class extra_buffer_type : ggml::cpu::extra_buffer_type {
             if (op->src[1]->buffer && !ggml_backend_buft_is_host(op->src[1]->buffer->buft)) {
                 return false;
             }
-            if (op->src[1]->type == GGML_TYPE_F32) {
+            if (op->src[1]->type == GGML_TYPE_F32 && ggml_is_contiguous(op->src[1])) {
                 return true;
             }
             //if (op->src[1]->type == GGML_TYPE_Q8_0) {
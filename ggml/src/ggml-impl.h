@@ -301,6 +301,7 @@ struct ggml_cgraph {
     struct ggml_tensor ** grads;     // the outputs of these tensors are the gradients of the nodes
     struct ggml_tensor ** grad_accs; // accumulators for node gradients
     struct ggml_tensor ** leafs;     // tensors with constant data
+    int32_t             * use_counts;// number of uses of each tensor, indexed by hash table slot
 
     struct ggml_hash_set visited_hash_set;
 
@@ -312,6 +313,70 @@ struct ggml_cgraph {
 // if you need the gradients, get them from the original graph
 struct ggml_cgraph ggml_graph_view(struct ggml_cgraph * cgraph, int i0, int i1);
 
+// returns the number of nodes of the graph that use the tensor as a source
+// the use counts are computed when the tensor is added with ggml_build_forward_expand, -1 if they are unknown
+static inline int ggml_node_get_use_count(const struct ggml_cgraph * cgraph, const struct ggml_tensor * node) {
+    if (cgraph->use_counts == NULL || cgraph->visited_hash_set.size == 0) {
+        return -1;
+    }
+
+    const size_t i = ggml_hash_find(&cgraph->visited_hash_set, node);
+    if (i == GGML_HASHSET_FULL || !ggml_bitset_get(cgraph->visited_hash_set.used, i)) {
+        return -1;
+    }
+
+    return cgraph->use_counts[i];
+}
+
+// returns true if the output of the node is only used by the next n_uses nodes and does not need to be stored
+static inline bool ggml_node_has_n_uses(const struct ggml_cgraph * cgraph, int node_idx, int32_t n_uses) {
+    const struct ggml_tensor * node = cgraph->nodes[node_idx];
+
+    if (node->flags & GGML_TENSOR_FLAG_OUTPUT) {
+        return false;
+    }
+
+    return ggml_node_get_use_count(cgraph, node) == n_uses;
+}
+
+// returns true if the nodes [node_idx, node_idx + num_ops) have the given ops, form a chain where each node is
+// used only by the next one, and can be computed as a single fused op
+// the caller checks the op parameters, types and shapes
+static inline bool ggml_can_fuse(const struct ggml_cgraph * cgraph, int node_idx, const enum ggml_op * ops, int num_ops) {
+    if (node_idx + num_ops > cgraph->n_nodes) {
+        return false;
+    }
+
+    for (int i = 0; i < num_ops; ++i) {
+        const struct ggml_tensor * node = cgraph->nodes[node_idx + i];
+
+        if (node->op != ops[i]) {
+            return false;
+        }
+
+        if (i < num_ops - 1) {
+            if (!ggml_node_has_n_uses(cgraph, node_idx + i, 1)) {
+                return false;
+            }
+
+            const struct ggml_tensor * next = cgraph->nodes[node_idx + i + 1];
+
+            bool found = false;
+            for (int j = 0; j < GGML_MAX_SRC; ++j) {
+                if (next->src[j] == node) {
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
 // Memory allocation
 
 GGML_API void * ggml_aligned_malloc(size_t size);
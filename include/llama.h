@@ -976,6 +976,12 @@ extern "C" {
     // If true, all model tensors are activated during llama_decode() to load and cache their weights.
     LLAMA_API void llama_set_warmup(struct llama_context * ctx, bool warmup);
 
+    // Set the number of layers to evaluate, the output norm and head are applied right after the last one
+    // The layers after it are skipped and do not store anything in the KV cache for the evaluated tokens
+    // Used to draft tokens with the target model itself (self-speculative decoding)
+    // 0 - evaluate all layers (default)
+    LLAMA_API void llama_set_n_layer_exit(struct llama_context * ctx, int32_t n_layer_exit);
+
     // Set abort callback
     LLAMA_API void llama_set_abort_callback(struct llama_context * ctx, ggml_abort_callback abort_callback, void * abort_callback_data);
 
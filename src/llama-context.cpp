@@ -46,6 +46,7 @@ llama_context::llama_context(
     cparams.no_perf          = params.no_perf;
     cparams.pooling_type     = params.pooling_type;
     cparams.warmup           = false;
+    cparams.n_layer_exit     = 0;
 
     cparams.n_ctx            = params.n_ctx           == 0    ? hparams.n_ctx_train           : params.n_ctx;
     cparams.rope_freq_base   = params.rope_freq_base  == 0.0f ? hparams.rope_freq_base_train  : params.rope_freq_base;
@@ -640,6 +641,12 @@ void llama_context::set_warmup(bool value) {
     cparams.warmup = value;
 }
 
+void llama_context::set_n_layer_exit(uint32_t value) {
+    LLAMA_LOG_DEBUG("%s: value = %u\n", __func__, value);
+
+    cparams.n_layer_exit = value;
+}
+
 void llama_context::set_adapter_lora(
             llama_adapter_lora * adapter,
             float scale) {
@@ -2315,6 +2322,10 @@ void llama_set_warmup(llama_context * ctx, bool warmup) {
     ctx->set_warmup(warmup);
 }
 
+void llama_set_n_layer_exit(llama_context * ctx, int32_t n_layer_exit) {
+    ctx->set_n_layer_exit(std::max(0, n_layer_exit));
+}
+
 void llama_synchronize(llama_context * ctx) {
     ctx->synchronize();
 }
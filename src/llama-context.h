@@ -75,6 +75,7 @@ struct llama_context {
     void set_embeddings (bool value);
     void set_causal_attn(bool value);
     void set_warmup(bool value);
+    void set_n_layer_exit(uint32_t value);
 
     void set_adapter_lora(
             llama_adapter_lora * adapter,
@@ -34,6 +34,8 @@ struct llama_cparams {
     bool warmup;
     bool op_offload;
 
+    uint32_t n_layer_exit; // evaluate only the first n_layer_exit layers (0 - all layers)
+
     enum llama_pooling_type pooling_type;
 
     ggml_backend_sched_eval_callback cb_eval;
@@ -6,6 +6,7 @@
 
 #include <cmath>
 #include <algorithm>
+#include <functional>
 #include <stdexcept>
 
 //
@@ -743,6 +744,64 @@ static void llama_grammar_advance_stack(
     }
 }
 
+// marks all tokens in the vocab trie whose first code point cannot be matched by any of the stacks
+// assumes that there is no pending partial UTF-8 sequence, so each token starts with a new code point
+static void llama_grammar_reject_by_first_char(
+        const llama_grammar_stacks & stacks,
+        const llama_vocab_trie     & trie,
+              std::vector<bool>    & rejected) {
+    static const int lookup[] = { 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 2, 2, 3, 4 };
+
+    auto reject_subtree = [&](uint32_t id) {
+        const auto & node = trie.nodes[id];
+        for (uint32_t i = node.tok_begin; i < node.tok_end; ++i) {
+            rejected[trie.tokens[i]] = true;
+        }
+    };
+
+    auto accepts = [&](uint32_t chr) {
+        for (const auto & stack : stacks) {
+            if (!stack.empty() && llama_grammar_match_char(stack.back(), chr).first) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // tokens that end in the middle of the first code point are left to the full check
+    std::function<void(uint32_t, int, uint32_t)> visit = [&](uint32_t id, int n_remain, uint32_t value) {
+        if (n_remain == 0) {
+            if (!accepts(value)) {
+                reject_subtree(id);
+            }
+            return;
+        }
+        const auto & node = trie.nodes[id];
+        for (uint32_t e = node.edge_begin; e < node.edge_end; ++e) {
+            const uint8_t next_byte = trie.edge_bytes[e];
+            if (next_byte == 0) {
+                continue; // decoding stops at the null terminator
+            }
+            visit(trie.edge_nodes[e], n_remain - 1, (value << 6) + (next_byte & 0x3F));
+        }
+    };
+
+    const auto & root = trie.nodes[0];
+    for (uint32_t e = root.edge_begin; e < root.edge_end; ++e) {
+        const uint8_t first_byte = trie.edge_bytes[e];
+        const int     len        = lookup[first_byte >> 4];
+
+        if (first_byte == 0 || len == 0) {
+            // empty piece or invalid sequence, always rejected
+            reject_subtree(trie.edge_nodes[e]);
+            continue;
+        }
+
+        const uint8_t mask = (1 << (8 - len)) - 1;
+        visit(trie.edge_nodes[e], len - 1, first_byte & mask);
+    }
+}
+
 static llama_grammar_candidates llama_grammar_reject_candidates(
         const llama_grammar_rules      & rules,
         const llama_grammar_stacks     & stacks,
@@ -1130,6 +1189,14 @@ void llama_grammar_apply_impl(const struct llama_grammar & grammar, llama_token_
         }
     }
 
+    // when most of the vocabulary is considered, reject whole subtrees of the vocab trie by their first code point
+    // before decoding the remaining candidates one by one
+    std::vector<bool> rejected;
+    if (grammar.partial_utf8.n_remain == 0 && 4*cur_p->size >= grammar.vocab->n_tokens()) {
+        rejected.resize(grammar.vocab->n_tokens(), false);
+        llama_grammar_reject_by_first_char(grammar.stacks, grammar.vocab->token_trie(), rejected);
+    }
+
     std::vector<std::pair<std::vector<uint32_t>, llama_partial_utf8>> candidates_decoded;
     candidates_decoded.reserve(cur_p->size);
 
@@ -1144,6 +1211,8 @@ void llama_grammar_apply_impl(const struct llama_grammar & grammar, llama_token_
             if (!allow_eog) {
                 cur_p->data[i].logit = -INFINITY;
             }
+        } else if (!rejected.empty() && rejected[id]) {
+            cur_p->data[i].logit = -INFINITY;
         } else if (piece.empty() || piece[0] == 0) {
             cur_p->data[i].logit = -INFINITY;
         } else {
@@ -360,7 +360,7 @@ llm_graph_context::llm_graph_context(const llm_graph_params & params) :
     cparams          (params.cparams),
     ubatch           (params.ubatch),
     n_embd           (hparams.n_embd),
-    n_layer          (hparams.n_layer),
+    n_layer          (cparams.n_layer_exit > 0 ? std::min(hparams.n_layer, cparams.n_layer_exit) : hparams.n_layer),
     n_rot            (hparams.n_rot),
     n_ctx            (cparams.n_ctx),
     n_head           (hparams.n_head()),
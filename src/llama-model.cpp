@@ -8537,7 +8537,7 @@ struct llm_build_minicpm3 : public llm_graph_context {
             }
 
             // scale_res - scale the hidden states for residual connection
-            const float scale_res = scale_depth/sqrtf(float(n_layer)); // TODO: is this correct?
+            const float scale_res = scale_depth/sqrtf(float(hparams.n_layer)); // TODO: is this correct?
             cur = ggml_scale(ctx0, cur, scale_res);
             cb(cur, "hidden_scaled", il);
 
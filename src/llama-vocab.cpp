@@ -16,6 +16,8 @@
 #include <forward_list>
 #include <limits>
 #include <map>
+#include <mutex>
+#include <numeric>
 #include <queue>
 #include <set>
 #include <unordered_map>
@@ -1233,6 +1235,100 @@ struct fragment_buffer_variant {
     const uint64_t length;
 };
 
+//
+// llama_vocab_trie
+//
+
+static uint32_t llama_vocab_trie_build_node(
+        llama_vocab_trie & trie,
+        const std::vector<std::string> & pieces,
+        uint32_t begin,
+        uint32_t end,
+        size_t depth) {
+    const uint32_t id = trie.nodes.size();
+    trie.nodes.push_back({});
+
+    // the tokens are sorted, so the ones that end at this depth come first
+    uint32_t self = begin;
+    while (self < end && pieces[trie.tokens[self]].size() == depth) {
+        self++;
+    }
+
+    // group the remaining tokens by their next byte
+    std::vector<uint32_t> groups;
+    for (uint32_t i = self; i < end; ) {
+        const uint8_t c = pieces[trie.tokens[i]][depth];
+        groups.push_back(i);
+        trie.edge_bytes.push_back(c);
+        trie.edge_nodes.push_back(0);
+        while (i < end && (uint8_t) pieces[trie.tokens[i]][depth] == c) {
+            i++;
+        }
+    }
+    groups.push_back(end);
+
+    const uint32_t edge_begin = trie.edge_bytes.size() - (groups.size() - 1);
+
+    for (size_t i = 0; i + 1 < groups.size(); ++i) {
+        trie.edge_nodes[edge_begin + i] = llama_vocab_trie_build_node(trie, pieces, groups[i], groups[i + 1], depth + 1);
+    }
+
+    trie.nodes[id] = { edge_begin, edge_begin + (uint32_t) (groups.size() - 1), begin, self, end };
+
+    return id;
+}
+
+void llama_vocab_trie::build(const std::vector<std::string> & pieces) {
+    nodes.clear();
+    edge_bytes.clear();
+    edge_nodes.clear();
+
+    tokens.resize(pieces.size());
+    std::iota(tokens.begin(), tokens.end(), 0);
+
+    // std::string compares bytes as unsigned char, which gives the pre-order of the trie
+    std::stable_sort(tokens.begin(), tokens.end(), [&](llama_token a, llama_token b) {
+        return pieces[a] < pieces[b];
+    });
+
+    llama_vocab_trie_build_node(*this, pieces, 0, tokens.size(), 0);
+
+    nodes.shrink_to_fit();
+    edge_bytes.shrink_to_fit();
+    edge_nodes.shrink_to_fit();
+}
+
+int32_t llama_vocab_trie::child(int32_t id, uint8_t c) const {
+    const node & n = nodes[id];
+
+    const auto * first = edge_bytes.data() + n.edge_begin;
+    const auto * last  = edge_bytes.data() + n.edge_end;
+    const auto * it    = std::lower_bound(first, last, c);
+
+    if (it == last || *it != c) {
+        return -1;
+    }
+
+    return edge_nodes[it - edge_bytes.data()];
+}
+
+int32_t llama_vocab_trie::find(const char * text, size_t len) const {
+    if (nodes.empty()) {
+        return -1;
+    }
+
+    int32_t id = 0;
+    for (size_t i = 0; i < len && id >= 0; ++i) {
+        id = child(id, (uint8_t) text[i]);
+    }
+
+    return id;
+}
+
+size_t llama_vocab_trie::size_bytes() const {
+    return nodes.size()*sizeof(node) + edge_bytes.size()*sizeof(uint8_t) + edge_nodes.size()*sizeof(uint32_t) + tokens.size()*sizeof(llama_token);
+}
+
 struct llama_vocab::impl {
     uint32_t n_token_types = 0; // for BERT-style token types
 
@@ -1296,6 +1392,10 @@ struct llama_vocab::impl {
 
     std::vector<char> precompiled_charsmap;
 
+    // built lazily by token_trie()
+    mutable std::once_flag    trie_once;
+    mutable llama_vocab_trie trie;
+
     impl(const llama_vocab & vocab) : vocab(vocab) {
     }
 
@@ -1352,6 +1452,8 @@ struct llama_vocab::impl {
     // use cached data
     const std::string & token_to_piece(llama_token token) const;
 
+    const llama_vocab_trie & token_trie() const;
+
     int32_t detokenize(
             const llama_token * tokens,
                       int32_t   n_tokens,
@@ -2665,6 +2767,19 @@ const std::string & llama_vocab::impl::token_to_piece(llama_token token) const {
     return cache_token_to_piece.at(token);
 }
 
+const llama_vocab_trie & llama_vocab::impl::token_trie() const {
+    std::call_once(trie_once, [this]() {
+        const int64_t t_start_us = ggml_time_us();
+
+        trie.build(cache_token_to_piece);
+
+        LLAMA_LOG_DEBUG("%s: token trie: %zu nodes, %.2f MiB, built in %.2f ms\n", __func__,
+                trie.nodes.size(), trie.size_bytes() / 1024.0 / 1024.0, (ggml_time_us() - t_start_us) / 1000.0);
+    });
+
+    return trie;
+}
+
 int32_t llama_vocab::impl::detokenize(
                const llama_token * tokens,
                          int32_t   n_tokens,
@@ -3102,6 +3217,10 @@ const std::string & llama_vocab::token_to_piece(llama_token token) const {
     return pimpl->token_to_piece(token);
 }
 
+const llama_vocab_trie & llama_vocab::token_trie() const {
+    return pimpl->token_trie();
+}
+
 int32_t llama_vocab::token_to_piece(llama_token token, char * buf, int32_t length, int32_t lstrip, bool special) const {
     return pimpl->token_to_piece(token, buf, length, lstrip, special);
 }
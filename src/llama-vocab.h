@@ -9,6 +9,34 @@
 struct LLM_KV;
 struct llama_model_loader;
 
+// byte-level prefix trie over the token pieces (see llama_vocab::token_to_piece)
+// nodes are stored in DFS pre-order and the tokens are sorted by piece, so the tokens of any subtree
+// form a contiguous range of `tokens`, with the tokens ending exactly at the node coming first
+struct llama_vocab_trie {
+    struct node {
+        uint32_t edge_begin; // children are edge_bytes/edge_nodes[edge_begin, edge_end), sorted by byte
+        uint32_t edge_end;
+        uint32_t tok_begin;  // tokens[tok_begin, tok_self) end at this node
+        uint32_t tok_self;   // tokens[tok_begin, tok_end)  are in the subtree of this node
+        uint32_t tok_end;
+    };
+
+    std::vector<node>        nodes; // nodes[0] is the root (the empty prefix)
+    std::vector<uint8_t>     edge_bytes;
+    std::vector<uint32_t>    edge_nodes;
+    std::vector<llama_token> tokens;
+
+    void build(const std::vector<std::string> & pieces);
+
+    // returns -1 if there is no such child
+    int32_t child(int32_t id, uint8_t c) const;
+
+    // node for the given prefix, or -1 if no token starts with it
+    int32_t find(const char * text, size_t len) const;
+
+    size_t size_bytes() const;
+};
+
 struct llama_vocab {
     struct token_data {
         std::string      text;
@@ -112,6 +140,9 @@ struct llama_vocab {
     // use cached data
     const std::string & token_to_piece(llama_token token) const;
 
+    // prefix trie over the cached pieces, built on first use
+    const llama_vocab_trie & token_trie() const;
+
     int32_t detokenize(
             const llama_token * tokens,
                       int32_t   n_tokens,
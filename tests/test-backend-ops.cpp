@@ -100,7 +100,7 @@ static void init_tensor_uniform(ggml_tensor * tensor, float min = -1.0f, float m
             };
 
             const size_t min_blocks_per_thread = 1;
-            const size_t n_threads = std::min<size_t>(std::thread::hardware_concurrency()/2,
+            const size_t n_threads = std::min<size_t>(std::max<size_t>(1, std::thread::hardware_concurrency()/2),
                                                       std::max<size_t>(1, n_blocks / min_blocks_per_thread));
             std::vector<std::future<void>> tasks;
             tasks.reserve(n_threads);
@@ -311,6 +311,50 @@ static bool ggml_is_view_op(enum ggml_op op) {
     return op == GGML_OP_VIEW || op == GGML_OP_RESHAPE || op == GGML_OP_PERMUTE || op == GGML_OP_TRANSPOSE;
 }
 
+// on the CPU backend, move the weight of a matrix multiplication to the first extra buffer type
+// of the device that supports the op (AMX, repacked layouts, ...) so that these kernels are tested too
+// returns the buffer holding the weight, or NULL if the op stays on the regular CPU path
+static ggml_backend_buffer_t set_extra_buffer_weight(ggml_backend_t backend, ggml_context * ctx, ggml_tensor * out) {
+    ggml_backend_dev_t dev = ggml_backend_get_device(backend);
+    if (ggml_backend_dev_type(dev) != GGML_BACKEND_DEVICE_TYPE_CPU || (out->op != GGML_OP_MUL_MAT && out->op != GGML_OP_MUL_MAT_ID)) {
+        return NULL;
+    }
+
+    ggml_tensor * w = out->src[0];
+    if (w->op != GGML_OP_NONE || w->view_src != NULL) {
+        return NULL;
+    }
+
+    ggml_backend_reg_t reg = ggml_backend_dev_backend_reg(dev);
+    auto ggml_backend_dev_get_extra_bufts_fn = (ggml_backend_dev_get_extra_bufts_t) ggml_backend_reg_get_proc_address(reg, "ggml_backend_dev_get_extra_bufts");
+    if (!ggml_backend_dev_get_extra_bufts_fn) {
+        return NULL;
+    }
+
+    std::vector<uint8_t> data(ggml_nbytes(w));
+    ggml_backend_tensor_get(w, data.data(), 0, data.size());
+
+    for (ggml_backend_buffer_type_t * buft = ggml_backend_dev_get_extra_bufts_fn(dev); buft && *buft; ++buft) {
+        ggml_tensor * w_extra = ggml_dup_tensor(ctx, w);
+        ggml_backend_buffer_t buf = ggml_backend_buft_alloc_buffer(*buft, ggml_backend_buft_get_alloc_size(*buft, w_extra));
+        if (buf == NULL) {
+            continue;
+        }
+        ggml_backend_tensor_alloc(buf, w_extra, ggml_backend_buffer_get_base(buf));
+
+        out->src[0] = w_extra;
+        if (ggml_backend_supports_op(backend, out)) {
+            ggml_backend_tensor_set(w_extra, data.data(), 0, data.size());
+            return buf;
+        }
+        out->src[0] = w;
+
+        ggml_backend_buffer_free(buf);
+    }
+
+    return NULL;
+}
+
 enum test_mode {
     MODE_TEST,
     MODE_PERF,
@@ -338,6 +382,25 @@ struct test_case {
         return 1e-4;
     }
 
+    // If true, the whole graph is computed at once so that the backend can fuse its nodes, and only the output is compared.
+    // Otherwise the nodes are computed and compared one at a time.
+    virtual bool run_whole_graph() {
+        return false;
+    }
+
+    // Equivalent of out computed with other ops from the same inputs, compared with out on the same backend.
+    // Unlike the comparison between backends, this also checks the kernels of the reference backend.
+    virtual ggml_tensor * build_graph_ref(ggml_context * ctx, ggml_tensor * out) {
+        GGML_UNUSED(ctx);
+        GGML_UNUSED(out);
+        return nullptr;
+    }
+
+    // Number of threads of a CPU backend for this test, 0: keep the number of threads of the backend.
+    virtual int n_threads() {
+        return 0;
+    }
+
     virtual float grad_eps() {
         return 1e-1f;
     }
@@ -456,6 +519,8 @@ struct test_case {
             return true;
         }
 
+        ggml_tensor * out_ref = build_graph_ref(ctx, out);
+
         printf("  %s(%s): ", op_desc(out).c_str(), vars().c_str());
         fflush(stdout);
 
@@ -490,6 +555,9 @@ struct test_case {
 
         // build graph
         ggml_build_forward_expand(gf, out);
+        if (out_ref != nullptr) {
+            ggml_build_forward_expand(gf, out_ref);
+        }
 
         // add sentinels as graph nodes so that they are checked in the callback
         for (ggml_tensor * sentinel : sentinels) {
@@ -499,6 +567,16 @@ struct test_case {
         // randomize tensors
         initialize_tensors(ctx);
 
+        // e.g. more threads than rows, the number of threads set in main is restored after the comparison
+        ggml_backend_set_n_threads_t set_n_threads_fn = nullptr;
+        if (n_threads() > 0 && ggml_backend_dev_type(ggml_backend_get_device(backend1)) == GGML_BACKEND_DEVICE_TYPE_CPU) {
+            ggml_backend_reg_t reg = ggml_backend_dev_backend_reg(ggml_backend_get_device(backend1));
+            set_n_threads_fn = (ggml_backend_set_n_threads_t) ggml_backend_reg_get_proc_address(reg, "ggml_backend_set_n_threads");
+            if (set_n_threads_fn) {
+                set_n_threads_fn(backend1, n_threads());
+            }
+        }
+
         // compare
         struct callback_userdata {
             bool   ok;
@@ -574,12 +652,87 @@ struct test_case {
             GGML_UNUSED(index);
         };
 
-        const bool cmp_ok = ggml_backend_compare_graph_backend(backend1, backend2, gf, callback, &ud);
+        // on the CPU backend, the weight of the op is moved to an extra buffer type when possible
+        // the reference graph is copied before, the packed layouts of these buffers cannot be read back
+        struct ggml_backend_graph_copy copy = {};
+        ggml_backend_buffer_t buf_extra = NULL;
+        if (ggml_backend_dev_type(ggml_backend_get_device(backend1)) == GGML_BACKEND_DEVICE_TYPE_CPU) {
+            copy = ggml_backend_graph_copy(backend2, gf);
+            if (copy.buffer != NULL && !run_whole_graph()) {
+                buf_extra = set_extra_buffer_weight(backend1, ctx, out);
+            }
+        }
+
+        bool cmp_ok = true;
+        if (buf_extra != NULL || (copy.buffer != NULL && run_whole_graph())) {
+            if (buf_extra != NULL) {
+                printf("[%s] ", ggml_backend_buffer_name(buf_extra));
+            }
+
+            // both backends are CPU, the whole graph can be computed at once
+            // the reference computes the nodes of the copy one at a time, nothing is fused or reused between them
+            ggml_backend_graph_compute(backend1, gf);
+
+            ggml_init_params params_gv = {
+                /* .mem_size = */ ggml_graph_overhead_custom(1, false),
+                /* .mem_base = */ NULL,
+                /* .no_alloc = */ true,
+            };
+            ggml_context * ctx_gv = ggml_init(params_gv);
+            ggml_cgraph * gv = ggml_new_graph_custom(ctx_gv, 1, false);
+            for (int i = 0; i < ggml_graph_n_nodes(copy.graph); i++) {
+                ggml_graph_clear(gv);
+                ggml_graph_add_node(gv, ggml_graph_node(copy.graph, i));
+                ggml_backend_graph_compute(backend2, gv);
+            }
+            ggml_free(ctx_gv);
+
+            for (int i = 0; i < ggml_graph_n_nodes(gf); i++) {
+                ggml_tensor * t1 = ggml_graph_node(gf, i);
+                ggml_tensor * t2 = ggml_graph_node(copy.graph, i);
+
+                if (ggml_is_view_op(t1->op)) {
+                    continue;
+                }
+
+                // the intermediate results of fused nodes are not stored
+                if (run_whole_graph() && t1 != out && t1->op != GGML_OP_NONE) {
+                    continue;
+                }
+
+                if (!callback(i, t1, t2, &ud)) {
+                    break;
+                }
+            }
+
+            if (buf_extra != NULL) {
+                ggml_backend_buffer_free(buf_extra);
+            }
+        } else {
+            cmp_ok = ggml_backend_compare_graph_backend(backend1, backend2, gf, callback, &ud);
+        }
+
+        if (copy.buffer != NULL) {
+            ggml_backend_graph_copy_free(copy);
+        }
+
+        if (set_n_threads_fn) {
+            set_n_threads_fn(backend1, std::thread::hardware_concurrency());
+        }
 
         if (!cmp_ok) {
             printf("compare failed ");
         }
 
+        // compare with the equivalent graph, both computed by backend1
+        if (out_ref != nullptr && ud.ok && cmp_ok) {
+            ud.backend2 = backend1;
+            callback(-1, out, out_ref, &ud);
+            if (!ud.ok) {
+                printf("[%s] mismatch with %s ", op_desc(out).c_str(), ggml_op_desc(out_ref));
+            }
+        }
+
         ggml_backend_buffer_free(buf);
 
         ggml_free(ctx);
@@ -1826,6 +1979,188 @@ struct test_rms_norm_back : public test_case {
     }
 };
 
+// GGML_OP_RMS_NORM + GGML_OP_MUL
+struct test_rms_norm_mul : public test_case {
+    const ggml_type type;
+    const std::array<int64_t, 4> ne;
+    const float eps;
+
+    std::string op_desc(ggml_tensor * t) override {
+        GGML_UNUSED(t);
+        return "RMS_NORM_MUL";
+    }
+
+    std::string vars() override {
+        return VARS_TO_STR3(type, ne, eps);
+    }
+
+    bool run_whole_graph() override {
+        return true;
+    }
+
+    test_rms_norm_mul(ggml_type type = GGML_TYPE_F32,
+            std::array<int64_t, 4> ne = {64, 5, 4, 3},
+            float eps = 1e-6f)
+        : type(type), ne(ne), eps(eps) {}
+
+    ggml_tensor * build_graph(ggml_context * ctx) override {
+        ggml_tensor * a = ggml_new_tensor(ctx, type, 4, ne.data());
+        ggml_set_name(a, "a");
+
+        ggml_tensor * w = ggml_new_tensor_1d(ctx, type, ne[0]);
+        ggml_set_name(w, "w");
+
+        ggml_tensor * out = ggml_mul(ctx, ggml_rms_norm(ctx, a, eps), w);
+        ggml_set_name(out, "out");
+
+        return out;
+    }
+
+    void initialize_tensors(ggml_context * ctx) override {
+        for (ggml_tensor * t = ggml_get_first_tensor(ctx); t != NULL; t = ggml_get_next_tensor(ctx, t)) {
+            init_tensor_uniform(t, -10.f, 10.f);
+        }
+    }
+};
+
+// GGML_OP_RMS_NORM + GGML_OP_MUL + GGML_OP_MUL_MAT
+struct test_rms_norm_mul_mat : public test_case {
+    const ggml_type type_w;
+    const int64_t m, n, k;
+    const float eps;
+
+    std::string op_desc(ggml_tensor * t) override {
+        GGML_UNUSED(t);
+        return "RMS_NORM_MUL_MAT";
+    }
+
+    std::string vars() override {
+        return VARS_TO_STR5(type_w, m, n, k, eps);
+    }
+
+    double max_nmse_err() override {
+        return 5e-4;
+    }
+
+    bool run_whole_graph() override {
+        return true;
+    }
+
+    test_rms_norm_mul_mat(ggml_type type_w = GGML_TYPE_Q4_0,
+            int64_t m = 32, int64_t n = 1, int64_t k = 256,
+            float eps = 1e-6f)
+        : type_w(type_w), m(m), n(n), k(k), eps(eps) {}
+
+    ggml_tensor * build_graph(ggml_context * ctx) override {
+        ggml_tensor * a = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, k, n);
+        ggml_set_name(a, "a");
+
+        ggml_tensor * g = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, k);
+        ggml_set_name(g, "g");
+
+        ggml_tensor * w = ggml_new_tensor_2d(ctx, type_w, k, m);
+        ggml_set_name(w, "w");
+
+        ggml_tensor * cur = ggml_mul(ctx, ggml_rms_norm(ctx, a, eps), g);
+        ggml_set_name(cur, "cur");
+
+        ggml_tensor * out = ggml_mul_mat(ctx, w, cur);
+        ggml_set_name(out, "out");
+
+        return out;
+    }
+};
+
+// GGML_OP_MUL_MAT with the same src1 (e.g. Q, K and V projections)
+// the src1 converted by the first matmul is reused by the next ones, unless a node writes to it in between
+struct test_mul_mat_shared_src1 : public test_case {
+    const ggml_type type_w;
+    const int64_t k, n;
+    const bool overwrite;
+
+    std::string op_desc(ggml_tensor * t) override {
+        GGML_UNUSED(t);
+        return "MUL_MAT_SHARED_SRC1";
+    }
+
+    std::string vars() override {
+        return VARS_TO_STR4(type_w, k, n, overwrite);
+    }
+
+    double max_nmse_err() override {
+        return 5e-4;
+    }
+
+    bool run_whole_graph() override {
+        return true;
+    }
+
+    test_mul_mat_shared_src1(ggml_type type_w = GGML_TYPE_Q4_0,
+            int64_t k = 256, int64_t n = 1, bool overwrite = false)
+        : type_w(type_w), k(k), n(n), overwrite(overwrite) {}
+
+    ggml_tensor * build_graph(ggml_context * ctx) override {
+        ggml_tensor * x = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, k, n);
+        ggml_set_name(x, "x");
+
+        ggml_tensor * w[3];
+        for (int i = 0; i < 3; i++) {
+            w[i] = ggml_new_tensor_2d(ctx, type_w, k, k);
+            ggml_format_name(w[i], "w%d", i);
+        }
+
+        ggml_tensor * q = ggml_scale(ctx, ggml_mul_mat(ctx, w[0], x), 0.5f);
+        ggml_set_name(q, "q");
+
+        if (overwrite) {
+            // the matmuls computed after the copy read the new content of x
+            q = ggml_cpy(ctx, q, x);
+            ggml_set_name(q, "q_cpy");
+        }
+
+        ggml_tensor * out = ggml_add(ctx, ggml_add(ctx, q, ggml_mul_mat(ctx, w[1], x)), ggml_mul_mat(ctx, w[2], x));
+        ggml_set_name(out, "out");
+
+        return out;
+    }
+};
+
+// GGML_OP_UNARY(SILU) + GGML_OP_MUL (SwiGLU)
+struct test_silu_mul : public test_case {
+    const ggml_type type;
+    const std::array<int64_t, 4> ne;
+
+    std::string op_desc(ggml_tensor * t) override {
+        GGML_UNUSED(t);
+        return "SILU_MUL";
+    }
+
+    std::string vars() override {
+        return VARS_TO_STR2(type, ne);
+    }
+
+    bool run_whole_graph() override {
+        return true;
+    }
+
+    test_silu_mul(ggml_type type = GGML_TYPE_F32,
+            std::array<int64_t, 4> ne = {128, 5, 4, 3})
+        : type(type), ne(ne) {}
+
+    ggml_tensor * build_graph(ggml_context * ctx) override {
+        ggml_tensor * a = ggml_new_tensor(ctx, type, 4, ne.data());
+        ggml_set_name(a, "a");
+
+        ggml_tensor * b = ggml_new_tensor(ctx, type, 4, ne.data());
+        ggml_set_name(b, "b");
+
+        ggml_tensor * out = ggml_mul(ctx, ggml_silu(ctx, a), b);
+        ggml_set_name(out, "out");
+
+        return out;
+    }
+};
+
 // GGML_OP_SSM_CONV
 struct test_ssm_conv : public test_case {
     const ggml_type type;
@@ -3391,6 +3726,132 @@ struct test_flash_attn_ext : public test_case {
     }
 };
 
+// masks of the KV cache used with GGML_OP_FLASH_ATTN_EXT
+// the last quarter of the KV cells is empty and always masked, as in a KV cache that is not full
+enum test_fa_mask {
+    TEST_FA_MASK_CAUSAL, // the queries are the last positions of the used KV cells
+    TEST_FA_MASK_SWA,    // causal, with a sliding window of n_swa positions
+    TEST_FA_MASK_SEQS,   // n_seq sequences with their own block of KV cells, causal within each sequence
+};
+
+static std::string var_to_str(test_fa_mask mask) {
+    switch (mask) {
+        case TEST_FA_MASK_CAUSAL: return "causal";
+        case TEST_FA_MASK_SWA:    return "swa";
+        case TEST_FA_MASK_SEQS:   return "seqs";
+    }
+    return "unknown";
+}
+
+// GGML_OP_FLASH_ATTN_EXT compared with mul_mat + soft_max_ext + mul_mat
+struct test_flash_attn_ext_mask : public test_case {
+    const int64_t hsk; // K head size
+    const int64_t hsv; // V head size
+    const int64_t nh; // num heads
+    const int64_t nr; // repeat in Q, tests for grouped-query attention
+    const int64_t kv; // kv size
+    const int64_t nb; // batch size
+
+    const test_fa_mask mask;
+    const int64_t n_swa; // sliding window size with TEST_FA_MASK_SWA
+    const int64_t n_seq; // number of sequences with TEST_FA_MASK_SEQS
+
+    const int nth; // number of threads, 0: default
+
+    std::string vars() override {
+        return VARS_TO_STR10(hsk, hsv, nh, nr, kv, nb, mask, n_swa, n_seq, nth);
+    }
+
+    double max_nmse_err() override {
+        return 5e-4;
+    }
+
+    int n_threads() override {
+        return nth;
+    }
+
+    test_flash_attn_ext_mask(int64_t hsk = 64, int64_t hsv = 64, int64_t nh = 4, int64_t nr = 2, int64_t kv = 512, int64_t nb = 64,
+                             test_fa_mask mask = TEST_FA_MASK_CAUSAL, int64_t n_swa = 128, int64_t n_seq = 4, int nth = 0)
+        : hsk(hsk), hsv(hsv), nh(nh), nr(nr), kv(kv), nb(nb), mask(mask), n_swa(n_swa), n_seq(n_seq), nth(nth) {}
+
+    ggml_tensor * build_graph(ggml_context * ctx) override {
+        ggml_tensor * q = ggml_new_tensor_4d(ctx, GGML_TYPE_F32, hsk, nb, nh*nr, 1);
+        ggml_set_name(q, "q");
+
+        ggml_tensor * k = ggml_new_tensor_4d(ctx, GGML_TYPE_F16, hsk, kv, nh, 1);
+        ggml_set_name(k, "k");
+
+        ggml_tensor * v = ggml_new_tensor_4d(ctx, GGML_TYPE_F16, hsv, kv, nh, 1);
+        ggml_set_name(v, "v");
+
+        ggml_tensor * m = ggml_new_tensor_4d(ctx, GGML_TYPE_F16, kv, GGML_PAD(nb, GGML_KQ_MASK_PAD), 1, 1);
+        ggml_set_name(m, "m");
+
+        ggml_tensor * out = ggml_flash_attn_ext(ctx, q, k, v, m, 1.0f/sqrtf(hsk), 0.0f, 0.0f);
+        ggml_flash_attn_ext_set_prec(out, GGML_PREC_F32);
+        ggml_set_name(out, "out");
+
+        return out;
+    }
+
+    ggml_tensor * build_graph_ref(ggml_context * ctx, ggml_tensor * out) override {
+        ggml_tensor * q = out->src[0];
+        ggml_tensor * k = out->src[1];
+        ggml_tensor * v = out->src[2];
+        ggml_tensor * m = out->src[3];
+
+        ggml_tensor * kq = ggml_mul_mat(ctx, k, q);
+        kq = ggml_soft_max_ext(ctx, kq, m, 1.0f/sqrtf(hsk), 0.0f);
+
+        ggml_tensor * vt  = ggml_cont(ctx, ggml_transpose(ctx, v));
+        ggml_tensor * kqv = ggml_mul_mat(ctx, vt, kq);
+
+        // [hsv, nb, nh*nr] -> [hsv, nh*nr, nb], the layout of the flash attention result
+        ggml_tensor * out_ref = ggml_cont(ctx, ggml_permute(ctx, kqv, 0, 2, 1, 3));
+        ggml_set_name(out_ref, "out_ref");
+
+        return out_ref;
+    }
+
+    void initialize_tensors(ggml_context * ctx) override {
+        for (ggml_tensor * t = ggml_get_first_tensor(ctx); t != NULL; t = ggml_get_next_tensor(ctx, t)) {
+            if (strcmp(t->name, "m") != 0) {
+                init_tensor_uniform(t);
+                continue;
+            }
+
+            const int64_t n_used = kv - kv/4;
+
+            std::vector<ggml_fp16_t> data(ggml_nelements(t), ggml_fp32_to_fp16(0.0f));
+            for (int64_t i = 0; i < nb; ++i) {
+                // range of the visible KV cells and position of the query
+                int64_t c0  = 0;
+                int64_t c1  = n_used;
+                int64_t pos = n_used - nb + i;
+
+                if (mask == TEST_FA_MASK_SWA) {
+                    c0 = std::max<int64_t>(0, pos - n_swa + 1);
+                } else if (mask == TEST_FA_MASK_SEQS) {
+                    const int64_t s  = i*n_seq/nb;
+                    const int64_t i0 = (s*nb + n_seq - 1)/n_seq; // first query of the sequence
+                    const int64_t i1 = ((s + 1)*nb + n_seq - 1)/n_seq;
+
+                    c0  = s*n_used/n_seq;
+                    c1  = (s + 1)*n_used/n_seq;
+                    pos = c1 - (i1 - i0) + (i - i0);
+                }
+
+                for (int64_t j = 0; j < kv; ++j) {
+                    if (j < c0 || j >= c1 || j > pos) {
+                        data[i*kv + j] = ggml_fp32_to_fp16(-INFINITY);
+                    }
+                }
+            }
+            ggml_backend_tensor_set(t, data.data(), 0, data.size()*sizeof(ggml_fp16_t));
+        }
+    }
+};
+
 // GGML_OP_CROSS_ENTROPY_LOSS
 struct test_cross_entropy_loss : public test_case {
     const ggml_type type;
@@ -4146,6 +4607,11 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_eval() {
             test_cases.emplace_back(new test_cpy(type_src, type_dst, {256, 2, 3, 4}, {0, 2, 1, 3})); // cpy by rows
         }
     }
+    // K cache writes: few rows in dim 1, and a single long row split in blocks between the threads
+    for (ggml_type type_dst : {GGML_TYPE_Q4_0, GGML_TYPE_Q8_0, GGML_TYPE_IQ4_NL}) {
+        test_cases.emplace_back(new test_cpy(GGML_TYPE_F32, type_dst, {128, 2, 7, 1}));
+        test_cases.emplace_back(new test_cpy(GGML_TYPE_F16, type_dst, {4096, 1, 1, 1}));
+    }
     for (ggml_type type_src : all_types) {
         for (ggml_type type_dst : {GGML_TYPE_F32}) {
             test_cases.emplace_back(new test_cpy(type_src, type_dst, {256, 4, 4, 4}));
@@ -4218,10 +4684,23 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_eval() {
         }
         test_cases.emplace_back(new test_rms_norm_back(GGML_TYPE_F32, {64, 5, 4, 3}, eps));
         test_cases.emplace_back(new test_l2_norm      (GGML_TYPE_F32, {64, 5, 4, 3}, eps));
+        test_cases.emplace_back(new test_rms_norm_mul (GGML_TYPE_F32, {64, 5, 4, 3}, eps));
     }
 
     test_cases.emplace_back(new test_l2_norm(GGML_TYPE_F32, {64, 5, 4, 3}, 1e-12f));
 
+    // fused ops
+    for (ggml_type type_w : {GGML_TYPE_Q4_0, GGML_TYPE_Q8_0, GGML_TYPE_Q4_K, GGML_TYPE_F16}) {
+        for (int64_t n : {1, 7}) {
+            test_cases.emplace_back(new test_rms_norm_mul_mat(type_w, 32, n, 256));
+            test_cases.emplace_back(new test_mul_mat_shared_src1(type_w, 256, n, false));
+            test_cases.emplace_back(new test_mul_mat_shared_src1(type_w, 256, n, true));
+        }
+    }
+    test_cases.emplace_back(new test_silu_mul(GGML_TYPE_F32, {128, 5, 4, 3}));
+    test_cases.emplace_back(new test_silu_mul(GGML_TYPE_F32, {4096, 1, 1, 1}));
+    test_cases.emplace_back(new test_silu_mul(GGML_TYPE_F32, {67, 3, 1, 1}));
+
     test_cases.emplace_back(new test_ssm_conv(GGML_TYPE_F32, {4, 1536, 1, 1}, {4, 1536, 1, 1}));
     test_cases.emplace_back(new test_ssm_conv(GGML_TYPE_F32, {8, 1536, 1, 1}, {4, 1536, 1, 1}));
     test_cases.emplace_back(new test_ssm_conv(GGML_TYPE_F32, {4, 1536, 4, 1}, {4, 1536, 1, 1}));
@@ -4319,6 +4798,13 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_eval() {
     }
 #endif
 
+    // weights made of full tiles, used by the extra buffer types of the CPU backend (AMX, repack)
+    for (ggml_type type_a : {GGML_TYPE_F16, GGML_TYPE_BF16, GGML_TYPE_Q4_0, GGML_TYPE_Q8_0, GGML_TYPE_Q4_K, GGML_TYPE_Q6_K}) {
+        for (int n : {1, 4, 5, 16, 33}) {
+            test_cases.emplace_back(new test_mul_mat(type_a, GGML_TYPE_F32, 96, n, 512, {1, 1}, {1, 1}));
+        }
+    }
+
     test_cases.emplace_back(new test_mul_mat(GGML_TYPE_F16, GGML_TYPE_F32,  64, 2,  128, { 8,  1}, {1, 1}));
     test_cases.emplace_back(new test_mul_mat(GGML_TYPE_F16, GGML_TYPE_F32,  83, 2,  128, { 8,  1}, {4, 1}));
     test_cases.emplace_back(new test_mul_mat(GGML_TYPE_F16, GGML_TYPE_F32,  64, 2,   64, { 8,  1}, {4, 1}));
@@ -4361,6 +4847,12 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_eval() {
         }
     }
 
+    // many experts with a few rows each
+    for (ggml_type type_a : {GGML_TYPE_F32, GGML_TYPE_F16, GGML_TYPE_Q4_0, GGML_TYPE_Q8_0, GGML_TYPE_Q4_K}) {
+        test_cases.emplace_back(new test_mul_mat_id(type_a, GGML_TYPE_F32, 32, 4, false, 512,  7, 256));
+        test_cases.emplace_back(new test_mul_mat_id(type_a, GGML_TYPE_F32, 64, 8, true,  512, 33, 256));
+    }
+
     for (ggml_type type_a : other_types) {
         for (ggml_type type_b : {GGML_TYPE_F32 /*, GGML_TYPE_F16 */}) {
             for (int n_mats : {4}) {
@@ -4575,6 +5067,17 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_eval() {
         }
     }
 
+    // masks with fully masked KV tiles, with more threads than q rows for the KV rows split between threads
+    for (test_fa_mask mask : { TEST_FA_MASK_CAUSAL, TEST_FA_MASK_SWA, TEST_FA_MASK_SEQS }) {
+        for (int kv : { 512, 1024 }) {
+            for (int nb : { 1, 3, 64, 77 }) {
+                test_cases.emplace_back(new test_flash_attn_ext_mask(64, 64, 4, 2, kv, nb, mask, 128, 4, 0));
+            }
+            test_cases.emplace_back(new test_flash_attn_ext_mask(128, 128, 2, 2, kv, 1, mask, 128, 4, 8));
+            test_cases.emplace_back(new test_flash_attn_ext_mask(128, 128, 1, 2, kv, 1, mask, 128, 4, 3));
+        }
+    }
+
     test_cases.emplace_back(new test_cross_entropy_loss     (GGML_TYPE_F32, {   10, 5, 4, 3}));
     test_cases.emplace_back(new test_cross_entropy_loss     (GGML_TYPE_F32, {30000, 1, 1, 1}));
     test_cases.emplace_back(new test_cross_entropy_loss_back(GGML_TYPE_F32, {   10, 5, 4, 3}));
@@ -4647,6 +5150,13 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_perf() {
         }
     }
 
+    // prompt processing
+    for (int kv : { 4096, 16384, }) {
+        for (int nb : { 32, 512, }) {
+            test_cases.emplace_back(new test_flash_attn_ext(128, 128, 8, 4, kv, nb, true, 0, 0, GGML_PREC_F32, GGML_TYPE_F16));
+        }
+    }
+
     test_cases.emplace_back(new test_conv_2d_dw({512, 512, 256, 1}, {3, 3, 1, 256}, 1, 1, 1, false));
     test_cases.emplace_back(new test_conv_2d_dw({512, 512, 256, 1}, {3, 3, 1, 256}, 1, 1, 1, true));
 
@@ -0,0 +1,173 @@
+// checks that the images encoded in a single graph by clip_image_batch_encode give the same embeddings as the
+// images encoded one by one, for the projectors that support batching (see clip_image_batch_supported)
+// the models are tiny random mmproj files written by the test
+
+#include "../tools/mtmd/clip.h"
+
+#include "ggml.h"
+#include "gguf.h"
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+static const int N_EMBD  = 32;
+static const int N_FF    = 64;
+static const int N_HEAD  = 4;
+static const int N_LAYER = 2;
+static const int N_TEXT  = 64;
+static const int IMG     = 64;
+static const int PATCH   = 8;
+static const int SCALE   = 2;
+
+// writes a random mmproj of the given projector type to fname
+static void write_mmproj(const char * fname, const char * proj_type) {
+    const std::string proj = proj_type;
+    const int n_patches = (IMG/PATCH)*(IMG/PATCH);
+
+    ggml_init_params params = {
+        /*.mem_size   =*/ 16*1024*1024,
+        /*.mem_buffer =*/ nullptr,
+        /*.no_alloc   =*/ false,
+    };
+    ggml_context * ctx = ggml_init(params);
+    gguf_context * gguf = gguf_init_empty();
+
+    const float mean_std[3] = { 0.5f, 0.5f, 0.5f };
+
+    gguf_set_val_bool(gguf, "clip.has_vision_encoder", true);
+    gguf_set_val_str (gguf, "clip.projector_type", proj_type);
+    gguf_set_val_u32 (gguf, "clip.vision.embedding_length", N_EMBD);
+    gguf_set_val_u32 (gguf, "clip.vision.feed_forward_length", N_FF);
+    gguf_set_val_u32 (gguf, "clip.vision.block_count", N_LAYER);
+    gguf_set_val_u32 (gguf, "clip.vision.projection_dim", N_TEXT);
+    gguf_set_val_u32 (gguf, "clip.vision.attention.head_count", N_HEAD);
+    gguf_set_val_f32 (gguf, "clip.vision.attention.layer_norm_epsilon", 1e-6f);
+    gguf_set_val_u32 (gguf, "clip.vision.image_size", IMG);
+    gguf_set_val_u32 (gguf, "clip.vision.patch_size", PATCH);
+    gguf_set_val_u32 (gguf, "clip.vision.projector.scale_factor", SCALE);
+    gguf_set_arr_data(gguf, "clip.vision.image_mean", GGUF_TYPE_FLOAT32, mean_std, 3);
+    gguf_set_arr_data(gguf, "clip.vision.image_std",  GGUF_TYPE_FLOAT32, mean_std, 3);
+
+    std::mt19937 rng(1234);
+    std::normal_distribution<float> dist(0.0f, 0.2f);
+
+    auto add = [&](const std::string & name, int64_t ne0, int64_t ne1 = 1, int64_t ne2 = 1, int64_t ne3 = 1) {
+        ggml_tensor * t = ggml_new_tensor_4d(ctx, GGML_TYPE_F32, ne0, ne1, ne2, ne3);
+        ggml_set_name(t, name.c_str());
+        float * data = (float *) t->data;
+        for (int64_t i = 0; i < ggml_nelements(t); ++i) {
+            data[i] = dist(rng);
+        }
+        gguf_add_tensor(gguf, t);
+    };
+
+    add("v.patch_embd.weight", PATCH, PATCH, 3, N_EMBD);
+    add("v.patch_embd.bias", N_EMBD);
+    add("v.position_embd.weight", N_EMBD, n_patches);
+    for (int il = 0; il < N_LAYER; ++il) {
+        const std::string p = "v.blk." + std::to_string(il) + ".";
+        for (const char * n : { "attn_q", "attn_k", "attn_v", "attn_out" }) {
+            add(p + n + ".weight", N_EMBD, N_EMBD);
+            add(p + n + ".bias", N_EMBD);
+        }
+        add(p + "ln1.weight", N_EMBD);
+        add(p + "ln1.bias", N_EMBD);
+        add(p + "ln2.weight", N_EMBD);
+        add(p + "ln2.bias", N_EMBD);
+        add(p + "ffn_up.weight", N_EMBD, N_FF);
+        add(p + "ffn_up.bias", N_FF);
+        add(p + "ffn_down.weight", N_FF, N_EMBD);
+        add(p + "ffn_down.bias", N_EMBD);
+    }
+    add("v.post_ln.weight", N_EMBD);
+    add("v.post_ln.bias", N_EMBD);
+
+    if (proj == "gemma3") {
+        add("mm.input_projection.weight", N_TEXT, N_EMBD);
+        add("mm.soft_emb_norm.weight", N_EMBD);
+    } else {
+        add("mm.model.fc.weight", N_EMBD*SCALE*SCALE, N_TEXT);
+    }
+
+    GGML_ASSERT(gguf_write_to_file(gguf, fname, false));
+
+    gguf_free(gguf);
+    ggml_free(ctx);
+}
+
+static bool test_batch(const char * proj_type) {
+    const std::string fname = std::string("test-clip-batch-") + proj_type + ".gguf";
+    write_mmproj(fname.c_str(), proj_type);
+
+    clip_context_params cparams = {
+        /*.use_gpu   =*/ false,
+        /*.verbosity =*/ GGML_LOG_LEVEL_ERROR,
+        /*.n_threads =*/ 2,
+    };
+    clip_ctx * ctx = clip_init(fname.c_str(), cparams).ctx_v;
+    std::remove(fname.c_str());
+    GGML_ASSERT(ctx != nullptr);
+    GGML_ASSERT(clip_image_batch_supported(ctx));
+
+    const int n_imgs = 3;
+
+    // random images of different sizes, all preprocessed to the same size, appended to the same batch
+    std::mt19937 rng(42);
+    clip_image_f32_batch * batch = clip_image_f32_batch_init();
+    for (int i = 0; i < n_imgs; ++i) {
+        const int nx = IMG + 16*i;
+        const int ny = IMG + 8*(n_imgs - i);
+        std::vector<unsigned char> rgb(3*nx*ny);
+        for (auto & v : rgb) {
+            v = rng() % 256;
+        }
+        clip_image_u8 * img = clip_image_u8_init();
+        clip_build_img_from_pixels(rgb.data(), nx, ny, img);
+        GGML_ASSERT(clip_image_preprocess(ctx, img, batch));
+        clip_image_u8_free(img);
+    }
+    GGML_ASSERT(clip_image_f32_batch_n_images(batch) == (size_t) n_imgs);
+
+    const size_t n_out = clip_n_output_tokens(ctx, clip_image_f32_get_img(batch, 0))*clip_n_mmproj_embd(ctx);
+
+    std::vector<float> embd_batch(n_imgs*n_out);
+    GGML_ASSERT(clip_image_batch_encode(ctx, 2, batch, embd_batch.data()));
+
+    bool ok = true;
+
+    for (int i = 0; i < n_imgs; ++i) {
+        std::vector<float> embd(n_out);
+        GGML_ASSERT(clip_image_encode(ctx, 2, clip_image_f32_get_img(batch, i), embd.data()));
+
+        double err_max = 0.0;
+        double val_max = 0.0;
+        for (size_t j = 0; j < n_out; ++j) {
+            err_max = std::max(err_max, (double) std::fabs(embd[j] - embd_batch[i*n_out + j]));
+            val_max = std::max(val_max, (double) std::fabs(embd[j]));
+        }
+
+        const bool ok_img = err_max <= 1e-5*std::max(1.0, val_max);
+        printf("%s: %-8s image %d: max. abs. error %.3g (max. abs. value %.3g) %s\n",
+                __func__, proj_type, i, err_max, val_max, ok_img ? "OK" : "FAIL");
+        ok = ok && ok_img;
+    }
+
+    clip_image_f32_batch_free(batch);
+    clip_free(ctx);
+
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+
+    ok = test_batch("gemma3")   && ok;
+    ok = test_batch("idefics3") && ok;
+
+    printf("%s\n", ok ? "OK" : "FAIL");
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include "../tools/mtmd/mtmd-embd-cache.h"
+
+#include <cassert>
+#include <cstdio>
+#include <vector>
+
+static std::vector<uint8_t> make_key(int32_t nx, int32_t ny, float fill) {
+    std::vector<uint8_t> key;
+    const std::vector<float> buf(nx*ny*3, fill);
+    mtmd_embd_cache::key_add(key, &nx, sizeof(nx));
+    mtmd_embd_cache::key_add(key, &ny, sizeof(ny));
+    mtmd_embd_cache::key_add(key, buf.data(), buf.size()*sizeof(float));
+    return key;
+}
+
+// two different inputs forced into the same bucket must never return each other's embeddings
+static void test_collision() {
+    mtmd_embd_cache cache;
+    cache.size_max = 1024*1024;
+
+    const std::vector<uint8_t> key_a = make_key(4, 4, 0.25f);
+    const std::vector<uint8_t> key_b = make_key(4, 4, 0.75f);
+    assert(key_a != key_b);
+
+    const std::vector<float> embd_a(64, 1.0f);
+    const std::vector<float> embd_b(64, 2.0f);
+
+    const uint64_t hash = 0x0123456789abcdefULL;
+
+    cache.put(hash, key_a, embd_a.data(), embd_a.size());
+    assert(cache.get(hash, key_a) != nullptr && *cache.get(hash, key_a) == embd_a);
+    assert(cache.get(hash, key_b) == nullptr);
+
+    // the colliding entry replaces the old one, the old key misses afterwards
+    cache.put(hash, key_b, embd_b.data(), embd_b.size());
+    assert(cache.get(hash, key_a) == nullptr);
+    assert(cache.get(hash, key_b) != nullptr && *cache.get(hash, key_b) == embd_b);
+
+    assert(cache.entries.size() == 1);
+    assert(cache.size == key_b.size() + embd_b.size()*sizeof(float));
+
+    // the real hash still finds the entry through its key
+    cache.put(key_a, embd_a.data(), embd_a.size());
+    assert(cache.get(key_a) != nullptr && *cache.get(key_a) == embd_a);
+    assert(cache.get(mtmd_embd_cache::hash_key(key_a), key_b) == nullptr);
+
+    printf("%s: OK\n", __func__);
+}
+
+// the least recently used entries are evicted first, the keys count towards the size
+static void test_lru() {
+    const std::vector<uint8_t> key_0 = make_key(2, 2, 0.0f);
+    const std::vector<uint8_t> key_1 = make_key(2, 2, 1.0f);
+    const std::vector<uint8_t> key_2 = make_key(2, 2, 2.0f);
+
+    const std::vector<float> embd(16, 1.0f);
+
+    const size_t n_bytes = key_0.size() + embd.size()*sizeof(float);
+
+    mtmd_embd_cache cache;
+    cache.size_max = 2*n_bytes;
+
+    cache.put(key_0, embd.data(), embd.size());
+    cache.put(key_1, embd.data(), embd.size());
+    assert(cache.get(key_0) != nullptr); // key_1 is now the least recently used
+
+    cache.put(key_2, embd.data(), embd.size());
+    assert(cache.get(key_0) != nullptr);
+    assert(cache.get(key_1) == nullptr);
+    assert(cache.get(key_2) != nullptr);
+    assert(cache.size == 2*n_bytes);
+
+    // an entry larger than the cache is not stored
+    const std::vector<float> embd_large(2*n_bytes/sizeof(float), 1.0f);
+    cache.put(key_1, embd_large.data(), embd_large.size());
+    assert(cache.get(key_1) == nullptr);
+    assert(cache.entries.size() == 2);
+
+    printf("%s: OK\n", __func__);
+}
+
+int main() {
+    test_collision();
+    test_lru();
+
+    printf("OK\n");
+
+    return 0;
+}
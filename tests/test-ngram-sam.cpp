@@ -0,0 +1,212 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include "ngram-sam.h"
+#include "ggml.h"
+
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+// length of the longest suffix of inp that also ends at an earlier position
+static int32_t longest_match_ref(const std::vector<llama_token> & inp) {
+    const int32_t n = inp.size();
+
+    int32_t res = 0;
+    for (int32_t end = 0; end < n - 1; ++end) {
+        int32_t len = 0;
+        while (len <= end && inp[end - len] == inp[n - 1 - len]) {
+            len++;
+        }
+        res = std::max(res, len);
+    }
+
+    return res;
+}
+
+static void test_random(int n_tokens, int n_vocab, uint32_t seed) {
+    std::mt19937 rng(seed);
+
+    common_ngram_sam sam;
+    std::vector<llama_token> inp;
+
+    for (int i = 0; i < n_tokens; ++i) {
+        // repeat earlier spans from time to time, as an LLM quoting its input would
+        if (i > 16 && rng() % 8 == 0) {
+            const int start = rng() % (inp.size() - 8);
+            const int len   = 1 + rng() % 8;
+            for (int j = 0; j < len; ++j) {
+                inp.push_back(inp[start + j]);
+                sam.append(inp.back());
+            }
+        }
+
+        inp.push_back(rng() % 8 == 0 ? LLAMA_TOKEN_NULL : (llama_token) (rng() % n_vocab));
+        sam.append(inp.back());
+
+        std::vector<llama_token> draft;
+        const int32_t n_match = sam.draft(draft, 8, 1);
+
+        assert(n_match == longest_match_ref(inp));
+        assert(n_match > 0 || draft.empty());
+
+        if (draft.empty()) {
+            continue;
+        }
+
+        // the draft continues an earlier occurrence of the matched suffix
+        std::vector<llama_token> ext = inp;
+        ext.insert(ext.end(), draft.begin(), draft.end());
+
+        bool found = false;
+        for (size_t end = n_match - 1; end + 1 < inp.size() && !found; ++end) {
+            bool ok = true;
+            for (int32_t k = 0; k < n_match && ok; ++k) {
+                ok = ext[end - k] == inp[inp.size() - 1 - k];
+            }
+            for (size_t k = 0; k < draft.size() && ok; ++k) {
+                ok = ext[end + 1 + k] == draft[k] && draft[k] != LLAMA_TOKEN_NULL;
+            }
+            found = ok;
+        }
+        assert(found);
+    }
+
+    printf("%s: n_tokens = %zu, n_vocab = %d: OK\n", __func__, inp.size(), n_vocab);
+}
+
+static void test_periodic() {
+    common_ngram_sam sam;
+
+    const std::vector<llama_token> inp = { 5, 1, 2, 3, 1, 2, 3, 1 };
+    sam.append(inp.data(), inp.size());
+
+    std::vector<llama_token> draft;
+    assert(sam.draft(draft, 7) == 4);
+    assert((draft == std::vector<llama_token>{ 2, 3, 1, 2, 3, 1, 2 }));
+}
+
+static void test_save_load() {
+    common_ngram_sam sam;
+
+    std::vector<llama_token> inp;
+    for (int i = 0; i < 1000; ++i) {
+        inp.push_back((i*7919) % 97);
+    }
+    sam.append(inp.data(), inp.size());
+
+    const std::string fname = "test-ngram-sam.tmp";
+    assert(sam.save(fname));
+
+    common_ngram_sam sam2;
+    assert(sam2.load(fname));
+    assert(sam2.tokens == sam.tokens);
+
+    std::vector<llama_token> draft0;
+    std::vector<llama_token> draft1;
+    assert(sam.draft(draft0, 16) == sam2.draft(draft1, 16));
+    assert(draft0 == draft1);
+
+    std::remove(fname.c_str());
+}
+
+// the token log of lookup decoding skips texts it already contains and keeps at most n_max tokens
+static void test_log_append() {
+    const std::string fname = "test-ngram-sam-log.tmp";
+    std::remove(fname.c_str());
+
+    const std::vector<llama_token> text0 = { 1, 2, 3, 4, 5 };
+    const std::vector<llama_token> text1 = { 6, 7, 8 };
+
+    common_ngram_sam sam;
+    assert(common_ngram_sam_log_append(fname, text0, 16));
+    assert(sam.load(fname) && sam.tokens == text0);
+
+    assert(sam.contains(text0.data(), text0.size()));
+    assert(sam.contains(text0.data() + 1, 3));
+    assert(!sam.contains(text1.data(), text1.size()));
+
+    // the same text, or a part of it, is not appended again
+    assert(common_ngram_sam_log_append(fname, text0, 16));
+    assert(common_ngram_sam_log_append(fname, { 2, 3, 4 }, 16));
+    assert(sam.load(fname) && sam.tokens == text0);
+
+    assert(common_ngram_sam_log_append(fname, text1, 16));
+    assert(sam.load(fname) && sam.tokens == std::vector<llama_token>({ 1, 2, 3, 4, 5, LLAMA_TOKEN_NULL, 6, 7, 8 }));
+
+    // a text that extends an earlier one replaces it
+    assert(common_ngram_sam_log_append(fname, { 1, 2, 3, 4, 5, 15 }, 16));
+    assert(sam.load(fname) && sam.tokens == std::vector<llama_token>({ 6, 7, 8, LLAMA_TOKEN_NULL, 1, 2, 3, 4, 5, 15 }));
+    assert(common_ngram_sam_log_append(fname, text1, 16));
+    assert(sam.load(fname) && sam.tokens == std::vector<llama_token>({ 6, 7, 8, LLAMA_TOKEN_NULL, 1, 2, 3, 4, 5, 15 }));
+
+    // the oldest texts are dropped
+    assert(common_ngram_sam_log_append(fname, { 9, 10, 11, 12, 13, 14 }, 14));
+    assert(sam.load(fname) && sam.tokens == std::vector<llama_token>({ 1, 2, 3, 4, 5, 15, LLAMA_TOKEN_NULL, 9, 10, 11, 12, 13, 14 }));
+
+    // a text longer than the log keeps its end
+    assert(common_ngram_sam_log_append(fname, { 20, 21, 22, 23, 24, 25 }, 4));
+    assert(sam.load(fname) && sam.tokens == std::vector<llama_token>({ 22, 23, 24, 25 }));
+
+    // a file in another format is not overwritten
+    {
+        std::ofstream f(fname, std::ios::binary);
+        f << "not a token log";
+    }
+    assert(!common_ngram_sam_log_append(fname, text0, 16));
+    {
+        std::ifstream f(fname, std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        assert(content == "not a token log");
+    }
+
+    std::remove(fname.c_str());
+}
+
+static void bench(int n_tokens) {
+    std::mt19937 rng(42);
+
+    std::vector<llama_token> inp;
+    for (int i = 0; i < n_tokens; ++i) {
+        inp.push_back(rng() % 32000);
+    }
+
+    common_ngram_sam sam;
+
+    const int64_t t_start_us = ggml_time_us();
+
+    std::vector<llama_token> draft;
+    for (const llama_token token : inp) {
+        sam.append(token);
+
+        draft.clear();
+        sam.draft(draft, 16);
+    }
+
+    const int64_t t_us = ggml_time_us() - t_start_us;
+
+    printf("%s: n_tokens = %d, append + draft: %.3f us/token\n", __func__, n_tokens, (double) t_us / n_tokens);
+}
+
+int main() {
+    ggml_time_init();
+
+    test_periodic();
+    test_save_load();
+    test_log_append();
+
+    test_random(2000,  2, 1);
+    test_random(2000,  4, 2);
+    test_random(2000, 50, 3);
+
+    bench(1 << 20);
+
+    printf("OK\n");
+
+    return 0;
+}
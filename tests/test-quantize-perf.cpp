@@ -10,6 +10,7 @@
 #include <math.h>
 #include <memory>
 #include <stdio.h>
+#include <string.h>
 #include <string>
 #include <vector>
 
@@ -23,6 +24,10 @@
 #define ITERATIONS 10
 #define MAX_ITERATIONS 100000000
 
+// shape of the K cache writes benchmarked by cpy_q: n_embd_head x n_head_kv x n_tokens
+#define CPY_HEAD_SIZE 128
+#define CPY_N_HEAD      8
+
 #define L1_SIZE      32*128
 #define L2_SIZE     32*2048
 #define L3_SIZE    32*20480
@@ -37,7 +42,9 @@ struct quantize_perf_params {
     bool op_dequantize_row_q = false;
     bool op_quantize_row_q_dot = false;
     bool op_vec_dot_q = false;
+    bool op_cpy_q = false;
     int64_t iterations = ITERATIONS;
+    int n_threads = GGML_DEFAULT_N_THREADS;
 };
 
 #if defined(__x86_64__) || defined(__i386__)
@@ -118,7 +125,7 @@ static void usage(char * argv[]) {
     printf("  -3                    use size as L1, L2, L3 sizes (L1:%d L2:%d L3:%d)\n", L1_SIZE, L2_SIZE, L3_SIZE);
     printf("  -4                    use size as L1, L2, L3, MEM sizes (L1:%d L2:%d L3:%d MEM:%d)\n", L1_SIZE, L2_SIZE, L3_SIZE, MEM_SIZE);
     printf("  --op OP               set test operation as quantize_row_q_reference, quantize_row_q, dequantize_row_q,\n");
-    printf("                        quantize_row_q_dot, vec_dot_q (all)\n");
+    printf("                        quantize_row_q_dot, vec_dot_q, cpy_q (all)\n");
     printf("  --type TYPE           set test type as");
     for (int i = 0; i < GGML_TYPE_COUNT; i++) {
         ggml_type type = (ggml_type) i;
@@ -135,6 +142,7 @@ static void usage(char * argv[]) {
     printf("                        set alignment offset as OFFSET (0)\n");
     printf("  -i NUM, --iterations NUM\n");
     printf("                        set test iteration number (%d)\n", ITERATIONS);
+    printf("  -t N, --threads N     number of threads used by cpy_q (%d)\n", GGML_DEFAULT_N_THREADS);
 }
 
 int main(int argc, char * argv[]) {
@@ -186,6 +194,8 @@ int main(int argc, char * argv[]) {
                 params.op_quantize_row_q_dot = true;
             } else if (op == "vec_dot_q") {
                 params.op_vec_dot_q = true;
+            } else if (op == "cpy_q") {
+                params.op_cpy_q = true;
             } else {
                 invalid_param = true;
                 break;
@@ -220,6 +230,17 @@ int main(int argc, char * argv[]) {
                 break;
             }
             params.iterations = number;
+        } else if ((arg == "-t") || (arg == "--threads")) {
+            if (++i >= argc) {
+                invalid_param = true;
+                break;
+            }
+            params.n_threads = std::stoi(argv[i]);
+            if (params.n_threads <= 0) {
+                fprintf(stderr, "error: threads must be positive\n");
+                invalid_param = true;
+                break;
+            }
         } else if ((arg == "-h") || (arg == "--help")) {
             usage(argv);
             return 1;
@@ -236,8 +257,8 @@ int main(int argc, char * argv[]) {
     if (params.test_sizes.empty()) {
         params.test_sizes.push_back(L1_SIZE);
     }
-    if (!(params.op_quantize_row_q_reference || params.op_quantize_row_q || params.op_dequantize_row_q || params.op_quantize_row_q_dot || params.op_vec_dot_q)) {
-        params.op_quantize_row_q_reference = params.op_quantize_row_q = params.op_dequantize_row_q = params.op_quantize_row_q_dot = params.op_vec_dot_q = true;
+    if (!(params.op_quantize_row_q_reference || params.op_quantize_row_q || params.op_dequantize_row_q || params.op_quantize_row_q_dot || params.op_vec_dot_q || params.op_cpy_q)) {
+        params.op_quantize_row_q_reference = params.op_quantize_row_q = params.op_dequantize_row_q = params.op_quantize_row_q_dot = params.op_vec_dot_q = params.op_cpy_q = true;
     }
 
     std::sort(params.test_sizes.begin(), params.test_sizes.end());
@@ -356,6 +377,47 @@ int main(int argc, char * argv[]) {
                 }
                 printf("\n");
             }
+
+            // ggml_cpy of F32 rows into a quantized tensor with the shape of the K cache writes
+            if (params.op_cpy_q && CPY_HEAD_SIZE % ggml_blck_size(type) == 0) {
+                printf("  cpy_q (%d threads)\n", params.n_threads);
+                for (size_t size : params.test_sizes) {
+                    printf("    %zu values (%.2f MB)\n", size, 4*size/(float)(1024*1024));
+                    if (size % (CPY_HEAD_SIZE*CPY_N_HEAD) != 0) {
+                        printf("      skipped, size not divisible by %d\n", CPY_HEAD_SIZE*CPY_N_HEAD);
+                        continue;
+                    }
+                    const int64_t n_tokens = size/(CPY_HEAD_SIZE*CPY_N_HEAD);
+                    size_t quantized_size = ggml_row_size(type, size);
+
+                    struct ggml_init_params cpy_params = {
+                        /* .mem_size   = */ 4*ggml_tensor_overhead() + ggml_graph_overhead_custom(4, false) + 4*size + quantized_size + 2*MAX_ALIGNMENT,
+                        /* .mem_buffer = */ NULL,
+                        /* .no_alloc   = */ false,
+                    };
+                    struct ggml_context * cpy_ctx = ggml_init(cpy_params);
+
+                    struct ggml_tensor * src = ggml_new_tensor_3d(cpy_ctx, GGML_TYPE_F32, CPY_HEAD_SIZE, CPY_N_HEAD, n_tokens);
+                    struct ggml_tensor * dst = ggml_new_tensor_3d(cpy_ctx, type,          CPY_HEAD_SIZE, CPY_N_HEAD, n_tokens);
+                    memcpy(src->data, test_data1, 4*size);
+
+                    struct ggml_cgraph * gf = ggml_new_graph_custom(cpy_ctx, 4, false);
+                    ggml_build_forward_expand(gf, ggml_cpy(cpy_ctx, src, dst));
+
+                    struct ggml_cplan cplan = ggml_graph_plan(gf, params.n_threads, NULL);
+                    std::vector<uint8_t> work_data(cplan.work_size);
+                    cplan.work_data = work_data.data();
+
+                    auto quantize_fn = [&](void) -> float {
+                        ggml_graph_compute(gf, &cplan);
+                        return ((float *) dst->data)[0];
+                    };
+                    benchmark_function(size, quantized_size, iterations, quantize_fn);
+
+                    ggml_free(cpy_ctx);
+                }
+                printf("\n");
+            }
         }
     }
 
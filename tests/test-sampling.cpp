@@ -1,5 +1,8 @@
 #include "ggml.h"
+#include "ggml-backend.h"
+#include "ggml-cpu.h"
 #include "llama.h"
+#include "sampling.h"
 
 #ifdef NDEBUG
 #undef NDEBUG
@@ -7,6 +10,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <random>
 #include <string>
 #include <vector>
 
@@ -267,6 +271,151 @@ static void test_sampler_queue(const size_t n_vocab, const std::string & sampler
            samplers_sequence.c_str(), n_vocab, top_k, top_p, min_p);
 }
 
+// compare the partially sorted top-k/top-p against a full sort of the candidates
+static void test_partial_sort(size_t n_vocab, int top_k, float top_p) {
+    std::vector<llama_token_data> data;
+    data.reserve(n_vocab);
+    for (size_t i = 0; i < n_vocab; i++) {
+        // distinct logits, so that the order of the result is well defined
+        data.emplace_back(llama_token_data{(llama_token) i, -1e-3f*i, 0.0f});
+    }
+    std::mt19937 rng(1234);
+    std::shuffle(data.begin(), data.end(), rng);
+
+    std::vector<llama_token_data> ref = data;
+    std::sort(ref.begin(), ref.end(), [](const llama_token_data & a, const llama_token_data & b) {
+        return a.logit > b.logit;
+    });
+
+    {
+        std::vector<llama_token_data> cur = data;
+        llama_token_data_array cur_p = { cur.data(), cur.size(), -1, false };
+
+        auto * sampler = llama_sampler_init_top_k(top_k);
+        llama_sampler_apply(sampler, &cur_p);
+        llama_sampler_free(sampler);
+
+        GGML_ASSERT(cur_p.size == (size_t) top_k);
+        for (size_t i = 0; i < cur_p.size; i++) {
+            GGML_ASSERT(cur_p.data[i].id == ref[i].id);
+        }
+    }
+
+    {
+        std::vector<llama_token_data> cur = data;
+        llama_token_data_array cur_p = { cur.data(), cur.size(), -1, false };
+
+        auto * sampler = llama_sampler_init_top_p(top_p, 1);
+        llama_sampler_apply(sampler, &cur_p);
+        llama_sampler_free(sampler);
+
+        // reference: softmax and cumulative sum over the fully sorted candidates
+        float sum = 0.0f;
+        for (size_t i = 0; i < ref.size(); i++) {
+            sum += expf(ref[i].logit - ref[0].logit);
+        }
+        float cum_sum = 0.0f;
+        size_t expected_size = ref.size();
+        for (size_t i = 0; i < ref.size(); i++) {
+            cum_sum += expf(ref[i].logit - ref[0].logit)/sum;
+            if (cum_sum >= top_p) {
+                expected_size = i + 1;
+                break;
+            }
+        }
+
+        GGML_ASSERT(cur_p.sorted);
+        GGML_ASSERT(cur_p.size == expected_size);
+        for (size_t i = 0; i < cur_p.size; i++) {
+            GGML_ASSERT(cur_p.data[i].id == ref[i].id);
+            GGML_ASSERT(cur_p.data[i].p == expf(ref[i].logit - ref[0].logit)/sum);
+        }
+    }
+
+    printf("Partial sort OK with n_vocab=%06zu top_k=%05d top_p=%f\n", n_vocab, top_k, top_p);
+}
+
+// the batched sampling of common_sampler on a ggml threadpool must give the same tokens as sampling each slot on its own
+static void test_sample_batch(const char * fname_vocab) {
+    auto mparams = llama_model_default_params();
+    mparams.vocab_only = true;
+
+    llama_model * model = llama_model_load_from_file(fname_vocab, mparams);
+    GGML_ASSERT(model != nullptr);
+
+    const int n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(model));
+
+    auto * reg = ggml_backend_dev_backend_reg(ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_CPU));
+    auto * ggml_threadpool_new_fn  = (decltype(ggml_threadpool_new)  *) ggml_backend_reg_get_proc_address(reg, "ggml_threadpool_new");
+    auto * ggml_threadpool_free_fn = (decltype(ggml_threadpool_free) *) ggml_backend_reg_get_proc_address(reg, "ggml_threadpool_free");
+
+    ggml_threadpool_params tpp = ggml_threadpool_params_default(4);
+    ggml_threadpool * threadpool = ggml_threadpool_new_fn(&tpp);
+    GGML_ASSERT(threadpool != nullptr);
+
+    std::mt19937 rng(42);
+    std::normal_distribution<float> normal(0.0f, 3.0f);
+
+    for (const int n_slots : { 2, 7, 64 }) {
+        std::vector<common_sampler *> smpls_batch;
+        std::vector<common_sampler *> smpls_slot;
+
+        for (int i = 0; i < n_slots; ++i) {
+            common_params_sampling sparams;
+            sparams.seed  = 1234 + i;
+            sparams.temp  = i % 3 == 0 ? 0.0f : 0.8f; // mix greedy and stochastic slots
+            sparams.top_k = 40 + i;
+
+            smpls_batch.push_back(common_sampler_init(model, sparams));
+            smpls_slot .push_back(common_sampler_init(model, sparams));
+        }
+
+        std::vector<std::vector<float>> logits(n_slots, std::vector<float>(n_vocab));
+        std::vector<const float *> logits_ptr(n_slots);
+
+        const int n_iter = 8;
+
+        int64_t t_batch = 0;
+        int64_t t_slot  = 0;
+
+        for (int it = 0; it < n_iter; ++it) {
+            for (int i = 0; i < n_slots; ++i) {
+                for (auto & l : logits[i]) {
+                    l = normal(rng);
+                }
+                logits_ptr[i] = logits[i].data();
+            }
+
+            int64_t t_start = ggml_time_us();
+            const auto ids = common_sampler_sample_batch_logits(smpls_batch, logits_ptr, n_vocab, threadpool);
+            t_batch += ggml_time_us() - t_start;
+
+            t_start = ggml_time_us();
+            for (int i = 0; i < n_slots; ++i) {
+                const llama_token id = common_sampler_sample_logits(smpls_slot[i], logits_ptr[i], n_vocab);
+                GGML_ASSERT(id == ids[i]);
+            }
+            t_slot += ggml_time_us() - t_start;
+
+            for (int i = 0; i < n_slots; ++i) {
+                common_sampler_accept(smpls_batch[i], ids[i], true);
+                common_sampler_accept(smpls_slot [i], ids[i], true);
+            }
+        }
+
+        printf("Sample batch OK with n_slots=%2d: batched %8.3f us/iter, per slot %8.3f us/iter\n",
+                n_slots, t_batch / (float) n_iter, t_slot / (float) n_iter);
+
+        for (int i = 0; i < n_slots; ++i) {
+            common_sampler_free(smpls_batch[i]);
+            common_sampler_free(smpls_slot [i]);
+        }
+    }
+
+    ggml_threadpool_free_fn(threadpool);
+    llama_model_free(model);
+}
+
 static void bench(llama_sampler * cnstr, const char * cnstr_name, const std::vector<llama_token_data> & data, int n_iter) {
     std::vector<llama_token_data> cur(data.size());
     std::copy(data.begin(), data.end(), cur.begin());
@@ -287,6 +436,14 @@ static void bench(llama_sampler * cnstr, const char * cnstr_name, const std::vec
 
 #define BENCH(__cnstr, __data, __n_iter) bench((__cnstr), #__cnstr, (__data), (__n_iter))
 
+static llama_sampler * init_chain(const std::vector<llama_sampler *> & samplers) {
+    auto * chain = llama_sampler_chain_init(llama_sampler_chain_default_params());
+    for (auto * smpl : samplers) {
+        llama_sampler_chain_add(chain, smpl);
+    }
+    return chain;
+}
+
 static void test_perf() {
     const int n_vocab = 1 << 17;
 
@@ -303,9 +460,28 @@ static void test_perf() {
     BENCH(llama_sampler_init_min_p  (0.2f, 1),                data, 32);
     BENCH(llama_sampler_init_typical(0.5f, 1),                data, 32);
     BENCH(llama_sampler_init_xtc    (1.0f, 0.1f, 1, 1),       data, 32);
+
+    // large vocab with a peaked distribution of the logits
+    const int n_vocab_large = 1 << 18;
+
+    std::mt19937 rng(1234);
+    std::normal_distribution<float> normal(0.0f, 3.0f);
+
+    data.clear();
+    data.reserve(n_vocab_large);
+    for (int i = 0; i < n_vocab_large; i++) {
+        data.emplace_back(llama_token_data{i, normal(rng), 0.0f});
+    }
+
+    BENCH(llama_sampler_init_top_k  (40),                     data, 32);
+    BENCH(llama_sampler_init_top_k  (1000),                   data, 32);
+    BENCH(llama_sampler_init_top_p  (0.9f, 1),                data, 32);
+    BENCH(llama_sampler_init_typical(0.5f, 1),                data, 32);
+    BENCH(init_chain({llama_sampler_init_top_k(40), llama_sampler_init_top_p(0.9f, 1), llama_sampler_init_min_p(0.05f, 1), llama_sampler_init_temp(0.8f), llama_sampler_init_dist(1)}), data, 32);
+    BENCH(init_chain({llama_sampler_init_top_p(0.9f, 1), llama_sampler_init_min_p(0.05f, 1), llama_sampler_init_temp(0.8f), llama_sampler_init_dist(1)}), data, 32);
 }
 
-int main(void) {
+int main(int argc, char ** argv) {
     ggml_time_init();
 
     test_temp({0.1f, 0.2f, 0.3f, 0.4f}, {0.4f, 0.3f, 0.2f, 0.1f}, 1.0f);
@@ -392,6 +568,16 @@ int main(void) {
     test_sampler_queue(10000, "mkp", 100, 0.8f, 0.1f);
     test_sampler_queue(10000, "mpk", 100, 0.8f, 0.1f);
 
+    test_partial_sort(1 << 17,    40, 0.5f);
+    test_partial_sort(1 << 17,  1000, 0.9f);
+    test_partial_sort(1 << 17,  5000, 0.99f);
+    test_partial_sort(   1000,   200, 1.0f - 1e-4f);
+
+    if (argc > 1) {
+        llama_backend_init();
+        test_sample_batch(argv[1]);
+    }
+
     printf("OK\n");
 
     test_perf();
@@ -0,0 +1,187 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include "llama.h"
+#include "ggml.h"
+
+#include "../src/llama-vocab.h"
+#include "../src/llama-grammar.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+static const char * json_grammar = R"""(
+root   ::= object
+value  ::= object | array | string | number | ("true" | "false" | "null") ws
+
+object ::=
+  "{" ws (
+            string ":" ws value
+    ("," ws string ":" ws value)*
+  )? "}" ws
+
+array  ::=
+  "[" ws (
+            value
+    ("," ws value)*
+  )? "]" ws
+
+string ::=
+  "\"" (
+    [^"\\\x7F\x00-\x1F] |
+    "\\" (["\\bfnrt] | "u" [0-9a-fA-F]{4}) # escapes
+  )* "\"" ws
+
+number ::= ("-"? ([0-9] | [1-9] [0-9]{0,15})) ("." [0-9]+)? ([eE] [-+]? [0-9] [1-9]{0,15})? ws
+
+ws ::= | " " | "\n" [ \t]{0,20}
+)""";
+
+static const char * json_text = R"""({"name": "Zoë", "tags": ["α", "b\n", "日本語"], "price": 12.50, "stock": null, "ok": true})""";
+
+static void test_trie(const llama_vocab & vocab) {
+    const auto & trie = vocab.token_trie();
+
+    const uint32_t n_tokens = vocab.n_tokens();
+
+    assert(trie.tokens.size() == n_tokens);
+    assert(trie.nodes[0].tok_begin == 0 && trie.nodes[0].tok_end == n_tokens);
+
+    // every token ends at the node of its piece
+    for (uint32_t id = 0; id < n_tokens; ++id) {
+        const std::string & piece = vocab.token_to_piece(id);
+
+        const int32_t node = trie.find(piece.data(), piece.size());
+        assert(node >= 0);
+
+        bool found = false;
+        for (uint32_t i = trie.nodes[node].tok_begin; i < trie.nodes[node].tok_self; ++i) {
+            found = found || trie.tokens[i] == (llama_token) id;
+        }
+        assert(found);
+    }
+
+    // the subtree of a prefix contains exactly the tokens starting with it
+    std::map<std::string, uint32_t> n_with_prefix;
+    for (uint32_t id = 0; id < n_tokens; ++id) {
+        const std::string & piece = vocab.token_to_piece(id);
+        for (size_t len = 1; len <= std::min<size_t>(piece.size(), 2); ++len) {
+            n_with_prefix[piece.substr(0, len)]++;
+        }
+    }
+
+    for (const auto & it : n_with_prefix) {
+        const int32_t node = trie.find(it.first.data(), it.first.size());
+        assert(node >= 0);
+        assert(trie.nodes[node].tok_end - trie.nodes[node].tok_begin == it.second);
+    }
+
+    assert(trie.find("\xff\xff\xff\xff\xff\xff", 6) == -1);
+
+    printf("%s: %u tokens, %zu nodes, %.2f MiB\n", __func__, n_tokens, trie.nodes.size(), trie.size_bytes() / 1024.0 / 1024.0);
+}
+
+static void test_grammar(const llama_vocab & vocab) {
+    const uint32_t n_tokens = vocab.n_tokens();
+
+    // the candidates are applied in small chunks for the reference, which bypasses the trie
+    const size_t n_chunk = std::max<size_t>(1, n_tokens / 64);
+
+    llama_grammar * grammar = llama_grammar_init_impl(&vocab, json_grammar, "root", false, nullptr, 0, nullptr, 0);
+    assert(grammar != nullptr);
+
+    const auto & trie = vocab.token_trie();
+
+    std::vector<llama_token_data> cur(n_tokens);
+    std::vector<llama_token_data> ref(n_tokens);
+
+    int64_t t_trie_us = 0;
+    int64_t t_ref_us  = 0;
+
+    std::string text = json_text;
+    size_t n_steps = 0;
+
+    while (!text.empty()) {
+        for (uint32_t id = 0; id < n_tokens; ++id) {
+            cur[id] = ref[id] = llama_token_data{ (llama_token) id, 0.0f, 0.0f };
+        }
+
+        int64_t t_start_us = ggml_time_us();
+        {
+            llama_token_data_array cur_p = { cur.data(), cur.size(), -1, false };
+            llama_grammar_apply_impl(*grammar, &cur_p);
+        }
+        t_trie_us += ggml_time_us() - t_start_us;
+
+        t_start_us = ggml_time_us();
+        for (size_t i = 0; i < ref.size(); i += n_chunk) {
+            llama_token_data_array ref_p = { ref.data() + i, std::min(n_chunk, ref.size() - i), -1, false };
+            llama_grammar_apply_impl(*grammar, &ref_p);
+        }
+        t_ref_us += ggml_time_us() - t_start_us;
+
+        for (uint32_t id = 0; id < n_tokens; ++id) {
+            assert(std::isinf(cur[id].logit) == std::isinf(ref[id].logit));
+        }
+
+        // continue with the longest allowed token that is a prefix of the remaining text
+        llama_token token = LLAMA_TOKEN_NULL;
+        size_t      len   = 0;
+        int32_t     node  = 0;
+        for (size_t i = 0; node >= 0; ++i) {
+            for (uint32_t j = trie.nodes[node].tok_begin; j < trie.nodes[node].tok_self; ++j) {
+                if (!std::isinf(cur[trie.tokens[j]].logit)) {
+                    token = trie.tokens[j];
+                    len   = i;
+                }
+            }
+            node = i < text.size() ? trie.child(node, text[i]) : -1;
+        }
+        assert(token != LLAMA_TOKEN_NULL && len > 0);
+
+        llama_grammar_accept_impl(*grammar, token);
+
+        text = text.substr(len);
+        n_steps++;
+    }
+
+    llama_grammar_free_impl(grammar);
+
+    printf("%s: %zu steps, apply with trie: %.3f ms/step, without: %.3f ms/step\n", __func__,
+            n_steps, t_trie_us / 1000.0 / n_steps, t_ref_us / 1000.0 / n_steps);
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s vocab-file\n", argv[0]);
+        return 1;
+    }
+
+    llama_backend_init();
+
+    auto mparams = llama_model_default_params();
+    mparams.vocab_only = true;
+
+    llama_model * model = llama_model_load_from_file(argv[1], mparams);
+    if (model == NULL) {
+        fprintf(stderr, "%s: error: failed to load vocab '%s'\n", __func__, argv[1]);
+        return 1;
+    }
+
+    const llama_vocab * vocab = llama_model_get_vocab(model);
+
+    test_trie(*vocab);
+    test_grammar(*vocab);
+
+    llama_model_free(model);
+    llama_backend_free();
+
+    fprintf(stderr, "All tests passed.\n");
+    return 0;
+}
@@ -27,6 +27,7 @@
 #include <array>
 #include <numeric>
 #include <functional>
+#include <thread>
 
 struct clip_logger_state g_logger_state = {GGML_LOG_LEVEL_CONT, clip_log_callback_default, NULL};
 
@@ -374,12 +375,16 @@ struct clip_ctx {
     int max_nodes = 8192;
     ggml_backend_sched_ptr sched;
 
+    // number of threads used to preprocess the images
+    int n_threads = 1;
+
     // for debugging
     bool debug_graph = false;
     std::vector<ggml_tensor *> debug_print_tensors;
 
     clip_ctx(clip_context_params & ctx_params) {
         debug_graph = std::getenv("MTMD_DEBUG_GRAPH") != nullptr;
+        n_threads = std::max(1, ctx_params.n_threads);
         backend_cpu = ggml_backend_init_by_type(GGML_BACKEND_DEVICE_TYPE_CPU, nullptr);
         if (!backend_cpu) {
             throw std::runtime_error("failed to initialize CPU backend");
@@ -423,8 +428,9 @@ struct clip_graph {
     const clip_model & model;
     const clip_hparams & hparams;
 
-    // we only support single image per batch
+    // all images of a batch have the same size, only some graphs support more than one (see clip_image_batch_supported)
     const clip_image_f32 & img;
+    const int n_batch;
 
     const int patch_size;
     const int n_patches_x;
@@ -441,11 +447,12 @@ struct clip_graph {
     ggml_context * ctx0;
     ggml_cgraph * gf;
 
-    clip_graph(clip_ctx * ctx, const clip_image_f32 & img) :
+    clip_graph(clip_ctx * ctx, const clip_image_f32 & img, int n_batch = 1) :
             ctx(ctx),
             model(ctx->model),
             hparams(model.hparams),
             img(img),
+            n_batch(n_batch),
             patch_size(hparams.patch_size),
             n_patches_x(img.nx / patch_size),
             n_patches_y(img.ny / patch_size),
@@ -476,7 +483,7 @@ struct clip_graph {
                                 nullptr);
 
         if (ctx->proj_type() == PROJECTOR_TYPE_GEMMA3) {
-            const int batch_size = 1;
+            const int batch_size = n_batch;
             GGML_ASSERT(n_patches_x == n_patches_y);
             const int patches_per_image = n_patches_x;
             const int kernel_size = hparams.proj_scale_factor;
@@ -504,7 +511,7 @@ struct clip_graph {
             const int scale_factor = model.hparams.proj_scale_factor;
             const int n_embd = cur->ne[0];
             const int seq    = cur->ne[1];
-            const int bsz    = 1; // batch size, always 1 for now since we don't support batching
+            const int bsz    = n_batch;
             const int height = std::sqrt(seq);
             const int width  = std::sqrt(seq);
             GGML_ASSERT(scale_factor != 0);
@@ -1612,9 +1619,9 @@ private:
                     cb(Kcur, "Kcur_norm", il);
                 }
 
-                Qcur = ggml_reshape_3d(ctx0, Qcur, d_head, n_head, n_pos);
-                Kcur = ggml_reshape_3d(ctx0, Kcur, d_head, n_head, n_pos);
-                Vcur = ggml_reshape_3d(ctx0, Vcur, d_head, n_head, n_pos);
+                Qcur = ggml_reshape_4d(ctx0, Qcur, d_head, n_head, n_pos, n_batch);
+                Kcur = ggml_reshape_4d(ctx0, Kcur, d_head, n_head, n_pos, n_batch);
+                Vcur = ggml_reshape_4d(ctx0, Vcur, d_head, n_head, n_pos, n_batch);
 
                 cb(Qcur, "Qcur", il);
                 cb(Kcur, "Kcur", il);
@@ -1688,11 +1695,11 @@ private:
     }
 
     // build the input after conv2d (inp_raw --> patches)
-    // returns tensor with shape [n_embd, n_patches]
+    // returns tensor with shape [n_embd, n_patches, n_batch]
     ggml_tensor * build_inp() {
         ggml_tensor * inp_raw = build_inp_raw();
         ggml_tensor * inp = ggml_conv_2d(ctx0, model.patch_embeddings_0, inp_raw, patch_size, patch_size, 0, 0, 1, 1);
-        inp = ggml_reshape_2d(ctx0, inp, n_patches, n_embd);
+        inp = ggml_reshape_3d(ctx0, inp, n_patches, n_embd, n_batch);
         inp = ggml_cont(ctx0, ggml_transpose(ctx0, inp));
         if (model.patch_bias) {
             inp = ggml_add(ctx0, inp, model.patch_bias);
@@ -1702,7 +1709,7 @@ private:
     }
 
     ggml_tensor * build_inp_raw(int channels = 3) {
-        ggml_tensor * inp_raw = ggml_new_tensor_3d(ctx0, GGML_TYPE_F32, img.nx, img.ny, channels);
+        ggml_tensor * inp_raw = ggml_new_tensor_4d(ctx0, GGML_TYPE_F32, img.nx, img.ny, channels, n_batch);
         ggml_set_name(inp_raw, "inp_raw");
         ggml_set_input(inp_raw);
         return inp_raw;
@@ -1854,7 +1861,7 @@ private:
 
             ggml_tensor * kqv = ggml_mul_mat(ctx0, v, kq);
             cur = ggml_permute(ctx0, kqv, 0, 2, 1, 3);
-            cur = ggml_cont_2d(ctx0, cur, cur->ne[0]*n_head, n_tokens);
+            cur = ggml_cont_3d(ctx0, cur, cur->ne[0]*n_head, n_tokens, cur->ne[3]);
         }
 
         cb(cur, "kqv_out", il);
@@ -1944,8 +1951,8 @@ private:
 };
 
 static ggml_cgraph * clip_image_build_graph(clip_ctx * ctx, const clip_image_f32_batch & imgs) {
-    GGML_ASSERT(imgs.entries.size() == 1 && "n_batch > 1 is not supported");
-    clip_graph graph(ctx, *imgs.entries[0]);
+    GGML_ASSERT((imgs.entries.size() == 1 || clip_image_batch_supported(ctx)) && "n_batch > 1 is not supported");
+    clip_graph graph(ctx, *imgs.entries[0], imgs.entries.size());
 
     ggml_cgraph * res;
 
@@ -2802,118 +2809,135 @@ void clip_build_img_from_pixels(const unsigned char * rgb_pixels, int nx, int ny
     memcpy(img->buf.data(), rgb_pixels, img->buf.size());
 }
 
+// split the rows [0, n_rows) of an image into contiguous chunks processed by up to n_threads threads
+// small images are processed on the calling thread, spawning threads costs more than the work itself
+template <typename F>
+static void image_parallel_rows(int n_rows, int n_cols, int n_threads, F && fn) {
+    const int n_pixels_min = 1 << 16; // min number of pixels per thread
+
+    n_threads = std::max(1, std::min(n_threads, (int) (((int64_t) n_rows * n_cols) / n_pixels_min)));
+    n_threads = std::min(n_threads, std::max(1, n_rows));
+
+    if (n_threads == 1) {
+        fn(0, n_rows);
+        return;
+    }
+
+    const int n_rows_per_thread = (n_rows + n_threads - 1) / n_threads;
+
+    std::vector<std::thread> workers;
+    workers.reserve(n_threads - 1);
+    for (int i = 1; i < n_threads; ++i) {
+        const int r0 = std::min(n_rows, i*n_rows_per_thread);
+        const int r1 = std::min(n_rows, r0 + n_rows_per_thread);
+        workers.emplace_back([&fn, r0, r1]() { fn(r0, r1); });
+    }
+    fn(0, std::min(n_rows, n_rows_per_thread));
+
+    for (auto & w : workers) {
+        w.join();
+    }
+}
+
+// normalized value of each of the 256 levels of a u8 pixel, per channel
+// a table lookup gives the same result as the division below, without doing it for every pixel
+struct image_norm_lut {
+    float v[3][256];
+
+    image_norm_lut(const float mean[3], const float std[3]) {
+        for (int c = 0; c < 3; ++c) {
+            for (int i = 0; i < 256; ++i) {
+                v[c][i] = (static_cast<float>(i) / 255.0f - mean[c]) / std[c];
+            }
+        }
+    }
+};
+
+// destinations of the resize kernels below, pixel (x, y) of channel c is written as dst[3*(y*nx + x) + c]
+struct image_u8_writer {
+    uint8_t * dst;
+    int nx;
+
+    void operator()(int x, int y, int c, uint8_t v) const {
+        dst[3*((size_t) y*nx + x) + c] = v;
+    }
+};
+
+struct image_f32_writer {
+    float * dst;
+    int nx;
+    const image_norm_lut & lut;
+
+    void operator()(int x, int y, int c, uint8_t v) const {
+        dst[3*((size_t) y*nx + x) + c] = lut.v[c][v];
+    }
+};
+
 // Normalize image to float32 - careful with pytorch .to(model.device, dtype=torch.float16) - this sometimes reduces precision (32>16>32), sometimes not
-static void normalize_image_u8_to_f32(const clip_image_u8 & src, clip_image_f32 & dst, const float mean[3], const float std[3]) {
+static void normalize_image_u8_to_f32(const clip_image_u8 & src, clip_image_f32 & dst, const float mean[3], const float std[3], int n_threads = 1) {
     dst.nx = src.nx;
     dst.ny = src.ny;
     dst.buf.resize(src.buf.size());
 
-    // TODO @ngxson : seems like this could be done more efficiently on cgraph
-    for (size_t i = 0; i < src.buf.size(); ++i) {
-        int c = i % 3; // rgb
-        dst.buf[i] = (static_cast<float>(src.buf[i]) / 255.0f - mean[c]) / std[c];
-    }
+    const image_norm_lut lut(mean, std);
+
+    const uint8_t * s = src.buf.data();
+    float         * d = dst.buf.data();
+
+    image_parallel_rows(src.ny, src.nx, n_threads, [&](int y0, int y1) {
+        for (size_t i = 3*(size_t) y0*src.nx; i < 3*(size_t) y1*src.nx; i += 3) {
+            d[i + 0] = lut.v[0][s[i + 0]];
+            d[i + 1] = lut.v[1][s[i + 1]];
+            d[i + 2] = lut.v[2][s[i + 2]];
+        }
+    });
 }
 
 // set of tools to manupulate images
 // in the future, we can have HW acceleration by allowing this struct to access 3rd party lib like imagick or opencv
+//
+// the resize functions have an overload that normalizes the result to float32 in the same pass,
+// this avoids the intermediate u8 image and gives the same result as resize + normalize_image_u8_to_f32
 struct image_manipulation {
     // Bilinear resize function
-    static void bilinear_resize(const clip_image_u8& src, clip_image_u8& dst, int target_width, int target_height) {
+    static void bilinear_resize(const clip_image_u8 & src, clip_image_u8 & dst, int target_width, int target_height, int n_threads = 1) {
         dst.nx = target_width;
         dst.ny = target_height;
         dst.buf.resize(3 * target_width * target_height);
 
-        float x_ratio = static_cast<float>(src.nx - 1) / target_width;
-        float y_ratio = static_cast<float>(src.ny - 1) / target_height;
+        bilinear_resize_impl(src, target_width, target_height, image_u8_writer{dst.buf.data(), target_width}, n_threads);
+    }
 
-        for (int y = 0; y < target_height; y++) {
-            for (int x = 0; x < target_width; x++) {
-                float px = x_ratio * x;
-                float py = y_ratio * y;
-                int x_floor = static_cast<int>(px);
-                int y_floor = static_cast<int>(py);
-                float x_lerp = px - x_floor;
-                float y_lerp = py - y_floor;
+    static void bilinear_resize(const clip_image_u8 & src, clip_image_f32 & dst, int target_width, int target_height,
+            const float mean[3], const float std[3], int n_threads = 1) {
+        dst.nx = target_width;
+        dst.ny = target_height;
+        dst.buf.resize(3 * target_width * target_height);
 
-                for (int c = 0; c < 3; c++) {
-                    float top = lerp(
-                        static_cast<float>(src.buf[3 * (y_floor * src.nx + x_floor) + c]),
-                        static_cast<float>(src.buf[3 * (y_floor * src.nx + (x_floor + 1)) + c]),
-                        x_lerp
-                    );
-                    float bottom = lerp(
-                        static_cast<float>(src.buf[3 * ((y_floor + 1) * src.nx + x_floor) + c]),
-                        static_cast<float>(src.buf[3 * ((y_floor + 1) * src.nx + (x_floor + 1)) + c]),
-                        x_lerp
-                    );
-                    dst.buf[3 * (y * target_width + x) + c] = static_cast<uint8_t>(lerp(top, bottom, y_lerp));
-                }
-            }
-        }
+        const image_norm_lut lut(mean, std);
+        bilinear_resize_impl(src, target_width, target_height, image_f32_writer{dst.buf.data(), target_width, lut}, n_threads);
     }
 
     // Bicubic resize function
     // part of image will be cropped if the aspect ratio is different
-    static bool bicubic_resize(const clip_image_u8 & img, clip_image_u8 & dst, int target_width, int target_height) {
-        const int nx = img.nx;
-        const int ny = img.ny;
-
+    static bool bicubic_resize(const clip_image_u8 & img, clip_image_u8 & dst, int target_width, int target_height, int n_threads = 1) {
         dst.nx = target_width;
         dst.ny = target_height;
         dst.buf.resize(3 * target_width * target_height);
 
-        float Cc;
-        float C[5];
-        float d0, d2, d3, a0, a1, a2, a3;
-        int i, j, k, jj;
-        int x, y;
-        float dx, dy;
-        float tx, ty;
+        bicubic_resize_impl(img, target_width, target_height, image_u8_writer{dst.buf.data(), target_width}, n_threads);
 
-        tx = (float)nx / (float)target_width;
-        ty = (float)ny / (float)target_height;
+        return true;
+    }
 
-        // Bicubic interpolation; adapted from ViT.cpp, inspired from :
-        //    -> https://github.com/yglukhov/bicubic-interpolation-image-processing/blob/master/libimage.c#L36
-        //    -> https://en.wikipedia.org/wiki/Bicubic_interpolation
+    static bool bicubic_resize(const clip_image_u8 & img, clip_image_f32 & dst, int target_width, int target_height,
+            const float mean[3], const float std[3], int n_threads = 1) {
+        dst.nx = target_width;
+        dst.ny = target_height;
+        dst.buf.resize(3 * target_width * target_height);
 
-        for (i = 0; i < target_height; i++) {
-            for (j = 0; j < target_width; j++) {
-                x = (int)(tx * j);
-                y = (int)(ty * i);
-
-                dx = tx * j - x;
-                dy = ty * i - y;
-
-                for (k = 0; k < 3; k++) {
-                    for (jj = 0; jj <= 3; jj++) {
-                        d0 = img.buf[(clip(y - 1 + jj, 0, ny - 1) * nx + clip(x - 1, 0, nx - 1)) * 3 + k] - img.buf[(clip(y - 1 + jj, 0, ny - 1) * nx + clip(x, 0, nx - 1)) * 3 + k];
-                        d2 = img.buf[(clip(y - 1 + jj, 0, ny - 1) * nx + clip(x + 1, 0, nx - 1)) * 3 + k] - img.buf[(clip(y - 1 + jj, 0, ny - 1) * nx + clip(x, 0, nx - 1)) * 3 + k];
-                        d3 = img.buf[(clip(y - 1 + jj, 0, ny - 1) * nx + clip(x + 2, 0, nx - 1)) * 3 + k] - img.buf[(clip(y - 1 + jj, 0, ny - 1) * nx + clip(x, 0, nx - 1)) * 3 + k];
-                        a0 = img.buf[(clip(y - 1 + jj, 0, ny - 1) * nx + clip(x, 0, nx - 1)) * 3 + k];
-
-                        a1 = -1.0 / 3 * d0 + d2 - 1.0 / 6 * d3;
-                        a2 =  1.0 / 2 * d0 +      1.0 / 2 * d2;
-                        a3 = -1.0 / 6 * d0 -      1.0 / 2 * d2 + 1.0 / 6 * d3;
-
-                        C[jj] = a0 + a1 * dx + a2 * dx * dx + a3 * dx * dx * dx;
-
-                        d0 = C[0] - C[1];
-                        d2 = C[2] - C[1];
-                        d3 = C[3] - C[1];
-                        a0 = C[1];
-                        a1 = -1.0 / 3 * d0 + d2 - 1.0 / 6 * d3;
-                        a2 =  1.0 / 2 * d0 +      1.0 / 2 * d2;
-                        a3 = -1.0 / 6 * d0 -      1.0 / 2 * d2 + 1.0 / 6 * d3;
-                        Cc = a0 + a1 * dy + a2 * dy * dy + a3 * dy * dy * dy;
-
-                        const uint8_t Cc2 = std::min(std::max(std::round(Cc), 0.0f), 255.0f);
-                        dst.buf[(i * target_width + j) * 3 + k] = float(Cc2);
-                    }
-                }
-            }
-        }
+        const image_norm_lut lut(mean, std);
+        bicubic_resize_impl(img, target_width, target_height, image_f32_writer{dst.buf.data(), target_width, lut}, n_threads);
 
         return true;
     }
@@ -2921,51 +2945,51 @@ struct image_manipulation {
     // llava-1.6 type of resize_and_pad
     // if the ratio is not 1:1, padding with pad_color will be applied
     // pad_color is single channel, default is 0 (black)
-    static void resize_and_pad_image(const clip_image_u8 & image, clip_image_u8 & dst, const clip_image_size & target_resolution, std::array<uint8_t, 3> pad_color = {0, 0, 0}) {
-        int target_width  = target_resolution.width;
-        int target_height = target_resolution.height;
+    static void resize_and_pad_image(const clip_image_u8 & image, clip_image_u8 & dst, const clip_image_size & target_resolution,
+            std::array<uint8_t, 3> pad_color = {0, 0, 0}, int n_threads = 1) {
+        dst.nx = target_resolution.width;
+        dst.ny = target_resolution.height;
+        dst.buf.resize(3 * dst.nx * dst.ny);
 
-        float scale_w = static_cast<float>(target_width) / image.nx;
-        float scale_h = static_cast<float>(target_height) / image.ny;
+        // Fill the padded image with the fill color
+        for (size_t i = 0; i < dst.buf.size(); i += 3) {
+            dst.buf[i]     = pad_color[0];
+            dst.buf[i + 1] = pad_color[1];
+            dst.buf[i + 2] = pad_color[2];
+        }
 
-        int new_width, new_height;
+        const clip_image_size new_size = calc_size_padded(image, target_resolution);
 
-        if (scale_w < scale_h) {
-            new_width  = target_width;
-            new_height = std::min(static_cast<int>(std::ceil(image.ny * scale_w)), target_height);
-        } else {
-            new_height = target_height;
-            new_width  = std::min(static_cast<int>(std::ceil(image.nx * scale_h)), target_width);
-        }
+        // Calculate padding offsets
+        int pad_x = (dst.nx - new_size.width)  / 2;
+        int pad_y = (dst.ny - new_size.height) / 2;
 
-        clip_image_u8 resized_image;
-        bicubic_resize(image, resized_image, new_width, new_height);
+        // resize directly into the center of the padded buffer
+        uint8_t * center = dst.buf.data() + 3 * ((size_t) pad_y * dst.nx + pad_x);
+        bicubic_resize_impl(image, new_size.width, new_size.height, image_u8_writer{center, dst.nx}, n_threads);
+    }
 
-        clip_image_u8 padded_image;
-        padded_image.nx = target_width;
-        padded_image.ny = target_height;
-        padded_image.buf.resize(3 * target_width * target_height);
+    static void resize_and_pad_image(const clip_image_u8 & image, clip_image_f32 & dst, const clip_image_size & target_resolution,
+            const float mean[3], const float std[3], std::array<uint8_t, 3> pad_color = {0, 0, 0}, int n_threads = 1) {
+        dst.nx = target_resolution.width;
+        dst.ny = target_resolution.height;
+        dst.buf.resize(3 * dst.nx * dst.ny);
 
-        // Fill the padded image with the fill color
-        for (size_t i = 0; i < padded_image.buf.size(); i += 3) {
-            padded_image.buf[i]     = pad_color[0];
-            padded_image.buf[i + 1] = pad_color[1];
-            padded_image.buf[i + 2] = pad_color[2];
-        }
+        const image_norm_lut lut(mean, std);
 
-        // Calculate padding offsets
-        int pad_x = (target_width  - new_width)  / 2;
-        int pad_y = (target_height - new_height) / 2;
-
-        // Copy the resized image into the center of the padded buffer
-        for (int y = 0; y < new_height; ++y) {
-            for (int x = 0; x < new_width; ++x) {
-                for (int c = 0; c < 3; ++c) {
-                    padded_image.buf[3 * ((y + pad_y) * target_width + (x + pad_x)) + c] = resized_image.buf[3 * (y * new_width + x) + c];
-                }
-            }
+        for (size_t i = 0; i < dst.buf.size(); i += 3) {
+            dst.buf[i]     = lut.v[0][pad_color[0]];
+            dst.buf[i + 1] = lut.v[1][pad_color[1]];
+            dst.buf[i + 2] = lut.v[2][pad_color[2]];
         }
-        dst = std::move(padded_image);
+
+        const clip_image_size new_size = calc_size_padded(image, target_resolution);
+
+        int pad_x = (dst.nx - new_size.width)  / 2;
+        int pad_y = (dst.ny - new_size.height) / 2;
+
+        float * center = dst.buf.data() + 3 * ((size_t) pad_y * dst.nx + pad_x);
+        bicubic_resize_impl(image, new_size.width, new_size.height, image_f32_writer{center, dst.nx, lut}, n_threads);
     }
 
     static void crop_image(const clip_image_u8 & image, clip_image_u8 & dst, int x, int y, int w, int h) {
@@ -2974,13 +2998,7 @@ struct image_manipulation {
         dst.buf.resize(3 * w * h);
 
         for (int i = 0; i < h; ++i) {
-            for (int j = 0; j < w; ++j) {
-                int src_idx = 3 * ((y + i)*image.nx + (x + j));
-                int dst_idx = 3 * (i*w + j);
-                dst.buf[dst_idx]     = image.buf[src_idx];
-                dst.buf[dst_idx + 1] = image.buf[src_idx + 1];
-                dst.buf[dst_idx + 2] = image.buf[src_idx + 2];
-            }
+            memcpy(dst.buf.data() + 3 * (size_t) i*w, image.buf.data() + 3 * ((size_t) (y + i)*image.nx + x), 3 * w);
         }
     }
 
@@ -3005,6 +3023,154 @@ struct image_manipulation {
     }
 
 private:
+    // size of the image inside the padding of resize_and_pad_image
+    static clip_image_size calc_size_padded(const clip_image_u8 & image, const clip_image_size & target_resolution) {
+        int target_width  = target_resolution.width;
+        int target_height = target_resolution.height;
+
+        float scale_w = static_cast<float>(target_width) / image.nx;
+        float scale_h = static_cast<float>(target_height) / image.ny;
+
+        int new_width, new_height;
+
+        if (scale_w < scale_h) {
+            new_width  = target_width;
+            new_height = std::min(static_cast<int>(std::ceil(image.ny * scale_w)), target_height);
+        } else {
+            new_height = target_height;
+            new_width  = std::min(static_cast<int>(std::ceil(image.nx * scale_h)), target_width);
+        }
+
+        return {new_width, new_height};
+    }
+
+    template <typename W>
+    static void bilinear_resize_impl(const clip_image_u8 & src, int target_width, int target_height, const W & write, int n_threads) {
+        float x_ratio = static_cast<float>(src.nx - 1) / target_width;
+        float y_ratio = static_cast<float>(src.ny - 1) / target_height;
+
+        // the source columns and the weights only depend on the destination column, compute them once
+        std::vector<int>   x_off(2 * target_width);
+        std::vector<float> x_lerp(target_width);
+        for (int x = 0; x < target_width; x++) {
+            float px = x_ratio * x;
+            int x_floor = static_cast<int>(px);
+            x_off[2*x + 0] = 3 * x_floor;
+            x_off[2*x + 1] = 3 * std::min(x_floor + 1, src.nx - 1);
+            x_lerp[x] = px - x_floor;
+        }
+
+        image_parallel_rows(target_height, target_width, n_threads, [&](int y0, int y1) {
+            for (int y = y0; y < y1; y++) {
+                float py = y_ratio * y;
+                int y_floor = static_cast<int>(py);
+                float y_lerp = py - y_floor;
+
+                const uint8_t * row0 = src.buf.data() + 3 * (size_t) y_floor * src.nx;
+                const uint8_t * row1 = src.buf.data() + 3 * (size_t) std::min(y_floor + 1, src.ny - 1) * src.nx;
+
+                for (int x = 0; x < target_width; x++) {
+                    const int i0 = x_off[2*x + 0];
+                    const int i1 = x_off[2*x + 1];
+
+                    for (int c = 0; c < 3; c++) {
+                        float top    = lerp(static_cast<float>(row0[i0 + c]), static_cast<float>(row0[i1 + c]), x_lerp[x]);
+                        float bottom = lerp(static_cast<float>(row1[i0 + c]), static_cast<float>(row1[i1 + c]), x_lerp[x]);
+                        write(x, y, c, static_cast<uint8_t>(lerp(top, bottom, y_lerp)));
+                    }
+                }
+            }
+        });
+    }
+
+    template <typename W>
+    static void bicubic_resize_impl(const clip_image_u8 & img, int target_width, int target_height, const W & write, int n_threads) {
+        const int nx = img.nx;
+        const int ny = img.ny;
+
+        const float tx = (float)nx / (float)target_width;
+        const float ty = (float)ny / (float)target_height;
+
+        // Bicubic interpolation; adapted from ViT.cpp, inspired from :
+        //    -> https://github.com/yglukhov/bicubic-interpolation-image-processing/blob/master/libimage.c#L36
+        //    -> https://en.wikipedia.org/wiki/Bicubic_interpolation
+
+        // offsets of the 4 source columns around each destination column, clamped to the image
+        std::vector<int>   x_off(4 * target_width);
+        std::vector<float> x_d(target_width);
+        for (int j = 0; j < target_width; j++) {
+            const int x = (int)(tx * j);
+            x_d[j] = tx * j - x;
+            for (int m = 0; m < 4; m++) {
+                x_off[4*j + m] = 3 * clip(x - 1 + m, 0, nx - 1);
+            }
+        }
+
+        // each destination row is computed in two passes:
+        //  - horizontal: interpolate the 4 source rows at every destination column
+        //  - vertical:   interpolate the 4 results, on contiguous buffers that the compiler can vectorize
+        image_parallel_rows(target_height, target_width, n_threads, [&](int i0, int i1) {
+            const int n = 3 * target_width;
+
+            std::vector<float> C(4 * n);
+            std::vector<uint8_t> out(n);
+
+            for (int i = i0; i < i1; i++) {
+                const int   y  = (int)(ty * i);
+                const float dy = ty * i - y;
+
+                for (int jj = 0; jj <= 3; jj++) {
+                    const uint8_t * row = img.buf.data() + 3 * (size_t) clip(y - 1 + jj, 0, ny - 1) * nx;
+                    float * Cj = C.data() + jj * n;
+
+                    for (int j = 0; j < target_width; j++) {
+                        const int * xo = x_off.data() + 4*j;
+                        const float dx = x_d[j];
+
+                        for (int k = 0; k < 3; k++) {
+                            const float d0 = row[xo[0] + k] - row[xo[1] + k];
+                            const float d2 = row[xo[2] + k] - row[xo[1] + k];
+                            const float d3 = row[xo[3] + k] - row[xo[1] + k];
+                            const float a0 = row[xo[1] + k];
+
+                            const float a1 = -1.0 / 3 * d0 + d2 - 1.0 / 6 * d3;
+                            const float a2 =  1.0 / 2 * d0 +      1.0 / 2 * d2;
+                            const float a3 = -1.0 / 6 * d0 -      1.0 / 2 * d2 + 1.0 / 6 * d3;
+
+                            Cj[3*j + k] = a0 + a1 * dx + a2 * dx * dx + a3 * dx * dx * dx;
+                        }
+                    }
+                }
+
+                const float * C0 = C.data() + 0 * n;
+                const float * C1 = C.data() + 1 * n;
+                const float * C2 = C.data() + 2 * n;
+                const float * C3 = C.data() + 3 * n;
+
+                for (int l = 0; l < n; l++) {
+                    const float d0 = C0[l] - C1[l];
+                    const float d2 = C2[l] - C1[l];
+                    const float d3 = C3[l] - C1[l];
+                    const float a0 = C1[l];
+
+                    const float a1 = -1.0 / 3 * d0 + d2 - 1.0 / 6 * d3;
+                    const float a2 =  1.0 / 2 * d0 +      1.0 / 2 * d2;
+                    const float a3 = -1.0 / 6 * d0 -      1.0 / 2 * d2 + 1.0 / 6 * d3;
+
+                    const float Cc = a0 + a1 * dy + a2 * dy * dy + a3 * dy * dy * dy;
+
+                    out[l] = std::min(std::max(std::round(Cc), 0.0f), 255.0f);
+                }
+
+                for (int j = 0; j < target_width; j++) {
+                    write(j, i, 0, out[3*j + 0]);
+                    write(j, i, 1, out[3*j + 1]);
+                    write(j, i, 2, out[3*j + 2]);
+                }
+            }
+        });
+    }
+
     static inline int clip(int x, int lower, int upper) {
         return std::max(lower, std::min(x, upper));
     }
@@ -3151,12 +3317,12 @@ struct llava_uhd {
         return res;
     }
 
-    static std::vector<clip_image_u8_ptr> slice_image(const clip_image_u8 * img, const slice_instructions & inst) {
+    static std::vector<clip_image_u8_ptr> slice_image(const clip_image_u8 * img, const slice_instructions & inst, int n_threads = 1) {
         std::vector<clip_image_u8_ptr> output;
 
         // resize to overview size
         clip_image_u8_ptr resized_img(clip_image_u8_init());
-        image_manipulation::bicubic_resize(*img, *resized_img, inst.overview_size.width, inst.overview_size.height);
+        image_manipulation::bicubic_resize(*img, *resized_img, inst.overview_size.width, inst.overview_size.height, n_threads);
         output.push_back(std::move(resized_img));
         if (inst.slices.empty()) {
             // no slices, just return the resized image
@@ -3166,9 +3332,9 @@ struct llava_uhd {
         // resize to refined size
         clip_image_u8_ptr refined_img(clip_image_u8_init());
         if (inst.padding_refined) {
-            image_manipulation::resize_and_pad_image(*img, *refined_img, inst.refined_size);
+            image_manipulation::resize_and_pad_image(*img, *refined_img, inst.refined_size, {0, 0, 0}, n_threads);
         } else {
-            image_manipulation::bilinear_resize(*img, *refined_img, inst.refined_size.width, inst.refined_size.height);
+            image_manipulation::bilinear_resize(*img, *refined_img, inst.refined_size.width, inst.refined_size.height, n_threads);
         }
 
         // create slices
@@ -3323,12 +3489,12 @@ bool clip_image_preprocess(struct clip_ctx * ctx, const clip_image_u8 * img, str
 
     if (clip_is_minicpmv(ctx)) {
         auto const inst = llava_uhd::get_slice_instructions(ctx, original_size);
-        std::vector<clip_image_u8_ptr> imgs = llava_uhd::slice_image(img, inst);
+        std::vector<clip_image_u8_ptr> imgs = llava_uhd::slice_image(img, inst, ctx->n_threads);
 
         for (size_t i = 0; i < imgs.size(); ++i) {
             // clip_image_save_to_bmp(*imgs[i], "slice_" + std::to_string(i) + ".bmp");
             clip_image_f32_ptr res(clip_image_f32_init());
-            normalize_image_u8_to_f32(*imgs[i], *res, params.image_mean, params.image_std);
+            normalize_image_u8_to_f32(*imgs[i], *res, params.image_mean, params.image_std, ctx->n_threads);
             res_imgs->entries.push_back(std::move(res));
         }
 
@@ -3337,15 +3503,11 @@ bool clip_image_preprocess(struct clip_ctx * ctx, const clip_image_u8 * img, str
         return true;
 
     } else if (ctx->proj_type() == PROJECTOR_TYPE_QWEN2VL || ctx->proj_type() == PROJECTOR_TYPE_QWEN25VL) {
-        clip_image_u8 resized;
         auto patch_size = params.patch_size * 2;
         auto new_size = image_manipulation::calc_size_preserved_ratio(original_size, patch_size, params.image_size);
-        image_manipulation::bicubic_resize(*img, resized, new_size.width, new_size.height);
 
         clip_image_f32_ptr img_f32(clip_image_f32_init());
-        // clip_image_f32_ptr res(clip_image_f32_init());
-        normalize_image_u8_to_f32(resized, *img_f32, params.image_mean, params.image_std);
-        // res_imgs->data[0] = *res;
+        image_manipulation::bicubic_resize(*img, *img_f32, new_size.width, new_size.height, params.image_mean, params.image_std, ctx->n_threads);
         res_imgs->entries.push_back(std::move(img_f32));
         return true;
     }
@@ -3354,32 +3516,27 @@ bool clip_image_preprocess(struct clip_ctx * ctx, const clip_image_u8 * img, str
             || ctx->proj_type() == PROJECTOR_TYPE_IDEFICS3
             || ctx->proj_type() == PROJECTOR_TYPE_INTERNVL // TODO @ngxson : support dynamic resolution
     ) {
-        clip_image_u8 resized_image;
         int sz = params.image_size;
-        image_manipulation::resize_and_pad_image(*img, resized_image, {sz, sz});
         clip_image_f32_ptr img_f32(clip_image_f32_init());
-        //clip_image_save_to_bmp(resized_image, "resized.bmp");
-        normalize_image_u8_to_f32(resized_image, *img_f32, params.image_mean, params.image_std);
+        image_manipulation::resize_and_pad_image(*img, *img_f32, {sz, sz}, params.image_mean, params.image_std, {0, 0, 0}, ctx->n_threads);
         res_imgs->entries.push_back(std::move(img_f32));
         return true;
 
     } else if (ctx->proj_type() == PROJECTOR_TYPE_PIXTRAL) {
-        clip_image_u8 resized_image;
         auto new_size = image_manipulation::calc_size_preserved_ratio(original_size, params.patch_size, params.image_size);
-        image_manipulation::bilinear_resize(*img, resized_image, new_size.width, new_size.height);
         clip_image_f32_ptr img_f32(clip_image_f32_init());
-        normalize_image_u8_to_f32(resized_image, *img_f32, params.image_mean, params.image_std);
+        image_manipulation::bilinear_resize(*img, *img_f32, new_size.width, new_size.height, params.image_mean, params.image_std, ctx->n_threads);
         res_imgs->entries.push_back(std::move(img_f32));
         return true;
 
     } else if (ctx->proj_type() == PROJECTOR_TYPE_LLAMA4) {
         GGML_ASSERT(!params.image_res_candidates.empty());
         auto const inst = llava_uhd::get_slice_instructions(ctx, original_size);
-        std::vector<clip_image_u8_ptr> imgs = llava_uhd::slice_image(img, inst);
+        std::vector<clip_image_u8_ptr> imgs = llava_uhd::slice_image(img, inst, ctx->n_threads);
 
         for (size_t i = 0; i < imgs.size(); ++i) {
             clip_image_f32_ptr res(clip_image_f32_init());
-            normalize_image_u8_to_f32(*imgs[i], *res, params.image_mean, params.image_std);
+            normalize_image_u8_to_f32(*imgs[i], *res, params.image_mean, params.image_std, ctx->n_threads);
             res_imgs->entries.push_back(std::move(res));
         }
 
@@ -3392,36 +3549,29 @@ bool clip_image_preprocess(struct clip_ctx * ctx, const clip_image_u8 * img, str
     // the logic below is to pad the shorter side to the longer side with a background color: rgb(122, 116, 104)
     // see https://github.com/haotian-liu/LLaVA/blob/e854a2bf85118c504f6f16bf5c3c7c92f8fa8c6b/llava/conversation.py#L113-L156
 
-    clip_image_u8_ptr temp(clip_image_u8_init()); // we will keep the input image data here temporarily
-
     if (pad_to_square) {
         // for llava-1.5, we resize image to a square, and pad the shorter side with a background color
         // see https://github.com/haotian-liu/LLaVA/blob/e854a2bf85118c504f6f16bf5c3c7c92f8fa8c6b/llava/conversation.py#L113-L156
-        const int longer_side = std::max(img->nx, img->ny);
-        temp->nx = longer_side;
-        temp->ny = longer_side;
-        temp->buf.resize(3 * longer_side * longer_side);
 
         // background color in RGB from LLaVA (this is the mean rgb color * 255)
         const std::array<uint8_t, 3> pad_color = {122, 116, 104};
 
         // resize the image to the target_size
-        image_manipulation::resize_and_pad_image(*img, *temp, clip_image_size{params.image_size, params.image_size}, pad_color);
-
         clip_image_f32_ptr res(clip_image_f32_init());
-        normalize_image_u8_to_f32(*temp, *res, params.image_mean, params.image_std);
+        image_manipulation::resize_and_pad_image(*img, *res, clip_image_size{params.image_size, params.image_size},
+                params.image_mean, params.image_std, pad_color, ctx->n_threads);
         res_imgs->entries.push_back(std::move(res));
         return true;
 
     } else if (!params.image_res_candidates.empty()) {
         // "spatial_unpad" with "anyres" processing for llava-1.6
         auto const inst = llava_uhd::get_slice_instructions(ctx, original_size);
-        std::vector<clip_image_u8_ptr> imgs = llava_uhd::slice_image(img, inst);
+        std::vector<clip_image_u8_ptr> imgs = llava_uhd::slice_image(img, inst, ctx->n_threads);
 
         for (size_t i = 0; i < imgs.size(); ++i) {
             // clip_image_save_to_bmp(*imgs[i], "slice_" + std::to_string(i) + ".bmp");
             clip_image_f32_ptr res(clip_image_f32_init());
-            normalize_image_u8_to_f32(*imgs[i], *res, params.image_mean, params.image_std);
+            normalize_image_u8_to_f32(*imgs[i], *res, params.image_mean, params.image_std, ctx->n_threads);
             res_imgs->entries.push_back(std::move(res));
         }
 
@@ -3677,10 +3827,17 @@ bool clip_image_batch_encode(clip_ctx * ctx, const int n_threads, const clip_ima
     const clip_image_f32_batch & imgs = *imgs_c_ptr;
     int batch_size = imgs.entries.size();
 
-    // TODO @ngxson : implement batch size > 1 as a loop
-    //                we don't need true batching support because the cgraph will gonna be big anyway
     if (batch_size != 1) {
-        return false; // only support batch size of 1
+        if (!clip_image_batch_supported(ctx)) {
+            LOG_ERR("%s: batch size > 1 is not supported by this model\n", __func__);
+            return false;
+        }
+        for (const auto & img : imgs.entries) {
+            if (img->nx != imgs.entries[0]->nx || img->ny != imgs.entries[0]->ny) {
+                LOG_ERR("%s: all images in a batch must have the same size\n", __func__);
+                return false;
+            }
+        }
     }
 
     // build the inference graph
@@ -3748,21 +3905,19 @@ bool clip_image_batch_encode(clip_ctx * ctx, const int n_threads, const clip_ima
         // └─────┘ │
         //   ──────┘ x B
 
-        for (size_t i = 0; i < imgs.entries.size(); i++) {
-            const int nx = imgs.entries[i]->nx;
-            const int ny = imgs.entries[i]->ny;
+        for (int b = 0; b < batch_size; b++) {
+            const int nx = imgs.entries[b]->nx;
+            const int ny = imgs.entries[b]->ny;
             const int n = nx * ny;
 
-            for (int b = 0; b < batch_size; b++) {
-                float * batch_entry = inp_raw.data() + b * (3*n);
-                for (int y = 0; y < ny; y++) {
-                    for (int x = 0; x < nx; x++) {
-                        size_t base_src = 3*(y * nx + x); // idx of the first channel
-                        size_t base_dst =    y * nx + x;  // idx of the first channel
-                        batch_entry[      base_dst] = imgs.entries[b]->buf[base_src    ];
-                        batch_entry[1*n + base_dst] = imgs.entries[b]->buf[base_src + 1];
-                        batch_entry[2*n + base_dst] = imgs.entries[b]->buf[base_src + 2];
-                    }
+            float * batch_entry = inp_raw.data() + b * (3*n);
+            for (int y = 0; y < ny; y++) {
+                for (int x = 0; x < nx; x++) {
+                    size_t base_src = 3*(y * nx + x); // idx of the first channel
+                    size_t base_dst =    y * nx + x;  // idx of the first channel
+                    batch_entry[      base_dst] = imgs.entries[b]->buf[base_src    ];
+                    batch_entry[1*n + base_dst] = imgs.entries[b]->buf[base_src + 1];
+                    batch_entry[2*n + base_dst] = imgs.entries[b]->buf[base_src + 2];
                 }
             }
         }
@@ -4030,7 +4185,8 @@ bool clip_image_batch_encode(clip_ctx * ctx, const int n_threads, const clip_ima
     // the last node is the embedding tensor
     ggml_tensor * embeddings = ggml_graph_node(gf, -1);
 
-    // sanity check (only support batch size of 1 for now)
+    // sanity check, the output of each image of the batch is contiguous
+    GGML_ASSERT(batch_size == 1 || embeddings->ne[2] == batch_size);
     const int n_tokens_out = embeddings->ne[1];
     const int expected_n_tokens_out = clip_n_output_tokens(ctx, imgs.entries[0].get());
     if (n_tokens_out != expected_n_tokens_out) {
@@ -4111,6 +4267,16 @@ bool clip_is_gemma3(const struct clip_ctx * ctx) {
     return ctx->proj_type() == PROJECTOR_TYPE_GEMMA3;
 }
 
+bool clip_image_batch_supported(const struct clip_ctx * ctx) {
+    switch (ctx->proj_type()) {
+        case PROJECTOR_TYPE_GEMMA3:
+        case PROJECTOR_TYPE_IDEFICS3:
+            return true;
+        default:
+            return false;
+    }
+}
+
 bool clip_has_vision_encoder(const struct clip_ctx * ctx) {
     return ctx->model.modality == CLIP_MODALITY_VISION;
 }
@@ -25,6 +25,7 @@ enum clip_modality {
 struct clip_context_params {
     bool use_gpu;
     enum ggml_log_level verbosity;
+    int n_threads; // number of threads used to preprocess the images
 };
 
 struct clip_init_result {
@@ -95,6 +96,10 @@ struct ggml_tensor * clip_get_newline_tensor(const struct clip_ctx * ctx);
 bool clip_image_encode      (struct clip_ctx * ctx, int n_threads, struct clip_image_f32 * img, float * vec);
 bool clip_image_batch_encode(struct clip_ctx * ctx, int n_threads, const struct clip_image_f32_batch * imgs, float * vec);
 
+// whether clip_image_batch_encode can encode more than one image of the same size in a single graph
+// the output embeddings of the images are concatenated
+bool clip_image_batch_supported(const struct clip_ctx * ctx);
+
 int clip_is_minicpmv(const struct clip_ctx * ctx);
 bool clip_is_glm(const struct clip_ctx * ctx);
 bool clip_is_qwen2vl(const struct clip_ctx * ctx);
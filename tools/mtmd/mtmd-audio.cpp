@@ -1,5 +1,7 @@
 #include "mtmd-audio.h"
 
+#include "common/fft.h"
+
 #define _USE_MATH_DEFINES // for M_PI
 #include <cmath>
 #include <cstdint>
@@ -16,32 +18,75 @@
 
 namespace whisper_preprocessor {
 
-#define SIN_COS_N_COUNT WHISPER_N_FFT
 namespace {
+
+// FFT of a real-valued input of even size n_real, computed with a complex FFT of size n_real/2
+// ref: https://en.wikipedia.org/wiki/Fast_Fourier_transform#FFT_algorithms_specialized_for_real_or_symmetric_data
+struct whisper_rfft {
+    int n_real;
+    int n_cplx;
+
+    common_fft fft;
+
+    std::vector<float> w_real; // twiddles of the post-processing of the real input, [n_cplx + 1], complex
+
+    explicit whisper_rfft(int n) : n_real(n), n_cplx(n / 2), fft(n / 2, false) {
+        WHISPER_ASSERT(n % 2 == 0);
+
+        w_real.resize(2 * (n_cplx + 1));
+        for (int k = 0; k <= n_cplx; k++) {
+            const double theta = (2 * M_PI * k) / n_real;
+            w_real[2 * k + 0] =  cos(theta);
+            w_real[2 * k + 1] = -sin(theta);
+        }
+    }
+
+    // in:   n_real samples
+    // out:  n_real/2 + 1 complex bins, bin_0 to bin_nyquist
+    // work: scratch buffer of 2*n_real floats
+    void compute(const float * in, float * out, float * work) const {
+        // the even and odd samples are the real and imaginary parts of the complex input
+        float * xr = work;
+        float * xi = work + n_cplx;
+        for (int j = 0; j < n_cplx; j++) {
+            xr[j] = in[2 * j + 0];
+            xi[j] = in[2 * j + 1];
+        }
+
+        fft.compute(xr, xi, work + 2 * n_cplx, work + 3 * n_cplx);
+
+        // split the spectrum of the complex input into the spectrum of the real input
+        for (int k = 0; k <= n_cplx; k++) {
+            const int ik = k % n_cplx;
+            const int ic = (n_cplx - k) % n_cplx;
+
+            const float er = 0.5f * (xr[ik] + xr[ic]);
+            const float ei = 0.5f * (xi[ik] - xi[ic]);
+            const float or_ = 0.5f * (xi[ik] + xi[ic]);
+            const float oi  = 0.5f * (xr[ic] - xr[ik]);
+
+            const float wr = w_real[2 * k + 0];
+            const float wi = w_real[2 * k + 1];
+
+            out[2 * k + 0] = er + wr * or_ - wi * oi;
+            out[2 * k + 1] = ei + wr * oi  + wi * or_;
+        }
+    }
+};
+
 struct whisper_global_cache {
-    // In FFT, we frequently use sine and cosine operations with the same values.
-    // We can use precalculated values to speed up the process.
-    float sin_vals[SIN_COS_N_COUNT];
-    float cos_vals[SIN_COS_N_COUNT];
+    // FFT plan for the frame size
+    whisper_rfft rfft;
 
     // Hann window (Use cosf to eliminate difference)
     // ref: https://pytorch.org/docs/stable/generated/torch.hann_window.html
     // ref: https://github.com/openai/whisper/blob/main/whisper/audio.py#L147
     float hann_window[WHISPER_N_FFT];
 
-    whisper_global_cache() {
-        fill_sin_cos_table();
+    whisper_global_cache() : rfft(WHISPER_N_FFT) {
         fill_hann_window(sizeof(hann_window)/sizeof(hann_window[0]), true, hann_window);
     }
 
-    void fill_sin_cos_table() {
-        for (int i = 0; i < SIN_COS_N_COUNT; i++) {
-            double theta = (2 * M_PI * i) / SIN_COS_N_COUNT;
-            sin_vals[i] = sinf(theta);
-            cos_vals[i] = cosf(theta);
-        }
-    }
-
     void fill_hann_window(int length, bool periodic, float * output) {
         int offset = -1;
         if (periodic) {
@@ -54,103 +99,94 @@ struct whisper_global_cache {
 } global_cache;
 }
 
-// naive Discrete Fourier Transform
-// input is real-valued
-// output is complex-valued
-static void dft(const float* in, int N, float* out) {
-    const int sin_cos_step = SIN_COS_N_COUNT / N;
-
-    for (int k = 0; k < N; k++) {
-        float re = 0;
-        float im = 0;
+// the filter bank is sparse, each mel bin only uses a narrow range of the FFT bins
+// the range of each bin is computed once so that only the non-zero coefficients are applied
+struct whisper_filter_ranges {
+    std::vector<int> k0; // first non-zero coefficient, [n_mel]
+    std::vector<int> k1; // one past the last non-zero coefficient, [n_mel]
+
+    explicit whisper_filter_ranges(const whisper_filters & filters) : k0(filters.n_mel, 0), k1(filters.n_mel, 0) {
+        for (int j = 0; j < filters.n_mel; j++) {
+            const float * row = filters.data.data() + j * filters.n_fft;
+
+            int first = -1;
+            int last  = -1;
+            for (int k = 0; k < filters.n_fft; k++) {
+                if (row[k] != 0.0f) {
+                    first = first < 0 ? k : first;
+                    last  = k;
+                }
+            }
 
-        for (int n = 0; n < N; n++) {
-            int idx = (k * n * sin_cos_step) % (SIN_COS_N_COUNT); // t = 2*M_PI*k*n/N
-            re += in[n]*global_cache.cos_vals[idx]; // cos(t)
-            im -= in[n]*global_cache.sin_vals[idx]; // sin(t)
+            if (first >= 0) {
+                k0[j] = first;
+                k1[j] = last + 1;
+            }
         }
-
-        out[k*2 + 0] = re;
-        out[k*2 + 1] = im;
     }
-}
-
-// Cooley-Tukey FFT
-// poor man's implementation - use something better
-// input is real-valued
-// output is complex-valued
-static void fft(float* in, int N, float* out) {
-    if (N == 1) {
-        out[0] = in[0];
-        out[1] = 0;
-        return;
-    }
-
-    const int half_N = N / 2;
-    if (N - half_N*2 == 1) {
-        dft(in, N, out);
-        return;
-    }
-
-    float* even = in + N;
-    for (int i = 0; i < half_N; ++i) {
-        even[i]= in[2*i];
+};
+
+// view of the padded input without materializing it:
+//  - n_pad samples of reflective padding at the beginning
+//  - the audio
+//  - zeros until the end
+// only the samples [off, n_samples) of the audio are accessible, samples points to sample off
+// t0 is the position of the view in the padded input
+struct whisper_padded_samples {
+    const float * samples;
+    int64_t off;
+    int64_t n_samples;
+    int64_t n_pad;
+    int64_t t0;
+
+    float operator[](int64_t t) const {
+        t += t0;
+        if (t < n_pad) {
+            const int64_t i = n_pad - t;
+            return i < n_samples ? samples[i - off] : 0.0f;
+        }
+        return t - n_pad < n_samples ? samples[t - n_pad - off] : 0.0f;
     }
-    float* even_fft = out + 2 * N;
-    fft(even, half_N, even_fft);
 
-    float* odd = even;
-    for (int i = 0; i < half_N; ++i) {
-        odd[i] = in[2*i + 1];
+    // pointer to the frame [t, t + n) if it does not overlap the padding, nullptr otherwise
+    const float * frame(int64_t t, int n) const {
+        const int64_t i = t + t0 - n_pad;
+        return i >= off && i + n <= n_samples ? samples + (i - off) : nullptr;
     }
-    float* odd_fft = even_fft + N;
-    fft(odd, half_N, odd_fft);
-
-    const int sin_cos_step = SIN_COS_N_COUNT / N;
-    for (int k = 0; k < half_N; k++) {
-        int idx = k * sin_cos_step; // t = 2*M_PI*k/N
-        float re = global_cache.cos_vals[idx]; // cos(t)
-        float im = -global_cache.sin_vals[idx]; // sin(t)
-
-        float re_odd = odd_fft[2*k + 0];
-        float im_odd = odd_fft[2*k + 1];
+};
 
-        out[2*k + 0] = even_fft[2*k + 0] + re*re_odd - im*im_odd;
-        out[2*k + 1] = even_fft[2*k + 1] + re*im_odd + im*re_odd;
+// compute the frames [i0, i1), frames are processed one at a time to keep the working set in cache
+static void log_mel_spectrogram_worker_thread(int i0, int i1, const float * hann, const whisper_padded_samples & samples,
+                                              int frame_size, int frame_step,
+                                              const whisper_filters & filters, const whisper_filter_ranges & ranges, whisper_mel & mel) {
+    const auto & rfft = global_cache.rfft;
 
-        out[2*(k + half_N) + 0] = even_fft[2*k + 0] - re*re_odd + im*im_odd;
-        out[2*(k + half_N) + 1] = even_fft[2*k + 1] - re*im_odd - im*re_odd;
-    }
-}
-
-static void log_mel_spectrogram_worker_thread(int ith, const float * hann, const std::vector<float> & samples,
-                                              int n_samples, int frame_size, int frame_step, int n_threads,
-                                              const whisper_filters & filters, whisper_mel & mel) {
-    std::vector<float> fft_in(frame_size * 2, 0.0);
-    std::vector<float> fft_out(frame_size * 2 * 2 * 2);
+    std::vector<float> fft_in(frame_size, 0.0);
+    std::vector<float> fft_out(2 * (frame_size / 2 + 1));
+    std::vector<float> fft_work(2 * frame_size);
 
     int n_fft = filters.n_fft;
-    int i = ith;
 
     // make sure n_fft == 1 + (WHISPER_N_FFT / 2), bin_0 to bin_nyquist
     WHISPER_ASSERT(n_fft == 1 + (frame_size / 2));
 
-    // calculate FFT only when fft_in are not all zero
-    for (; i < std::min(n_samples / frame_step + 1, mel.n_len); i += n_threads) {
-        const int offset = i * frame_step;
+    for (int i = i0; i < i1; i++) {
+        const int64_t offset = (int64_t) i * frame_step;
 
         // apply Hann window (~10% faster)
-        for (int j = 0; j < std::min(frame_size, n_samples - offset); j++) {
-            fft_in[j] = hann[j] * samples[offset + j];
-        }
-
-        // fill the rest with zeros
-        if (n_samples - offset < frame_size) {
-            std::fill(fft_in.begin() + (n_samples - offset), fft_in.end(), 0.0);
+        if (const float * src = samples.frame(offset, frame_size)) {
+            for (int j = 0; j < frame_size; j++) {
+                fft_in[j] = hann[j] * src[j];
+            }
+        } else {
+            // frame overlapping the padding
+            for (int j = 0; j < frame_size; j++) {
+                fft_in[j] = hann[j] * samples[offset + j];
+            }
         }
 
         // FFT
-        fft(fft_in.data(), frame_size, fft_out.data());
+        rfft.compute(fft_in.data(), fft_out.data(), fft_work.data());
 
         // Calculate modulus^2 of complex numbers
         // Use pow(fft_out[2 * j + 0], 2) + pow(fft_out[2 * j + 1], 2) causes inference quality problem? Interesting.
@@ -160,32 +196,72 @@ static void log_mel_spectrogram_worker_thread(int ith, const float * hann, const
 
         // mel spectrogram
         for (int j = 0; j < mel.n_mel; j++) {
+            const float * row = filters.data.data() + j * n_fft;
+
             double sum = 0.0;
-            // unroll loop (suggested by GH user @lunixbochs)
-            int k = 0;
-            for (k = 0; k < n_fft - 3; k += 4) {
-                sum +=
-                        fft_out[k + 0] * filters.data[j * n_fft + k + 0] +
-                        fft_out[k + 1] * filters.data[j * n_fft + k + 1] +
-                        fft_out[k + 2] * filters.data[j * n_fft + k + 2] +
-                        fft_out[k + 3] * filters.data[j * n_fft + k + 3];
-            }
-            // handle n_fft remainder
-            for (; k < n_fft; k++) {
-                sum += fft_out[k] * filters.data[j * n_fft + k];
+            for (int k = ranges.k0[j]; k < ranges.k1[j]; k++) {
+                sum += fft_out[k] * row[k];
             }
             sum = log10(std::max(sum, 1e-10));
             mel.data[j * mel.n_len + i] = sum;
         }
     }
+}
 
-    // Otherwise fft_out are all zero
-    double sum = log10(1e-10);
-    for (; i < mel.n_len; i += n_threads) {
-        for (int j = 0; j < mel.n_mel; j++) {
-            mel.data[j * mel.n_len + i] = sum;
+// compute the mel.n_len frames of the view, the FFT is only calculated for the first n_len_fft frames
+// the remaining frames only contain the zero padding
+static void log_mel_spectrogram_frames(const whisper_padded_samples & samples, int n_len_fft,
+                                       int frame_size, int frame_step, int n_threads,
+                                       const whisper_filters & filters, whisper_mel & mel) {
+    const float * hann = global_cache.hann_window;
+
+    const whisper_filter_ranges ranges(filters);
+
+    {
+        // each thread computes a contiguous range of frames
+        const int n_per_thread = (n_len_fft + n_threads - 1) / n_threads;
+
+        std::vector<std::thread> workers(n_threads - 1);
+        for (int iw = 0; iw < n_threads - 1; ++iw) {
+            const int i0 = std::min(n_len_fft, (iw + 1) * n_per_thread);
+            const int i1 = std::min(n_len_fft, i0 + n_per_thread);
+            workers[iw] = std::thread(
+                    log_mel_spectrogram_worker_thread, i0, i1, hann, std::cref(samples),
+                    frame_size, frame_step, std::cref(filters), std::cref(ranges), std::ref(mel));
+        }
+
+        // main thread
+        log_mel_spectrogram_worker_thread(0, std::min(n_len_fft, n_per_thread), hann, samples, frame_size, frame_step, filters, ranges, mel);
+
+        for (int iw = 0; iw < n_threads - 1; ++iw) {
+            workers[iw].join();
         }
     }
+
+    const float sum_zero = log10(1e-10);
+    for (int j = 0; j < mel.n_mel; j++) {
+        std::fill(mel.data.begin() + j * mel.n_len + n_len_fft, mel.data.begin() + (j + 1) * mel.n_len, sum_zero);
+    }
+}
+
+// clamping and normalization
+// mmax is the max of the previous chunks when streaming, it is updated with the max of mel
+static void log_mel_spectrogram_normalize(whisper_mel & mel, double & mmax) {
+    for (int i = 0; i < mel.n_mel*mel.n_len; i++) {
+        if (mel.data[i] > mmax) {
+            mmax = mel.data[i];
+        }
+    }
+
+    const double mmin = mmax - 8.0;
+
+    for (int i = 0; i < mel.n_mel*mel.n_len; i++) {
+        if (mel.data[i] < mmin) {
+            mel.data[i] = mmin;
+        }
+
+        mel.data[i] = (mel.data[i] + 4.0)/4.0;
+    }
 }
 
 // ref: https://github.com/openai/whisper/blob/main/whisper/audio.py#L110-L157
@@ -204,65 +280,31 @@ static bool log_mel_spectrogram(
 
     // Hann window
     WHISPER_ASSERT(frame_size == WHISPER_N_FFT && "Unsupported frame_size");
-    const float * hann = global_cache.hann_window;
 
     // Calculate the length of padding
     int64_t stage_1_pad = WHISPER_SAMPLE_RATE * 30;
     int64_t stage_2_pad = frame_size / 2;
 
-    // Initialize a vector and copy data from C array to it.
-    std::vector<float> samples_padded;
-    samples_padded.resize(n_samples + stage_1_pad + stage_2_pad * 2);
-    std::copy(samples, samples + n_samples, samples_padded.begin() + stage_2_pad);
-
-    // pad 30 seconds of zeros at the end of audio (480,000 samples) + reflective pad 200 samples at the end of audio
-    std::fill(samples_padded.begin() + n_samples + stage_2_pad, samples_padded.begin() + n_samples + stage_1_pad + 2 * stage_2_pad, 0);
-
-    // reflective pad 200 samples at the beginning of audio
-    std::reverse_copy(samples + 1, samples + 1 + stage_2_pad, samples_padded.begin());
+    // reflective pad 200 samples at the beginning of audio, then pad 30 seconds of zeros at the end of audio (480,000 samples) + 200 samples
+    // the padded samples are read through a view, there is no copy of the whole input
+    const whisper_padded_samples samples_padded = { samples, 0, n_samples, stage_2_pad, 0 };
+    const int64_t n_samples_padded = n_samples + stage_1_pad + stage_2_pad * 2;
 
     mel.n_mel     = n_mel;
     // https://github.com/pytorch/pytorch/blob/main/aten/src/ATen/native/SpectralOps.cpp#L936
     // Calculate number of frames + remove the last frame
-    mel.n_len     = (samples_padded.size() - frame_size) / frame_step;
+    mel.n_len     = (n_samples_padded - frame_size) / frame_step;
     // Calculate semi-padded sample length to ensure compatibility
     mel.n_len_org = 1 + (n_samples + stage_2_pad - frame_size) / frame_step;
     mel.data.resize(mel.n_mel * mel.n_len);
 
-    {
-        std::vector<std::thread> workers(n_threads - 1);
-        for (int iw = 0; iw < n_threads - 1; ++iw) {
-            workers[iw] = std::thread(
-                    log_mel_spectrogram_worker_thread, iw + 1, hann, std::cref(samples_padded),
-                    n_samples + stage_2_pad, frame_size, frame_step, n_threads,
-                    std::cref(filters), std::ref(mel));
-        }
-
-        // main thread
-        log_mel_spectrogram_worker_thread(0, hann, samples_padded, n_samples + stage_2_pad, frame_size, frame_step, n_threads, filters, mel);
+    // calculate FFT only for the frames that are not all zero
+    const int n_len_fft = std::min<int64_t>((n_samples + stage_2_pad) / frame_step + 1, mel.n_len);
 
-        for (int iw = 0; iw < n_threads - 1; ++iw) {
-            workers[iw].join();
-        }
-    }
+    log_mel_spectrogram_frames(samples_padded, n_len_fft, frame_size, frame_step, n_threads, filters, mel);
 
-    // clamping and normalization
     double mmax = -1e20;
-    for (int i = 0; i < mel.n_mel*mel.n_len; i++) {
-        if (mel.data[i] > mmax) {
-            mmax = mel.data[i];
-        }
-    }
-
-    mmax -= 8.0;
-
-    for (int i = 0; i < mel.n_mel*mel.n_len; i++) {
-        if (mel.data[i] < mmax) {
-            mel.data[i] = mmax;
-        }
-
-        mel.data[i] = (mel.data[i] + 4.0)/4.0;
-    }
+    log_mel_spectrogram_normalize(mel, mmax);
 
     // Dump log_mel_spectrogram
     if (debug) {
@@ -282,6 +324,7 @@ bool preprocess_audio(
         const float * samples,
         size_t n_samples,
         const whisper_filters & filters,
+        int n_threads,
         std::vector<whisper_mel> & output) {
 
     if (n_samples == 0) {
@@ -297,7 +340,7 @@ bool preprocess_audio(
                 WHISPER_N_FFT,
                 WHISPER_HOP_LENGTH,
                 filters.n_mel,
-                4, // n_threads
+                std::max(1, n_threads),
                 filters,
                 false, // debug
                 out_full);
@@ -308,7 +351,7 @@ bool preprocess_audio(
     // because the cgraph in clip.cpp only accepts 3000 frames each, we need to split the mel
     // we always expect the mel to have 3000 silent frames at the end
     // printf("n_len %d\n", out_full.n_len);
-    const size_t frames_per_chunk = 3000;
+    const size_t frames_per_chunk = WHISPER_N_FRAMES_CHUNK;
     GGML_ASSERT((size_t)out_full.n_len > frames_per_chunk);
     for (size_t off = 0; off < (size_t)out_full.n_len; off += frames_per_chunk) {
         int n_len = std::min(frames_per_chunk, (size_t)out_full.n_len - off);
@@ -333,6 +376,76 @@ bool preprocess_audio(
     return true;
 }
 
+//
+// whisper_mel_stream
+//
+
+whisper_mel_stream::whisper_mel_stream(const whisper_filters & filters, int n_threads)
+    : filters(filters), n_threads(std::max(1, n_threads)) {}
+
+// a chunk starts every WHISPER_N_FRAMES_CHUNK*WHISPER_HOP_LENGTH samples of the padded input
+// its last frame ends (WHISPER_N_FFT - WHISPER_HOP_LENGTH) samples after the start of the next chunk
+static const int64_t whisper_chunk_step = (int64_t) WHISPER_N_FRAMES_CHUNK * WHISPER_HOP_LENGTH;
+static const int64_t whisper_chunk_span = whisper_chunk_step + WHISPER_N_FFT - WHISPER_HOP_LENGTH;
+
+void whisper_mel_stream::push(const float * samples, size_t n_samples, std::vector<whisper_mel> & output) {
+    GGML_ASSERT(!finished);
+
+    buf.insert(buf.end(), samples, samples + n_samples);
+    n_total += n_samples;
+
+    // the padded input has WHISPER_N_FFT/2 samples of reflective padding before the audio
+    while ((n_chunks * whisper_chunk_step + whisper_chunk_span) - WHISPER_N_FFT/2 <= n_total) {
+        output.push_back(compute_chunk());
+    }
+}
+
+void whisper_mel_stream::finish(std::vector<whisper_mel> & output) {
+    GGML_ASSERT(!finished);
+    finished = true;
+
+    if (n_total == 0) {
+        return;
+    }
+
+    // same number of chunks as preprocess_audio(): the audio is followed by 30 seconds of silence
+    // and the last incomplete chunk is dropped
+    const int64_t n_len = (n_total + WHISPER_SAMPLE_RATE * 30) / WHISPER_HOP_LENGTH;
+    while (n_chunks < n_len / WHISPER_N_FRAMES_CHUNK) {
+        output.push_back(compute_chunk());
+    }
+}
+
+whisper_mel whisper_mel_stream::compute_chunk() {
+    const int64_t stage_2_pad = WHISPER_N_FFT / 2;
+    const int64_t t0 = n_chunks * whisper_chunk_step;
+
+    whisper_mel mel;
+    mel.n_mel     = filters.n_mel;
+    mel.n_len     = WHISPER_N_FRAMES_CHUNK;
+    mel.n_len_org = filters.n_mel; // unused
+    mel.data.resize(mel.n_mel * mel.n_len);
+
+    // calculate FFT only for the frames that are not all zero
+    const int64_t n_len_fft = (n_total + stage_2_pad) / WHISPER_HOP_LENGTH + 1 - n_chunks * WHISPER_N_FRAMES_CHUNK;
+
+    const whisper_padded_samples view = { buf.data(), n_off, n_total, stage_2_pad, t0 };
+    log_mel_spectrogram_frames(view, std::max<int64_t>(0, std::min<int64_t>(n_len_fft, mel.n_len)),
+        WHISPER_N_FFT, WHISPER_HOP_LENGTH, n_threads, filters, mel);
+    log_mel_spectrogram_normalize(mel, mmax);
+
+    n_chunks++;
+
+    // drop the samples before the next chunk, the first chunk also needs them for the reflective padding
+    const int64_t n_drop = std::min<int64_t>(n_chunks * whisper_chunk_step - stage_2_pad, n_total) - n_off;
+    if (n_drop > 0) {
+        buf.erase(buf.begin(), buf.begin() + n_drop);
+        n_off += n_drop;
+    }
+
+    return mel;
+}
+
 } // namespace whisper_preprocessor
 
 
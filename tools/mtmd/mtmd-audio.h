@@ -13,6 +13,9 @@
 #define WHISPER_HOP_LENGTH  160
 #define WHISPER_CHUNK_SIZE  30
 
+// number of mel frames per chunk given to the encoder (30 seconds)
+#define WHISPER_N_FRAMES_CHUNK 3000
+
 #define COMMON_SAMPLE_RATE 16000
 
 namespace whisper_preprocessor {
@@ -36,8 +39,40 @@ bool preprocess_audio(
         const float * samples,
         size_t n_samples,
         const whisper_filters & filters,
+        int n_threads,
         std::vector<whisper_mel> & output);
 
+// incremental version of preprocess_audio()
+// the samples are pushed as they arrive, and each chunk of WHISPER_N_FRAMES_CHUNK frames is output
+// as soon as all the samples it covers have been pushed
+// the chunks are normalized with the max of the audio pushed so far, preprocess_audio() uses the max
+// of the whole audio: the output is the same for the first chunk, and for the next ones if their max
+// is not higher than the max of the previous ones
+struct whisper_mel_stream {
+    whisper_mel_stream(const whisper_filters & filters, int n_threads);
+
+    // append the complete chunks to output
+    void push(const float * samples, size_t n_samples, std::vector<whisper_mel> & output);
+
+    // end of input, pad the audio with silence and append the remaining chunks to output
+    void finish(std::vector<whisper_mel> & output);
+
+private:
+    whisper_mel compute_chunk();
+
+    const whisper_filters & filters;
+    const int n_threads;
+
+    std::vector<float> buf; // samples that are still needed, starting at sample n_off
+    int64_t n_off    = 0;
+    int64_t n_total  = 0;   // number of samples pushed
+    int64_t n_chunks = 0;   // number of chunks output
+
+    double mmax = -1e20;    // max of the chunks output
+
+    bool finished = false;
+};
+
 } // namespace whisper_preprocessor
 
 namespace whisper_precalc_filters {
@@ -0,0 +1,101 @@
+#pragma once
+
+// internal header, LRU cache of the output embeddings of image/audio chunks
+
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+// the key of an entry is the preprocessed chunk itself, serialized to bytes
+// the 64-bit hash of the key only selects the bucket, and the key is compared on lookup, so that two chunks with
+// the same hash can never return each other's embeddings (the hash is not collision-resistant)
+struct mtmd_embd_cache {
+    struct entry {
+        uint64_t             hash;
+        std::vector<uint8_t> key;
+        std::vector<float>   embd;
+
+        size_t n_bytes() const {
+            return key.size() + embd.size()*sizeof(float);
+        }
+    };
+
+    size_t size_max = 0; // in bytes, keys and embeddings, 0 = disabled
+    size_t size     = 0;
+
+    std::list<entry> entries; // the most recently used first
+    std::unordered_map<uint64_t, std::list<entry>::iterator> map;
+
+    bool enabled() const {
+        return size_max > 0;
+    }
+
+    // returns nullptr on miss
+    const std::vector<float> * get(uint64_t hash, const std::vector<uint8_t> & key) {
+        auto it = map.find(hash);
+        if (it == map.end() || it->second->key != key) {
+            return nullptr;
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        return &it->second->embd;
+    }
+
+    const std::vector<float> * get(const std::vector<uint8_t> & key) {
+        return get(hash_key(key), key);
+    }
+
+    // on a hash collision, the new entry replaces the old one
+    void put(uint64_t hash, const std::vector<uint8_t> & key, const float * embd, size_t n_embd) {
+        const size_t n_bytes = key.size() + n_embd*sizeof(float);
+        if (n_bytes > size_max) {
+            return;
+        }
+
+        auto it = map.find(hash);
+        if (it != map.end()) {
+            size -= it->second->n_bytes();
+            entries.erase(it->second);
+            map.erase(it);
+        }
+
+        while (size + n_bytes > size_max) {
+            const entry & last = entries.back();
+            size -= last.n_bytes();
+            map.erase(last.hash);
+            entries.pop_back();
+        }
+
+        entries.push_front({hash, key, std::vector<float>(embd, embd + n_embd)});
+        map[hash] = entries.begin();
+        size += n_bytes;
+    }
+
+    void put(const std::vector<uint8_t> & key, const float * embd, size_t n_embd) {
+        put(hash_key(key), key, embd, n_embd);
+    }
+
+    // FNV-1a, 8 bytes at a time
+    static uint64_t hash_key(const std::vector<uint8_t> & key) {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        const uint8_t * p = key.data();
+        const size_t    n = key.size();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            uint64_t w;
+            std::memcpy(&w, p + i, 8);
+            h = (h ^ w) * 0x100000001b3ULL;
+        }
+        for (; i < n; ++i) {
+            h = (h ^ p[i]) * 0x100000001b3ULL;
+        }
+        return h;
+    }
+
+    // appends n_bytes of data to the key
+    static void key_add(std::vector<uint8_t> & key, const void * data, size_t n_bytes) {
+        const uint8_t * p = (const uint8_t *) data;
+        key.insert(key.end(), p, p + n_bytes);
+    }
+};
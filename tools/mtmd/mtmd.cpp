@@ -2,15 +2,20 @@
 #include "clip-impl.h"
 #include "mtmd.h"
 #include "mtmd-audio.h"
+#include "mtmd-embd-cache.h"
 
 #include "llama.h"
 
 #include <algorithm>
 #include <cerrno>
+#include <cinttypes>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
+#include <fstream>
 #include <limits>
+#include <map>
 #include <vector>
 
 // represents raw image data, layout is RGBRGBRGB...
@@ -91,9 +96,26 @@ mtmd_context_params mtmd_context_params_default() {
     params.verbosity = GGML_LOG_LEVEL_INFO;
     params.image_marker = MTMD_DEFAULT_IMAGE_MARKER;
     params.media_marker = mtmd_default_marker();
+    params.embd_cache_size = 0;
+    params.embd_cache_file = nullptr;
+    params.batch_encode = false;
     return params;
 }
 
+// key of the embedding cache: the type of the chunk and its preprocessed images
+static std::vector<uint8_t> mtmd_embd_cache_key(mtmd_input_chunk_type type, const clip_image_f32_batch & batch) {
+    std::vector<uint8_t> key;
+
+    const int32_t t = type;
+    mtmd_embd_cache::key_add(key, &t, sizeof(t));
+    for (const auto & img : batch.entries) {
+        mtmd_embd_cache::key_add(key, &img->nx, sizeof(img->nx));
+        mtmd_embd_cache::key_add(key, &img->ny, sizeof(img->ny));
+        mtmd_embd_cache::key_add(key, img->buf.data(), img->buf.size()*sizeof(float));
+    }
+    return key;
+}
+
 struct mtmd_context {
     struct clip_ctx * ctx_v; // vision
     struct clip_ctx * ctx_a; // audio
@@ -130,6 +152,11 @@ struct mtmd_context {
     // for whisper, we pre-calculate the mel filter bank
     whisper_preprocessor::whisper_filters w_filters;
 
+    mtmd_embd_cache embd_cache;
+    std::string embd_cache_file;
+
+    bool batch_encode;
+
     // TODO @ngxson : add timings
 
     mtmd_context(const char * mmproj_fname,
@@ -139,7 +166,8 @@ struct mtmd_context {
         print_timings(ctx_params.print_timings),
         n_threads    (ctx_params.n_threads),
         media_marker (ctx_params.media_marker),
-        n_embd_text  (llama_model_n_embd(text_model))
+        n_embd_text  (llama_model_n_embd(text_model)),
+        batch_encode (ctx_params.batch_encode)
     {
         if (std::string(ctx_params.image_marker) != MTMD_DEFAULT_IMAGE_MARKER) {
             throw std::runtime_error("custom image_marker is not supported anymore, use media_marker instead");
@@ -152,6 +180,7 @@ struct mtmd_context {
         clip_context_params ctx_clip_params;
         ctx_clip_params.use_gpu   = ctx_params.use_gpu;
         ctx_clip_params.verbosity = ctx_params.verbosity;
+        ctx_clip_params.n_threads = ctx_params.n_threads;
         auto res = clip_init(mmproj_fname, ctx_clip_params);
         ctx_v = res.ctx_v;
         ctx_a = res.ctx_a;
@@ -185,6 +214,18 @@ struct mtmd_context {
         if (ctx_a) {
             init_audio();
         }
+
+        embd_cache.size_max = (size_t) std::max(0, ctx_params.embd_cache_size)*1024*1024;
+        if (embd_cache.enabled() && ctx_params.embd_cache_file) {
+            embd_cache_file = ctx_params.embd_cache_file;
+            std::ifstream f(embd_cache_file, std::ios::binary);
+            if (f.good()) {
+                f.close();
+                if (!mtmd_embd_cache_load(this, embd_cache_file.c_str())) {
+                    LOG_WRN("%s: failed to load embedding cache from %s, starting empty\n", __func__, embd_cache_file.c_str());
+                }
+            }
+        }
     }
 
     void init_vision() {
@@ -311,6 +352,9 @@ struct mtmd_context {
     }
 
     ~mtmd_context() {
+        if (!embd_cache_file.empty()) {
+            mtmd_embd_cache_save(this, embd_cache_file.c_str());
+        }
         clip_free(ctx_a);
         clip_free(ctx_v);
     }
@@ -359,6 +403,33 @@ void mtmd_free(mtmd_context * ctx) {
     }
 }
 
+// audio chunk from the mel spectrogram of a window of the audio
+static mtmd_input_chunk mtmd_audio_chunk_from_mel(mtmd_context * ctx, whisper_preprocessor::whisper_mel && mel_spec, const std::string & id) {
+    clip_image_f32_ptr mel_f32(clip_image_f32_init());
+    mel_f32->nx  = mel_spec.n_len;
+    mel_f32->ny  = mel_spec.n_mel;
+    mel_f32->buf = std::move(mel_spec.data);
+    size_t n_tokens = clip_n_output_tokens(ctx->ctx_a, mel_f32.get());
+
+    clip_image_f32_batch batch_f32;
+    batch_f32.is_audio = true;
+    batch_f32.entries.push_back(std::move(mel_f32));
+
+    mtmd_audio_tokens_ptr audio_tokens(new mtmd_audio_tokens);
+    audio_tokens->n_tokens = n_tokens;
+    audio_tokens->batch_f32 = std::move(batch_f32);
+    audio_tokens->id = id; // optional
+
+    LOG_DBG("audio_tokens->n_tokens = %d\n", audio_tokens->n_tokens);
+
+    return mtmd_input_chunk{
+        MTMD_INPUT_CHUNK_TYPE_AUDIO,
+        {}, // text tokens
+        nullptr, // image tokens
+        std::move(audio_tokens),
+    };
+}
+
 struct mtmd_tokenizer {
     mtmd_context * ctx;
     std::vector<const mtmd_bitmap *> bitmaps;
@@ -621,7 +692,7 @@ struct mtmd_tokenizer {
             std::vector<whisper_preprocessor::whisper_mel> mel_spec_chunks;
             const float * samples = (const float *)bitmap->data.data();
             size_t n_samples = bitmap->data.size() / sizeof(float);
-            bool ok = whisper_preprocessor::preprocess_audio(samples, n_samples, ctx->w_filters, mel_spec_chunks);
+            bool ok = whisper_preprocessor::preprocess_audio(samples, n_samples, ctx->w_filters, ctx->n_threads, mel_spec_chunks);
             if (!ok) {
                 LOG_ERR("Unable to preprocess audio\n");
                 return 2;
@@ -630,30 +701,7 @@ struct mtmd_tokenizer {
             // consider each mel_spec as a separate audio chunk
             // TODO: maybe support batching, but this may come with memory cost
             for (auto & mel_spec : mel_spec_chunks) {
-                clip_image_f32_ptr mel_f32(clip_image_f32_init());
-                mel_f32->nx  = mel_spec.n_len;
-                mel_f32->ny  = mel_spec.n_mel;
-                mel_f32->buf = std::move(mel_spec.data);
-                size_t n_tokens = clip_n_output_tokens(ctx->ctx_a, mel_f32.get());
-
-                clip_image_f32_batch batch_f32;
-                batch_f32.is_audio = true;
-                batch_f32.entries.push_back(std::move(mel_f32));
-
-                mtmd_audio_tokens_ptr audio_tokens(new mtmd_audio_tokens);
-                audio_tokens->n_tokens = n_tokens;
-                audio_tokens->batch_f32 = std::move(batch_f32);
-                audio_tokens->id = bitmap->id; // optional
-
-                LOG_DBG("audio_tokens->n_tokens = %d\n", audio_tokens->n_tokens);
-
-                mtmd_input_chunk chunk{
-                    MTMD_INPUT_CHUNK_TYPE_AUDIO,
-                    {}, // text tokens
-                    nullptr, // image tokens
-                    std::move(audio_tokens),
-                };
-                cur.entries.emplace_back(std::move(chunk));
+                cur.entries.emplace_back(mtmd_audio_chunk_from_mel(ctx, std::move(mel_spec), bitmap->id));
             }
 
             if (!ctx->aud_end.empty()) {
@@ -737,6 +785,73 @@ int32_t mtmd_tokenize(mtmd_context * ctx,
     return tokenizer.tokenize(output);
 }
 
+static int32_t mtmd_encode_image(mtmd_context * ctx, const mtmd_image_tokens * image_tokens) {
+    clip_ctx * ctx_clip = ctx->ctx_v;
+    int n_mmproj_embd = clip_n_mmproj_embd(ctx_clip);
+    ctx->image_embd_v.resize(image_tokens->n_tokens() * n_mmproj_embd);
+    bool ok = false;
+
+    if (clip_is_llava(ctx_clip) || clip_is_minicpmv(ctx_clip) || clip_is_glm(ctx_clip)) {
+        // TODO @ngxson : llava does not support batched encoding ; this should be fixed inside clip_image_batch_encode()
+        const auto & entries = image_tokens->batch_f32.entries;
+        for (size_t i = 0; i < entries.size(); i++) {
+            int n_tokens_per_image = clip_n_output_tokens(ctx_clip, entries[i].get());
+            ok = clip_image_encode(
+                ctx_clip,
+                ctx->n_threads,
+                entries[i].get(),
+                ctx->image_embd_v.data() + i*n_mmproj_embd*n_tokens_per_image);
+        }
+    } else {
+        ok = clip_image_batch_encode(
+            ctx_clip,
+            ctx->n_threads,
+            &image_tokens->batch_f32,
+            ctx->image_embd_v.data());
+    }
+
+    return ok ? 0 : 1;
+}
+
+static int32_t mtmd_encode_audio(mtmd_context * ctx, const mtmd_audio_tokens * audio_tokens) {
+    int n_mmproj_embd = ctx->n_embd_text;
+    ctx->image_embd_v.resize(audio_tokens->n_tokens * n_mmproj_embd);
+    bool ok = clip_image_batch_encode(
+        ctx->ctx_a,
+        ctx->n_threads,
+        &audio_tokens->batch_f32,
+        ctx->image_embd_v.data());
+    return ok ? 0 : 1;
+}
+
+// look up the embeddings of the chunk in the cache, run the encoder on miss
+template <typename F>
+static int32_t mtmd_encode_cached(mtmd_context * ctx,
+        mtmd_input_chunk_type type,
+        const clip_image_f32_batch & batch_f32,
+        size_t n_tokens,
+        F && encode) {
+    if (!ctx->embd_cache.enabled()) {
+        return encode();
+    }
+
+    const size_t n_embd = n_tokens * ctx->n_embd_text;
+    const std::vector<uint8_t> key = mtmd_embd_cache_key(type, batch_f32);
+
+    const std::vector<float> * embd = ctx->embd_cache.get(key);
+    if (embd && embd->size() == n_embd) {
+        LOG_DBG("%s: embedding cache hit, hash = %016llx\n", __func__, (unsigned long long) mtmd_embd_cache::hash_key(key));
+        ctx->image_embd_v = *embd;
+        return 0;
+    }
+
+    int32_t res = encode();
+    if (res == 0) {
+        ctx->embd_cache.put(key, ctx->image_embd_v.data(), n_embd);
+    }
+    return res;
+}
+
 int32_t mtmd_encode_chunk(mtmd_context * ctx, const mtmd_input_chunk * chunk) {
     if (chunk->type == MTMD_INPUT_CHUNK_TYPE_TEXT) {
         LOG_WRN("mtmd_encode_chunk has no effect for text chunks\n");
@@ -752,14 +867,10 @@ int32_t mtmd_encode_chunk(mtmd_context * ctx, const mtmd_input_chunk * chunk) {
             LOG_ERR("%s: model does not support audio input\n", __func__);
             return 1;
         }
-        int n_mmproj_embd = ctx->n_embd_text;
-        ctx->image_embd_v.resize(chunk->tokens_audio->n_tokens * n_mmproj_embd);
-        bool ok = clip_image_batch_encode(
-            ctx->ctx_a,
-            ctx->n_threads,
-            &chunk->tokens_audio->batch_f32,
-            ctx->image_embd_v.data());
-        return ok ? 0 : 1;
+        const mtmd_audio_tokens * audio_tokens = chunk->tokens_audio.get();
+        return mtmd_encode_cached(ctx, chunk->type, audio_tokens->batch_f32, audio_tokens->n_tokens, [&]() {
+            return mtmd_encode_audio(ctx, audio_tokens);
+        });
     }
 
     LOG_ERR("%s: unknown chunk type %d\n", __func__, (int)chunk->type);
@@ -767,41 +878,222 @@ int32_t mtmd_encode_chunk(mtmd_context * ctx, const mtmd_input_chunk * chunk) {
 }
 
 int32_t mtmd_encode(mtmd_context * ctx, const mtmd_image_tokens * image_tokens) {
-    clip_ctx * ctx_clip = ctx->ctx_v;
-    if (!ctx_clip) {
+    if (!ctx->ctx_v) {
         LOG_ERR("%s: this API does not support non-vision input, please use mtmd_encode_chunk instead\n", __func__);
         return 1;
     }
-    int n_mmproj_embd = clip_n_mmproj_embd(ctx_clip);
-    ctx->image_embd_v.resize(image_tokens->n_tokens() * n_mmproj_embd);
-    bool ok = false;
+    return mtmd_encode_cached(ctx, MTMD_INPUT_CHUNK_TYPE_IMAGE, image_tokens->batch_f32, image_tokens->n_tokens(), [&]() {
+        return mtmd_encode_image(ctx, image_tokens);
+    });
+}
 
-    if (clip_is_llava(ctx_clip) || clip_is_minicpmv(ctx_clip) || clip_is_glm(ctx_clip)) {
-        // TODO @ngxson : llava does not support batched encoding ; this should be fixed inside clip_image_batch_encode()
-        const auto & entries = image_tokens->batch_f32.entries;
-        for (size_t i = 0; i < entries.size(); i++) {
-            int n_tokens_per_image = clip_n_output_tokens(ctx_clip, entries[i].get());
-            ok = clip_image_encode(
-                ctx_clip,
-                ctx->n_threads,
-                entries[i].get(),
-                ctx->image_embd_v.data() + i*n_mmproj_embd*n_tokens_per_image);
+// max. number of images encoded in a single graph by mtmd_encode_chunks, bounds the size of the compute buffer
+#define MTMD_ENCODE_BATCH_MAX 8
+
+int32_t mtmd_encode_chunks(mtmd_context * ctx, const mtmd_input_chunk ** chunks, size_t n_chunks) {
+    const size_t n_embd = ctx->n_embd_text;
+
+    // offset of the output embeddings of each chunk
+    std::vector<size_t> offs(n_chunks + 1, 0);
+    for (size_t i = 0; i < n_chunks; ++i) {
+        if (chunks[i]->type == MTMD_INPUT_CHUNK_TYPE_TEXT) {
+            LOG_ERR("%s: chunk %zu is a text chunk\n", __func__, i);
+            return 1;
         }
-    } else {
-        ok = clip_image_batch_encode(
-            ctx_clip,
-            ctx->n_threads,
-            &image_tokens->batch_f32,
-            ctx->image_embd_v.data());
+        offs[i + 1] = offs[i] + mtmd_input_chunk_get_n_tokens(chunks[i])*n_embd;
     }
 
-    return ok ? 0 : 1;
+    std::vector<float> embd(offs[n_chunks]);
+
+    // the images that are not in the cache are bucketed by the size of the preprocessed image
+    std::map<std::pair<int, int>, std::vector<size_t>> buckets;
+    std::vector<std::vector<uint8_t>> keys(n_chunks);
+
+    const bool use_batch = ctx->batch_encode && ctx->ctx_v && clip_image_batch_supported(ctx->ctx_v);
+
+    for (size_t i = 0; i < n_chunks; ++i) {
+        const mtmd_input_chunk * chunk = chunks[i];
+
+        if (use_batch && chunk->type == MTMD_INPUT_CHUNK_TYPE_IMAGE && chunk->tokens_image->batch_f32.entries.size() == 1) {
+            if (ctx->embd_cache.enabled()) {
+                keys[i] = mtmd_embd_cache_key(chunk->type, chunk->tokens_image->batch_f32);
+
+                const std::vector<float> * cached = ctx->embd_cache.get(keys[i]);
+                if (cached && cached->size() == offs[i + 1] - offs[i]) {
+                    std::copy(cached->begin(), cached->end(), embd.begin() + offs[i]);
+                    continue;
+                }
+            }
+
+            const auto & img = chunk->tokens_image->batch_f32.entries[0];
+            buckets[{img->nx, img->ny}].push_back(i);
+            continue;
+        }
+
+        int32_t res = mtmd_encode_chunk(ctx, chunk);
+        if (res != 0) {
+            return res;
+        }
+        std::copy(ctx->image_embd_v.begin(), ctx->image_embd_v.begin() + (offs[i + 1] - offs[i]), embd.begin() + offs[i]);
+    }
+
+    for (const auto & it : buckets) {
+        const auto & ids = it.second;
+
+        for (size_t i0 = 0; i0 < ids.size(); i0 += MTMD_ENCODE_BATCH_MAX) {
+            const size_t n_imgs = std::min(ids.size() - i0, (size_t) MTMD_ENCODE_BATCH_MAX);
+
+            // the images of a bucket have the same number of output tokens
+            const size_t n_out = offs[ids[i0] + 1] - offs[ids[i0]];
+
+            clip_image_f32_batch batch_f32;
+            for (size_t k = 0; k < n_imgs; ++k) {
+                clip_image_f32_ptr img(clip_image_f32_init());
+                *img = *chunks[ids[i0 + k]]->tokens_image->batch_f32.entries[0];
+                batch_f32.entries.push_back(std::move(img));
+            }
+
+            ctx->image_embd_v.resize(n_imgs*n_out);
+            if (!clip_image_batch_encode(ctx->ctx_v, ctx->n_threads, &batch_f32, ctx->image_embd_v.data())) {
+                return 1;
+            }
+
+            for (size_t k = 0; k < n_imgs; ++k) {
+                const size_t i = ids[i0 + k];
+                const float * out = ctx->image_embd_v.data() + k*n_out;
+                std::copy(out, out + n_out, embd.begin() + offs[i]);
+                if (ctx->embd_cache.enabled()) {
+                    ctx->embd_cache.put(keys[i], out, n_out);
+                }
+            }
+        }
+    }
+
+    ctx->image_embd_v = std::move(embd);
+
+    return 0;
 }
 
 float * mtmd_get_output_embd(mtmd_context * ctx) {
     return ctx->image_embd_v.data();
 }
 
+// embedding cache file format:
+//   uint32 magic, uint32 version, int32 n_embd, int32 projector type (vision), int32 projector type (audio), uint32 n_entries
+//   n_entries x { uint64 n_key, uint8[n_key] key, uint64 n_floats, float[n_floats] }, the least recently used first
+static const uint32_t MTMD_EMBD_CACHE_MAGIC   = 0x4345544d; // "MTEC"
+static const uint32_t MTMD_EMBD_CACHE_VERSION = 2;
+
+bool mtmd_embd_cache_save(mtmd_context * ctx, const char * fname) {
+    std::ofstream f(fname, std::ios::binary);
+    if (!f) {
+        LOG_ERR("%s: failed to open %s for writing\n", __func__, fname);
+        return false;
+    }
+
+    const auto & entries = ctx->embd_cache.entries;
+
+    const int32_t  n_embd    = ctx->n_embd_text;
+    const int32_t  proj_v    = ctx->proj_type_v();
+    const int32_t  proj_a    = ctx->proj_type_a();
+    const uint32_t n_entries = entries.size();
+
+    f.write((const char *) &MTMD_EMBD_CACHE_MAGIC,   sizeof(MTMD_EMBD_CACHE_MAGIC));
+    f.write((const char *) &MTMD_EMBD_CACHE_VERSION, sizeof(MTMD_EMBD_CACHE_VERSION));
+    f.write((const char *) &n_embd,    sizeof(n_embd));
+    f.write((const char *) &proj_v,    sizeof(proj_v));
+    f.write((const char *) &proj_a,    sizeof(proj_a));
+    f.write((const char *) &n_entries, sizeof(n_entries));
+
+    for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+        const uint64_t n_key    = it->key.size();
+        const uint64_t n_floats = it->embd.size();
+        f.write((const char *) &n_key,     sizeof(n_key));
+        f.write((const char *) it->key.data(), n_key);
+        f.write((const char *) &n_floats,  sizeof(n_floats));
+        f.write((const char *) it->embd.data(), n_floats*sizeof(float));
+    }
+
+    if (!f) {
+        LOG_ERR("%s: failed to write %s\n", __func__, fname);
+        return false;
+    }
+
+    LOG_INF("%s: saved %u embeddings (%.2f MiB) to %s\n", __func__, n_entries, ctx->embd_cache.size/1024.0/1024.0, fname);
+    return true;
+}
+
+bool mtmd_embd_cache_load(mtmd_context * ctx, const char * fname) {
+    std::ifstream f(fname, std::ios::binary);
+    if (!f) {
+        LOG_ERR("%s: failed to open %s\n", __func__, fname);
+        return false;
+    }
+
+    uint32_t magic     = 0;
+    uint32_t version   = 0;
+    int32_t  n_embd    = 0;
+    int32_t  proj_v    = 0;
+    int32_t  proj_a    = 0;
+    uint32_t n_entries = 0;
+
+    f.read((char *) &magic,     sizeof(magic));
+    f.read((char *) &version,   sizeof(version));
+    f.read((char *) &n_embd,    sizeof(n_embd));
+    f.read((char *) &proj_v,    sizeof(proj_v));
+    f.read((char *) &proj_a,    sizeof(proj_a));
+    f.read((char *) &n_entries, sizeof(n_entries));
+
+    if (!f || magic != MTMD_EMBD_CACHE_MAGIC || version != MTMD_EMBD_CACHE_VERSION) {
+        LOG_ERR("%s: %s is not a valid embedding cache file\n", __func__, fname);
+        return false;
+    }
+
+    if (n_embd != ctx->n_embd_text || proj_v != ctx->proj_type_v() || proj_a != ctx->proj_type_a()) {
+        LOG_ERR("%s: %s was saved for a different mmproj model\n", __func__, fname);
+        return false;
+    }
+
+    std::vector<uint8_t> key;
+    std::vector<float>   embd;
+    for (uint32_t i = 0; i < n_entries; ++i) {
+        uint64_t n_key    = 0;
+        uint64_t n_floats = 0;
+        f.read((char *) &n_key, sizeof(n_key));
+        if (!f) {
+            LOG_ERR("%s: %s is corrupted\n", __func__, fname);
+            return false;
+        }
+        // an entry with a larger key does not fit in the cache, it was saved with a larger size
+        const bool fits = n_key <= ctx->embd_cache.size_max;
+        if (fits) {
+            key.resize(n_key);
+            f.read((char *) key.data(), n_key);
+        } else {
+            f.seekg(n_key, std::ios::cur);
+        }
+        f.read((char *) &n_floats, sizeof(n_floats));
+        if (!f || n_floats % n_embd != 0) {
+            LOG_ERR("%s: %s is corrupted\n", __func__, fname);
+            return false;
+        }
+        if (!fits || n_key + n_floats*sizeof(float) > ctx->embd_cache.size_max) {
+            f.seekg(n_floats*sizeof(float), std::ios::cur);
+            continue;
+        }
+        embd.resize(n_floats);
+        f.read((char *) embd.data(), n_floats*sizeof(float));
+        if (!f) {
+            LOG_ERR("%s: %s is truncated\n", __func__, fname);
+            return false;
+        }
+        ctx->embd_cache.put(key, embd.data(), embd.size());
+    }
+
+    LOG_INF("%s: loaded %zu embeddings (%.2f MiB) from %s\n", __func__, ctx->embd_cache.entries.size(), ctx->embd_cache.size/1024.0/1024.0, fname);
+    return true;
+}
+
 bool mtmd_decode_use_non_causal(mtmd_context * ctx) {
     if (ctx->ctx_v && clip_get_projector_type(ctx->ctx_v) == PROJECTOR_TYPE_GEMMA3) {
         return true;
@@ -1026,6 +1318,118 @@ llama_pos mtmd_image_tokens_get_n_pos(const mtmd_image_tokens * image_tokens) {
     return image_tokens->n_tokens();
 }
 
+// mtmd_audio_stream
+
+struct mtmd_audio_stream {
+    struct entry {
+        mtmd_input_chunk chunk;
+        std::vector<float> embd; // empty for text chunks
+    };
+
+    mtmd_context * ctx;
+    whisper_preprocessor::whisper_mel_stream mel_stream;
+
+    std::deque<entry> ready;
+    std::vector<float> embd; // embeddings of the last popped chunk
+
+    bool finished = false;
+
+    mtmd_audio_stream(mtmd_context * ctx) : ctx(ctx), mel_stream(ctx->w_filters, ctx->n_threads) {}
+
+    void add_text(const std::string & txt) {
+        const llama_vocab * vocab = llama_model_get_vocab(ctx->text_model);
+        auto tokens = mtmd_tokenizer::mtmd_tokenize_text_internal(vocab, txt, /* add_special */ false, /* parse_special */ true);
+        if (tokens.empty()) {
+            return;
+        }
+        ready.push_back({ mtmd_input_chunk{ MTMD_INPUT_CHUNK_TYPE_TEXT, std::move(tokens), nullptr, nullptr }, {} });
+    }
+
+    // encode the windows as soon as they are complete
+    int32_t add_audio(std::vector<whisper_preprocessor::whisper_mel> & mel_spec_chunks) {
+        for (auto & mel_spec : mel_spec_chunks) {
+            entry e = { mtmd_audio_chunk_from_mel(ctx, std::move(mel_spec), ""), {} };
+
+            const int64_t t_start = ggml_time_ms();
+            int32_t res = mtmd_encode_chunk(ctx, &e.chunk);
+            if (res != 0) {
+                return res;
+            }
+            LOG_DBG("%s: audio window %zu encoded in %" PRId64 " ms\n", __func__, ready.size(), ggml_time_ms() - t_start);
+
+            const float * out = mtmd_get_output_embd(ctx);
+            e.embd.assign(out, out + e.chunk.tokens_audio->n_tokens * ctx->n_embd_text);
+
+            ready.push_back(std::move(e));
+        }
+        return 0;
+    }
+};
+
+mtmd_audio_stream * mtmd_audio_stream_init(mtmd_context * ctx) {
+    if (!ctx->ctx_a) {
+        LOG_ERR("%s: model does not support audio input\n", __func__);
+        return nullptr;
+    }
+    GGML_ASSERT(ctx->w_filters.n_mel); // make sure we have filter preloaded
+
+    mtmd_audio_stream * stream = new mtmd_audio_stream(ctx);
+    if (!ctx->aud_beg.empty()) {
+        stream->add_text(ctx->aud_beg); // add audio begin token
+    }
+    return stream;
+}
+
+void mtmd_audio_stream_free(mtmd_audio_stream * stream) {
+    if (stream) {
+        delete stream;
+    }
+}
+
+int32_t mtmd_audio_stream_push(mtmd_audio_stream * stream, const float * samples, size_t n_samples) {
+    if (stream->finished) {
+        LOG_ERR("%s: the stream is already finished\n", __func__);
+        return 1;
+    }
+    std::vector<whisper_preprocessor::whisper_mel> mel_spec_chunks;
+    stream->mel_stream.push(samples, n_samples, mel_spec_chunks);
+    return stream->add_audio(mel_spec_chunks);
+}
+
+int32_t mtmd_audio_stream_finish(mtmd_audio_stream * stream) {
+    if (stream->finished) {
+        return 0;
+    }
+    stream->finished = true;
+
+    std::vector<whisper_preprocessor::whisper_mel> mel_spec_chunks;
+    stream->mel_stream.finish(mel_spec_chunks);
+    int32_t res = stream->add_audio(mel_spec_chunks);
+    if (res != 0) {
+        return res;
+    }
+
+    if (!stream->ctx->aud_end.empty()) {
+        stream->add_text(stream->ctx->aud_end); // add audio end token
+    }
+    return 0;
+}
+
+mtmd_input_chunk * mtmd_audio_stream_pop(mtmd_audio_stream * stream) {
+    if (stream->ready.empty()) {
+        return nullptr;
+    }
+    auto & e = stream->ready.front();
+    mtmd_input_chunk * chunk = new mtmd_input_chunk(std::move(e.chunk));
+    stream->embd = std::move(e.embd);
+    stream->ready.pop_front();
+    return chunk;
+}
+
+float * mtmd_audio_stream_get_embd(mtmd_audio_stream * stream) {
+    return stream->embd.empty() ? nullptr : stream->embd.data();
+}
+
 // test function
 
 mtmd_input_chunks * mtmd_test_create_input_chunks() {
@@ -57,6 +57,7 @@ struct mtmd_bitmap;
 struct mtmd_image_tokens;
 struct mtmd_input_chunk;
 struct mtmd_input_chunks;
+struct mtmd_audio_stream;
 
 struct mtmd_input_text {
     const char * text;
@@ -74,6 +75,7 @@ typedef struct mtmd_image_tokens mtmd_image_tokens;
 typedef struct mtmd_input_chunk  mtmd_input_chunk;
 typedef struct mtmd_input_chunks mtmd_input_chunks;
 typedef struct mtmd_input_text   mtmd_input_text;
+typedef struct mtmd_audio_stream mtmd_audio_stream;
 
 struct mtmd_context_params {
     bool use_gpu;
@@ -82,6 +84,14 @@ struct mtmd_context_params {
     enum ggml_log_level verbosity;
     const char * image_marker; // deprecated, use media_marker instead
     const char * media_marker;
+
+    // cache of the output embeddings of image/audio chunks, keyed by the preprocessed chunk
+    // repeated images/audio skip the encoder, the least recently used entries are evicted first
+    int embd_cache_size;          // max. size of the cache in MiB, the preprocessed inputs are stored as keys too, 0 = disabled
+    const char * embd_cache_file; // optional, load the cache from this file on init and save it on mtmd_free
+
+    // encode the images of the same size in a single graph in mtmd_encode_chunks, if the model supports it
+    bool batch_encode;
 };
 
 MTMD_API const char * mtmd_default_marker(void);
@@ -96,6 +106,13 @@ MTMD_API mtmd_context * mtmd_init_from_file(const char * mmproj_fname,
 
 MTMD_API void mtmd_free(mtmd_context * ctx);
 
+// thread safety of mtmd_context:
+// - the encode functions (mtmd_encode, mtmd_encode_chunk, mtmd_encode_chunks, mtmd_get_output_embd, mtmd_embd_cache_*
+//   and mtmd_audio_stream_*) use the compute state of ctx, they must not be called concurrently with each other
+// - mtmd_tokenize, mtmd_decode_use_*, mtmd_support_*, mtmd_get_audio_bitrate and mtmd_helper_decode_image_chunk
+//   (with the embeddings given by the caller) only read the model parameters, they can be called from other threads,
+//   including while an encode is running on another thread
+
 // whether we need to set non-causal mask before llama_decode
 MTMD_API bool mtmd_decode_use_non_causal(mtmd_context * ctx);
 
@@ -205,11 +222,60 @@ MTMD_API int32_t mtmd_encode(mtmd_context * ctx,
 MTMD_API int32_t mtmd_encode_chunk(mtmd_context * ctx,
                                    const mtmd_input_chunk * chunk);
 
+// encode several image/audio chunks, for ex. the images of different requests
+// with batch_encode, the images of the same size are encoded in a single graph if the model supports it, the other chunks one by one
+// the output embeddings of the chunks are concatenated in the order of the chunks
+// this function is NOT thread-safe
+// returns 0 on success
+MTMD_API int32_t mtmd_encode_chunks(mtmd_context * ctx,
+                                    const mtmd_input_chunk ** chunks,
+                                    size_t n_chunks);
+
 // get output embeddings from the last encode pass
 // the reading size (in bytes) is equal to:
 // llama_model_n_embd(model) * mtmd_input_chunk_get_n_tokens(chunk) * sizeof(float)
 MTMD_API float * mtmd_get_output_embd(mtmd_context * ctx);
 
+// save/load the embedding cache to/from a file
+// the file is only valid for the same mmproj model
+// returns true on success
+MTMD_API bool mtmd_embd_cache_save(mtmd_context * ctx, const char * fname);
+MTMD_API bool mtmd_embd_cache_load(mtmd_context * ctx, const char * fname);
+
+// streaming audio input
+//
+// the PCM F32 samples are pushed as they arrive, for ex. during an upload or from a microphone
+// the mel spectrogram is computed incrementally, and each 30-second window of the audio is encoded
+// as soon as it is complete, instead of after the whole audio is available
+// the chunks of the stream are popped in order, so the prefill can start on the first windows
+// while the rest of the audio is still coming:
+//   1. a text chunk with the audio begin marker, if the model has one
+//   2. one audio chunk per window, its embeddings are already computed
+//   3. a text chunk with the audio end marker, if the model has one, after mtmd_audio_stream_finish()
+// the audio chunks can be decoded with mtmd_helper_decode_image_chunk() and mtmd_audio_stream_get_embd()
+// note: the windows are normalized with the max of the audio pushed so far, so for audio longer than
+//       one window the embeddings can be slightly different from the ones of mtmd_tokenize()
+// these functions are NOT thread-safe, and the encoder of ctx must not be used concurrently
+// return nullptr if the model does not support audio input
+MTMD_API mtmd_audio_stream * mtmd_audio_stream_init(mtmd_context * ctx);
+MTMD_API void                mtmd_audio_stream_free(mtmd_audio_stream * stream);
+
+// push samples, the windows that become complete are encoded
+// returns 0 on success
+MTMD_API int32_t mtmd_audio_stream_push(mtmd_audio_stream * stream, const float * samples, size_t n_samples);
+
+// end of the audio: the last window is padded with silence and encoded
+// returns 0 on success
+MTMD_API int32_t mtmd_audio_stream_finish(mtmd_audio_stream * stream);
+
+// pop the next chunk of the stream, nullptr if no chunk is ready
+// the caller owns the chunk, free it with mtmd_input_chunk_free()
+MTMD_API mtmd_input_chunk * mtmd_audio_stream_pop(mtmd_audio_stream * stream);
+
+// embeddings of the last popped chunk, nullptr for text chunks
+// valid until the next call to mtmd_audio_stream_pop(), the size is the same as for mtmd_get_output_embd()
+MTMD_API float * mtmd_audio_stream_get_embd(mtmd_audio_stream * stream);
+
 /////////////////////////////////////////
 
 // test function, to be used in test-mtmd-c-api.c
@@ -247,6 +313,11 @@ struct mtmd_input_chunk_deleter {
 };
 using input_chunk_ptr = std::unique_ptr<mtmd_input_chunk, mtmd_input_chunk_deleter>;
 
+struct mtmd_audio_stream_deleter {
+    void operator()(mtmd_audio_stream * val) { mtmd_audio_stream_free(val); }
+};
+using audio_stream_ptr = std::unique_ptr<mtmd_audio_stream, mtmd_audio_stream_deleter>;
+
 struct bitmap {
     bitmap_ptr ptr;
     bitmap() : ptr(nullptr) {}
@@ -6,11 +6,15 @@
 #include "json-schema-to-grammar.h"
 #include "llama.h"
 #include "log.h"
+#include "lookahead.h"
+#include "ngram-cache.h"
 #include "sampling.h"
 #include "speculative.h"
 #include "mtmd.h"
 #include "mtmd-helper.h"
 
+#include "ggml-cpu.h"
+
 // mime type for sending response
 #define MIMETYPE_JSON "application/json; charset=utf-8"
 
@@ -24,8 +28,10 @@
 #include <cstddef>
 #include <cinttypes>
 #include <deque>
+#include <fstream>
 #include <memory>
 #include <mutex>
+#include <numeric>
 #include <signal.h>
 #include <thread>
 #include <unordered_map>
@@ -1159,6 +1165,9 @@ struct server_task_result_metrics : server_task_result {
     uint64_t n_decode_total     = 0;
     uint64_t n_busy_slots_total = 0;
 
+    std::vector<uint64_t> n_draft_total;
+    std::vector<uint64_t> n_draft_accepted;
+
     // while we can also use std::vector<server_slot> this requires copying the slot object which can be quite messy
     // therefore, we use json to temporarily store the slot.to_json() result
     json slots_data = json::array();
@@ -1183,6 +1192,9 @@ struct server_task_result_metrics : server_task_result {
             { "n_decode_total",                  n_decode_total },
             { "n_busy_slots_total",              n_busy_slots_total },
 
+            { "n_draft_total",                   n_draft_total },
+            { "n_draft_accepted",                n_draft_accepted },
+
             { "slots",                           slots_data },
         };
     }
@@ -1238,6 +1250,142 @@ struct server_task_result_apply_lora : server_task_result {
     }
 };
 
+// encodes the image/audio chunks of the prompts on a background thread, so that a large image does not block
+// the text decode of the other slots
+// the chunks that are queued at the same time, for ex. by concurrent requests, are encoded together (see mtmd_encode_chunks)
+//
+// the worker is the only thread that uses the encode state of mctx (compute scheduler, output embeddings, embedding cache)
+// the main loop decodes the embeddings copied into the jobs, with functions of mctx that only read the model parameters
+// and can be called during an encode (see the thread safety notes in mtmd.h)
+struct server_mtmd_encoder {
+    struct job {
+        llama_pos pos; // position of the chunk in the prompt
+
+        mtmd::input_chunk_ptr chunk;
+
+        // written by the worker before done is set
+        std::vector<float> embd;
+        int32_t res = 0;
+
+        std::atomic<bool> done = false;
+    };
+
+    using job_ptr = std::shared_ptr<job>;
+
+    mtmd_context * mctx = nullptr;
+
+    size_t n_embd = 0; // of the text model
+
+    // called by the worker after a group of jobs is done
+    std::function<void()> callback_done;
+
+    void start(mtmd_context * mctx, size_t n_embd, std::function<void()> callback_done) {
+        this->mctx          = mctx;
+        this->n_embd        = n_embd;
+        this->callback_done = std::move(callback_done);
+
+        running = true;
+        worker = std::thread([this]() { loop(); });
+    }
+
+    void stop() {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            running = false;
+        }
+        condition.notify_all();
+
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    void post(std::vector<job_ptr> && jobs) {
+        if (jobs.empty()) {
+            return;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (auto & job : jobs) {
+                queue.push_back(std::move(job));
+            }
+        }
+        condition.notify_one();
+    }
+
+private:
+    std::thread worker;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+
+    std::vector<job_ptr> queue;
+
+    bool running = false;
+
+    void loop() {
+        while (true) {
+            std::vector<job_ptr> jobs;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [&]{ return !queue.empty() || !running; });
+                if (!running) {
+                    return;
+                }
+
+                // the jobs of the released slots are not referenced anymore
+                for (auto & job : queue) {
+                    if (job.use_count() > 1) {
+                        jobs.push_back(std::move(job));
+                    }
+                }
+                queue.clear();
+            }
+
+            if (jobs.empty()) {
+                continue;
+            }
+
+            encode(jobs);
+
+            callback_done();
+        }
+    }
+
+    void encode(std::vector<job_ptr> & jobs) {
+        const int64_t t0 = ggml_time_ms();
+
+        std::vector<const mtmd_input_chunk *> chunks;
+        for (const auto & job : jobs) {
+            chunks.push_back(job->chunk.get());
+        }
+
+        int32_t res = mtmd_encode_chunks(mctx, chunks.data(), chunks.size());
+        if (res == 0) {
+            const float * embd = mtmd_get_output_embd(mctx);
+            for (auto & job : jobs) {
+                const size_t n = mtmd_input_chunk_get_n_tokens(job->chunk.get()) * n_embd;
+                job->embd.assign(embd, embd + n);
+                job->done = true;
+                embd += n;
+            }
+        } else {
+            // encode the chunks one by one to find the failing ones
+            for (auto & job : jobs) {
+                job->res = mtmd_encode_chunk(mctx, job->chunk.get());
+                if (job->res == 0) {
+                    const float * embd = mtmd_get_output_embd(mctx);
+                    job->embd.assign(embd, embd + mtmd_input_chunk_get_n_tokens(job->chunk.get()) * n_embd);
+                }
+                job->done = true;
+            }
+        }
+
+        SRV_INF("encoded %zu media chunks in %" PRId64 " ms\n", jobs.size(), ggml_time_ms() - t0);
+    }
+};
+
 struct server_slot {
     int id;
     int id_task = -1;
@@ -1255,6 +1403,20 @@ struct server_slot {
 
     common_speculative * spec = nullptr;
 
+    // additional sequences of the slot for tree-based and self-speculative decoding
+    std::vector<llama_seq_id> seq_extra;
+
+    // prompt-lookup decoding: the drafts are verified in the main batch, right after the sampled token
+    bool spec_in_batch = false;
+
+    llama_tokens drafted;
+
+    // lookahead decoding, also evaluated in the main batch
+    common_lookahead * la = nullptr;
+
+    // number of tokens after i_batch in the main batch that belong to the speculation of the slot
+    int32_t n_batch_spec = 0;
+
     std::vector<common_adapter_lora_info> lora;
 
     // the index relative to completion multi-task request
@@ -1282,6 +1444,9 @@ struct server_slot {
     // input prompt tokens
     server_tokens prompt_tokens;
 
+    // background encodes of the media chunks of the prompt after n_past, in prompt order
+    std::deque<server_mtmd_encoder::job_ptr> encode_jobs;
+
     size_t last_nl_pos = 0;
 
     std::string  generated_text;
@@ -1348,6 +1513,16 @@ struct server_slot {
         // clear speculative decoding stats
         n_draft_total = 0;
         n_draft_accepted = 0;
+
+        drafted.clear();
+        n_batch_spec = 0;
+
+        encode_jobs.clear();
+    }
+
+    // the media chunk at n_past is being encoded in the background
+    bool is_waiting_encode() const {
+        return state == SLOT_STATE_PROCESSING_PROMPT && !encode_jobs.empty() && encode_jobs.front()->pos == n_past && !encode_jobs.front()->done;
     }
 
     bool need_embd() const {
@@ -1391,7 +1566,12 @@ struct server_slot {
     }
 
     bool can_speculate() const {
-        return ctx_dft && params.speculative.n_max > 0 && params.cache_prompt;
+        return spec && params.speculative.n_max > 0 && params.cache_prompt;
+    }
+
+    bool can_lookahead() const {
+        // the probs of the accepted tokens are not tracked
+        return la && params.speculative.n_max > 0 && params.sampling.n_probs == 0;
     }
 
     void add_token(const completion_token_output & token) {
@@ -1409,6 +1589,7 @@ struct server_slot {
             t_last_used = ggml_time_us();
             t_token_generation = (ggml_time_us() - t_start_generation) / 1e3;
             state = SLOT_STATE_IDLE;
+            encode_jobs.clear();
             callback_on_release(id);
         }
     }
@@ -1543,8 +1724,15 @@ struct server_metrics {
     uint64_t n_decode_total     = 0;
     uint64_t n_busy_slots_total = 0;
 
-    void init() {
+    // per slot
+    std::vector<uint64_t> n_draft_total;
+    std::vector<uint64_t> n_draft_accepted;
+
+    void init(int n_slots) {
         t_start = ggml_time_us();
+
+        n_draft_total   .assign(n_slots, 0);
+        n_draft_accepted.assign(n_slots, 0);
     }
 
     void on_prompt_eval(const server_slot & slot) {
@@ -1559,6 +1747,9 @@ struct server_metrics {
         n_tokens_predicted         += slot.n_decoded;
         t_tokens_generation        += slot.t_token_generation;
         t_tokens_generation_total  += slot.t_token_generation;
+
+        n_draft_total   [slot.id] += slot.n_draft_total;
+        n_draft_accepted[slot.id] += slot.n_draft_accepted;
     }
 
     void on_decoded(const std::vector<server_slot> & slots) {
@@ -1885,15 +2076,26 @@ struct server_context {
     llama_model * model = nullptr;
     llama_context * ctx = nullptr;
 
+    // CPU threadpools attached to ctx, the slots are also sampled in parallel on threadpool
+    ggml_threadpool * threadpool       = nullptr;
+    ggml_threadpool * threadpool_batch = nullptr;
+
+    decltype(ggml_threadpool_free) * threadpool_free_fn = nullptr;
+
     // multimodal
     mtmd_context * mctx = nullptr;
 
+    server_mtmd_encoder mtmd_encoder;
+
     const llama_vocab * vocab = nullptr;
 
     llama_model * model_dft = nullptr;
 
     llama_context_params cparams_dft;
 
+    // n-gram cache of a text corpus for prompt-lookup decoding
+    common_ngram_cache nc_static;
+
     llama_batch batch {};
 
     bool clean_kv_cache = true;
@@ -1918,6 +2120,7 @@ struct server_context {
     oaicompat_parser_options  oai_parser_opt;
 
     ~server_context() {
+        mtmd_encoder.stop();
         mtmd_free(mctx);
 
         // Clear any sampling context
@@ -1931,10 +2134,59 @@ struct server_context {
             common_speculative_free(slot.spec);
             slot.spec = nullptr;
 
+            delete slot.la;
+            slot.la = nullptr;
+
             llama_batch_free(slot.batch_spec);
         }
 
         llama_batch_free(batch);
+
+        if (ctx) {
+            llama_detach_threadpool(ctx);
+        }
+        if (threadpool_free_fn) {
+            threadpool_free_fn(threadpool);
+            threadpool_free_fn(threadpool_batch);
+        }
+    }
+
+    // same as llama-cli: the threads of ctx follow the cpumask, priority and polling of the parameters
+    bool init_threadpools() {
+        auto * cpu_dev = ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_CPU);
+        if (!cpu_dev) {
+            SRV_ERR("%s", "no CPU backend found\n");
+            return false;
+        }
+        auto * reg = ggml_backend_dev_backend_reg(cpu_dev);
+        auto * threadpool_new_fn = (decltype(ggml_threadpool_new) *) ggml_backend_reg_get_proc_address(reg, "ggml_threadpool_new");
+        threadpool_free_fn       = (decltype(ggml_threadpool_free) *) ggml_backend_reg_get_proc_address(reg, "ggml_threadpool_free");
+
+        struct ggml_threadpool_params tpp_batch = ggml_threadpool_params_from_cpu_params(params_base.cpuparams_batch);
+        struct ggml_threadpool_params tpp       = ggml_threadpool_params_from_cpu_params(params_base.cpuparams);
+
+        set_process_priority(params_base.cpuparams.priority);
+
+        if (!ggml_threadpool_params_match(&tpp, &tpp_batch)) {
+            threadpool_batch = threadpool_new_fn(&tpp_batch);
+            if (!threadpool_batch) {
+                SRV_ERR("batch threadpool create failed : n_threads %d\n", tpp_batch.n_threads);
+                return false;
+            }
+
+            // start the non-batch threadpool in the paused state
+            tpp.paused = true;
+        }
+
+        threadpool = threadpool_new_fn(&tpp);
+        if (!threadpool) {
+            SRV_ERR("threadpool create failed : n_threads %d\n", tpp.n_threads);
+            return false;
+        }
+
+        llama_attach_threadpool(ctx, threadpool, threadpool_batch);
+
+        return true;
     }
 
     bool load_model(const common_params & params) {
@@ -1952,6 +2204,10 @@ struct server_context {
             return false;
         }
 
+        if (!init_threadpools()) {
+            return false;
+        }
+
         vocab = llama_model_get_vocab(model);
 
         n_ctx = llama_n_ctx(ctx);
@@ -1994,6 +2250,27 @@ struct server_context {
 
             // the context is not needed - we will create one for each slot
             llama_init_dft.context.reset();
+        } else if (params_base.speculative.n_layer_exit > 0) {
+            if (params_base.speculative.n_layer_exit >= llama_model_n_layer(model)) {
+                SRV_ERR("the draft layer exit (%d) must be less than the number of layers of the model (%d)\n", params_base.speculative.n_layer_exit, llama_model_n_layer(model));
+                return false;
+            }
+
+            SRV_INF("using the first %d layers of the model for self-speculative decoding\n", params_base.speculative.n_layer_exit);
+        } else if (params_base.speculative.n_lookup_min > 0 || !params_base.lookup_cache_static.empty()) {
+            if (!params_base.lookup_cache_static.empty()) {
+                try {
+                    nc_static = common_ngram_cache_load(params_base.lookup_cache_static);
+                } catch (std::ifstream::failure const &) {
+                    SRV_ERR("failed to open static lookup cache: %s\n", params_base.lookup_cache_static.c_str());
+                    return false;
+                }
+            }
+
+            SRV_INF("%s\n", "using prompt-lookup decoding");
+        } else if (params_base.speculative.n_la_window > 0) {
+            SRV_INF("using lookahead decoding, W = %d, N = %d, G = %d\n",
+                    params_base.speculative.n_la_window, params_base.speculative.n_la_ngram, params_base.speculative.n_la_verify);
         }
 
         chat_templates = common_chat_templates_init(model, params_base.chat_template);
@@ -2008,10 +2285,13 @@ struct server_context {
         std::string & mmproj_path = params_base.mmproj.path;
         if (!mmproj_path.empty()) {
             mtmd_context_params mparams = mtmd_context_params_default();
-            mparams.use_gpu       = params_base.mmproj_use_gpu;
-            mparams.print_timings = false;
-            mparams.n_threads     = params_base.cpuparams.n_threads;
-            mparams.verbosity     = params_base.verbosity > 0 ? GGML_LOG_LEVEL_DEBUG : GGML_LOG_LEVEL_INFO;
+            mparams.use_gpu         = params_base.mmproj_use_gpu;
+            mparams.print_timings   = false;
+            mparams.n_threads       = params_base.cpuparams.n_threads;
+            mparams.verbosity       = params_base.verbosity > 0 ? GGML_LOG_LEVEL_DEBUG : GGML_LOG_LEVEL_INFO;
+            mparams.embd_cache_size = params_base.mmproj_cache_size;
+            mparams.embd_cache_file = params_base.mmproj_cache_file.empty() ? nullptr : params_base.mmproj_cache_file.c_str();
+            mparams.batch_encode    = params_base.mmproj_batch;
             mctx = mtmd_init_from_file(mmproj_path.c_str(), model, mparams);
             if (mctx == nullptr) {
                 SRV_ERR("failed to load multimodal model, '%s'\n", mmproj_path.c_str());
@@ -2033,6 +2313,23 @@ struct server_context {
                 SRV_ERR("%s\n", "err: speculative decode is not supported by multimodal");
                 return false;
             }
+
+            if (params_base.speculative.n_layer_exit > 0) {
+                params_base.speculative.n_layer_exit = 0;
+                SRV_WRN("%s\n", "self-speculative decoding is not supported by multimodal, it will be disabled");
+            }
+
+            if (params_base.speculative.n_lookup_min > 0 || !params_base.lookup_cache_static.empty()) {
+                params_base.speculative.n_lookup_min = 0;
+                params_base.lookup_cache_static.clear();
+                nc_static.clear();
+                SRV_WRN("%s\n", "prompt-lookup decoding is not supported by multimodal, it will be disabled");
+            }
+
+            if (params_base.speculative.n_la_window > 0) {
+                params_base.speculative.n_la_window = 0;
+                SRV_WRN("%s\n", "lookahead decoding is not supported by multimodal, it will be disabled");
+            }
         }
 
         if (!llama_memory_can_shift(llama_get_memory(ctx))) {
@@ -2055,6 +2352,9 @@ struct server_context {
 
         SRV_INF("initializing slots, n_slots = %d\n", params_base.n_parallel);
 
+        // the sequences after the first n_parallel are split evenly among the slots
+        const int32_t n_seq_extra = llama_n_seq_max(ctx) / params_base.n_parallel - 1;
+
         for (int i = 0; i < params_base.n_parallel; i++) {
             server_slot slot;
 
@@ -2065,8 +2365,12 @@ struct server_context {
             slot.mctx = mctx;
             slot.cache_tokens.has_mtmd = mctx != nullptr;
 
+            for (int32_t s = 0; s < n_seq_extra; ++s) {
+                slot.seq_extra.push_back(params_base.n_parallel + i*n_seq_extra + s);
+            }
+
             if (model_dft) {
-                slot.batch_spec = llama_batch_init(params_base.speculative.n_max + 1, 0, 1);
+                slot.batch_spec = llama_batch_init(params_base.speculative.n_max + 1, 0, params_base.speculative.n_branch);
 
                 slot.ctx_dft = llama_init_from_model(model_dft, cparams_dft);
                 if (slot.ctx_dft == nullptr) {
@@ -2079,6 +2383,34 @@ struct server_context {
                     SRV_ERR("%s", "failed to create speculator\n");
                     return;
                 }
+            } else if (params_base.speculative.n_layer_exit > 0) {
+                slot.batch_spec = llama_batch_init(params_base.speculative.n_max + 1, 0, params_base.speculative.n_branch);
+
+                slot.spec = common_speculative_init_self(ctx, params_base.speculative.n_layer_exit, slot.id, slot.seq_extra);
+                if (slot.spec == nullptr) {
+                    SRV_ERR("%s", "failed to create speculator\n");
+                    return;
+                }
+            } else if (params_base.speculative.n_lookup_min > 0 || !params_base.lookup_cache_static.empty()) {
+                slot.spec = common_speculative_init_lookup(&nc_static);
+                if (slot.spec == nullptr) {
+                    SRV_ERR("%s", "failed to create speculator\n");
+                    return;
+                }
+
+                slot.spec_in_batch = true;
+            } else if (params_base.speculative.n_la_window > 0) {
+                common_lookahead_params params_la;
+                params_la.n_window = params_base.speculative.n_la_window;
+                params_la.n_ngram  = params_base.speculative.n_la_ngram;
+                params_la.n_verify = params_base.speculative.n_la_verify;
+
+                if ((int32_t) slot.seq_extra.size() + 1 < params_la.n_window + params_la.n_verify) {
+                    SRV_ERR("%s", "not enough sequences for lookahead decoding\n");
+                    return;
+                }
+
+                slot.la = new common_lookahead(params_la);
             }
 
             SLT_INF(slot, "new slot n_ctx_slot = %d\n", slot.n_ctx);
@@ -2099,12 +2431,22 @@ struct server_context {
 
         // the update_slots() logic will always submit a maximum of n_batch or n_parallel tokens
         // note that n_batch can be > n_ctx (e.g. for non-causal attention models such as BERT where the KV cache is not used)
+        // a token of lookahead decoding can belong to all sequences of its slot
         {
             const int32_t n_batch = llama_n_batch(ctx);
-            batch = llama_batch_init(std::max(n_batch, params_base.n_parallel), 0, 1);
+            batch = llama_batch_init(std::max(n_batch, params_base.n_parallel), 0, 1 + n_seq_extra);
         }
 
-        metrics.init();
+        metrics.init(params_base.n_parallel);
+
+        if (mctx) {
+            // wake up the main loop when the slots waiting for an encode can continue
+            mtmd_encoder.start(mctx, llama_model_n_embd(model), [this]() {
+                server_task task(SERVER_TASK_TYPE_NEXT_RESPONSE);
+                task.id = queue_tasks.get_new_id();
+                queue_tasks.post(std::move(task));
+            });
+        }
 
         oai_parser_opt = {
             /* use_jinja             */ params_base.use_jinja,
@@ -2233,10 +2575,14 @@ struct server_context {
             }
         }
 
-        if (slot.ctx_dft) {
+        if (slot.la) {
+            slot.la->reset();
+        }
+
+        if (slot.spec && !slot.spec_in_batch) {
             llama_batch_free(slot.batch_spec);
 
-            slot.batch_spec = llama_batch_init(slot.params.speculative.n_max + 1, 0, 1);
+            slot.batch_spec = llama_batch_init(slot.params.speculative.n_max + 1, 0, params_base.speculative.n_branch);
         }
 
         slot.state = SLOT_STATE_STARTED;
@@ -2826,6 +3172,9 @@ struct server_context {
                     res->n_decode_total          = metrics.n_decode_total;
                     res->n_busy_slots_total      = metrics.n_busy_slots_total;
 
+                    res->n_draft_total           = metrics.n_draft_total;
+                    res->n_draft_accepted        = metrics.n_draft_accepted;
+
                     if (task.metrics_reset_bucket) {
                         metrics.reset_bucket();
                     }
@@ -2961,11 +3310,12 @@ struct server_context {
         // check if all slots are idle
         {
             bool all_idle = true;
+            bool all_wait = true;
 
             for (auto & slot : slots) {
                 if (slot.is_processing()) {
                     all_idle = false;
-                    break;
+                    all_wait = all_wait && slot.is_waiting_encode();
                 }
             }
 
@@ -2977,6 +3327,11 @@ struct server_context {
 
                 return;
             }
+
+            // nothing to do until an encode is done, the encoder posts the next update
+            if (all_wait) {
+                return;
+            }
         }
 
         {
@@ -3043,8 +3398,22 @@ struct server_context {
             return params_base.special || slot.params.sampling.preserved_tokens.find(token) != slot.params.sampling.preserved_tokens.end();
         };
 
+        // the speculation of prompt-lookup and lookahead decoding may use the part of the batch that is not needed for
+        // the sampled tokens, it is shared evenly by the generating slots so that they do not starve each other
+        int32_t n_spec_batch = llama_n_batch(ctx);
+        int32_t n_spec_slots = 0;
+        for (const auto & slot : slots) {
+            if (slot.state == SLOT_STATE_GENERATING) {
+                n_spec_batch -= 1;
+                n_spec_slots += 1;
+            }
+        }
+
         // frist, add sampled tokens from any ongoing sequences
         for (auto & slot : slots) {
+            slot.drafted.clear();
+            slot.n_batch_spec = 0;
+
             if (slot.state != SLOT_STATE_GENERATING) {
                 continue;
             }
@@ -3058,7 +3427,68 @@ struct server_context {
 
             slot.i_batch = batch.n_tokens;
 
-            common_batch_add(batch, slot.sampled, slot.n_past, { slot.id }, true);
+            const int32_t n_spec_max = n_spec_batch / std::max(n_spec_slots, 1);
+            n_spec_slots--;
+
+            // note: leave space for 1 extra token to allow context shifts
+            int n_draft_max = std::min(slot.params.speculative.n_max, slot.n_ctx - slot.n_past - 2);
+
+            if (slot.n_remaining > 0) {
+                n_draft_max = std::min(n_draft_max, slot.n_remaining - 1);
+            }
+
+            // the post-sampling probs are only available for the last sampled token
+            const bool need_probs_post = slot.params.sampling.n_probs > 0 && slot.params.post_sampling_probs;
+
+            if (slot.can_lookahead() && n_draft_max > 0 && n_spec_max > 0 &&
+                slot.n_past + params_base.speculative.n_la_ngram + params_base.speculative.n_la_window < slot.n_ctx) {
+                auto * mem = llama_get_memory(ctx);
+
+                // the lookahead window and the verified n-grams see the prompt through their own sequences
+                std::vector<llama_seq_id> seq_ids = { slot.id };
+                for (const auto seq : slot.seq_extra) {
+                    llama_memory_seq_rm(mem,          seq, -1, -1);
+                    llama_memory_seq_cp(mem, slot.id, seq, -1, -1);
+
+                    seq_ids.push_back(seq);
+                }
+
+                slot.n_batch_spec = slot.la->batch_add(batch, slot.cache_tokens.get_text_tokens(), slot.sampled, slot.n_past, seq_ids, n_draft_max, 1 + n_spec_max) - 1;
+
+                if (slot.n_batch_spec == 0) {
+                    for (const auto seq : slot.seq_extra) {
+                        llama_memory_seq_rm(mem, seq, -1, -1);
+                    }
+                }
+            } else {
+                common_batch_add(batch, slot.sampled, slot.n_past, { slot.id }, true);
+            }
+
+            if (slot.spec_in_batch && slot.can_speculate() && !need_probs_post) {
+                n_draft_max = std::min(n_draft_max, n_spec_max);
+
+                if (n_draft_max >= std::max(slot.params.speculative.n_min, 1)) {
+                    struct common_speculative_params params_spec;
+                    params_spec.n_draft      = n_draft_max;
+                    params_spec.n_lookup_min = params_base.speculative.n_lookup_min;
+
+                    slot.drafted = common_speculative_gen_draft(slot.spec, params_spec, slot.cache_tokens.get_text_tokens(), slot.sampled);
+
+                    // ignore small drafts
+                    if (slot.params.speculative.n_min > (int) slot.drafted.size()) {
+                        slot.drafted.clear();
+                    }
+                }
+
+                // the drafted tokens follow the sampled token in the sequence of the slot
+                for (size_t j = 0; j < slot.drafted.size(); ++j) {
+                    common_batch_add(batch, slot.drafted[j], slot.n_past + 1 + j, { slot.id }, true);
+                }
+
+                slot.n_batch_spec = slot.drafted.size();
+            }
+
+            n_spec_batch -= slot.n_batch_spec;
 
             slot.n_past += 1;
             slot.cache_tokens.push_back(slot.sampled);
@@ -3071,6 +3501,9 @@ struct server_context {
         int32_t n_batch  = llama_n_batch(ctx);
         int32_t n_ubatch = llama_n_ubatch(ctx);
 
+        // the encodes queued by the slots below are posted together, so that they can be batched
+        std::vector<server_mtmd_encoder::job_ptr> jobs_encode;
+
         // next, batch any pending prompts without exceeding n_batch
         if (params_base.cont_batching || batch.n_tokens == 0) {
             for (auto & slot : slots) {
@@ -3278,6 +3711,10 @@ struct server_context {
                         }
                     }
 
+                    if (slot.is_waiting_encode()) {
+                        continue;
+                    }
+
                     // keep only the common part
                     if (!llama_memory_seq_rm(llama_get_memory(ctx), slot.id, slot.n_past, -1)) {
                         // could not partially delete (likely using a non-Transformer model)
@@ -3294,9 +3731,42 @@ struct server_context {
 
                     // check if we should process the image
                     if (slot.n_past < slot.n_prompt_tokens && slot.prompt_tokens[slot.n_past] == LLAMA_TOKEN_NULL) {
+                        // queue the encodes of all media chunks of the rest of the prompt
+                        if (slot.encode_jobs.empty() || slot.encode_jobs.front()->pos != slot.n_past) {
+                            slot.encode_jobs.clear();
+
+                            for (llama_pos pos = slot.n_past; pos < slot.n_prompt_tokens; ) {
+                                if (slot.prompt_tokens[pos] != LLAMA_TOKEN_NULL) {
+                                    pos++;
+                                    continue;
+                                }
+
+                                const auto & chunk = slot.prompt_tokens.find_chunk(pos);
+
+                                auto job = std::make_shared<server_mtmd_encoder::job>();
+                                job->pos = pos;
+                                job->chunk.reset(mtmd_input_chunk_copy(chunk.get()));
+
+                                slot.encode_jobs.push_back(job);
+                                jobs_encode.push_back(std::move(job));
+
+                                pos += mtmd_input_chunk_get_n_pos(chunk.get());
+                            }
+                        }
+
+                        if (slot.is_waiting_encode()) {
+                            continue;
+                        }
+
+                        const auto job = std::move(slot.encode_jobs.front());
+                        slot.encode_jobs.pop_front();
+
                         // process the image
-                        int32_t new_n_past;
-                        int32_t res = slot.prompt_tokens.process_chunk(ctx, mctx, slot.n_past, slot.id, new_n_past);
+                        int32_t new_n_past = slot.n_past;
+                        int32_t res = job->res;
+                        if (res == 0) {
+                            res = slot.prompt_tokens.process_chunk(ctx, mctx, slot.n_past, slot.id, job->embd.data(), new_n_past);
+                        }
                         int32_t n_pos = new_n_past - slot.n_past;
 
                         if (res != 0) {
@@ -3371,8 +3841,18 @@ struct server_context {
             }
         }
 
+        mtmd_encoder.post(std::move(jobs_encode));
+
         if (batch.n_tokens == 0) {
-            SRV_WRN("%s", "no tokens to decode\n");
+            // the slots that wait for an encode are updated again when it is done
+            const bool any_wait = std::any_of(slots.begin(), slots.end(), [](const server_slot & slot) {
+                return slot.is_waiting_encode();
+            });
+            if (any_wait) {
+                SRV_DBG("%s", "no tokens to decode, waiting for the media encoder\n");
+            } else {
+                SRV_WRN("%s", "no tokens to decode\n");
+            }
             return;
         }
 
@@ -3389,7 +3869,19 @@ struct server_context {
 
         // process the created batch of tokens
         for (int32_t i = 0; i < batch.n_tokens; i = i_next) {
-            const int32_t n_tokens = std::min(n_batch, batch.n_tokens - i);
+            int32_t n_tokens = std::min(n_batch, batch.n_tokens - i);
+
+            // the speculation of a slot is verified together with its sampled token, so they must be in the same view
+            for (const auto & slot : slots) {
+                if (slot.n_batch_spec == 0 || slot.i_batch < i || slot.i_batch >= i + n_tokens) {
+                    continue;
+                }
+
+                const int32_t i_end = slot.i_batch + 1 + slot.n_batch_spec;
+                if (i_end > i + n_tokens) {
+                    n_tokens = slot.i_batch > i ? slot.i_batch - i : i_end - i;
+                }
+            }
 
             llama_batch batch_view = {
                 n_tokens,
@@ -3445,6 +3937,14 @@ struct server_context {
             // on successful decode, restore the original batch size
             n_batch = llama_n_batch(ctx);
 
+            // collect the slots that sample from this part of the batch
+            std::vector<server_slot *>    slots_sample;
+            std::vector<common_sampler *> smpls_sample;
+            std::vector<int>              idxs_sample;
+
+            // the slots that verify a prompt-lookup draft or a lookahead step
+            std::vector<server_slot *>    slots_draft;
+
             for (auto & slot : slots) {
                 if (slot.i_batch < (int) i || slot.i_batch >= (int) (i + n_tokens)) {
                     continue; // continue loop of slots
@@ -3472,9 +3972,25 @@ struct server_context {
                     continue; // continue loop of slots
                 }
 
-                const int tok_idx = slot.i_batch - i;
+                if (slot.n_batch_spec > 0) {
+                    slots_draft.push_back(&slot);
+                    continue; // continue loop of slots
+                }
+
+                slots_sample.push_back(&slot);
+                smpls_sample.push_back(slot.smpl);
+                idxs_sample.push_back(slot.i_batch - i);
+            }
 
-                llama_token id = common_sampler_sample(slot.smpl, ctx, tok_idx);
+            // sample all slots at once, in parallel on the threads of ctx, which are idle after llama_decode
+            const auto ids = common_sampler_sample_batch(smpls_sample, ctx, idxs_sample, threadpool);
+
+            for (size_t j = 0; j < slots_sample.size(); ++j) {
+                auto & slot = *slots_sample[j];
+
+                const int tok_idx = idxs_sample[j];
+
+                llama_token id = ids[j];
 
                 slot.i_batch = -1;
 
@@ -3511,9 +4027,90 @@ struct server_context {
                 }
             }
 
+            // verify the prompt-lookup drafts and the lookahead steps
+            for (auto * slot_ptr : slots_draft) {
+                auto & slot = *slot_ptr;
+
+                auto * mem = llama_get_memory(ctx);
+
+                const int tok_idx = slot.i_batch - i;
+
+                // the accepted drafted tokens, followed by one token sampled by the target model
+                llama_tokens ids;
+
+                int32_t n_drafted = 0;
+
+                if (slot.drafted.empty()) {
+                    int32_t seq_best = 0;
+
+                    ids = slot.la->accept(slot.smpl, ctx, tok_idx, seq_best);
+
+                    n_drafted = slot.la->tree.tokens.size();
+
+                    // keep the accepted n-gram in the sequence of the slot
+                    // note: n_past was already increased for the sampled token
+                    if (seq_best > 0) {
+                        llama_memory_seq_rm(mem,                            slot.id, slot.n_past, -1);
+                        llama_memory_seq_cp(mem, slot.seq_extra[seq_best - 1], slot.id, slot.n_past, slot.n_past + ids.size() - 1);
+                    }
+
+                    for (const auto seq : slot.seq_extra) {
+                        llama_memory_seq_rm(mem, seq, -1, -1);
+                    }
+                } else {
+                    std::vector<int> idxs(slot.drafted.size() + 1);
+                    std::iota(idxs.begin(), idxs.end(), tok_idx);
+
+                    ids = common_sampler_sample_and_accept_n(slot.smpl, ctx, idxs, slot.drafted);
+
+                    n_drafted = slot.drafted.size();
+                }
+
+                slot.i_batch = -1;
+
+                slot.n_draft_total    += n_drafted;
+                slot.n_draft_accepted += ids.size() - 1;
+
+                // the accepted drafted tokens are already in the KV cache, the rest is discarded
+                slot.n_past += ids.size() - 1;
+                slot.cache_tokens.insert({ids.begin(), ids.end() - 1});
+
+                llama_memory_seq_rm(mem, slot.id, slot.n_past, -1);
+
+                SLT_DBG(slot, "accepted %d/%d draft tokens, new n_past = %d\n", (int) ids.size() - 1, n_drafted, slot.n_past);
+
+                slot.drafted.clear();
+                slot.n_batch_spec = 0;
+
+                slot.t_token_generation = (ggml_time_us() - slot.t_start_generation) / 1e3;
+
+                for (size_t k = 0; k < ids.size(); ++k) {
+                    // count the tokens one by one, so that the budget check in process_token sees each of them
+                    slot.n_decoded += 1;
+
+                    completion_token_output result;
+                    result.tok          = ids[k];
+                    result.text_to_send = common_token_to_piece(ctx, result.tok, accept_special_token(slot, result.tok));
+                    result.prob         = 1.0f; // TODO: set it here instead of doing inside populate_token_probs
+
+                    if (slot.params.sampling.n_probs > 0) {
+                        populate_token_probs(slot, result, slot.params.post_sampling_probs, params_base.special, tok_idx + k);
+                    }
+
+                    if (!process_token(result, slot)) {
+                        // release slot because of stop condition
+                        slot.release();
+                        slot.print_timings();
+                        send_final_response(slot);
+                        metrics.on_prediction(slot);
+                        break;
+                    }
+                }
+            }
+
             // do speculative decoding
             for (auto & slot : slots) {
-                if (!slot.is_processing() || !slot.can_speculate()) {
+                if (!slot.is_processing() || !slot.can_speculate() || slot.spec_in_batch) {
                     continue;
                 }
 
@@ -3548,40 +4145,65 @@ struct server_context {
                 llama_token id = slot.sampled;
 
                 struct common_speculative_params params_spec;
-                params_spec.n_draft   = n_draft_max;
-                params_spec.n_reuse   = llama_n_ctx(slot.ctx_dft) - slot.params.speculative.n_max;
-                params_spec.p_min     = slot.params.speculative.p_min;
+                params_spec.n_draft      = n_draft_max;
+                params_spec.n_reuse      = slot.ctx_dft ? llama_n_ctx(slot.ctx_dft) - slot.params.speculative.n_max : 0;
+                params_spec.n_branch     = params_base.speculative.n_branch;
+                params_spec.n_lookup_min = params_base.speculative.n_lookup_min;
+                params_spec.p_min        = slot.params.speculative.p_min;
+                params_spec.p_split      = params_base.speculative.p_split;
 
                 const llama_tokens & cached_text_tokens = slot.cache_tokens.get_text_tokens();
-                llama_tokens draft = common_speculative_gen_draft(slot.spec, params_spec, cached_text_tokens, id);
+                const common_speculative_tree draft = common_speculative_gen_draft_tree(slot.spec, params_spec, cached_text_tokens, id);
 
                 // ignore small drafts
-                if (slot.params.speculative.n_min > (int) draft.size()) {
-                    SLT_DBG(slot, "ignoring small draft: %d < %d\n", (int) draft.size(), slot.params.speculative.n_min);
+                if (slot.params.speculative.n_min > (int) draft.tokens.size()) {
+                    SLT_DBG(slot, "ignoring small draft: %d < %d\n", (int) draft.tokens.size(), slot.params.speculative.n_min);
 
                     continue;
                 }
 
                 // keep track of total number of drafted tokens tested
-                slot.n_draft_total += draft.size();
+                slot.n_draft_total += draft.tokens.size();
 
-                // construct the speculation batch
-                common_batch_clear(slot.batch_spec);
-                common_batch_add  (slot.batch_spec, id, slot.n_past, { slot.id }, true);
+                auto * mem = llama_get_memory(ctx);
+
+                // branch 0 is verified in the sequence of the slot, the other branches get their own sequences
+                std::vector<llama_seq_id> seq_ids = { slot.id };
+                for (int s = 1; s < draft.n_seq; ++s) {
+                    seq_ids.push_back(slot.seq_extra[s - 1]);
 
-                for (size_t i = 0; i < draft.size(); ++i) {
-                    common_batch_add(slot.batch_spec, draft[i], slot.n_past + 1 + i, { slot.id }, true);
+                    llama_memory_seq_rm(mem,          seq_ids[s], -1, -1);
+                    llama_memory_seq_cp(mem, slot.id, seq_ids[s], -1, -1);
                 }
 
-                SLT_DBG(slot, "decoding speculative batch, size = %d\n", slot.batch_spec.n_tokens);
+                // construct the speculation batch
+                common_batch_clear(slot.batch_spec);
+                common_speculative_tree_batch_add(slot.batch_spec, draft, id, slot.n_past, seq_ids);
+
+                SLT_DBG(slot, "decoding speculative batch, size = %d, branches = %d\n", slot.batch_spec.n_tokens, draft.n_seq);
 
                 llama_decode(ctx, slot.batch_spec);
 
                 // the accepted tokens from the speculation
-                const auto ids = common_sampler_sample_and_accept_n(slot.smpl, ctx, draft);
+                int32_t i_last = -1;
+                const auto ids = common_speculative_tree_accept(slot.smpl, ctx, draft, i_last);
+
+                // keep the accepted path in the sequence of the slot
+                if (i_last >= 0 && (draft.seq_mask[i_last] & 1) == 0) {
+                    int s = 0;
+                    while ((draft.seq_mask[i_last] & (1ull << s)) == 0) {
+                        s++;
+                    }
+
+                    llama_memory_seq_rm(mem, slot.id, slot.n_past + 1, -1);
+                    llama_memory_seq_cp(mem, seq_ids[s], slot.id, slot.n_past + 1, slot.n_past + ids.size());
+                }
 
-                slot.n_past    += ids.size();
-                slot.n_decoded += ids.size();
+                for (int s = 1; s < draft.n_seq; ++s) {
+                    llama_memory_seq_rm(mem, seq_ids[s], -1, -1);
+                }
+
+                slot.n_past += ids.size();
 
                 // update how many tokens out of those tested were accepted
                 slot.n_draft_accepted += ids.size() - 1;
@@ -3589,9 +4211,11 @@ struct server_context {
                 slot.cache_tokens.push_back(id);
                 slot.cache_tokens.insert({ids.begin(), ids.end() - 1});
 
-                llama_memory_seq_rm(llama_get_memory(ctx), slot.id, slot.n_past, -1);
+                llama_memory_seq_rm(mem, slot.id, slot.n_past, -1);
 
                 for (size_t i = 0; i < ids.size(); ++i) {
+                    slot.n_decoded += 1;
+
                     completion_token_output result;
 
                     result.tok          = ids[i];
@@ -3610,7 +4234,7 @@ struct server_context {
                     }
                 }
 
-                SLT_DBG(slot, "accepted %d/%d draft tokens, new n_past = %d\n", (int) ids.size() - 1, (int) draft.size(), slot.n_past);
+                SLT_DBG(slot, "accepted %d/%d draft tokens, new n_past = %d\n", (int) ids.size() - 1, (int) draft.tokens.size(), slot.n_past);
             }
         }
 
@@ -3977,6 +4601,25 @@ int main(int argc, char ** argv) {
             }
         }
 
+        // speculative decoding counters, labeled by slot
+        struct {
+            const char * name;
+            const char * help;
+            const std::vector<uint64_t> & values;
+        } slot_metrics_def[] = {
+            { "draft_tokens_total",          "Number of draft tokens verified, per slot.", res_metrics->n_draft_total    },
+            { "draft_tokens_accepted_total", "Number of draft tokens accepted, per slot.", res_metrics->n_draft_accepted },
+        };
+
+        for (const auto & metric_def : slot_metrics_def) {
+            prometheus << "# HELP llamacpp:" << metric_def.name << " " << metric_def.help << "\n"
+                        << "# TYPE llamacpp:" << metric_def.name << " counter\n";
+
+            for (size_t id_slot = 0; id_slot < metric_def.values.size(); ++id_slot) {
+                prometheus << "llamacpp:" << metric_def.name << "{slot=\"" << id_slot << "\"} " << metric_def.values[id_slot] << "\n";
+            }
+        }
+
         res.set_header("Process-Start-Time-Unix", std::to_string(res_metrics->t_start));
 
         res.set_content(prometheus.str(), "text/plain; version=0.0.4");
@@ -1,4 +1,5 @@
 import pytest
+import struct
 from utils import *
 
 # We use a F16 MOE gguf as main model, and q4_0 as draft model
@@ -124,3 +125,126 @@ def test_multi_requests_parallel(n_slots: int, n_requests: int):
     for res in results:
         assert res.status_code == 200
         assert match_regex("(wise|kind|owl|answer)+", res.body["content"])
+
+
+def get_greedy_contents(n_requests: int) -> list[str]:
+    tasks = []
+    for _ in range(n_requests):
+        tasks.append((server.make_request, ("POST", "/completion", {
+            "prompt": "I believe the meaning of life is",
+            "temperature": 0.0,
+            "top_k": 1,
+        })))
+    results = parallel_function_calls(tasks)
+    for res in results:
+        assert res.status_code == 200
+    return [res.body["content"] for res in results]
+
+
+@pytest.mark.parametrize("n_slots", [1, 2])
+def test_with_and_without_draft_branches(n_slots: int):
+    global server
+    create_server()
+    server.model_draft = None  # disable draft model
+    server.n_slots = n_slots
+    server.start()
+    contents_no_draft = get_greedy_contents(n_slots)
+    server.stop()
+
+    # create new server with a draft tree
+    create_server()
+    server.n_slots = n_slots
+    server.draft_branches = 4
+    server.start()
+    contents_draft = get_greedy_contents(n_slots)
+
+    assert contents_no_draft == contents_draft
+
+
+@pytest.mark.parametrize("n_slots,n_branches", [
+    (1, 1),
+    (2, 1),
+    (2, 3),
+])
+def test_with_and_without_draft_layer_exit(n_slots: int, n_branches: int):
+    global server
+    create_server()
+    server.model_draft = None  # disable draft model
+    server.n_slots = n_slots
+    server.start()
+    contents_no_draft = get_greedy_contents(n_slots)
+    server.stop()
+
+    # draft with the first layers of the main model
+    server.draft_layer_exit = 2
+    server.draft_branches = n_branches
+    server.start()
+    contents_draft = get_greedy_contents(n_slots)
+
+    assert contents_no_draft == contents_draft
+
+
+def write_lookup_cache_static(path: str, tokens: list[int]):
+    # same format as common_ngram_cache_save, with the 2-grams used by the static cache
+    # the static cache only drafts from 2-grams seen at least twice, so the tokens are counted twice
+    counts: dict[tuple[int, int], dict[int, int]] = {}
+    for i in range(len(tokens) - 2):
+        next_counts = counts.setdefault((tokens[i], tokens[i + 1]), {})
+        next_counts[tokens[i + 2]] = next_counts.get(tokens[i + 2], 0) + 2
+    with open(path, "wb") as f:
+        for (t0, t1), next_counts in counts.items():
+            f.write(struct.pack("<iiiii", t0, t1, -1, -1, len(next_counts)))
+            for token, count in next_counts.items():
+                f.write(struct.pack("<ii", token, count))
+
+
+@pytest.mark.parametrize("n_slots,lookup_min,use_cache_static", [
+    (1, 2, False),
+    (2, 2, False),
+    (1, 0, True),
+    (2, 2, True),
+])
+def test_with_and_without_draft_lookup(n_slots: int, lookup_min: int, use_cache_static: bool, tmp_path):
+    global server
+    create_server()
+    server.model_draft = None  # disable draft model
+    server.n_slots = n_slots
+    server.start()
+    contents_no_draft = get_greedy_contents(n_slots)
+    if use_cache_static:
+        res = server.make_request("POST", "/tokenize", data={
+            "content": "I believe the meaning of life is" + contents_no_draft[0],
+        })
+        assert res.status_code == 200
+        server.lookup_cache_static = str(tmp_path / "lookup-static.bin")
+        write_lookup_cache_static(server.lookup_cache_static, res.body["tokens"])
+    server.stop()
+
+    # draft from the prompt and the generated text, or from the static cache
+    server.draft_lookup_min = lookup_min
+    server.start()
+    contents_draft = get_greedy_contents(n_slots)
+
+    assert contents_no_draft == contents_draft
+
+
+@pytest.mark.parametrize("n_slots,window", [
+    (1, 4),
+    (2, 4),
+    (2, 8),
+])
+def test_with_and_without_lookahead(n_slots: int, window: int):
+    global server
+    create_server()
+    server.model_draft = None  # disable draft model
+    server.n_slots = n_slots
+    server.start()
+    contents_no_lookahead = get_greedy_contents(n_slots)
+    server.stop()
+
+    # verify the n-grams collected by the lookahead window
+    server.lookahead = window
+    server.start()
+    contents_lookahead = get_greedy_contents(n_slots)
+
+    assert contents_no_lookahead == contents_lookahead
@@ -82,6 +82,11 @@ class ServerProcess:
     disable_ctx_shift: int | None = False
     draft_min: int | None = None
     draft_max: int | None = None
+    draft_branches: int | None = None
+    draft_layer_exit: int | None = None
+    draft_lookup_min: int | None = None
+    lookup_cache_static: str | None = None
+    lookahead: int | None = None
     no_webui: bool | None = None
     jinja: bool | None = None
     reasoning_format: Literal['deepseek', 'none', 'nothink'] | None = None
@@ -186,6 +191,16 @@ class ServerProcess:
             server_args.extend(["--draft-max", self.draft_max])
         if self.draft_min:
             server_args.extend(["--draft-min", self.draft_min])
+        if self.draft_branches:
+            server_args.extend(["--draft-branches", self.draft_branches])
+        if self.draft_layer_exit:
+            server_args.extend(["--draft-layer-exit", self.draft_layer_exit])
+        if self.draft_lookup_min:
+            server_args.extend(["--draft-lookup-min", self.draft_lookup_min])
+        if self.lookup_cache_static:
+            server_args.extend(["--lookup-cache-static", self.lookup_cache_static])
+        if self.lookahead:
+            server_args.extend(["--lookahead", self.lookahead])
         if self.no_webui:
             server_args.append("--no-webui")
         if self.jinja:
@@ -1293,11 +1293,13 @@ public:
     }
 
     // encode and decode the image chunk
+    // decode the chunk at n_past, embd are its output embeddings from the encoder
     int32_t process_chunk(
                 llama_context * ctx,
                 mtmd_context * mctx,
                 llama_pos n_past,
                 int32_t seq_id,
+                float * embd,
                 llama_pos & n_pos_out) {
         auto & chunk = find_chunk(n_past);
         const char * name = mtmd_input_chunk_get_type(chunk.get()) == MTMD_INPUT_CHUNK_TYPE_IMAGE
@@ -1306,12 +1308,12 @@ public:
         int32_t n_batch = llama_n_batch(ctx);
         int64_t t0 = ggml_time_ms();
         llama_pos new_n_past = n_past;
-        int32_t result = mtmd_helper_eval_chunk_single(mctx, ctx,
+        int32_t result = mtmd_helper_decode_image_chunk(mctx, ctx,
             chunk.get(),
+            embd,
             n_past,
             seq_id,
             n_batch,
-            true, // logits last
             &new_n_past);
         SRV_INF("%s processed in %" PRId64 " ms\n", name, ggml_time_ms() - t0);
         if (result != 0) {
@@ -2,6 +2,7 @@
 
 #include "arg.h"
 #include "common.h"
+#include "fft.h"
 #include "sampling.h"
 #include "log.h"
 #include "llama.h"
@@ -13,6 +14,7 @@
 #include <cmath>
 #include <cstdio>
 #include <fstream>
+#include <functional>
 #include <map>
 #include <regex>
 #include <string>
@@ -89,28 +91,64 @@ struct wav_header {
     uint32_t data_size;
 };
 
-static bool save_wav16(const std::string & fname, const std::vector<float> & data, int sample_rate) {
-    std::ofstream file(fname, std::ios::binary);
-    if (!file) {
-        LOG_ERR("%s: Failed to open file '%s' for writing.\n", __func__, fname.c_str());
-        return false;
+// WAV file that is written incrementally, the sizes in the header are updated when the file is closed
+struct wav_writer {
+    std::ofstream file;
+    wav_header    header;
+
+    bool open(const std::string & fname, int sample_rate) {
+        file.open(fname, std::ios::binary);
+        if (!file) {
+            LOG_ERR("%s: Failed to open file '%s' for writing.\n", __func__, fname.c_str());
+            return false;
+        }
+
+        header.sample_rate = sample_rate;
+        header.byte_rate = header.sample_rate * header.num_channels * (header.bits_per_sample / 8);
+        header.block_align = header.num_channels * (header.bits_per_sample / 8);
+        header.data_size = 0;
+        header.chunk_size = 36 + header.data_size;
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        return file.good();
     }
 
-    wav_header header;
-    header.sample_rate = sample_rate;
-    header.byte_rate = header.sample_rate * header.num_channels * (header.bits_per_sample / 8);
-    header.block_align = header.num_channels * (header.bits_per_sample / 8);
-    header.data_size = data.size() * (header.bits_per_sample / 8);
-    header.chunk_size = 36 + header.data_size;
+    bool write(const float * data, size_t n) {
+        std::vector<int16_t> pcm(n);
+        for (size_t i = 0; i < n; ++i) {
+            pcm[i] = static_cast<int16_t>(std::clamp(data[i] * 32767.0, -32768.0, 32767.0));
+        }
+
+        file.write(reinterpret_cast<const char*>(pcm.data()), pcm.size()*sizeof(int16_t));
+        file.flush();
+
+        header.data_size += n * (header.bits_per_sample / 8);
+
+        return file.good();
+    }
+
+    bool close() {
+        header.chunk_size = 36 + header.data_size;
+
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.close();
+
+        return !file.fail();
+    }
+};
 
-    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+static bool save_wav16(const std::string & fname, const std::vector<float> & data, int sample_rate) {
+    wav_writer wav;
 
-    for (const auto & sample : data) {
-        int16_t pcm_sample = static_cast<int16_t>(std::clamp(sample * 32767.0, -32768.0, 32767.0));
-        file.write(reinterpret_cast<const char*>(&pcm_sample), sizeof(pcm_sample));
+    if (!wav.open(fname, sample_rate)) {
+        return false;
     }
 
-    return file.good();
+    bool ok = wav.write(data.data(), data.size());
+
+    return wav.close() && ok;
 }
 
 static void fill_hann_window(int length, bool periodic, float * output) {
@@ -123,44 +161,75 @@ static void fill_hann_window(int length, bool periodic, float * output) {
     }
 }
 
-// very poor-man fft
-static void twiddle(float * real, float * imag, int k, int N) {
-    float angle = 2 * M_PI * k / N;
-    *real = cos(angle);
-    *imag = sin(angle);
-}
+// inverse real FFT of size n, computed with a complex FFT of size n/2
+struct tts_irfft {
+    int n_real;
+    int n_cplx;
 
-static void irfft(int n, const float * inp_cplx, float * out_real) {
-    int N = n / 2 + 1;
+    common_fft fft;
 
-    std::vector<float> real_input(N);
-    std::vector<float> imag_input(N);
-    for (int i = 0; i < N; ++i) {
-        real_input[i] = inp_cplx[2 * i];
-        imag_input[i] = inp_cplx[2 * i + 1];
+    // twiddles of the pre-processing of the real output, [n_cplx]
+    std::vector<float> pr;
+    std::vector<float> pi;
+
+    explicit tts_irfft(int n) : n_real(n), n_cplx(n/2), fft(n/2, true) {
+        GGML_ASSERT(n % 2 == 0);
+
+        pr.resize(n_cplx);
+        pi.resize(n_cplx);
+        for (int k = 0; k < n_cplx; ++k) {
+            const double theta = (2*M_PI*k)/n_real;
+            pr[k] = cos(theta);
+            pi[k] = sin(theta);
+        }
     }
 
-    std::vector<float> real_output(n);
-    std::vector<float> imag_output(n);
+    // in:   n/2 + 1 complex bins
+    // out:  n real samples
+    // work: scratch buffer of 2*n floats
+    //
+    // same result as the direct sum over the bins used before:
+    //   out[k] = sum_{m = 0}^{n/2} Re(in[m]*e^(2*pi*i*k*m/n)) / (n/2 + 1)
+    // i.e. the DC and Nyquist bins have half the weight of a true inverse transform
+    void compute(const float * in, float * out, float * work) const {
+        float * xr = work + 0*n_cplx;
+        float * xi = work + 1*n_cplx;
+
+        // the even and odd output samples are the real and imaginary parts of the complex output
+        for (int k = 0; k < n_cplx; ++k) {
+            float ar = in[2*k + 0];
+            float ai = in[2*k + 1];
+            float br = in[2*(n_cplx - k) + 0];
+            float bi = in[2*(n_cplx - k) + 1];
+
+            if (k == 0) {
+                ar *= 2.0f; ai = 0.0f;
+                br *= 2.0f; bi = 0.0f;
+            }
 
-    for (int k = 0; k < n; ++k) {
-        real_output[k] = 0.0f;
-        imag_output[k] = 0.0f;
-        for (int m = 0; m < N; ++m) {
-            float twiddle_real;
-            float twiddle_imag;
+            const float er = ar + br;
+            const float ei = ai - bi;
+            const float dr = ar - br;
+            const float di = ai + bi;
 
-            twiddle(&twiddle_real, &twiddle_imag, k * m, n);
+            // z = e + i*(d*e^(2*pi*i*k/n))
+            const float or_ = dr*pr[k] - di*pi[k];
+            const float oi  = dr*pi[k] + di*pr[k];
 
-            real_output[k] += real_input[m] * twiddle_real - imag_input[m] * twiddle_imag;
-            imag_output[k] += real_input[m] * twiddle_imag + imag_input[m] * twiddle_real;
+            xr[k] = er - oi;
+            xi[k] = ei + or_;
         }
-    }
 
-    for (int i = 0; i < n; ++i) {
-        out_real[i] = real_output[i] / N;
+        fft.compute(xr, xi, work + 2*n_cplx, work + 3*n_cplx);
+
+        const float scale = 1.0f/(2*(n_cplx + 1));
+
+        for (int m = 0; m < n_cplx; ++m) {
+            out[2*m + 0] = xr[m]*scale;
+            out[2*m + 1] = xi[m]*scale;
+        }
     }
-}
+};
 
 //
 //  y = torch.nn.functional.fold(
@@ -173,111 +242,215 @@ static void irfft(int n, const float * inp_cplx, float * out_real) {
 // hop_length =  320
 // pad =  480
 //
-static void fold(const std::vector<float> & data, int64_t n_out, int64_t n_win, int64_t n_hop, int64_t n_pad, std::vector<float> & output) {
-    int64_t output_height = n_out;
-    int64_t kernel_w = n_win;
-    int64_t stride_w = n_hop;
-    int64_t width    = n_out;
-
-    output.resize(width, 0.0f);
-
-    int64_t col_idx = 0;
-    for (int64_t w_col = 0; w_col < width; ++w_col) {
-        int64_t start = w_col * stride_w - n_pad;
-        int64_t end   = start + kernel_w;
-
-        for (int64_t w_im = start; w_im < end; ++w_im) {
-            if (w_im >= 0 && w_im < output_height && col_idx < (int64_t) data.size()) {
-                output[w_im] += data[col_idx];
+// the inverse STFT of the vocoder output, computed incrementally:
+// the frames are overlap-added in the order of the codes and a sample is output as soon as no later frame
+// overlaps it, so the audio of the first codes is available before the rest of the codes are generated
+//
+struct tts_istft {
+    static constexpr int n_fft = 1280;
+    static constexpr int n_hop = 320;
+    static constexpr int n_win = 1280;
+    static constexpr int n_pad = (n_win - n_hop)/2;
+
+    tts_istft() : fft(n_fft), hann(n_fft), hann2(n_fft) {
+        fill_hann_window(hann.size(), true, hann.data());
+
+        for (int j = 0; j < n_fft; ++j) {
+            hann2[j] = hann[j]*hann[j];
+        }
+    }
+
+    // add the frames of n_codes codes and append the samples that are now final to audio
+    void add(const float * embd, int n_codes, int n_embd, int n_thread, std::vector<float> & audio) {
+        std::vector<float> res(n_codes*n_fft);
+
+        n_thread = std::max(1, std::min(n_thread, n_codes));
+
+        std::vector<std::thread> workers(n_thread);
+        for (int i = 0; i < n_thread; ++i) {
+            workers[i] = std::thread([&, i]() {
+                std::vector<float> spec(n_embd);
+                std::vector<float> work(2*n_fft);
+
+                for (int l = i; l < n_codes; l += n_thread) {
+                    for (int k = 0; k < n_embd/2; ++k) {
+                        float mag = embd[l*n_embd + k           ];
+                        float phi = embd[l*n_embd + k + n_embd/2];
+
+                        mag = exp(mag);
+
+                        if (mag > 1e2) {
+                            mag = 1e2;
+                        }
+                        spec[2*k + 0] = mag*cosf(phi);
+                        spec[2*k + 1] = mag*sinf(phi);
+                    }
+
+                    fft.compute(spec.data(), res.data() + l*n_fft, work.data());
+                }
+            });
+        }
+        for (int i = 0; i < n_thread; ++i) {
+            workers[i].join();
+        }
+
+        // windowing and overlap-add
+        for (int l = 0; l < n_codes; ++l) {
+            const int64_t i0 = (n_frames + l)*n_hop - n_base;
+
+            acc.resize(i0 + n_win, 0.0f);
+            env.resize(i0 + n_win, 0.0f);
+
+            const float * frame = res.data() + l*n_fft;
+
+            float * a = acc.data() + i0;
+            float * e = env.data() + i0;
+
+            for (int j = 0; j < n_win; ++j) {
+                a[j] += frame[j]*hann[j];
+                e[j] += hann2[j];
             }
-            col_idx++;
         }
+
+        n_frames += n_codes;
+
+        // the next frame starts at sample n_frames*n_hop
+        output(n_frames*n_hop, audio);
     }
 
-    output.resize(n_out - 2 * n_pad);
-}
+    // no more frames - append the remaining samples to audio
+    void flush(std::vector<float> & audio) {
+        output(n_frames*n_hop + n_pad, audio);
+    }
+
+private:
+    // output the samples before n_end (not trimmed) and drop them from the buffers
+    void output(int64_t n_end, std::vector<float> & audio) {
+        for (int64_t i = std::max(n_base, (int64_t) n_pad); i < n_end; ++i) {
+            audio.push_back(acc[i - n_base] / env[i - n_base]);
+        }
+
+        const int64_t n_drop = std::min((int64_t) acc.size(), n_end - n_base);
+
+        acc.erase(acc.begin(), acc.begin() + n_drop);
+        env.erase(env.begin(), env.begin() + n_drop);
+
+        n_base += n_drop;
+    }
+
+    tts_irfft fft;
+
+    std::vector<float> hann;
+    std::vector<float> hann2;
+
+    // overlap-added frames and squared window, starting at sample n_base
+    std::vector<float> acc;
+    std::vector<float> env;
+
+    int64_t n_base   = 0;
+    int64_t n_frames = 0;
+};
 
-// TODO: not optimized at all
 static std::vector<float> embd_to_audio(
         const float * embd,
         const int n_codes,
         const int n_embd,
         const int n_thread) {
-    const int n_fft = 1280;
-    const int n_hop = 320;
-    const int n_win = 1280;
-    const int n_pad = (n_win - n_hop)/2;
-    const int n_out = (n_codes - 1)*n_hop + n_win;
+    std::vector<float> audio;
 
-    std::vector<float> hann(n_fft);
+    tts_istft istft;
+    istft.add(embd, n_codes, n_embd, n_thread, audio);
+    istft.flush(audio);
 
-    fill_hann_window(hann.size(), true, hann.data());
+    return audio;
+}
 
-    int n_spec = n_embd*n_codes;
+// decodes the audio codes with the vocoder while they are generated
+// the codes are processed in chunks of n_chunk, each one together with n_ctx codes of context on both sides,
+// and the audio of each chunk is passed to the callback as soon as it is ready
+struct tts_vocoder_stream {
+    static constexpr int n_chunk = 32;
+    static constexpr int n_ctx   = 16;
 
-    std::vector<float> E (n_spec);
-    std::vector<float> S (n_spec);
-    std::vector<float> ST(n_spec);
+    using callback = std::function<bool(const float * audio, size_t n)>;
 
-    for (int l = 0; l < n_codes; ++l) {
-        for (int k = 0; k < n_embd; ++k) {
-            E[k*n_codes + l] = embd[l*n_embd + k];
-        }
+    tts_vocoder_stream(llama_context * ctx, int n_thread, callback cb)
+        : ctx(ctx), n_embd(llama_model_n_embd(llama_get_model(ctx))), n_thread(n_thread), cb(std::move(cb)) {
+        batch = llama_batch_init(n_chunk + 2*n_ctx, 0, 1);
     }
 
-    for (int k = 0; k < n_embd/2; ++k) {
-        for (int l = 0; l < n_codes; ++l) {
-            float mag = E[(k           )*n_codes + l];
-            float phi = E[(k + n_embd/2)*n_codes + l];
+    ~tts_vocoder_stream() {
+        llama_batch_free(batch);
+    }
+
+    // add a generated token, the non-audio tokens are ignored
+    bool add(llama_token token) {
+        if (token < 151672 || token > 155772) {
+            return true;
+        }
 
-            mag = exp(mag);
+        codes.push_back(token - 151672);
 
-            if (mag > 1e2) {
-                mag = 1e2;
-            }
-            S[2*(k*n_codes + l) + 0] = mag*cosf(phi);
-            S[2*(k*n_codes + l) + 1] = mag*sinf(phi);
+        if ((int) codes.size() >= n_done + n_chunk + n_ctx) {
+            return decode(n_done + n_chunk);
         }
+
+        return true;
     }
 
-    for (int l = 0; l < n_codes; ++l) {
-        for (int k = 0; k < n_embd/2; ++k) {
-            ST[l*n_embd + 2*k + 0] = S[2*(k*n_codes + l) + 0];
-            ST[l*n_embd + 2*k + 1] = S[2*(k*n_codes + l) + 1];
+    // the generation is done - decode the remaining codes
+    bool finish() {
+        if (n_done < (int) codes.size() && !decode(codes.size())) {
+            return false;
         }
-    }
 
-    std::vector<float> res  (n_codes*n_fft);
-    std::vector<float> hann2(n_codes*n_fft);
-
-    std::vector<std::thread> workers(n_thread);
-    for (int i = 0; i < n_thread; ++i) {
-        workers[i] = std::thread([&, i]() {
-            for (int l = i; l < n_codes; l += n_thread) {
-                irfft(n_fft, ST.data() + l*n_embd, res.data() + l*n_fft);
-                for (int j = 0; j < n_fft; ++j) {
-                    res  [l*n_fft + j] *= hann[j];
-                    hann2[l*n_fft + j]  = hann[j] * hann[j];
-                }
-            }
-        });
-    }
-    for (int i = 0; i < n_thread; ++i) {
-        workers[i].join();
+        std::vector<float> audio;
+        istft.flush(audio);
+
+        return cb(audio.data(), audio.size());
     }
 
-    std::vector<float> audio;
-    std::vector<float> env;
+private:
+    // decode the codes [n_done, n_end) in a window with the available context
+    bool decode(int n_end) {
+        const int i0 = std::max(0, n_done - n_ctx);
+        const int i1 = std::min((int) codes.size(), n_end + n_ctx);
+
+        common_batch_clear(batch);
+        for (int i = i0; i < i1; ++i) {
+            common_batch_add(batch, codes[i], i, { 0 }, true);
+        }
+
+        if (llama_encode(ctx, batch) != 0) {
+            LOG_ERR("%s: llama_encode() failed\n", __func__);
+            return false;
+        }
+
+        const float * embd = llama_get_embeddings(ctx) + (size_t) (n_done - i0)*n_embd;
 
-    fold(res,   n_out, n_win, n_hop, n_pad, audio);
-    fold(hann2, n_out, n_win, n_hop, n_pad, env); // TODO: can be done once
+        std::vector<float> audio;
+        istft.add(embd, n_end - n_done, n_embd, n_thread, audio);
 
-    for (size_t i = 0; i < audio.size(); ++i) {
-        audio[i] /= env[i];
+        n_done = n_end;
+
+        return cb(audio.data(), audio.size());
     }
 
-    return audio;
-}
+    llama_context * ctx;
+    llama_batch     batch;
+
+    const int n_embd;
+    const int n_thread;
+
+    callback cb;
+
+    tts_istft istft;
+
+    // audio codes generated so far and the number of them that have been decoded
+    std::vector<llama_token> codes;
+
+    int n_done = 0;
+};
 
 static const std::map<int, std::string> ones = {
     {0, "zero"}, {1, "one"}, {2, "two"}, {3, "three"}, {4, "four"},
@@ -609,6 +782,43 @@ int main(int argc, char ** argv) {
 
     const auto t_main_start = ggml_time_us();
 
+    const int n_sr = 24000; // sampling rate
+
+    // streaming: the audio is decoded and written to the output file while the codes are generated
+    const bool stream = params.vocoder.stream && n_parallel == 1;
+    if (params.vocoder.stream && !stream) {
+        LOG_WRN("%s: streaming is not supported with multiple parallel sequences - disabling\n", __func__);
+    }
+
+    wav_writer wav;
+    std::unique_ptr<tts_vocoder_stream> voc;
+
+    if (stream) {
+        if (!wav.open(params.out_file, n_sr)) {
+            return ENOENT;
+        }
+
+        voc.reset(new tts_vocoder_stream(ctx_cts, params.cpuparams.n_threads, [&, n_written = (size_t) 0](const float * audio, size_t n) mutable {
+            if (n == 0) {
+                return true;
+            }
+
+            if (n_written == 0) {
+                LOG_INF("%s: time to first audio: %.3f ms\n", __func__, (ggml_time_us() - t_main_start) / 1000.0f);
+            }
+
+            // zero out first 0.25 seconds
+            std::vector<float> data(audio, audio + n);
+            for (size_t i = n_written; i < std::min(n_written + n, (size_t) n_sr/4); ++i) {
+                data[i - n_written] = 0.0f;
+            }
+
+            n_written += n;
+
+            return wav.write(data.data(), data.size());
+        }));
+    }
+
     std::vector<llama_token> codes;
     std::vector<llama_token> guide_tokens;
 
@@ -896,6 +1106,10 @@ lovely<|t_0.56|><|code_start|><|634|><|596|><|1766|><|1556|><|1306|><|1285|><|14
 
                 codes.push_back(new_token_id);
 
+                if (stream && !voc->add(new_token_id)) {
+                    return 1;
+                }
+
                 const auto * cands = common_sampler_get_candidates(smpl[i]);
 
                 // is it an end of generation? -> mark the stream as finished
@@ -1013,6 +1227,26 @@ lovely<|t_0.56|><|code_start|><|634|><|596|><|1766|><|1556|><|1306|><|1285|><|14
         token -= 151672;
     }
 
+    if (stream) {
+        if (!voc->finish()) {
+            return 1;
+        }
+
+        LOG_INF("%s: total time:            %.3f ms\n", __func__, (ggml_time_us() - t_main_start) / 1000.0f);
+
+        int retval = 0;
+
+        if (wav.close()) {
+            LOG_INF("%s: audio written to file '%s'\n", __func__, params.out_file.c_str());
+        } else {
+            retval = ENOENT;
+        }
+
+        llama_backend_free();
+
+        return retval;
+    }
+
     const auto t_voc_start = ggml_time_us();
 
     const int n_codes = codes.size();
@@ -1070,8 +1304,6 @@ lovely<|t_0.56|><|code_start|><|634|><|596|><|1766|><|1556|><|1306|><|1285|><|14
     }
 #endif
 
-    const int n_sr = 24000; // sampling rate
-
     // zero out first 0.25 seconds
     for (int i = 0; i < 24000/4; ++i) {
         audio[i] = 0.0f;